@@ -29,9 +29,8 @@
 (define shadow-map-tex
   (make-instance texture2d '(512 512)
     (reserve 'rg-f32)))
-(define shadow-map-depth-tex
-  (make-instance texture2d '(512 512)
-    (reserve 'depth-f32)))
+(define shadow-map-depth-rb                 ; only depth tested, never sampled
+  (make-instance renderbuffer '(512 512 depth-u24)))
 
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 
@@ -47,7 +46,7 @@
 (define light-cam
   (make-instance camera '()
     (attach-texture 'color-buffer-0 shadow-map-tex)
-    (attach-texture 'depth-buffer shadow-map-depth-tex)
+    (attach-renderbuffer 'depth-buffer shadow-map-depth-rb)
     (set-visible-angle (/ pi 1.8))
     (set-depth-test #t)
     (set-bgcolor (make-fcolor 1 1 1 1))
@@ -77,9 +76,8 @@
   (make-instance texture2d '(800 600)
     (reserve 'rgba-f32)))
 
-(define geometry-map-depth-tex
-  (make-instance texture2d '(800 600)
-    (reserve 'depth-f32)))
+(define geometry-map-depth-rb                 ; only depth tested, never sampled
+  (make-instance renderbuffer '(800 600 depth-u24)))
 
 (define main-cam-transfrm
   (make-instance transfrm '()
@@ -101,7 +99,7 @@
   (make-instance camera '()
     (set-depth-test #t)
     (attach-texture 'color-buffer-0 geometry-map-tex)
-    (attach-texture 'depth-buffer geometry-map-depth-tex)
+    (attach-renderbuffer 'depth-buffer geometry-map-depth-rb)
     (set-bgcolor (color-from-rgba 0 0 0 0))))
 
 (define geometry-map-rtasks
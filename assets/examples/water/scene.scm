@@ -105,8 +105,9 @@
 (define screen-clear-rtask
   (rtask-def-clear screen-cam '(depth-buffer color-buffer)))
 
+; the cross is uploaded face by face in place, no need to extract it
 (define water-surf-skybox-image
-  ($ (built-in-image "skybox-texture-small-2") : extract-cubemap))
+  (built-in-image "skybox-texture-small-2"))
 
 (define env-map-cubemap
   (make-instance texture-cubemap '(512)
@@ -91,9 +91,10 @@
                     (set-attributes mesh)
                     (set-shader shader)
                     (set-target cam))))
-      (if (string=? (instance-get-type tex #t) "image")
-         ($ rtask : set-texture2d-image "texMap" tex)
-         ($ rtask : set-texture "texMap" tex))
+      (case (string->symbol (instance-get-type tex #t))
+        ((image) ($ rtask : set-texture2d-image "texMap" tex))
+        ((async_image) ($ rtask : set-texture2d-async-image "texMap" tex))
+        (else ($ rtask : set-texture "texMap" tex)))
       (set-object-properties! rtask
         `((mesh ,mesh)
           (shader ,shader)
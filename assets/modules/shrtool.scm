@@ -46,16 +46,27 @@
         name
         ".obj"))))
 
+; a QOI texture is taken over a PPM one of the same name
+(define built-in-image-path
+  (lambda (name)
+    (let ((base (string-append
+                  (getenv "SHRTOOL_ASSETS_DIR")
+                  file-name-separator-string
+                  "textures"
+                  file-name-separator-string
+                  name)))
+      (if (file-exists? (string-append base ".qoi"))
+        (string-append base ".qoi")
+        (string-append base ".ppm")))))
+
 (define-public built-in-image
   (lambda (name)
-    (image-from-ppm
-      (string-append
-        (getenv "SHRTOOL_ASSETS_DIR")
-        file-name-separator-string
-        "textures"
-        file-name-separator-string
-        name
-        ".ppm"))))
+    (image-from-file (built-in-image-path name))))
+
+; decoded on other threads, see ready? and wait
+(define-public built-in-image-async
+  (lambda (name)
+    (image-from-file-async (built-in-image-path name))))
 
 (define symbol-concat
   (lambda (a . b)
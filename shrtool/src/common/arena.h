@@ -0,0 +1,153 @@
+#ifndef ARENA_H_INCLUDED
+#define ARENA_H_INCLUDED
+
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <new>
+#include <cstdint>
+#include <type_traits>
+
+namespace shrtool {
+
+/*
+ * arena is a monotonic allocator: it hands out memory from a few large blocks
+ * and never reuses what has been given back, except the latest allocation,
+ * so a vector growing at the top of the arena does not leave holes. All the
+ * blocks are released at once with the arena.
+ *
+ * It is meant for things which live and die together, like the meshes loaded
+ * from one file. Allocations are serialized by a lock, a load that fills
+ * several containers at once can share one arena among its threads.
+ */
+class arena {
+public:
+    static constexpr size_t default_block_size = 1 << 20;
+
+    explicit arena(size_t block_size = default_block_size) :
+        block_size_(block_size) { }
+
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+
+    ~arena() {
+        for(void* b : blocks_)
+            ::operator delete(b);
+    }
+
+    void* allocate(size_t n, size_t align) {
+        std::lock_guard<std::mutex> lck(lock_);
+
+        char* p = align_up_(cur_, align);
+        if(cur_ && p + n <= end_) {
+            cur_ = p + n;
+            return p;
+        }
+
+        // big requests get a block of their own, and leave the current one
+        // alone for the small requests to come
+        if(n + align > block_size_ / 4) {
+            char* b = new_block_(n + align);
+            return align_up_(b, align);
+        }
+
+        char* b = new_block_(block_size_);
+        end_ = b + block_size_;
+        p = align_up_(b, align);
+        cur_ = p + n;
+        return p;
+    }
+
+    void deallocate(void* p, size_t n) {
+        std::lock_guard<std::mutex> lck(lock_);
+        if(static_cast<char*>(p) + n == cur_)
+            cur_ = static_cast<char*>(p);
+    }
+
+    size_t blocks() const {
+        std::lock_guard<std::mutex> lck(lock_);
+        return blocks_.size();
+    }
+
+    size_t capacity() const {
+        std::lock_guard<std::mutex> lck(lock_);
+        return capacity_;
+    }
+
+private:
+    static char* align_up_(char* p, size_t align) {
+        uintptr_t v = reinterpret_cast<uintptr_t>(p);
+        return reinterpret_cast<char*>((v + align - 1) & ~uintptr_t(align - 1));
+    }
+
+    char* new_block_(size_t size) {
+        char* b = static_cast<char*>(::operator new(size));
+        blocks_.push_back(b);
+        capacity_ += size;
+        return b;
+    }
+
+    mutable std::mutex lock_;
+    std::vector<void*> blocks_;
+    char* cur_ = nullptr;
+    char* end_ = nullptr;
+    size_t block_size_;
+    size_t capacity_ = 0;
+};
+
+/*
+ * arena_allocator allocates from an arena it shares the ownership of, so the
+ * arena lives as long as any container using it. A default constructed one
+ * has no arena and goes to the global heap.
+ *
+ * Copies of a container are never placed in the arena of the original: a
+ * monotonic arena would only grow with them.
+ */
+template<typename T>
+struct arena_allocator {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    typedef std::false_type propagate_on_container_copy_assignment;
+
+    template<typename U>
+    struct rebind { typedef arena_allocator<U> other; };
+
+    std::shared_ptr<arena> source;
+
+    arena_allocator() { }
+    arena_allocator(std::shared_ptr<arena> a) : source(std::move(a)) { }
+    template<typename U>
+    arena_allocator(const arena_allocator<U>& other) : source(other.source) { }
+
+    T* allocate(size_t n) {
+        if(!source)
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(source->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n) {
+        if(!source)
+            ::operator delete(p);
+        else
+            source->deallocate(p, n * sizeof(T));
+    }
+
+    arena_allocator select_on_container_copy_construction() const {
+        return arena_allocator();
+    }
+
+    template<typename U>
+    bool operator==(const arena_allocator<U>& other) const {
+        return source == other.source;
+    }
+
+    template<typename U>
+    bool operator!=(const arena_allocator<U>& other) const {
+        return source != other.source;
+    }
+};
+
+}
+
+#endif // ARENA_H_INCLUDED
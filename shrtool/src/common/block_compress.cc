@@ -0,0 +1,496 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "block_compress.h"
+#include "parallel.h"
+
+#if defined(__SSE__) || defined(_M_X64)
+#define BLOCK_COMPRESS_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace shrtool {
+
+namespace {
+
+// rows of blocks of about this many blocks are given to each thread
+const size_t parallel_grain_blocks = 256;
+
+////////////////////////////////////////////////////////////////////////////////
+// BC1 color
+
+struct rgb565 {
+    static uint16_t pack(const float* c) {
+        int r = std::min(31, std::max(0, int(c[0] * 31 / 255 + 0.5f)));
+        int g = std::min(63, std::max(0, int(c[1] * 63 / 255 + 0.5f)));
+        int b = std::min(31, std::max(0, int(c[2] * 31 / 255 + 0.5f)));
+        return r << 11 | g << 5 | b;
+    }
+
+    static void unpack(uint16_t v, int* c) {
+        int r = v >> 11 & 31, g = v >> 5 & 63, b = v & 31;
+        c[0] = r << 3 | r >> 2;
+        c[1] = g << 2 | g >> 4;
+        c[2] = b << 3 | b >> 2;
+    }
+};
+
+/*
+ * The four colors of a block and the nearest of them for each pixel. In the
+ * punch-through mode the fourth is transparent, and never the nearest to an
+ * opaque pixel.
+ */
+void bc1_palette(uint16_t c0, uint16_t c1, float pal[4][3])
+{
+    int a[3], b[3];
+    rgb565::unpack(c0, a);
+    rgb565::unpack(c1, b);
+
+    for(size_t k = 0; k < 3; k++) {
+        pal[0][k] = a[k];
+        pal[1][k] = b[k];
+        if(c0 > c1) {
+            pal[2][k] = (2 * a[k] + b[k]) / 3;
+            pal[3][k] = (a[k] + 2 * b[k]) / 3;
+        } else {
+            pal[2][k] = (a[k] + b[k]) / 2;
+            pal[3][k] = 1e9f;
+        }
+    }
+}
+
+// indices of the nearest palette color, and the total squared error
+float bc1_indices(const float px[3][16], const float pal[4][3],
+        uint8_t idx[16])
+{
+    float err = 0;
+
+#ifdef BLOCK_COMPRESS_USE_SSE
+    for(size_t i = 0; i < 16; i += 4) {
+        __m128 r = _mm_loadu_ps(px[0] + i);
+        __m128 g = _mm_loadu_ps(px[1] + i);
+        __m128 b = _mm_loadu_ps(px[2] + i);
+
+        __m128 best = _mm_set1_ps(3e38f);
+        __m128 best_i = _mm_setzero_ps();
+        for(size_t p = 0; p < 4; p++) {
+            __m128 dr = _mm_sub_ps(r, _mm_set1_ps(pal[p][0]));
+            __m128 dg = _mm_sub_ps(g, _mm_set1_ps(pal[p][1]));
+            __m128 db = _mm_sub_ps(b, _mm_set1_ps(pal[p][2]));
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr),
+                        _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+            __m128 less = _mm_cmplt_ps(d, best);
+            best = _mm_min_ps(d, best);
+            best_i = _mm_or_ps(_mm_and_ps(less, _mm_set1_ps(float(p))),
+                    _mm_andnot_ps(less, best_i));
+        }
+
+        float bi[4], be[4];
+        _mm_storeu_ps(bi, best_i);
+        _mm_storeu_ps(be, best);
+        for(size_t j = 0; j < 4; j++) {
+            idx[i + j] = uint8_t(bi[j]);
+            err += be[j];
+        }
+    }
+#else
+    for(size_t i = 0; i < 16; i++) {
+        float best = 3e38f;
+        for(size_t p = 0; p < 4; p++) {
+            float d = 0;
+            for(size_t k = 0; k < 3; k++) {
+                float e = px[k][i] - pal[p][k];
+                d += e * e;
+            }
+            if(d < best) { best = d; idx[i] = p; }
+        }
+        err += best;
+    }
+#endif
+
+    return err;
+}
+
+void write_bc1(uint8_t* out, uint16_t c0, uint16_t c1, const uint8_t idx[16])
+{
+    uint32_t bits = 0;
+    for(size_t i = 0; i < 16; i++)
+        bits |= uint32_t(idx[i]) << (i * 2);
+
+    out[0] = c0 & 0xff; out[1] = c0 >> 8;
+    out[2] = c1 & 0xff; out[3] = c1 >> 8;
+    for(size_t i = 0; i < 4; i++)
+        out[4 + i] = bits >> (i * 8) & 0xff;
+}
+
+// end points along the principal axis of the colors, a little inset
+void bc1_fit_axis(const float px[3][16], const bool* use,
+        float e0[3], float e1[3])
+{
+    float mean[3] = { 0, 0, 0 };
+    size_t n = 0;
+    for(size_t i = 0; i < 16; i++) {
+        if(!use[i]) continue;
+        for(size_t k = 0; k < 3; k++) mean[k] += px[k][i];
+        n++;
+    }
+    for(size_t k = 0; k < 3; k++) mean[k] /= n;
+
+    float cov[6] = { 0, 0, 0, 0, 0, 0 };
+    for(size_t i = 0; i < 16; i++) {
+        if(!use[i]) continue;
+        float r = px[0][i] - mean[0];
+        float g = px[1][i] - mean[1];
+        float b = px[2][i] - mean[2];
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+        cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+
+    // a few rounds of power iteration from the luminance axis
+    float axis[3] = { 0.299f, 0.587f, 0.114f };
+    for(size_t it = 0; it < 6; it++) {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float len = std::max(std::abs(x), std::max(std::abs(y), std::abs(z)));
+        if(len < 1e-6f) break;
+        axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+    }
+
+    float tmin = 3e38f, tmax = -3e38f;
+    for(size_t i = 0; i < 16; i++) {
+        if(!use[i]) continue;
+        float t = (px[0][i] - mean[0]) * axis[0] +
+            (px[1][i] - mean[1]) * axis[1] + (px[2][i] - mean[2]) * axis[2];
+        tmin = std::min(tmin, t);
+        tmax = std::max(tmax, t);
+    }
+
+    float axis_len2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    if(axis_len2 < 1e-12f) axis_len2 = 1;
+    float inset = (tmax - tmin) / 16;
+    for(size_t k = 0; k < 3; k++) {
+        e0[k] = mean[k] + axis[k] * (tmax - inset) / axis_len2;
+        e1[k] = mean[k] + axis[k] * (tmin + inset) / axis_len2;
+    }
+}
+
+// least squares end points for the indices of the four color mode
+bool bc1_refine(const float px[3][16], const uint8_t idx[16],
+        float e0[3], float e1[3])
+{
+    static const float wa[4] = { 1, 0, 2 / 3.f, 1 / 3.f };
+
+    float aa = 0, ab = 0, bb = 0;
+    float ap[3] = { 0, 0, 0 }, bp[3] = { 0, 0, 0 };
+    for(size_t i = 0; i < 16; i++) {
+        float a = wa[idx[i]], b = 1 - a;
+        aa += a * a; ab += a * b; bb += b * b;
+        for(size_t k = 0; k < 3; k++) {
+            ap[k] += a * px[k][i];
+            bp[k] += b * px[k][i];
+        }
+    }
+
+    float det = aa * bb - ab * ab;
+    if(std::abs(det) < 1e-6f) return false;
+
+    for(size_t k = 0; k < 3; k++) {
+        e0[k] = (ap[k] * bb - bp[k] * ab) / det;
+        e1[k] = (bp[k] * aa - ap[k] * ab) / det;
+    }
+    return true;
+}
+
+// the order of the end points selects the mode, indices follow a swap
+void bc1_order(uint16_t& c0, uint16_t& c1, bool four, uint8_t idx[16])
+{
+    static const uint8_t swap4[4] = { 1, 0, 3, 2 };
+    static const uint8_t swap3[4] = { 1, 0, 2, 3 };
+
+    if(four ? c0 < c1 : c0 > c1) {
+        std::swap(c0, c1);
+        for(size_t i = 0; i < 16; i++)
+            idx[i] = four ? swap4[idx[i]] : swap3[idx[i]];
+    }
+}
+
+void encode_bc1(const color px[16], uint8_t* out, bool alpha)
+{
+    float c[3][16];
+    bool opaque[16];
+    bool transparent = false;
+    for(size_t i = 0; i < 16; i++) {
+        for(size_t k = 0; k < 3; k++)
+            c[k][i] = px[i].data.bytes[k];
+        opaque[i] = !alpha || px[i].data.bytes[3] >= 128;
+        transparent |= !opaque[i];
+    }
+
+    uint8_t idx[16];
+
+    if(transparent) {
+        if(std::none_of(opaque, opaque + 16, [](bool o) { return o; })) {
+            std::fill(idx, idx + 16, 3);
+            write_bc1(out, 0, 0, idx);
+            return;
+        }
+
+        float e0[3], e1[3], pal[4][3];
+        bc1_fit_axis(c, opaque, e0, e1);
+        uint16_t c0 = rgb565::pack(e0), c1 = rgb565::pack(e1);
+        if(c0 > c1) std::swap(c0, c1);
+
+        bc1_palette(c0, c1, pal);
+        bc1_indices(c, pal, idx);
+        for(size_t i = 0; i < 16; i++)
+            if(!opaque[i]) idx[i] = 3;
+        write_bc1(out, c0, c1, idx);
+        return;
+    }
+
+    float e0[3], e1[3], pal[4][3];
+    bc1_fit_axis(c, opaque, e0, e1);
+    uint16_t c0 = rgb565::pack(e0), c1 = rgb565::pack(e1);
+
+    if(c0 == c1) {
+        std::fill(idx, idx + 16, 0);
+        write_bc1(out, c0, c1, idx);
+        return;
+    }
+
+    if(c0 < c1) std::swap(c0, c1);
+    bc1_palette(c0, c1, pal);
+    float err = bc1_indices(c, pal, idx);
+
+    uint8_t ridx[16];
+    if(bc1_refine(c, idx, e0, e1)) {
+        uint16_t r0 = rgb565::pack(e0), r1 = rgb565::pack(e1);
+        if(r0 != r1) {
+            if(r0 < r1) std::swap(r0, r1);
+            bc1_palette(r0, r1, pal);
+            if(bc1_indices(c, pal, ridx) < err) {
+                c0 = r0;
+                c1 = r1;
+                std::copy(ridx, ridx + 16, idx);
+            }
+        }
+    }
+
+    bc1_order(c0, c1, true, idx);
+    write_bc1(out, c0, c1, idx);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// BC4 channel
+
+void encode_bc4(const color px[16], size_t channel, uint8_t* out)
+{
+    uint8_t v[16];
+    for(size_t i = 0; i < 16; i++)
+        v[i] = px[i].data.bytes[channel];
+
+    int r0 = *std::max_element(v, v + 16);
+    int r1 = *std::min_element(v, v + 16);
+
+    int pal[8] = { r0, r1 };
+    for(int i = 2; i < 8; i++)
+        pal[i] = ((8 - i) * r0 + (i - 1) * r1) / 7;
+
+    uint64_t bits = 0;
+    if(r0 != r1) {
+        for(size_t i = 0; i < 16; i++) {
+            // the nearest step from the bottom, then its index
+            int s = ((v[i] - r1) * 14 + (r0 - r1)) / ((r0 - r1) * 2);
+            int idx = s == 7 ? 0 : s == 0 ? 1 : 8 - s;
+            // integer palette values may round either way
+            for(int d = -1; d <= 1; d += 2) {
+                int s2 = s + d;
+                if(s2 < 0 || s2 > 7) continue;
+                int i2 = s2 == 7 ? 0 : s2 == 0 ? 1 : 8 - s2;
+                if(std::abs(pal[i2] - v[i]) < std::abs(pal[idx] - v[i]))
+                    idx = i2;
+            }
+            bits |= uint64_t(idx) << (i * 3);
+        }
+    }
+
+    out[0] = r0;
+    out[1] = r1;
+    for(size_t i = 0; i < 6; i++)
+        out[2 + i] = bits >> (i * 8) & 0xff;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// decoding
+
+void decode_bc1(const uint8_t* in, color px[16], bool four_only)
+{
+    uint16_t c0 = in[0] | in[1] << 8, c1 = in[2] | in[3] << 8;
+    int a[3], b[3];
+    rgb565::unpack(c0, a);
+    rgb565::unpack(c1, b);
+
+    color pal[4];
+    pal[0] = color(a[0], a[1], a[2]);
+    pal[1] = color(b[0], b[1], b[2]);
+    if(c0 > c1 || four_only) {
+        pal[2] = color((2 * a[0] + b[0]) / 3, (2 * a[1] + b[1]) / 3,
+                (2 * a[2] + b[2]) / 3);
+        pal[3] = color((a[0] + 2 * b[0]) / 3, (a[1] + 2 * b[1]) / 3,
+                (a[2] + 2 * b[2]) / 3);
+    } else {
+        pal[2] = color((a[0] + b[0]) / 2, (a[1] + b[1]) / 2,
+                (a[2] + b[2]) / 2);
+        pal[3] = color(0, 0, 0, 0);
+    }
+
+    uint32_t bits = in[4] | in[5] << 8 | in[6] << 16 | uint32_t(in[7]) << 24;
+    for(size_t i = 0; i < 16; i++)
+        px[i] = pal[bits >> (i * 2) & 3];
+}
+
+void decode_bc4(const uint8_t* in, color px[16], size_t channel)
+{
+    int r0 = in[0], r1 = in[1];
+    int pal[8] = { r0, r1 };
+    if(r0 > r1) {
+        for(int i = 2; i < 8; i++)
+            pal[i] = ((8 - i) * r0 + (i - 1) * r1) / 7;
+    } else {
+        for(int i = 2; i < 6; i++)
+            pal[i] = ((6 - i) * r0 + (i - 1) * r1) / 5;
+        pal[6] = 0;
+        pal[7] = 255;
+    }
+
+    uint64_t bits = 0;
+    for(size_t i = 0; i < 6; i++)
+        bits |= uint64_t(in[2 + i]) << (i * 8);
+    for(size_t i = 0; i < 16; i++)
+        px[i].data.bytes[channel] = pal[bits >> (i * 3) & 7];
+}
+
+// the 16 pixels of a block, those out of the image repeat the edges
+void gather_block(const const_image_view& v, size_t bx, size_t by,
+        color px[16])
+{
+    for(size_t y = 0; y < 4; y++) {
+        const color* row = v.row(std::min(by * 4 + y, v.height() - 1));
+        for(size_t x = 0; x < 4; x++)
+            px[y * 4 + x] = row[std::min(bx * 4 + x, v.width() - 1)];
+    }
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+compressed_image::compressed_image(size_t w, size_t h, size_t fmt) :
+    width_(w), height_(h), format_(fmt), data_(encoded_size(w, h, fmt)) { }
+
+bool compressed_image::is_compressed(size_t fmt)
+{
+    return fmt == BC1_RGBA || fmt == BC3_RGBA ||
+        fmt == BC4_R || fmt == BC5_RG;
+}
+
+size_t compressed_image::block_size(size_t fmt)
+{
+    switch(fmt) {
+    case BC1_RGBA: case BC4_R: return 8;
+    case BC3_RGBA: case BC5_RG: return 16;
+    }
+    throw unsupported_error("Not a block compressed format");
+}
+
+size_t compressed_image::encoded_size(size_t w, size_t h, size_t fmt)
+{
+    return ((w + 3) / 4) * ((h + 3) / 4) * block_size(fmt);
+}
+
+compressed_image block_compress::encode(const const_image_view& v, size_t fmt)
+{
+    if(!v.width() || !v.height())
+        throw restriction_error("Size of image cannot be zero");
+
+    compressed_image ci(v.width(), v.height(), fmt);
+    size_t bw = (v.width() + 3) / 4, bh = (v.height() + 3) / 4;
+    size_t bs = compressed_image::block_size(fmt);
+    uint8_t* out = ci.data();
+
+    parallel_for(bh, std::max<size_t>(1, parallel_grain_blocks / bw),
+            [&](size_t b, size_t e) {
+        color px[16];
+        for(size_t by = b; by < e; by++) {
+            for(size_t bx = 0; bx < bw; bx++) {
+                gather_block(v, bx, by, px);
+                uint8_t* blk = out + (by * bw + bx) * bs;
+
+                switch(fmt) {
+                case BC1_RGBA:
+                    encode_bc1(px, blk, true);
+                    break;
+                case BC3_RGBA:
+                    encode_bc4(px, 3, blk);
+                    encode_bc1(px, blk + 8, false);
+                    break;
+                case BC4_R:
+                    encode_bc4(px, 0, blk);
+                    break;
+                case BC5_RG:
+                    encode_bc4(px, 0, blk);
+                    encode_bc4(px, 1, blk + 8);
+                    break;
+                }
+            }
+        }
+    });
+
+    return ci;
+}
+
+image block_compress::decode(const compressed_image& ci)
+{
+    image im(ci.width(), ci.height());
+    size_t bw = (ci.width() + 3) / 4, bh = (ci.height() + 3) / 4;
+    size_t bs = compressed_image::block_size(ci.format());
+
+    parallel_for(bh, std::max<size_t>(1, parallel_grain_blocks / bw),
+            [&](size_t b, size_t e) {
+        color px[16];
+        for(size_t by = b; by < e; by++) {
+            for(size_t bx = 0; bx < bw; bx++) {
+                const uint8_t* blk = ci.data() + (by * bw + bx) * bs;
+
+                switch(ci.format()) {
+                case BC1_RGBA:
+                    decode_bc1(blk, px, false);
+                    break;
+                case BC3_RGBA:
+                    decode_bc1(blk + 8, px, true);
+                    decode_bc4(blk, px, 3);
+                    break;
+                case BC4_R:
+                    std::fill(px, px + 16, color(0, 0, 0));
+                    decode_bc4(blk, px, 0);
+                    break;
+                case BC5_RG:
+                    std::fill(px, px + 16, color(0, 0, 0));
+                    decode_bc4(blk, px, 0);
+                    decode_bc4(blk + 8, px, 1);
+                    break;
+                }
+
+                for(size_t y = 0; y < 4 && by * 4 + y < ci.height(); y++)
+                    for(size_t x = 0; x < 4 && bx * 4 + x < ci.width(); x++)
+                        im.pixel(bx * 4 + x, by * 4 + y) = px[y * 4 + x];
+            }
+        }
+    });
+
+    return im;
+}
+
+}
@@ -0,0 +1,89 @@
+#ifndef BLOCK_COMPRESS_H_INCLUDED
+#define BLOCK_COMPRESS_H_INCLUDED
+
+#include <vector>
+#include <cstdint>
+
+#include "image.h"
+
+namespace shrtool {
+
+/*
+ * Pixels compressed in blocks of 4x4, as the display driver takes them
+ * without decompressing. Partial blocks at the edges are whole in data.
+ */
+class compressed_image {
+    size_t width_ = 0;
+    size_t height_ = 0;
+    size_t format_ = BC1_RGBA;
+    std::vector<uint8_t> data_;
+
+public:
+    compressed_image() { }
+    compressed_image(size_t w, size_t h, size_t fmt);
+
+    size_t width() const { return width_; }
+    size_t height() const { return height_; }
+    size_t format() const { return format_; }
+
+    uint8_t* data() { return data_.data(); }
+    const uint8_t* data() const { return data_.data(); }
+    size_t size() const { return data_.size(); }
+
+    // bytes of a block, 8 or 16
+    static size_t block_size(size_t fmt);
+    static size_t encoded_size(size_t w, size_t h, size_t fmt);
+    static bool is_compressed(size_t fmt);
+};
+
+/*
+ * Encodes images into the BCn formats, rows of blocks are encoded on several
+ * threads.
+ *
+ * - BC1_RGBA: color in 4 bits per pixel, with 1-bit alpha. Blocks of which
+ *   any pixel has an alpha under 128 use the punch-through mode.
+ * - BC3_RGBA: BC1 color and 8-bit interpolated alpha, in 8 bits per pixel.
+ * - BC4_R: the red channel alone, in 4 bits per pixel, for masks and heights.
+ * - BC5_RG: red and green as two BC4 blocks, for normal maps.
+ *
+ * Color endpoints are fitted along the principal axis of the block and then
+ * refined by least squares; BC4 endpoints are the range of the block.
+ */
+struct block_compress {
+    static compressed_image encode(const const_image_view& v, size_t fmt);
+    static compressed_image encode(const image& im, size_t fmt) {
+        return encode(im.view(), fmt);
+    }
+
+    /*
+     * Decodes as the display driver does, BC4 and BC5 channels which are
+     * absent are 0, with an opaque alpha.
+     */
+    static image decode(const compressed_image& ci);
+};
+
+template<>
+struct texture2d_trait<compressed_image> {
+    typedef shrtool::raw_data_tag transfer_tag;
+    typedef compressed_image input_type;
+
+    static size_t width(const input_type& i) {
+        return i.width();
+    }
+
+    static size_t height(const input_type& i) {
+        return i.height();
+    }
+
+    static size_t format(const input_type& i) {
+        return i.format();
+    }
+
+    static const void* data(const input_type& i) {
+        return i.data();
+    }
+};
+
+}
+
+#endif // BLOCK_COMPRESS_H_INCLUDED
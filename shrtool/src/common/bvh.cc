@@ -0,0 +1,651 @@
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <cmath>
+
+#include "bvh.h"
+#include "exception.h"
+#include "parallel.h"
+
+#if defined(__SSE__) || defined(_M_X64)
+#define BVH_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace shrtool {
+
+namespace {
+
+const size_t bin_count = 16;
+// ranges longer than these are binned, or have their subtrees built, on
+// separate threads
+const size_t parallel_bin_threshold = 1 << 16;
+const size_t parallel_subtree_threshold = 1 << 12;
+// beyond this depth nodes are split at the median, which keeps the
+// traversal stack bounded whatever SAH decides
+const size_t max_sah_depth = 64;
+const size_t traversal_stack_size = 128;
+
+struct aabb {
+    float bmin[3] = {
+        std::numeric_limits<float>::infinity(),
+        std::numeric_limits<float>::infinity(),
+        std::numeric_limits<float>::infinity(),
+    };
+    float bmax[3] = {
+        -std::numeric_limits<float>::infinity(),
+        -std::numeric_limits<float>::infinity(),
+        -std::numeric_limits<float>::infinity(),
+    };
+
+    void grow(const float* p) {
+        for(size_t a = 0; a < 3; a++) {
+            bmin[a] = std::min(bmin[a], p[a]);
+            bmax[a] = std::max(bmax[a], p[a]);
+        }
+    }
+
+    void grow(const aabb& b) {
+        for(size_t a = 0; a < 3; a++) {
+            bmin[a] = std::min(bmin[a], b.bmin[a]);
+            bmax[a] = std::max(bmax[a], b.bmax[a]);
+        }
+    }
+
+    float area() const {
+        float d[3];
+        for(size_t a = 0; a < 3; a++)
+            d[a] = std::max(0.f, bmax[a] - bmin[a]);
+        return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+    }
+};
+
+struct prim_info {
+    aabb box;
+    float centroid[3];
+};
+
+struct bin {
+    aabb box;
+    size_t count = 0;
+};
+
+struct range_bounds {
+    aabb box;
+    aabb centroids;
+
+    void merge(const range_bounds& r) {
+        box.grow(r.box);
+        centroids.grow(r.centroids);
+    }
+};
+
+struct range_bins {
+    bin bins[3][bin_count];
+
+    void merge(const range_bins& r) {
+        for(size_t a = 0; a < 3; a++)
+        for(size_t i = 0; i < bin_count; i++) {
+            bins[a][i].box.grow(r.bins[a][i].box);
+            bins[a][i].count += r.bins[a][i].count;
+        }
+    }
+};
+
+/*
+ * Reduce over [b, e) with f(acc, i), on several threads if the range is long
+ * enough to pay for them.
+ */
+template<typename Acc, typename Func>
+Acc reduce_range(size_t b, size_t e, Func f)
+{
+    Acc result;
+
+    if(e - b < parallel_bin_threshold) {
+        for(size_t i = b; i < e; i++)
+            f(result, i);
+        return result;
+    }
+
+    std::mutex mtx;
+    parallel_for(e - b, parallel_bin_threshold / 4,
+        [&](size_t cb, size_t ce) {
+            Acc local;
+            for(size_t i = cb; i < ce; i++)
+                f(local, b + i);
+            std::lock_guard<std::mutex> lck(mtx);
+            result.merge(local);
+        });
+
+    return result;
+}
+
+inline size_t bin_of(float c, float cmin, float scale)
+{
+    size_t i = size_t((c - cmin) * scale);
+    return std::min(i, bin_count - 1);
+}
+
+// leaves are tested a packet at a time, so the SAH cost counts packets
+inline float packets_of(size_t n)
+{
+    return float((n + mesh_bvh::max_leaf_size - 1) / mesh_bvh::max_leaf_size);
+}
+
+class builder {
+public:
+    typedef mesh_bvh::node node;
+
+    builder(const std::vector<prim_info>& p, std::vector<uint32_t>& ids) :
+        prims_(p), ids_(ids) { }
+
+    uint32_t build(size_t b, size_t e, std::vector<node>& out,
+            size_t depth, size_t spawn);
+
+private:
+    size_t split_(size_t b, size_t e, const aabb& cb, size_t depth);
+    static void append_(std::vector<node>& out, const std::vector<node>& sub);
+
+    const std::vector<prim_info>& prims_;
+    std::vector<uint32_t>& ids_;
+};
+
+uint32_t builder::build(size_t b, size_t e, std::vector<node>& out,
+        size_t depth, size_t spawn)
+{
+    range_bounds rb = reduce_range<range_bounds>(b, e,
+        [this](range_bounds& acc, size_t i) {
+            const prim_info& p = prims_[ids_[i]];
+            acc.box.grow(p.box);
+            acc.centroids.grow(p.centroid);
+        });
+
+    uint32_t me = uint32_t(out.size());
+    out.emplace_back();
+    std::copy(rb.box.bmin, rb.box.bmin + 3, out[me].bmin);
+    std::copy(rb.box.bmax, rb.box.bmax + 3, out[me].bmax);
+
+    if(e - b <= mesh_bvh::max_leaf_size) {
+        // offset points into ids for now, packets are assigned afterwards
+        out[me].offset = uint32_t(b);
+        out[me].count = uint32_t(e - b);
+        return me;
+    }
+
+    size_t mid = split_(b, e, rb.centroids, depth);
+
+    if(spawn > 0 && e - b >= parallel_subtree_threshold) {
+        std::vector<node> left, right;
+        std::exception_ptr err;
+
+        std::thread t([&]() {
+            try { build(b, mid, left, depth + 1, spawn - 1); }
+            catch(...) { err = std::current_exception(); }
+        });
+        build(mid, e, right, depth + 1, spawn - 1);
+        t.join();
+        if(err) std::rethrow_exception(err);
+
+        append_(out, left);
+        out[me].offset = uint32_t(out.size());
+        append_(out, right);
+    } else {
+        build(b, mid, out, depth + 1, spawn);
+        out[me].offset = uint32_t(out.size());
+        build(mid, e, out, depth + 1, spawn);
+    }
+
+    out[me].count = 0;
+    return me;
+}
+
+size_t builder::split_(size_t b, size_t e, const aabb& cb, size_t depth)
+{
+    size_t median = b + (e - b) / 2;
+    if(depth >= max_sah_depth)
+        return median;
+
+    float scale[3];
+    bool splittable = false;
+    for(size_t a = 0; a < 3; a++) {
+        float ext = cb.bmax[a] - cb.bmin[a];
+        scale[a] = ext > 0 ? bin_count / ext : 0;
+        splittable = splittable || ext > 0;
+    }
+    // every centroid at the same point, no plane can tell them apart
+    if(!splittable)
+        return median;
+
+    range_bins rbins = reduce_range<range_bins>(b, e,
+        [&](range_bins& acc, size_t i) {
+            const prim_info& p = prims_[ids_[i]];
+            for(size_t a = 0; a < 3; a++) {
+                if(scale[a] == 0) continue;
+                bin& bn = acc.bins[a][bin_of(p.centroid[a], cb.bmin[a], scale[a])];
+                bn.box.grow(p.box);
+                bn.count++;
+            }
+        });
+
+    float best_cost = std::numeric_limits<float>::infinity();
+    size_t best_axis = 0, best_plane = 0;
+
+    for(size_t a = 0; a < 3; a++) {
+        if(scale[a] == 0) continue;
+        const bin* bins = rbins.bins[a];
+
+        // sweep from the right first and keep the suffix costs, then from
+        // the left to combine them plane by plane
+        float right_cost[bin_count];
+        aabb acc;
+        size_t cnt = 0;
+        for(size_t i = bin_count - 1; i > 0; i--) {
+            acc.grow(bins[i].box);
+            cnt += bins[i].count;
+            right_cost[i] = cnt ? packets_of(cnt) * acc.area() : 0;
+        }
+
+        acc = aabb();
+        cnt = 0;
+        for(size_t i = 0; i < bin_count - 1; i++) {
+            acc.grow(bins[i].box);
+            cnt += bins[i].count;
+            if(!cnt || cnt == e - b) continue;
+            float cost = packets_of(cnt) * acc.area() + right_cost[i + 1];
+            if(cost < best_cost) {
+                best_cost = cost;
+                best_axis = a;
+                best_plane = i + 1;
+            }
+        }
+    }
+
+    if(best_plane == 0)
+        return median;
+
+    float cmin = cb.bmin[best_axis], s = scale[best_axis];
+    auto it = std::partition(ids_.begin() + b, ids_.begin() + e,
+        [&](uint32_t id) {
+            return bin_of(prims_[id].centroid[best_axis], cmin, s) < best_plane;
+        });
+
+    size_t mid = it - ids_.begin();
+    return mid == b || mid == e ? median : mid;
+}
+
+void builder::append_(std::vector<node>& out, const std::vector<node>& sub)
+{
+    uint32_t base = uint32_t(out.size());
+    for(const node& n : sub) {
+        out.push_back(n);
+        if(!n.is_leaf())
+            out.back().offset += base;
+    }
+}
+
+void fill_packet(mesh_bvh::tri_packet& p, const mesh_indexed& m,
+        const uint32_t* ids, size_t count)
+{
+    for(size_t l = 0; l < mesh_bvh::max_leaf_size; l++) {
+        if(l >= count) {
+            // degenerate padding, its determinant is zero and never hits
+            for(size_t a = 0; a < 3; a++)
+                p.v0[a][l] = p.e1[a][l] = p.e2[a][l] = 0;
+            p.ids[l] = ids[0];
+            continue;
+        }
+
+        const math::col4& p0 = m.get_position(ids[l], 0);
+        const math::col4& p1 = m.get_position(ids[l], 1);
+        const math::col4& p2 = m.get_position(ids[l], 2);
+        for(size_t a = 0; a < 3; a++) {
+            p.v0[a][l] = float(p0[a]);
+            p.e1[a][l] = float(p1[a] - p0[a]);
+            p.e2[a][l] = float(p2[a] - p0[a]);
+        }
+        p.ids[l] = ids[l];
+    }
+}
+
+void packet_bounds(const mesh_bvh::tri_packet& p, size_t count, mesh_bvh::node& n)
+{
+    aabb box;
+    for(size_t l = 0; l < count; l++) {
+        float v[3][3];
+        for(size_t a = 0; a < 3; a++) {
+            v[0][a] = p.v0[a][l];
+            v[1][a] = p.v0[a][l] + p.e1[a][l];
+            v[2][a] = p.v0[a][l] + p.e2[a][l];
+        }
+        box.grow(v[0]); box.grow(v[1]); box.grow(v[2]);
+    }
+    std::copy(box.bmin, box.bmin + 3, n.bmin);
+    std::copy(box.bmax, box.bmax + 3, n.bmax);
+}
+
+size_t spawn_depth()
+{
+    size_t d = 0;
+    while((size_t(1) << d) < hardware_concurrency())
+        d++;
+    return d;
+}
+
+struct ray_ctx {
+    float o[3], d[3], inv_d[3];
+    float tmin;
+#ifdef BVH_USE_SSE
+    __m128 o4, inv_d4;
+#endif
+
+    ray_ctx(const math::fcol3& origin, const math::fcol3& dir, float tmin_) :
+        tmin(tmin_) {
+        for(size_t a = 0; a < 3; a++) {
+            o[a] = origin[a];
+            d[a] = dir[a];
+            // a zero component would give 0 * inf = NaN in the slab test
+            // for boxes flat on that axis, nudge it off zero instead
+            float safe = std::abs(d[a]) > 1e-20f ? d[a] :
+                std::copysign(1e-20f, d[a]);
+            inv_d[a] = 1.f / safe;
+        }
+#ifdef BVH_USE_SSE
+        o4 = _mm_set_ps(0, o[2], o[1], o[0]);
+        inv_d4 = _mm_set_ps(0, inv_d[2], inv_d[1], inv_d[0]);
+#endif
+    }
+
+    // slab test, t_near is where the ray enters the box
+    bool hit_box(const mesh_bvh::node& n, float tmax, float& t_near) const {
+#ifdef BVH_USE_SSE
+        // the fourth lane loads offset and count, it is left out of the
+        // reductions below
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n.bmin), o4), inv_d4);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n.bmax), o4), inv_d4);
+        __m128 tn = _mm_min_ps(t0, t1), tf = _mm_max_ps(t0, t1);
+
+        __m128 tn_n = _mm_max_ss(
+            _mm_max_ss(tn, _mm_shuffle_ps(tn, tn, _MM_SHUFFLE(1, 1, 1, 1))),
+            _mm_max_ss(_mm_shuffle_ps(tn, tn, _MM_SHUFFLE(2, 2, 2, 2)),
+                _mm_set_ss(tmin)));
+        __m128 tf_f = _mm_min_ss(
+            _mm_min_ss(tf, _mm_shuffle_ps(tf, tf, _MM_SHUFFLE(1, 1, 1, 1))),
+            _mm_min_ss(_mm_shuffle_ps(tf, tf, _MM_SHUFFLE(2, 2, 2, 2)),
+                _mm_set_ss(tmax)));
+
+        t_near = _mm_cvtss_f32(tn_n);
+        return _mm_comile_ss(tn_n, tf_f);
+#else
+        float tn = tmin, tf = tmax;
+        for(size_t a = 0; a < 3; a++) {
+            float t0 = (n.bmin[a] - o[a]) * inv_d[a];
+            float t1 = (n.bmax[a] - o[a]) * inv_d[a];
+            tn = std::max(tn, std::min(t0, t1));
+            tf = std::min(tf, std::max(t0, t1));
+        }
+        t_near = tn;
+        return tn <= tf;
+#endif
+    }
+
+    /*
+     * Moller-Trumbore against the four lanes of a packet. On a hit closer
+     * than t_best it updates t_best and h and returns true.
+     */
+    bool hit_packet(const mesh_bvh::tri_packet& p, float& t_best,
+            ray_hit& h) const {
+        float t[4], u[4], v[4];
+        int mask = 0;
+#ifdef BVH_USE_SSE
+        __m128 dx = _mm_set1_ps(d[0]), dy = _mm_set1_ps(d[1]),
+               dz = _mm_set1_ps(d[2]);
+        __m128 e1x = _mm_loadu_ps(p.e1[0]), e1y = _mm_loadu_ps(p.e1[1]),
+               e1z = _mm_loadu_ps(p.e1[2]);
+        __m128 e2x = _mm_loadu_ps(p.e2[0]), e2y = _mm_loadu_ps(p.e2[1]),
+               e2z = _mm_loadu_ps(p.e2[2]);
+
+        __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        __m128 det = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        __m128 inv_det = _mm_div_ps(_mm_set1_ps(1), det);
+
+        __m128 tx = _mm_sub_ps(_mm_set1_ps(o[0]), _mm_loadu_ps(p.v0[0]));
+        __m128 ty = _mm_sub_ps(_mm_set1_ps(o[1]), _mm_loadu_ps(p.v0[1]));
+        __m128 tz = _mm_sub_ps(_mm_set1_ps(o[2]), _mm_loadu_ps(p.v0[2]));
+        __m128 u4 = _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)),
+            inv_det);
+
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+        __m128 v4 = _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)),
+            inv_det);
+        __m128 t4 = _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)),
+            inv_det);
+
+        __m128 zero = _mm_setzero_ps();
+        __m128 ok = _mm_cmpneq_ps(det, zero);
+        ok = _mm_and_ps(ok, _mm_cmpge_ps(u4, zero));
+        ok = _mm_and_ps(ok, _mm_cmpge_ps(v4, zero));
+        ok = _mm_and_ps(ok, _mm_cmple_ps(_mm_add_ps(u4, v4), _mm_set1_ps(1)));
+        ok = _mm_and_ps(ok, _mm_cmpge_ps(t4, _mm_set1_ps(tmin)));
+        ok = _mm_and_ps(ok, _mm_cmplt_ps(t4, _mm_set1_ps(t_best)));
+
+        mask = _mm_movemask_ps(ok);
+        if(!mask) return false;
+        _mm_storeu_ps(t, t4);
+        _mm_storeu_ps(u, u4);
+        _mm_storeu_ps(v, v4);
+#else
+        for(size_t l = 0; l < 4; l++) {
+            float e1[3] = { p.e1[0][l], p.e1[1][l], p.e1[2][l] };
+            float e2[3] = { p.e2[0][l], p.e2[1][l], p.e2[2][l] };
+            float pv[3] = {
+                d[1] * e2[2] - d[2] * e2[1],
+                d[2] * e2[0] - d[0] * e2[2],
+                d[0] * e2[1] - d[1] * e2[0],
+            };
+            float det = e1[0] * pv[0] + e1[1] * pv[1] + e1[2] * pv[2];
+            if(det == 0) continue;
+            float inv_det = 1 / det;
+
+            float tv[3] = {
+                o[0] - p.v0[0][l], o[1] - p.v0[1][l], o[2] - p.v0[2][l] };
+            u[l] = (tv[0] * pv[0] + tv[1] * pv[1] + tv[2] * pv[2]) * inv_det;
+            float qv[3] = {
+                tv[1] * e1[2] - tv[2] * e1[1],
+                tv[2] * e1[0] - tv[0] * e1[2],
+                tv[0] * e1[1] - tv[1] * e1[0],
+            };
+            v[l] = (d[0] * qv[0] + d[1] * qv[1] + d[2] * qv[2]) * inv_det;
+            t[l] = (e2[0] * qv[0] + e2[1] * qv[1] + e2[2] * qv[2]) * inv_det;
+
+            if(u[l] >= 0 && v[l] >= 0 && u[l] + v[l] <= 1 &&
+                    t[l] >= tmin && t[l] < t_best)
+                mask |= 1 << l;
+        }
+        if(!mask) return false;
+#endif
+        size_t best = 4;
+        for(size_t l = 0; l < 4; l++)
+            if((mask & (1 << l)) && (best == 4 || t[l] < t[best]))
+                best = l;
+
+        t_best = t[best];
+        h.t = t[best];
+        h.u = u[best];
+        h.v = v[best];
+        h.triangle = p.ids[best];
+        return true;
+    }
+};
+
+}
+
+void mesh_bvh::build(const mesh_indexed& m)
+{
+    nodes_.clear();
+    packets_.clear();
+    tri_count_ = m.has_positions() ? m.triangles() : 0;
+    if(!tri_count_) return;
+    if(tri_count_ > std::numeric_limits<uint32_t>::max())
+        throw restriction_error("Too many triangles for a BVH");
+
+    std::vector<prim_info> prims(tri_count_);
+    std::vector<uint32_t> ids(tri_count_);
+
+    parallel_for(tri_count_, parallel_bin_threshold / 4,
+        [&](size_t b, size_t e) {
+            for(size_t i = b; i < e; i++) {
+                prim_info& p = prims[i];
+                p = prim_info();
+                for(size_t k = 0; k < 3; k++) {
+                    const math::col4& v = m.get_position(i, k);
+                    float fv[3] = { float(v[0]), float(v[1]), float(v[2]) };
+                    p.box.grow(fv);
+                }
+                for(size_t a = 0; a < 3; a++)
+                    p.centroid[a] = (p.box.bmin[a] + p.box.bmax[a]) * 0.5f;
+                ids[i] = uint32_t(i);
+            }
+        });
+
+    // a tree of n leaves has 2n - 1 nodes, and there are at least
+    // n / max_leaf_size leaves
+    nodes_.reserve(2 * (tri_count_ / max_leaf_size + 1));
+    builder(prims, ids).build(0, tri_count_, nodes_, 0, spawn_depth());
+
+    // leaves get their packets in depth-first order, so that a subtree's
+    // triangles lie next to each other as well
+    size_t leaves = 0;
+    for(node& n : nodes_)
+        if(n.is_leaf()) leaves++;
+    packets_.resize(leaves);
+
+    size_t pi = 0;
+    for(node& n : nodes_) {
+        if(!n.is_leaf()) continue;
+        fill_packet(packets_[pi], m, &ids[n.offset], n.count);
+        n.offset = uint32_t(pi++);
+    }
+}
+
+void mesh_bvh::refit(const mesh_indexed& m)
+{
+    if(!m.has_positions() || m.triangles() != tri_count_)
+        throw restriction_error("Mesh topology differs from the BVH");
+    if(nodes_.empty()) return;
+
+    std::vector<const node*> leaves(packets_.size());
+    for(const node& n : nodes_)
+        if(n.is_leaf()) leaves[n.offset] = &n;
+
+    parallel_for(packets_.size(), parallel_bin_threshold / 16,
+        [&](size_t b, size_t e) {
+            for(size_t i = b; i < e; i++) {
+                tri_packet& p = packets_[i];
+                uint32_t ids[max_leaf_size];
+                std::copy(p.ids, p.ids + max_leaf_size, ids);
+                fill_packet(p, m, ids, leaves[i]->count);
+            }
+        });
+
+    // children always come after their parent
+    for(size_t i = nodes_.size(); i-- > 0;) {
+        node& n = nodes_[i];
+        if(n.is_leaf()) {
+            packet_bounds(packets_[n.offset], n.count, n);
+            continue;
+        }
+
+        const node& l = nodes_[i + 1];
+        const node& r = nodes_[n.offset];
+        for(size_t a = 0; a < 3; a++) {
+            n.bmin[a] = std::min(l.bmin[a], r.bmin[a]);
+            n.bmax[a] = std::max(l.bmax[a], r.bmax[a]);
+        }
+    }
+}
+
+template<bool AnyHit>
+bool mesh_bvh::traverse_(const math::fcol3& origin, const math::fcol3& dir,
+        float tmin, float tmax, ray_hit& h) const
+{
+    if(nodes_.empty()) return false;
+
+    ray_ctx ray(origin, dir, tmin);
+    float t_best = tmax;
+    float t_near;
+    if(!ray.hit_box(nodes_[0], t_best, t_near))
+        return false;
+
+    uint32_t stack_node[traversal_stack_size];
+    float stack_t[traversal_stack_size];
+    size_t sp = 0;
+    uint32_t cur = 0;
+    bool found = false;
+
+    while(true) {
+        const node& n = nodes_[cur];
+
+        if(n.is_leaf()) {
+            if(ray.hit_packet(packets_[n.offset], t_best, h)) {
+                found = true;
+                if(AnyHit) return true;
+            }
+        } else {
+            uint32_t near = cur + 1, far = n.offset;
+            float t_l, t_r;
+            bool hit_l = ray.hit_box(nodes_[near], t_best, t_l);
+            bool hit_r = ray.hit_box(nodes_[far], t_best, t_r);
+
+            if(hit_l && hit_r) {
+                if(t_r < t_l) {
+                    std::swap(near, far);
+                    std::swap(t_l, t_r);
+                }
+                stack_node[sp] = far;
+                stack_t[sp] = t_r;
+                sp++;
+                cur = near;
+                continue;
+            }
+            if(hit_l) { cur = near; continue; }
+            if(hit_r) { cur = far; continue; }
+        }
+
+        // skip the postponed subtrees that begin beyond the closest hit
+        bool popped = false;
+        while(sp > 0) {
+            sp--;
+            if(stack_t[sp] <= t_best) {
+                cur = stack_node[sp];
+                popped = true;
+                break;
+            }
+        }
+        if(!popped) return found;
+    }
+}
+
+ray_hit mesh_bvh::intersect(const math::fcol3& origin,
+        const math::fcol3& dir, float tmin, float tmax) const
+{
+    ray_hit h;
+    traverse_<false>(origin, dir, tmin, tmax, h);
+    return h;
+}
+
+bool mesh_bvh::occluded(const math::fcol3& origin, const math::fcol3& dir,
+        float tmin, float tmax) const
+{
+    ray_hit h;
+    return traverse_<true>(origin, dir, tmin, tmax, h);
+}
+
+}
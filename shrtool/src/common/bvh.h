@@ -0,0 +1,125 @@
+#ifndef BVH_H_INCLUDED
+#define BVH_H_INCLUDED
+
+#include <vector>
+#include <limits>
+#include <cstdint>
+
+#include "matrix.h"
+#include "mesh.h"
+#include "reflection.h"
+
+namespace shrtool {
+
+struct ray_hit {
+    float t = std::numeric_limits<float>::infinity();
+    // barycentric coordinates of the hit point on the hit triangle, with
+    // p = (1 - u - v) * p0 + u * p1 + v * p2
+    float u = 0;
+    float v = 0;
+    size_t triangle = std::numeric_limits<size_t>::max();
+
+    bool hit() const { return triangle != std::numeric_limits<size_t>::max(); }
+    double distance() const { return t; }
+    size_t get_triangle() const { return triangle; }
+    math::col3 barycentric() const { return math::col3 { 1 - u - v, u, v }; }
+
+    static void meta_reg_() {
+        refl::meta_manager::reg_class<ray_hit>("ray_hit")
+            .enable_clone()
+            .enable_auto_register()
+            .function("hit", &ray_hit::hit)
+            .function("distance", &ray_hit::distance)
+            .function("triangle", &ray_hit::get_triangle)
+            .function("barycentric", &ray_hit::barycentric);
+    }
+};
+
+/*
+ * mesh_bvh is a bounding volume hierarchy over the triangles of a mesh, for
+ * ray queries on CPU side such as picking, shadow probes or placement.
+ *
+ * It is built top-down with binned SAH and stored flattened in depth-first
+ * order: the left child of an inner node is always the next node, only the
+ * right one is recorded. Each leaf holds up to four triangles, kept as one
+ * SoA packet so that they are tested against a ray at once.
+ *
+ * The BVH copies the positions it needs and does not refer to the mesh
+ * afterwards. When vertices move but the topology stays, refit is a lot
+ * cheaper than building again, at the price of a looser tree.
+ */
+class mesh_bvh {
+public:
+    struct node {
+        float bmin[3];
+        // inner: index of the right child. leaf: index of the packet
+        uint32_t offset;
+        float bmax[3];
+        // 0 for inner nodes, number of triangles for leaves
+        uint32_t count;
+
+        bool is_leaf() const { return count > 0; }
+    };
+
+    struct tri_packet {
+        float v0[3][4];
+        float e1[3][4];
+        float e2[3][4];
+        uint32_t ids[4];
+    };
+
+    static constexpr size_t max_leaf_size = 4;
+
+    mesh_bvh() { }
+    mesh_bvh(const mesh_indexed& m) { build(m); }
+
+    void build(const mesh_indexed& m);
+    void refit(const mesh_indexed& m);
+
+    // nearest hit with t in [tmin, tmax]
+    ray_hit intersect(const math::fcol3& origin, const math::fcol3& dir,
+            float tmin = 0, float tmax =
+                std::numeric_limits<float>::infinity()) const;
+    // any hit with t in [tmin, tmax], which can stop early
+    bool occluded(const math::fcol3& origin, const math::fcol3& dir,
+            float tmin = 0, float tmax =
+                std::numeric_limits<float>::infinity()) const;
+
+    ray_hit raycast(math::col3 origin, math::col3 dir) const {
+        return intersect(math::fcol3(origin), math::fcol3(dir));
+    }
+
+    bool occluded_within(math::col3 origin, math::col3 dir, double dist) const {
+        return occluded(math::fcol3(origin), math::fcol3(dir), 0, dist);
+    }
+
+    size_t triangles() const { return tri_count_; }
+    size_t node_count() const { return nodes_.size(); }
+    const std::vector<node>& nodes() const { return nodes_; }
+    bool empty() const { return nodes_.empty(); }
+
+    static void meta_reg_() {
+        refl::meta_manager::reg_class<mesh_bvh>("bvh")
+            .enable_construct<const mesh_indexed&>()
+            .enable_auto_register()
+            .function("build", &mesh_bvh::build)
+            .function("refit", &mesh_bvh::refit)
+            .function("raycast", &mesh_bvh::raycast)
+            .function("occluded", &mesh_bvh::occluded_within)
+            .function("triangles", &mesh_bvh::triangles)
+            .function("node_count", &mesh_bvh::node_count);
+    }
+
+private:
+    template<bool AnyHit>
+    bool traverse_(const math::fcol3& origin, const math::fcol3& dir,
+            float tmin, float tmax, ray_hit& h) const;
+
+    std::vector<node> nodes_;
+    std::vector<tri_packet> packets_;
+    size_t tri_count_ = 0;
+};
+
+}
+
+#endif // BVH_H_INCLUDED
@@ -1,28 +1,67 @@
 #include <limits>
 #include <iomanip>
 #include <sstream>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
 
 #include "image.h"
+#include "image_sampler.h"
+#include "image_transform.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define NETPBM_USE_SSE2
+#include <emmintrin.h>
+#endif
 
 namespace shrtool {
 
-void image::copy_pixel(size_t offx, size_t offy, size_t w, size_t h,
-        image& dest, size_t dest_x, size_t dest_y) const {
-    if(offx + w > width() || offy + h > height() ||
-            dest_x + w > dest.width() || dest_y + h > dest.height()) {
-        throw restriction_error("Out of bound");
-    }
+void image::unshare_(size_t size) {
+    float_cache_.reset();
+    underlying_ = std::make_shared<storage_type>(data_, data_ + size);
+    data_ = underlying_->data();
+    may_share_ = false;
+}
 
-    const color* csrc = data() + width() * offy + offx;
-    color* cdest = dest.data() + dest.width() * dest_y + dest_x;
+void image::resize(size_t w, size_t h) {
+    float_cache_.reset();
 
-    for(size_t y = 0; y < h; y++) {
-        for(size_t x = 0; x < w; x++, cdest++, csrc++) {
-            *cdest = *csrc;
-        }
-        csrc += width() - w;
-        cdest += dest.width() - w;
-    }
+    // pixels are kept as they are in memory, as vector keeps them
+    if(!underlying_)
+        underlying_ = std::make_shared<storage_type>();
+    else if(shared_())
+        unshare_(std::min(w * h, width_ * height_));
+
+    width_ = w;
+    height_ = h;
+    underlying_->resize(w * h);
+    data_ = underlying_->data();
+}
+
+void image::make_float_cache() {
+    // only read, shared pixels are not copied for it; the cache goes once
+    // they are unshared to be written
+    float_cache_ = std::make_shared<float_tile_cache>(
+            static_cast<const image&>(*this).view());
+}
+
+void image::quad(size_t l, size_t t,
+        fcolor& c00, fcolor& c10, fcolor& c01, fcolor& c11) const {
+    if(!float_cache_)
+        throw restriction_error("Float cache is not made");
+
+    size_t r = std::min(l + 1, width_ - 1);
+    size_t b = std::min(t + 1, height_ - 1);
+
+    c00 = float_cache_->pixel(l, t);
+    c10 = float_cache_->pixel(r, t);
+    c01 = float_cache_->pixel(l, b);
+    c11 = float_cache_->pixel(r, b);
+}
+
+void image::copy_pixel(size_t offx, size_t offy, size_t w, size_t h,
+        image& dest, size_t dest_x, size_t dest_y) const {
+    view(offx, offy, w, h).copy_to(dest.view(dest_x, dest_y, w, h));
 }
 
 /* 0    +Y
@@ -30,8 +69,17 @@ void image::copy_pixel(size_t offx, size_t offy, size_t w, size_t h,
  * 2    -Y
  *   0  1  2  3
  */
-image image::load_cubemap_from(const image& img) {
-    if(img.width() % 4 || img.height() % 3 ||
+std::array<const_image_view, 6> image::cubemap_faces(const image& img) {
+    std::array<const_image_view, 6> faces;
+
+    if(img.width() && img.height() == img.width() * 6) {
+        size_t unit = img.width();
+        for(size_t i = 0; i < 6; i++)
+            faces[i] = img.view(0, i * unit, unit, unit);
+        return faces;
+    }
+
+    if(!img.width() || img.width() % 4 || img.height() % 3 ||
             img.width() / 4 != img.height() / 3) {
         throw restriction_error("Size of cubmap is not regular");
     }
@@ -44,58 +92,267 @@ image image::load_cubemap_from(const image& img) {
         { 1, 1 }, { 3, 1 },
     };
 
-    image new_img(unit, unit * 6);
     for(size_t i = 0; i < 6; i++) {
-        img.copy_pixel(coords[i][0] * unit, coords[i][1] * unit,
-                unit, unit, new_img, 0, i * unit);
+        faces[i] = img.view(coords[i][0] * unit, coords[i][1] * unit,
+                unit, unit);
     }
 
+    return faces;
+}
+
+image image::load_cubemap_from(const image& img) {
+    std::array<const_image_view, 6> faces = cubemap_faces(img);
+    size_t unit = faces[0].width();
+
+    image new_img(unit, unit * 6);
+    for(size_t i = 0; i < 6; i++)
+        faces[i].copy_to(new_img.view(0, i * unit, unit, unit));
+
     return std::move(new_img);
 }
-static void load_netpbm_body_plain(std::istream& is, image& im, size_t space)
+
+namespace {
+
+// bytes of the body read at once, a multiple of both 3 and 6 bytes
+const size_t netpbm_block_size = 3 * 2 * (1 << 15);
+
+/*
+ * Maps samples in [0, space] onto 8-bit channels, rounded to nearest. The
+ * usual space 255 is a copy, anything else goes through a table, and two-byte
+ * samples of the space 65535 are rounded in lanes as well. Samples beyond the
+ * space saturate.
+ */
+class netpbm_scale {
+    size_t space_;
+    std::vector<uint8_t> table_;
+
+public:
+    netpbm_scale(size_t space) : space_(space) {
+        if(space_ == 255) return;
+
+        table_.resize(space_ > 255 ? 65536 : 256, 0xff);
+        for(size_t v = 0; v <= space_ && v < table_.size(); v++)
+            table_[v] = (v * 255 + space_ / 2) / space_;
+    }
+
+    uint8_t operator()(size_t v) const {
+        if(space_ == 255) return v > 255 ? 255 : v;
+        return v < table_.size() ? table_[v] : 255;
+    }
+
+    // n samples of one byte each
+    void narrow8(const uint8_t* src, uint8_t* dst, size_t n) const {
+        if(space_ == 255) {
+            // narrowed in place, nothing to do then
+            if(src != dst) std::memcpy(dst, src, n);
+            return;
+        }
+        for(size_t i = 0; i < n; i++)
+            dst[i] = table_[src[i]];
+    }
+
+    // n samples of two bytes each, most significant first
+    void narrow16(const uint8_t* src, uint8_t* dst, size_t n) const {
+        if(space_ != 65535) {
+            for(size_t i = 0; i < n; i++)
+                dst[i] = table_[src[2 * i] << 8 | src[2 * i + 1]];
+            return;
+        }
+
+        size_t i = 0;
+#ifdef NETPBM_USE_SSE2
+        for(; i + 16 <= n; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(src + 2 * i + 16));
+            _mm_storeu_si128((__m128i*)(dst + i),
+                    _mm_packus_epi16(round16_(a), round16_(b)));
+        }
+#endif
+        for(; i < n; i++)
+            dst[i] = table_[src[2 * i] << 8 | src[2 * i + 1]];
+    }
+
+private:
+#ifdef NETPBM_USE_SSE2
+    /*
+     * Big-endian samples to (v * 255 + 32767) / 65535, as the table has them,
+     * which is (v + 128) / 257, and y / 257 is (y - (y >> 8)) >> 8 for y below
+     * 65536. Saturating v + 128 gives 255 for the samples it clamps anyway.
+     */
+    static __m128i round16_(__m128i v) {
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        __m128i y = _mm_adds_epu16(v, _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_sub_epi16(y, _mm_srli_epi16(y, 8)), 8);
+    }
+#endif
+};
+
+// n pixels of packed RGB to RGBA, opaque
+void expand_rgb(const uint8_t* src, color* dst, size_t n)
+{
+    size_t i = 0;
+#ifdef NETPBM_USE_SSE2
+    // pixel k is shifted k bytes up into its lane, the rest masked away
+    const __m128i m0 = _mm_setr_epi32(0xffffff, 0, 0, 0);
+    const __m128i m1 = _mm_setr_epi32(0, 0xffffff, 0, 0);
+    const __m128i m2 = _mm_setr_epi32(0, 0, 0xffffff, 0);
+    const __m128i m3 = _mm_setr_epi32(0, 0, 0, 0xffffff);
+    const __m128i alpha = _mm_set1_epi32(0xff << 24);
+    // each load takes 16 bytes for 12, leave the last pixels to the tail
+    for(; i + 6 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + 3 * i));
+        __m128i r = _mm_or_si128(_mm_and_si128(v, m0),
+                _mm_and_si128(_mm_slli_si128(v, 1), m1));
+        r = _mm_or_si128(r, _mm_and_si128(_mm_slli_si128(v, 2), m2));
+        r = _mm_or_si128(r, _mm_and_si128(_mm_slli_si128(v, 3), m3));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(r, alpha));
+    }
+#else
+    // a word at a time, the fourth byte is overwritten by the alpha
+    uint8_t* out = reinterpret_cast<uint8_t*>(dst);
+    for(; i + 2 <= n; i++) {
+        std::memcpy(out + 4 * i, src + 3 * i, 4);
+        out[4 * i + 3] = 0xff;
+    }
+#endif
+    for(; i < n; i++)
+        dst[i] = color(src[3 * i], src[3 * i + 1], src[3 * i + 2]);
+}
+
+// n pixels of RGBA to packed RGB, dropping the alpha
+void pack_rgb(const color* src, uint8_t* dst, size_t n)
+{
+    size_t i = 0;
+#ifdef NETPBM_USE_SSE2
+    // pixel k is shifted k bytes down out of its lane, the rest masked away
+    const __m128i m0 = _mm_setr_epi8(
+            -1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i m1 = _mm_slli_si128(m0, 3);
+    const __m128i m2 = _mm_slli_si128(m0, 6);
+    const __m128i m3 = _mm_slli_si128(m0, 9);
+    // each store writes 16 bytes for 12, the next one overwrites the rest
+    for(; i + 6 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i r = _mm_or_si128(_mm_and_si128(v, m0),
+                _mm_and_si128(_mm_srli_si128(v, 1), m1));
+        r = _mm_or_si128(r, _mm_and_si128(_mm_srli_si128(v, 2), m2));
+        r = _mm_or_si128(r, _mm_and_si128(_mm_srli_si128(v, 3), m3));
+        _mm_storeu_si128((__m128i*)(dst + 3 * i), r);
+    }
+#else
+    for(; i + 2 <= n; i++)
+        std::memcpy(dst + 3 * i, src + i, 4);
+#endif
+    for(; i < n; i++)
+        std::memcpy(dst + 3 * i, src + i, 3);
+}
+
+void netpbm_read_fully(std::istream& is, uint8_t* buf, size_t n)
 {
-for(auto i = im.begin(); i != im.end(); ++i) {
-    uint16_t channels;
-    for(size_t c = 0; c < 3; ++c) {
-        is >> channels >> std::ws;
+    is.read(reinterpret_cast<char*>(buf), n);
 
-        if(is.fail()) {
-            if(is.eof()) throw parse_error(
-                    "EOF too early while reading image");
-            else throw parse_error("Bad Netpbm image: body");
+    if(size_t(is.gcount()) != n || is.fail()) {
+        if(is.eof()) throw parse_error(
+                "EOF too early while reading image");
+        else throw parse_error("Bad Netpbm image: body");
+    }
+}
+
+/*
+ * Scans the unsigned decimals of a plain body out of blocks read from the
+ * stream, skipping whitespace and comments. It may read past the last sample,
+ * only trailing whitespace is expected there anyway.
+ */
+class netpbm_plain_scanner {
+    std::istream& is_;
+    std::vector<char> buf_;
+    const char* cur_ = nullptr;
+    const char* end_ = nullptr;
+
+    bool fill_() {
+        if(!is_) return false;
+        is_.read(buf_.data(), buf_.size());
+        cur_ = buf_.data();
+        end_ = cur_ + is_.gcount();
+        return cur_ != end_;
+    }
+
+    int peek_() {
+        if(cur_ == end_ && !fill_()) return -1;
+        return static_cast<unsigned char>(*cur_);
+    }
+
+public:
+    netpbm_plain_scanner(std::istream& is) :
+        is_(is), buf_(netpbm_block_size) { }
+
+    size_t next() {
+        int c = peek_();
+        while(c >= 0 && (std::isspace(c) || c == '#')) {
+            if(c == '#') {
+                while(c >= 0 && c != '\n') { cur_++; c = peek_(); }
+            } else {
+                cur_++; c = peek_();
+            }
         }
 
-        uint8_t channels_byte = channels;
-        if(space > 255)
-            channels_byte = channels / ((space + 1) / 256);
-        else if(space < 255)
-            channels_byte = channels * 256 / (space + 1) + channels;
-        i->data.bytes[c] = channels_byte;
+        if(c < 0) throw parse_error("EOF too early while reading image");
+        if(c < '0' || c > '9') throw parse_error("Bad Netpbm image: body");
+
+        size_t v = 0;
+        while(c >= '0' && c <= '9') {
+            // large samples saturate anyway, keep them from overflowing
+            if(v < 65536) v = v * 10 + (c - '0');
+            cur_++;
+            c = peek_();
+        }
+
+        return v;
     }
+};
+
 }
+
+static void load_netpbm_body_plain(std::istream& is, image& im, size_t space)
+{
+    netpbm_scale scale(space);
+    netpbm_plain_scanner scan(is);
+
+    for(auto i = im.begin(); i != im.end(); ++i) {
+        uint8_t r = scale(scan.next());
+        uint8_t g = scale(scan.next());
+        uint8_t b = scale(scan.next());
+        *i = color(r, g, b);
+    }
 }
 
-template<typename CompT>
+template<size_t SampleSize>
 static void load_netpbm_body_raw(std::istream& is, image& im, size_t space)
 {
-    for(auto i = im.begin(); i != im.end(); ++i) {
-        CompT channels;
-        for(size_t c = 0; c < 3; c++) {
-            is.read((char*)(&channels), sizeof(channels));
-
-            if(is.fail()) {
-                if(is.eof()) throw parse_error(
-                        "EOF too early while reading image");
-                else throw parse_error("Bad Netpbm image: body");
-            }
+    netpbm_scale scale(space);
 
-            uint8_t channels_byte = channels;
-            if(space > 255)
-                channels_byte = channels / ((space + 1) / 256);
-            else if(space < 255)
-                channels_byte = channels * 256 / (space + 1) + channels;
-            i->data.bytes[c] = channels_byte;
+    const size_t pixel_size = 3 * SampleSize;
+    const size_t block_pixels = netpbm_block_size / pixel_size;
+    std::vector<uint8_t> raw(block_pixels * pixel_size);
+    std::vector<uint8_t> rgb(SampleSize > 1 ? block_pixels * 3 : 0);
+
+    color* dst = im.data();
+    size_t left = im.width() * im.height();
+
+    while(left) {
+        size_t n = std::min(left, block_pixels);
+        netpbm_read_fully(is, raw.data(), n * pixel_size);
+
+        if(SampleSize > 1) {
+            scale.narrow16(raw.data(), rgb.data(), n * 3);
+            expand_rgb(rgb.data(), dst, n);
+        } else {
+            scale.narrow8(raw.data(), raw.data(), n * 3);
+            expand_rgb(raw.data(), dst, n);
         }
+
+        dst += n;
+        left -= n;
     }
 }
 
@@ -133,9 +390,9 @@ void image_io_netpbm::load_into_image(std::istream& is, image& im)
         load_netpbm_body_plain(is, im, space);
     else if(num == '6') {
         if(space > 255)
-            load_netpbm_body_raw<uint16_t>(is, im, space);
+            load_netpbm_body_raw<2>(is, im, space);
         else
-            load_netpbm_body_raw<uint8_t>(is, im, space);
+            load_netpbm_body_raw<1>(is, im, space);
     } else
         throw unsupported_error("Format other than PPM is unsupported");
 }
@@ -144,27 +401,252 @@ void image_io_netpbm::save_image(std::ostream& os, const image& im)
 {
     os << "P6\n# created by shrtool\n"
         << im.width() << ' ' << im.height() << "\n255\n";
-    for(const color& c : im) {
-        os.put(c.data.channels.r);
-        os.put(c.data.channels.g);
-        os.put(c.data.channels.b);
+
+    const size_t block_pixels = netpbm_block_size / 3;
+    std::vector<uint8_t> rgb(block_pixels * 3);
+
+    const color* src = im.data();
+    size_t left = im.width() * im.height();
+
+    while(left) {
+        size_t n = std::min(left, block_pixels);
+        pack_rgb(src, rgb.data(), n);
+        os.write(reinterpret_cast<const char*>(rgb.data()), n * 3);
+
+        src += n;
+        left -= n;
     }
 }
 
-void image::flip_h()
+namespace {
+
+const char qoi_magic[4] = { 'q', 'o', 'i', 'f' };
+const size_t qoi_header_size = 14;
+const uint8_t qoi_end_marker[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+// the largest image the reference decoder takes
+const size_t qoi_max_pixels = 400000000;
+// bytes of encoded chunks written at once, the largest chunk is 5 bytes
+const size_t qoi_block_size = 1 << 16;
+
+const uint8_t qoi_op_index = 0x00;
+const uint8_t qoi_op_diff = 0x40;
+const uint8_t qoi_op_luma = 0x80;
+const uint8_t qoi_op_run = 0xc0;
+const uint8_t qoi_op_rgb = 0xfe;
+const uint8_t qoi_op_rgba = 0xff;
+const uint8_t qoi_mask_2 = 0xc0;
+
+inline size_t qoi_hash(const color& c)
+{
+    const uint8_t* b = c.data.bytes;
+    return (b[0] * 3 + b[1] * 5 + b[2] * 7 + b[3] * 11) & 63;
+}
+
+inline uint32_t qoi_read32(const uint8_t* p)
 {
-    for(size_t r = 0; r < height(); r++) {
-        for(size_t i = 0, j = width() - 1; i < j; ++i, --j)
-            std::swap(pixel(i, r), pixel(j, r));
+    return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 |
+        uint32_t(p[2]) << 8 | uint32_t(p[3]);
+}
+
+inline void qoi_write32(uint8_t* p, uint32_t v)
+{
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+void qoi_clear_index(color* index)
+{
+    for(size_t i = 0; i < 64; i++)
+        index[i] = color(0, 0, 0, 0);
+}
+
+/*
+ * Chunks in [p, end) to n pixels. The buffer holds a few bytes beyond end,
+ * so a chunk is only checked to start before it.
+ */
+void qoi_decode(const uint8_t* p, const uint8_t* end, color* dst, size_t n)
+{
+    color index[64];
+    qoi_clear_index(index);
+    color px(0, 0, 0, 0xff);
+
+    for(size_t i = 0; i < n; ) {
+        if(p >= end)
+            throw parse_error("EOF too early while reading image");
+
+        uint8_t b = *p++;
+        uint8_t* c = px.data.bytes;
+
+        if(b == qoi_op_rgb) {
+            c[0] = p[0]; c[1] = p[1]; c[2] = p[2];
+            p += 3;
+        } else if(b == qoi_op_rgba) {
+            std::memcpy(c, p, 4);
+            p += 4;
+        } else switch(b & qoi_mask_2) {
+        case qoi_op_index:
+            px = index[b];
+            break;
+        case qoi_op_diff:
+            c[0] += ((b >> 4) & 3) - 2;
+            c[1] += ((b >> 2) & 3) - 2;
+            c[2] += (b & 3) - 2;
+            break;
+        case qoi_op_luma: {
+            int dg = (b & 0x3f) - 32;
+            uint8_t rb = *p++;
+            c[0] += dg - 8 + (rb >> 4);
+            c[1] += dg;
+            c[2] += dg - 8 + (rb & 0x0f);
+            break;
+        }
+        case qoi_op_run: {
+            // all but the last pixel of the run, which is written below
+            size_t run = b & 0x3f;
+            if(run >= n - i)
+                throw parse_error("Bad QOI image: body");
+            std::fill(dst + i, dst + i + run, px);
+            i += run;
+            break;
+        }
+        }
+
+        index[qoi_hash(px)] = px;
+        dst[i++] = px;
     }
 }
 
-void image::flip_v()
+}
+
+void image_io_qoi::load_into_image(std::istream& is, image& im)
+{
+    uint8_t hd[qoi_header_size];
+    is.read(reinterpret_cast<char*>(hd), qoi_header_size);
+    if(size_t(is.gcount()) != qoi_header_size)
+        throw parse_error("EOF too early while reading image");
+    if(std::memcmp(hd, qoi_magic, sizeof(qoi_magic)))
+        throw unsupported_error("Bad QOI image: magic number");
+
+    size_t w = qoi_read32(hd + 4), h = qoi_read32(hd + 8);
+    if(!w || !h || h > qoi_max_pixels / w ||
+            (hd[12] != 3 && hd[12] != 4) || hd[13] > 1)
+        throw parse_error("Bad QOI image: properties");
+
+    // the whole body at once, which the decoder runs through without checks
+    std::vector<uint8_t> body;
+    while(is) {
+        size_t n = body.size();
+        body.resize(n + qoi_block_size);
+        is.read(reinterpret_cast<char*>(body.data() + n), qoi_block_size);
+        body.resize(n + is.gcount());
+    }
+    if(is.bad()) throw parse_error("Bad QOI image: body");
+
+    size_t n = body.size();
+    body.resize(n + sizeof(qoi_end_marker), 0);
+
+    im.resize(w, h);
+    qoi_decode(body.data(), body.data() + n, im.data(), w * h);
+}
+
+void image_io_qoi::save_image(std::ostream& os, const image& im)
 {
-    for(size_t c = 0; c < width(); c++) {
-        for(size_t i = 0, j = height() - 1; i < j; ++i, --j)
-            std::swap(pixel(c, i), pixel(c, j));
+    const color* src = im.data();
+    size_t n = im.width() * im.height();
+    bool opaque = std::all_of(im.begin(), im.end(),
+            [](const color& c) { return c.data.bytes[3] == 0xff; });
+
+    std::vector<uint8_t> buf(qoi_block_size + 8);
+    uint8_t* p = buf.data();
+    auto flush = [&]() {
+        os.write(reinterpret_cast<const char*>(buf.data()), p - buf.data());
+        p = buf.data();
+    };
+
+    std::memcpy(p, qoi_magic, sizeof(qoi_magic));
+    qoi_write32(p + 4, im.width());
+    qoi_write32(p + 8, im.height());
+    p[12] = opaque ? 3 : 4;
+    p[13] = 0;
+    p += qoi_header_size;
+
+    color index[64];
+    qoi_clear_index(index);
+    color prev(0, 0, 0, 0xff);
+    size_t run = 0;
+
+    for(size_t i = 0; i < n; i++) {
+        const color& px = src[i];
+
+        if(px == prev) {
+            if(++run == 62 || i + 1 == n) {
+                *p++ = qoi_op_run | (run - 1);
+                run = 0;
+            }
+            continue;
+        }
+
+        if(run) {
+            *p++ = qoi_op_run | (run - 1);
+            run = 0;
+        }
+
+        const uint8_t* c = px.data.bytes;
+        const uint8_t* pc = prev.data.bytes;
+        size_t hash = qoi_hash(px);
+
+        if(index[hash] == px) {
+            *p++ = qoi_op_index | hash;
+        } else if(c[3] != pc[3]) {
+            index[hash] = px;
+            *p++ = qoi_op_rgba;
+            std::memcpy(p, c, 4);
+            p += 4;
+        } else {
+            index[hash] = px;
+            int vr = int8_t(c[0] - pc[0]);
+            int vg = int8_t(c[1] - pc[1]);
+            int vb = int8_t(c[2] - pc[2]);
+            int vg_r = vr - vg, vg_b = vb - vg;
+
+            if(vr >= -2 && vr <= 1 && vg >= -2 && vg <= 1 &&
+                    vb >= -2 && vb <= 1) {
+                *p++ = qoi_op_diff | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+            } else if(vg >= -32 && vg <= 31 && vg_r >= -8 && vg_r <= 7 &&
+                    vg_b >= -8 && vg_b <= 7) {
+                *p++ = qoi_op_luma | (vg + 32);
+                *p++ = (vg_r + 8) << 4 | (vg_b + 8);
+            } else {
+                *p++ = qoi_op_rgb;
+                p[0] = c[0]; p[1] = c[1]; p[2] = c[2];
+                p += 3;
+            }
+        }
+
+        prev = px;
+        if(size_t(p - buf.data()) >= qoi_block_size) flush();
     }
+
+    std::memcpy(p, qoi_end_marker, sizeof(qoi_end_marker));
+    p += sizeof(qoi_end_marker);
+    flush();
+}
+
+image image::load(std::istream& is)
+{
+    int c = is.peek();
+    if(c == 'P') return image_io_netpbm::load(is);
+    if(c == qoi_magic[0]) return image_io_qoi::load(is);
+    throw unsupported_error("Unknown image format");
+}
+
+void image::flip_h()
+{
+    image_transform::apply(*this, image_transform::FLIP_H);
+}
+
+void image::flip_v()
+{
+    image_transform::apply(*this, image_transform::FLIP_V);
 }
 
 }
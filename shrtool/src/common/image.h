@@ -2,6 +2,10 @@
 #define IMAGE_H_INCLUDED
 
 #include <iostream>
+#include <array>
+#include <memory>
+#include <atomic>
+#include <type_traits>
 
 #include "utilities.h"
 
@@ -11,15 +15,103 @@
 
 namespace shrtool {
 
+/*
+ * A non-owning view of a rect of pixels: rows of width pixels, stride pixels
+ * apart. Sub-views slice the same memory, and are uploaded in place since a
+ * view converts to a pixel_view. The owner must outlive the view.
+ */
+template<typename Color>
+class basic_image_view {
+    Color* data_ = nullptr;
+    size_t width_ = 0;
+    size_t height_ = 0;
+    size_t stride_ = 0;
+
+public:
+    basic_image_view() { }
+    basic_image_view(Color* data, size_t w, size_t h, size_t stride = 0) :
+        data_(data), width_(w), height_(h), stride_(stride ? stride : w) { }
+
+    // a view of color can be taken as a view of const color
+    template<typename C, typename = typename std::enable_if<
+        std::is_convertible<C*, Color*>::value>::type>
+    basic_image_view(const basic_image_view<C>& v) :
+        basic_image_view(v.data(), v.width(), v.height(), v.stride()) { }
+
+    size_t width() const { return width_; }
+    size_t height() const { return height_; }
+    size_t stride() const { return stride_; }
+    bool contiguous() const { return stride_ == width_; }
+
+    Color* data() const { return data_; }
+    Color* row(size_t t) const { return data_ + t * stride_; }
+    Color& pixel(size_t l, size_t t) const { return row(t)[l]; }
+
+    basic_image_view sub(size_t l, size_t t, size_t w, size_t h) const {
+        if(l + w > width_ || t + h > height_)
+            throw restriction_error("Out of bound");
+        return basic_image_view(&pixel(l, t), w, h, stride_);
+    }
+
+    // copies into a view of the same size, row by row
+    void copy_to(const basic_image_view<color>& dest) const {
+        if(dest.width() != width_ || dest.height() != height_)
+            throw restriction_error("Size of views mismatch");
+        for(size_t t = 0; t < height_; t++)
+            std::copy(row(t), row(t) + width_, dest.row(t));
+    }
+
+    operator pixel_view() const {
+        return pixel_view(data_, contiguous() ? 0 : stride_);
+    }
+};
+
+typedef basic_image_view<color> image_view;
+typedef basic_image_view<const color> const_image_view;
+
+class float_tile_cache;
+
+/*
+ * Copies of an image share its pixels until either of them is written: the
+ * mutable data, begin, end and view, as well as flips and resizing, first
+ * give the image pixels of its own. Pointers and views they give are
+ * invalidated by the next copy of the image, written through they would be
+ * seen by the copy; take them again after copying. The mutable pixel does
+ * not check, write the pixels of an image copied since through those first.
+ *
+ * Both sides of a copy are told that they may share pixels, rather than
+ * counting the owners, which other threads may change at any time. So an
+ * image of which the copies are all gone still copies its pixels once when
+ * it is next written.
+ *
+ * An image made of pixels it does not own never shares them, its copies
+ * have pixels of their own.
+ */
 class image {
     friend struct image_geometry_helper__;
+    friend struct image_transform;
+
+    typedef std::vector<color> storage_type;
 
     size_t width_ = 0;
     size_t height_ = 0;
 
-    std::vector<color> underlying_;
-    std::vector<fcolor> float_cache_;
+    std::shared_ptr<storage_type> underlying_;
+    std::shared_ptr<float_tile_cache> float_cache_;
     color* data_ = nullptr;
+    // set by a copy on both images, even one of them const
+    mutable std::atomic<bool> may_share_ { false };
+
+    bool shared_() const {
+        return may_share_.load();
+    }
+
+    // gives the image pixels of its own before they are written
+    void detach_() {
+        if(shared_()) unshare_(width_ * height_);
+    }
+
+    void unshare_(size_t size);
 
 public:
     typedef color* iterator;
@@ -35,8 +127,20 @@ public:
     image(image&& rhs) { operator=(std::move(rhs)); }
 
     image& operator=(const image& rhs) {
-        resize(rhs.width_, rhs.height_);
-        std::copy(rhs.begin(), rhs.end(), begin());
+        if(this == &rhs) return *this;
+
+        float_cache_.reset();
+        if(rhs.underlying_) {
+            width_ = rhs.width_;
+            height_ = rhs.height_;
+            underlying_ = rhs.underlying_;
+            data_ = rhs.data_;
+            may_share_ = true;
+            rhs.may_share_ = true;
+        } else {
+            resize(rhs.width_, rhs.height_);
+            std::copy(rhs.begin(), rhs.end(), begin());
+        }
         return *this;
     }
 
@@ -44,15 +148,17 @@ public:
         std::swap(width_, rhs.width_);
         std::swap(height_, rhs.height_);
         std::swap(underlying_, rhs.underlying_);
-
-        if(!underlying_.empty())
-            data_ = underlying_.data();
-        if(!rhs.underlying_.empty())
-            rhs.data_ = rhs.underlying_.data();
+        std::swap(float_cache_, rhs.float_cache_);
+        std::swap(data_, rhs.data_);
+        may_share_ = rhs.may_share_.exchange(may_share_);
 
         return *this;
     }
 
+    // whether the pixels may be shared with a copy of the image
+    bool shared() const { return shared_(); }
+
+    // done in place, as image_transform does
     void flip_h();
     void flip_v();
 
@@ -66,47 +172,50 @@ public:
     const_iterator cbegin() const { return data(); }
     const_iterator cend() const { return data() + width_ * height_; }
 
+    // not detached, see above
     color& pixel(size_t l, size_t t) {
-        return data()[t * width_ + l];
+        return data_[t * width_ + l];
     }
 
     const color& pixel(size_t l, size_t t) const {
         return data()[t * width_ + l];
     }
 
-    const void quad(size_t l, size_t t,
-            fcolor& c00, fcolor& c10, fcolor& c01, fcolor& c11) const {
-#if _DEBUG
-        GUARD_(!float_cache_.empty());
-#endif
-        l += t * width_;
+    /*
+     * The pixel at (l, t) and those to its right and below, clamped to the
+     * edges, from the float cache.
+     */
+    void quad(size_t l, size_t t,
+            fcolor& c00, fcolor& c10, fcolor& c01, fcolor& c11) const;
 
-        c00 = float_cache_[l];
-        c10 = float_cache_[l + 1];
-        c01 = float_cache_[l + width_];
-        c11 = float_cache_[l + width_ + 1];
-    }
+    void resize(size_t w, size_t h);
 
-    void resize(size_t w, size_t h) {
-        width_ = w;
-        height_ = h;
+    color* data() { detach_(); return data_; }
+    color const* data() const { return data_; }
 
-        underlying_.resize(w * h);
-        data_ = underlying_.data();
+    image_view view() {
+        return image_view(data(), width_, height_);
+    }
+    const_image_view view() const {
+        return const_image_view(data(), width_, height_);
+    }
+    image_view view(size_t l, size_t t, size_t w, size_t h) {
+        return view().sub(l, t, w, h);
+    }
+    const_image_view view(size_t l, size_t t, size_t w, size_t h) const {
+        return view().sub(l, t, w, h);
     }
-
-    color* data() { return data_; }
-    color const* data() const { return data_; }
 
     ~image() { }
 
     void copy_pixel(size_t offx, size_t offy, size_t w, size_t h,
             image& dest, size_t dest_x, size_t dest_y) const;
 
-    void make_float_cache() {
-        float_cache_.resize(width_ * height_);
-        std::copy(begin(), end(), float_cache_.begin());
-    }
+    /*
+     * Pixels are converted to float a tile at a time as quad reaches them,
+     * the cache is to be made again after they change.
+     */
+    void make_float_cache();
 
     /* Many cubemap images have layouts as such:
      *    +Y
@@ -115,6 +224,17 @@ public:
      */
     static image load_cubemap_from(const image& img);
 
+    /*
+     * An image of any format known by image_io_*, told apart by its magic
+     * number.
+     */
+    static image load(std::istream& is);
+    /*
+     * Views of the six faces, in the order of texture_cubemap, either of the
+     * layout above or of faces stacked from top to bottom. Nothing is copied.
+     */
+    static std::array<const_image_view, 6> cubemap_faces(const image& img);
+
     static void meta_reg_() {
         refl::meta_manager::reg_class<image>("image")
             .enable_auto_register()
@@ -153,6 +273,37 @@ struct image_io_netpbm {
     static void save_image(std::ostream& os, const image& im);
 };
 
+/*
+ * The Quite OK Image format: lossless, a few times smaller than PPM, and
+ * decoded in a single pass over a buffer of the whole file. Images are saved
+ * with three channels if all of them are opaque.
+ */
+struct image_io_qoi {
+    image* img;
+
+    image_io_qoi(image& im) : img(&im) { }
+
+    static image load(std::istream& is) {
+        image im;
+        load_into_image(is, im);
+        return std::move(im);
+    }
+
+    std::istream& operator()(std::istream& is) {
+        load_into_image(is, *img);
+        return is;
+    }
+
+    std::ostream& operator()(std::ostream& os) {
+        save_image(os, *img);
+        return os;
+    }
+
+    // the rest of the stream is read, the image being the last of it
+    static void load_into_image(std::istream& is, image& im);
+    static void save_image(std::ostream& os, const image& im);
+};
+
 template<>
 struct texture2d_trait<image> {
     typedef shrtool::raw_data_tag transfer_tag;
@@ -175,6 +326,46 @@ struct texture2d_trait<image> {
     }
 };
 
+template<>
+struct texture2d_trait<const_image_view> {
+    typedef shrtool::raw_data_tag transfer_tag;
+    typedef const_image_view input_type;
+
+    static size_t width(const input_type& i) {
+        return i.width();
+    }
+
+    static size_t height(const input_type& i) {
+        return i.height();
+    }
+
+    static size_t format(const input_type& i) {
+        return RGBA_U8888;
+    }
+
+    static pixel_view data(const input_type& i) {
+        return i;
+    }
+};
+
+template<>
+struct cubemap_trait<image> {
+    typedef image input_type;
+
+    static size_t edge(const input_type& i) {
+        return image::cubemap_faces(i)[0].width();
+    }
+
+    static size_t format(const input_type& i) {
+        return RGBA_U8888;
+    }
+
+    static std::array<pixel_view, 6> faces(const input_type& i) {
+        std::array<const_image_view, 6> f = image::cubemap_faces(i);
+        return {{ f[0], f[1], f[2], f[3], f[4], f[5] }};
+    }
+};
+
 }
 
 #endif // IMAGE_H_INCLUDED
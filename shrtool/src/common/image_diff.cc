@@ -0,0 +1,399 @@
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+#include "image_diff.h"
+#include "parallel.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define DIFF_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace shrtool {
+
+namespace {
+
+// rows of about this many pixels are given to each thread
+const size_t parallel_grain_pixels = 1 << 15;
+// pixels of 8 bits summed in 32 bits before being taken out
+const size_t narrow_sum_pixels = 4096;
+
+const uint32_t diff_white = 0xffffffff;
+const uint32_t diff_black = 0xff000000;
+
+size_t row_grain(size_t width)
+{
+    return std::max<size_t>(1, parallel_grain_pixels / std::max<size_t>(1, width));
+}
+
+/*
+ * Errors of a row, or of all of them once added up. The errors of 8-bit
+ * rows are kept in channel levels until the end.
+ */
+struct partial {
+    double sum[4] = { 0, 0, 0, 0 };
+    double sq[4] = { 0, 0, 0, 0 };
+    float max[4] = { 0, 0, 0, 0 };
+    size_t differing = 0;
+
+    void add(const partial& p) {
+        for(size_t c = 0; c < 4; c++) {
+            sum[c] += p.sum[c];
+            sq[c] += p.sq[c];
+            max[c] = std::max(max[c], p.max[c]);
+        }
+        differing += p.differing;
+    }
+};
+
+inline size_t count_bits4(int m)
+{
+    return (m & 1) + (m >> 1 & 1) + (m >> 2 & 1) + (m >> 3 & 1);
+}
+
+void diff_row(const color* a, const color* b, size_t n, uint8_t tol,
+        color* mask, partial& p)
+{
+    uint64_t sum[4] = { 0, 0, 0, 0 }, sq[4] = { 0, 0, 0, 0 };
+    uint8_t mx[4] = { 0, 0, 0, 0 };
+    size_t x = 0;
+
+#ifdef DIFF_USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i t = _mm_set1_epi8(char(tol));
+    const __m128i black = _mm_set1_epi32(int32_t(diff_black));
+    __m128i vmax = zero;
+    size_t n4 = n & ~size_t(3);
+
+    while(x < n4) {
+        // 32-bit lanes of r, g, b and a
+        __m128i vsum = zero, vsq = zero;
+        size_t e = std::min(n4, x + narrow_sum_pixels);
+
+        for(; x < e; x += 4) {
+            __m128i pa = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x));
+            __m128i pb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x));
+            __m128i d = _mm_or_si128(_mm_subs_epu8(pa, pb), _mm_subs_epu8(pb, pa));
+            vmax = _mm_max_epu8(vmax, d);
+
+            __m128i lo = _mm_unpacklo_epi8(d, zero);
+            __m128i hi = _mm_unpackhi_epi8(d, zero);
+            __m128i s = _mm_add_epi16(lo, hi);
+            vsum = _mm_add_epi32(vsum, _mm_add_epi32(
+                        _mm_unpacklo_epi16(s, zero), _mm_unpackhi_epi16(s, zero)));
+
+            // squares of up to 65025 fit 16 bits taken as unsigned
+            __m128i qlo = _mm_mullo_epi16(lo, lo);
+            __m128i qhi = _mm_mullo_epi16(hi, hi);
+            vsq = _mm_add_epi32(vsq, _mm_add_epi32(
+                        _mm_add_epi32(_mm_unpacklo_epi16(qlo, zero),
+                            _mm_unpackhi_epi16(qlo, zero)),
+                        _mm_add_epi32(_mm_unpacklo_epi16(qhi, zero),
+                            _mm_unpackhi_epi16(qhi, zero))));
+
+            // pixels of which no channel is beyond the tolerance
+            __m128i within = _mm_cmpeq_epi32(_mm_subs_epu8(d, t), zero);
+            p.differing += 4 - count_bits4(
+                    _mm_movemask_ps(_mm_castsi128_ps(within)));
+            if(mask)
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(mask + x),
+                        _mm_or_si128(_mm_andnot_si128(within,
+                                _mm_set1_epi32(-1)), black));
+        }
+
+        uint32_t s[4], q[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(s), vsum);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(q), vsq);
+        for(size_t c = 0; c < 4; c++) {
+            sum[c] += s[c];
+            sq[c] += q[c];
+        }
+    }
+
+    uint8_t m[16];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(m), vmax);
+    for(size_t i = 0; i < 16; i++)
+        mx[i % 4] = std::max(mx[i % 4], m[i]);
+#endif
+
+    for(; x < n; x++) {
+        bool differs = false;
+        for(size_t c = 0; c < 4; c++) {
+            int d = std::abs(int(a[x].data.bytes[c]) - int(b[x].data.bytes[c]));
+            sum[c] += d;
+            sq[c] += d * d;
+            mx[c] = std::max<uint8_t>(mx[c], d);
+            differs = differs || d > tol;
+        }
+        if(differs) p.differing++;
+        if(mask) mask[x] = color(differs ? diff_white : diff_black);
+    }
+
+    for(size_t c = 0; c < 4; c++) {
+        p.sum[c] += sum[c];
+        p.sq[c] += sq[c];
+        p.max[c] = std::max<float>(p.max[c], mx[c]);
+    }
+}
+
+void diff_row(const fcolor* a, const fcolor* b, size_t n, float tol,
+        color* mask, partial& p)
+{
+    float sum[4] = { 0, 0, 0, 0 }, sq[4] = { 0, 0, 0, 0 };
+    float mx[4] = { 0, 0, 0, 0 };
+    size_t x = 0;
+
+#ifdef DIFF_USE_SSE2
+    const __m128 sign = _mm_set1_ps(-0.f);
+    const __m128 t = _mm_set1_ps(tol);
+    __m128 vsum = _mm_setzero_ps(), vsq = vsum, vmax = vsum;
+
+    for(; x < n; x++) {
+        __m128 d = _mm_andnot_ps(sign, _mm_sub_ps(
+                    _mm_loadu_ps(a[x].data.floats),
+                    _mm_loadu_ps(b[x].data.floats)));
+        vmax = _mm_max_ps(vmax, d);
+        vsum = _mm_add_ps(vsum, d);
+        vsq = _mm_add_ps(vsq, _mm_mul_ps(d, d));
+
+        bool differs = _mm_movemask_ps(_mm_cmpgt_ps(d, t)) != 0;
+        if(differs) p.differing++;
+        if(mask) mask[x] = color(differs ? diff_white : diff_black);
+    }
+
+    _mm_storeu_ps(sum, vsum);
+    _mm_storeu_ps(sq, vsq);
+    _mm_storeu_ps(mx, vmax);
+#endif
+
+    for(; x < n; x++) {
+        bool differs = false;
+        for(size_t c = 0; c < 4; c++) {
+            float d = std::fabs(a[x].data.floats[c] - b[x].data.floats[c]);
+            sum[c] += d;
+            sq[c] += d * d;
+            mx[c] = std::max(mx[c], d);
+            differs = differs || d > tol;
+        }
+        if(differs) p.differing++;
+        if(mask) mask[x] = color(differs ? diff_white : diff_black);
+    }
+
+    for(size_t c = 0; c < 4; c++) {
+        p.sum[c] += sum[c];
+        p.sq[c] += sq[c];
+        p.max[c] = std::max(p.max[c], mx[c]);
+    }
+}
+
+inline float luma(const color& c)
+{
+    return (0.299f * c.data.bytes[0] + 0.587f * c.data.bytes[1] +
+            0.114f * c.data.bytes[2]) / 255.f;
+}
+
+inline float luma(const fcolor& c)
+{
+    return 0.299f * c.data.floats[0] + 0.587f * c.data.floats[1] +
+        0.114f * c.data.floats[2];
+}
+
+/*
+ * Sums over blocks of 4x4 of the luminance of both images, of which each
+ * window of 8x8 takes 2x2. Windows of images smaller than 8 are the whole
+ * image.
+ */
+struct ssim_blocks {
+    struct sums {
+        double a = 0, b = 0, aa = 0, bb = 0, ab = 0;
+        double n = 0;
+
+        void add(const sums& s) {
+            a += s.a; b += s.b; aa += s.aa; bb += s.bb; ab += s.ab;
+            n += s.n;
+        }
+
+        double ssim() const {
+            const double c1 = 0.01 * 0.01, c2 = 0.03 * 0.03;
+            double ma = a / n, mb = b / n;
+            double va = aa / n - ma * ma, vb = bb / n - mb * mb;
+            double cov = ab / n - ma * mb;
+            return ((2 * ma * mb + c1) * (2 * cov + c2)) /
+                ((ma * ma + mb * mb + c1) * (va + vb + c2));
+        }
+    };
+
+    static const size_t block = 4;
+};
+
+template<typename Pixel, typename RowOf>
+double ssim_of(size_t w, size_t h, RowOf row_a, RowOf row_b)
+{
+    typedef ssim_blocks::sums sums;
+    const size_t bs = ssim_blocks::block;
+
+    if(w < bs * 2 || h < bs * 2) {
+        sums s;
+        for(size_t y = 0; y < h; y++)
+            for(size_t x = 0; x < w; x++) {
+                double la = luma(row_a(y)[x]), lb = luma(row_b(y)[x]);
+                s.a += la; s.b += lb;
+                s.aa += la * la; s.bb += lb * lb; s.ab += la * lb;
+                s.n++;
+            }
+        return s.ssim();
+    }
+
+    // pixels beyond the last whole block are left out
+    size_t bw = w / bs, bh = h / bs;
+    std::vector<sums> blocks(bw * bh);
+
+    parallel_for(bh, row_grain(w * bs), [&](size_t b, size_t e) {
+        std::vector<float> la(w), lb(w);
+        for(size_t by = b; by < e; by++)
+        for(size_t y = by * bs; y < by * bs + bs; y++) {
+            const Pixel* pa = row_a(y);
+            const Pixel* pb = row_b(y);
+            for(size_t x = 0; x < bw * bs; x++) {
+                la[x] = luma(pa[x]);
+                lb[x] = luma(pb[x]);
+            }
+            for(size_t bx = 0; bx < bw; bx++) {
+                sums& s = blocks[by * bw + bx];
+                for(size_t x = bx * bs; x < bx * bs + bs; x++) {
+                    s.a += la[x]; s.b += lb[x];
+                    s.aa += la[x] * la[x]; s.bb += lb[x] * lb[x];
+                    s.ab += la[x] * lb[x];
+                }
+                s.n += bs;
+            }
+        }
+    });
+
+    std::vector<double> rows(bh - 1);
+    parallel_for(bh - 1, 1, [&](size_t b, size_t e) {
+        for(size_t by = b; by < e; by++) {
+            double r = 0;
+            for(size_t bx = 0; bx + 1 < bw; bx++) {
+                sums s = blocks[by * bw + bx];
+                s.add(blocks[by * bw + bx + 1]);
+                s.add(blocks[(by + 1) * bw + bx]);
+                s.add(blocks[(by + 1) * bw + bx + 1]);
+                r += s.ssim();
+            }
+            rows[by] = r;
+        }
+    });
+
+    double total = 0;
+    for(double r : rows) total += r;
+    return total / ((bw - 1) * (bh - 1));
+}
+
+template<typename Pixel, typename Tol, typename RowOf>
+image_diff::stats compare_rows(size_t w, size_t h, RowOf row_a, RowOf row_b,
+        Tol tol, double scale, color* mask)
+{
+    std::vector<partial> rows(h);
+    parallel_for(h, row_grain(w), [&](size_t b, size_t e) {
+        for(size_t y = b; y < e; y++)
+            diff_row(row_a(y), row_b(y), w, tol,
+                    mask ? mask + y * w : nullptr, rows[y]);
+    });
+
+    // added up in order, whichever thread made them
+    partial p;
+    for(const partial& r : rows) p.add(r);
+
+    image_diff::stats s;
+    double n = double(w) * h;
+    for(size_t c = 0; c < 4; c++) {
+        s.max_error.data.floats[c] = p.max[c] / scale;
+        s.mean_error.data.floats[c] = p.sum[c] / scale / n;
+    }
+    s.differing = p.differing;
+
+    double mse = (p.sq[0] + p.sq[1] + p.sq[2]) / (scale * scale) / (n * 3);
+    s.psnr = mse > 0 ? 10 * std::log10(1 / mse) :
+        std::numeric_limits<double>::infinity();
+    s.ssim = ssim_of<Pixel>(w, h, row_a, row_b);
+    return s;
+}
+
+uint8_t narrow_tolerance(float tolerance)
+{
+    // a hair over, so that a tolerance of k / 255 allows k levels
+    float t = std::floor(tolerance * 255 + 1e-3f);
+    return t < 0 ? 0 : t > 255 ? 255 : uint8_t(t);
+}
+
+void check_sizes(size_t wa, size_t ha, size_t wb, size_t hb)
+{
+    if(wa != wb || ha != hb)
+        throw restriction_error("Size of images mismatch");
+}
+
+struct view_rows {
+    const const_image_view* v;
+    const color* operator()(size_t y) const { return v->row(y); }
+};
+
+struct float_rows {
+    const float_image* im;
+    const fcolor* operator()(size_t y) const { return im->row(y); }
+};
+
+}
+
+image_diff::stats image_diff::compare(const const_image_view& a,
+        const const_image_view& b, float tolerance)
+{
+    check_sizes(a.width(), a.height(), b.width(), b.height());
+    return compare_rows<color>(a.width(), a.height(),
+            view_rows { &a }, view_rows { &b },
+            narrow_tolerance(tolerance), 255, nullptr);
+}
+
+image_diff::stats image_diff::compare(const float_image& a,
+        const float_image& b, float tolerance)
+{
+    check_sizes(a.width(), a.height(), b.width(), b.height());
+    return compare_rows<fcolor>(a.width(), a.height(),
+            float_rows { &a }, float_rows { &b }, tolerance, 1, nullptr);
+}
+
+image image_diff::mask(const const_image_view& a, const const_image_view& b,
+        float tolerance)
+{
+    check_sizes(a.width(), a.height(), b.width(), b.height());
+    image m(a.width(), a.height());
+    color* d = m.data();
+    uint8_t t = narrow_tolerance(tolerance);
+
+    parallel_for(a.height(), row_grain(a.width()), [&](size_t y0, size_t y1) {
+        partial p;
+        for(size_t y = y0; y < y1; y++)
+            diff_row(a.row(y), b.row(y), a.width(), t, d + y * a.width(), p);
+    });
+    return m;
+}
+
+image image_diff::mask(const float_image& a, const float_image& b,
+        float tolerance)
+{
+    check_sizes(a.width(), a.height(), b.width(), b.height());
+    image m(a.width(), a.height());
+    color* d = m.data();
+
+    parallel_for(a.height(), row_grain(a.width()), [&](size_t y0, size_t y1) {
+        partial p;
+        for(size_t y = y0; y < y1; y++)
+            diff_row(a.row(y), b.row(y), a.width(), tolerance,
+                    d + y * a.width(), p);
+    });
+    return m;
+}
+
+}
@@ -0,0 +1,54 @@
+#ifndef IMAGE_DIFF_H_INCLUDED
+#define IMAGE_DIFF_H_INCLUDED
+
+#include "image.h"
+#include "image_resample.h"
+
+namespace shrtool {
+
+/*
+ * Comparison of an image against a reference, as rendered frames are
+ * checked against golden ones. Rows are compared on several threads, four
+ * channels at a time, and the results do not depend on the number of
+ * threads.
+ *
+ * Errors are in the range of a channel taken as 1, so those of 8-bit and
+ * float images read alike. The tolerance is in the same range: pixels of
+ * which a channel differs by more are counted, and marked in masks.
+ */
+struct image_diff {
+    struct stats {
+        // of each channel
+        fcolor max_error;
+        fcolor mean_error;
+        // of the color channels, infinite if they are equal
+        double psnr = 0;
+        // of the luminance, over windows of 8x8 pixels every 4
+        double ssim = 1;
+        size_t differing = 0;
+
+        stats() : max_error(0, 0, 0, 0), mean_error(0, 0, 0, 0) { }
+    };
+
+    static stats compare(const const_image_view& a, const const_image_view& b,
+            float tolerance = 0);
+    static stats compare(const image& a, const image& b,
+            float tolerance = 0) {
+        return compare(a.view(), b.view(), tolerance);
+    }
+    static stats compare(const float_image& a, const float_image& b,
+            float tolerance = 0);
+
+    // white where pixels differ beyond the tolerance, black elsewhere
+    static image mask(const const_image_view& a, const const_image_view& b,
+            float tolerance = 0);
+    static image mask(const image& a, const image& b, float tolerance = 0) {
+        return mask(a.view(), b.view(), tolerance);
+    }
+    static image mask(const float_image& a, const float_image& b,
+            float tolerance = 0);
+};
+
+}
+
+#endif // IMAGE_DIFF_H_INCLUDED
@@ -0,0 +1,23 @@
+#include <fstream>
+
+#include "image_loader.h"
+
+namespace shrtool {
+
+async_image image_loader::load(const std::string& path, decoder d)
+{
+    return pool_.submit([path, d]() {
+        std::ifstream fin(path, std::ios::binary);
+        if(!fin)
+            throw not_found_error("Cannot open image file " + path);
+        return d(fin);
+    }).share();
+}
+
+image_loader& image_loader::global()
+{
+    static image_loader loader;
+    return loader;
+}
+
+}
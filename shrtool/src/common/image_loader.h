@@ -0,0 +1,101 @@
+#ifndef IMAGE_LOADER_H_INCLUDED
+#define IMAGE_LOADER_H_INCLUDED
+
+#include <string>
+#include <future>
+#include <functional>
+
+#include "image.h"
+#include "thread_pool.h"
+
+namespace shrtool {
+
+/*
+ * An image being decoded elsewhere. Copies share the same image, which
+ * stays valid as long as any of them does.
+ */
+class async_image {
+    std::shared_future<image> future_;
+
+public:
+    async_image() { }
+    async_image(std::shared_future<image> f) : future_(std::move(f)) { }
+
+    bool valid() const { return future_.valid(); }
+
+    // never blocks
+    bool ready() const {
+        return future_.valid() && future_.wait_for(
+                std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    // blocks until decoded, and rethrows what the decoding threw
+    const image& wait() const {
+        if(!future_.valid())
+            throw restriction_error("No image is being loaded");
+        return future_.get();
+    }
+
+    static void meta_reg_() {
+        refl::meta_manager::reg_class<async_image>("async_image")
+            .enable_auto_register();
+    }
+};
+
+/*
+ * image_loader decodes image files on a pool of threads. Loading returns at
+ * once, files are decoded in the order they are asked for.
+ */
+class image_loader {
+public:
+    typedef std::function<image(std::istream&)> decoder;
+
+    explicit image_loader(size_t threads = hardware_concurrency()) :
+        pool_(threads) { }
+
+    async_image load(const std::string& path, decoder d);
+    // of any format image::load tells apart
+    async_image load(const std::string& path) {
+        return load(path, image::load);
+    }
+
+    // the one scripts load with, of as many threads as the cores
+    static image_loader& global();
+
+private:
+    thread_pool pool_;
+};
+
+/*
+ * Textures of images yet to be decoded are left empty, and filled the first
+ * time they are updated after the image is ready.
+ */
+template<>
+struct texture2d_trait<async_image> {
+    typedef shrtool::raw_data_tag transfer_tag;
+    typedef async_image input_type;
+
+    static bool ready(const input_type& i) {
+        return i.ready();
+    }
+
+    static size_t width(const input_type& i) {
+        return i.wait().width();
+    }
+
+    static size_t height(const input_type& i) {
+        return i.wait().height();
+    }
+
+    static size_t format(const input_type& i) {
+        return RGBA_U8888;
+    }
+
+    static const void* data(const input_type& i) {
+        return i.wait().data();
+    }
+};
+
+}
+
+#endif // IMAGE_LOADER_H_INCLUDED
@@ -0,0 +1,380 @@
+#include <cmath>
+#include <algorithm>
+
+#include "image_resample.h"
+#include "parallel.h"
+
+#if defined(__SSE__) || defined(_M_X64)
+#define RESAMPLE_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace shrtool {
+
+namespace {
+
+// rows of about this many pixels are given to each thread
+const size_t parallel_grain_pixels = 1 << 14;
+
+size_t row_grain(size_t width)
+{
+    return std::max<size_t>(1, parallel_grain_pixels / std::max<size_t>(1, width));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// sRGB
+
+struct srgb_tables {
+    static const size_t encode_size = 1 << 14;
+
+    float decode[256];
+    uint8_t encode[encode_size];
+
+    srgb_tables() {
+        for(size_t i = 0; i < 256; i++) {
+            double c = i / 255.0;
+            decode[i] = c <= 0.04045 ? c / 12.92 :
+                std::pow((c + 0.055) / 1.055, 2.4);
+        }
+
+        for(size_t i = 0; i < encode_size; i++) {
+            double l = double(i) / (encode_size - 1);
+            double c = l <= 0.0031308 ? l * 12.92 :
+                1.055 * std::pow(l, 1 / 2.4) - 0.055;
+            encode[i] = uint8_t(c * 255 + 0.5);
+        }
+    }
+
+    uint8_t encode_linear(float l) const {
+        if(!(l > 0)) return 0;
+        if(l >= 1) return 255;
+        return encode[size_t(l * (encode_size - 1) + 0.5f)];
+    }
+};
+
+const srgb_tables& srgb_table()
+{
+    static const srgb_tables t;
+    return t;
+}
+
+uint8_t to_byte(float v)
+{
+    if(!(v > 0)) return 0;
+    if(v >= 1) return 255;
+    return uint8_t(v * 255 + 0.5f);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// kernels
+
+double sinc(double x)
+{
+    if(std::abs(x) < 1e-6) return 1;
+    x *= math::PI;
+    return std::sin(x) / x;
+}
+
+double bessel_i0(double x)
+{
+    double sum = 1, term = 1, q = x * x / 4;
+    for(size_t k = 1; k < 32; k++) {
+        term *= q / (k * k);
+        sum += term;
+        if(term < sum * 1e-12) break;
+    }
+    return sum;
+}
+
+const double kaiser_alpha = 4;
+
+double filter_support(image_resample::filter f)
+{
+    switch(f) {
+    case image_resample::BOX: return 0.5;
+    case image_resample::BILINEAR: return 1;
+    case image_resample::KAISER: return 3;
+    case image_resample::LANCZOS: return 3;
+    }
+    return 1;
+}
+
+double filter_weight(image_resample::filter f, double x)
+{
+    x = std::abs(x);
+
+    switch(f) {
+    case image_resample::BOX:
+        return x < 0.5 ? 1 : 0;
+    case image_resample::BILINEAR:
+        return x < 1 ? 1 - x : 0;
+    case image_resample::KAISER: {
+        if(x >= 3) return 0;
+        double r = x / 3;
+        return sinc(x) * bessel_i0(kaiser_alpha * std::sqrt(1 - r * r)) /
+            bessel_i0(kaiser_alpha);
+    }
+    case image_resample::LANCZOS:
+        return x < 3 ? sinc(x) * sinc(x / 3) : 0;
+    }
+    return 0;
+}
+
+/*
+ * The source pixels contributing to each pixel of the result along one axis,
+ * and their normalized weights, at most taps of them.
+ */
+struct weight_table {
+    size_t taps = 0;
+    std::vector<size_t> first;
+    std::vector<size_t> count;
+    std::vector<float> weights;
+
+    weight_table(size_t src, size_t dst, image_resample::filter f) :
+            first(dst), count(dst) {
+        double scale = double(src) / dst;
+        double stretch = std::max(1.0, scale);
+        double support = filter_support(f) * stretch;
+
+        taps = size_t(std::ceil(support * 2)) + 1;
+        weights.resize(dst * taps);
+
+        std::vector<double> w(taps);
+        for(size_t i = 0; i < dst; i++) {
+            double center = (i + 0.5) * scale;
+            long lo = std::max(0L, long(std::floor(center - support)));
+            long hi = std::min(long(src), long(std::ceil(center + support)));
+
+            double sum = 0;
+            size_t n = 0;
+            for(long j = lo; j < hi && n < taps; j++, n++) {
+                w[n] = filter_weight(f, (j + 0.5 - center) / stretch);
+                sum += w[n];
+            }
+
+            // trim the zeros at both ends
+            size_t b = 0;
+            while(b < n && w[b] == 0) b++;
+            while(n > b && w[n - 1] == 0) n--;
+
+            if(b == n || sum == 0) {
+                // too narrow to hit any pixel center, take the nearest
+                size_t nearest = std::min(src - 1, size_t(center));
+                first[i] = nearest;
+                count[i] = 1;
+                weights[i * taps] = 1;
+                continue;
+            }
+
+            first[i] = lo + b;
+            count[i] = n - b;
+            for(size_t k = b; k < n; k++)
+                weights[i * taps + k - b] = w[k] / sum;
+        }
+    }
+
+    const float* at(size_t i) const { return weights.data() + i * taps; }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// passes
+
+// acc += w * p, over n pixels
+inline void madd_row(fcolor* acc, const fcolor* p, float w, size_t n)
+{
+#ifdef RESAMPLE_USE_SSE
+    __m128 vw = _mm_set1_ps(w);
+    for(size_t i = 0; i < n; i++) {
+        __m128 a = _mm_loadu_ps(acc[i].data.floats);
+        __m128 v = _mm_loadu_ps(p[i].data.floats);
+        _mm_storeu_ps(acc[i].data.floats, _mm_add_ps(a, _mm_mul_ps(v, vw)));
+    }
+#else
+    for(size_t i = 0; i < n; i++)
+        for(size_t c = 0; c < 4; c++)
+            acc[i].data.floats[c] += w * p[i].data.floats[c];
+#endif
+}
+
+inline void dot_pixels(fcolor& out, const fcolor* p, const float* w, size_t n)
+{
+#ifdef RESAMPLE_USE_SSE
+    __m128 acc = _mm_setzero_ps();
+    for(size_t k = 0; k < n; k++)
+        acc = _mm_add_ps(acc, _mm_mul_ps(
+                _mm_loadu_ps(p[k].data.floats), _mm_set1_ps(w[k])));
+    _mm_storeu_ps(out.data.floats, acc);
+#else
+    float acc[4] = { 0, 0, 0, 0 };
+    for(size_t k = 0; k < n; k++)
+        for(size_t c = 0; c < 4; c++)
+            acc[c] += w[k] * p[k].data.floats[c];
+    for(size_t c = 0; c < 4; c++)
+        out.data.floats[c] = acc[c];
+#endif
+}
+
+float_image resample_h(const float_image& src, size_t w,
+        image_resample::filter f)
+{
+    weight_table wt(src.width(), w, f);
+    float_image dst(w, src.height());
+
+    parallel_for(src.height(), row_grain(w), [&](size_t b, size_t e) {
+        for(size_t y = b; y < e; y++) {
+            const fcolor* s = src.row(y);
+            fcolor* d = dst.row(y);
+            for(size_t x = 0; x < w; x++)
+                dot_pixels(d[x], s + wt.first[x], wt.at(x), wt.count[x]);
+        }
+    });
+
+    return dst;
+}
+
+float_image resample_v(const float_image& src, size_t h,
+        image_resample::filter f)
+{
+    weight_table wt(src.height(), h, f);
+    float_image dst(src.width(), h);
+
+    parallel_for(h, row_grain(src.width()), [&](size_t b, size_t e) {
+        for(size_t y = b; y < e; y++) {
+            fcolor* d = dst.row(y);
+            std::fill(d, d + dst.width(), fcolor(0, 0, 0, 0));
+
+            const float* w = wt.at(y);
+            for(size_t k = 0; k < wt.count[y]; k++)
+                madd_row(d, src.row(wt.first[y] + k), w[k], src.width());
+        }
+    });
+
+    return dst;
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+float_image float_image::from_image(const const_image_view& v, bool srgb)
+{
+    float_image fi(v.width(), v.height());
+    const float* dec = srgb_table().decode;
+
+    parallel_for(v.height(), row_grain(v.width()), [&](size_t b, size_t e) {
+        for(size_t y = b; y < e; y++) {
+            const color* s = v.row(y);
+            fcolor* d = fi.row(y);
+            for(size_t x = 0; x < v.width(); x++) {
+                const uint8_t* c = s[x].data.bytes;
+                if(srgb)
+                    d[x] = fcolor(dec[c[0]], dec[c[1]], dec[c[2]],
+                            c[3] / 255.f);
+                else
+                    d[x] = s[x];
+            }
+        }
+    });
+
+    return fi;
+}
+
+image float_image::to_image(bool srgb) const
+{
+    image im(width_, height_);
+    const srgb_tables& tab = srgb_table();
+
+    parallel_for(height_, row_grain(width_), [&](size_t b, size_t e) {
+        for(size_t y = b; y < e; y++) {
+            const fcolor* s = row(y);
+            color* d = im.data() + y * width_;
+            for(size_t x = 0; x < width_; x++) {
+                const float* c = s[x].data.floats;
+                if(srgb)
+                    d[x] = color(tab.encode_linear(c[0]),
+                            tab.encode_linear(c[1]),
+                            tab.encode_linear(c[2]), to_byte(c[3]));
+                else
+                    d[x] = color(to_byte(c[0]), to_byte(c[1]),
+                            to_byte(c[2]), to_byte(c[3]));
+            }
+        }
+    });
+
+    return im;
+}
+
+float_image image_resample::resize(const float_image& src,
+        size_t w, size_t h, filter f)
+{
+    if(!w || !h || !src.width() || !src.height())
+        throw restriction_error("Size of image cannot be zero");
+
+    // the narrower intermediate first, and no pass where nothing changes
+    bool h_first = w * src.height() <= src.width() * h;
+
+    if(w == src.width() && h == src.height())
+        return src;
+    if(w == src.width())
+        return resample_v(src, h, f);
+    if(h == src.height())
+        return resample_h(src, w, f);
+
+    if(h_first)
+        return resample_v(resample_h(src, w, f), h, f);
+    else
+        return resample_h(resample_v(src, h, f), w, f);
+}
+
+image image_resample::resize(const image& src,
+        size_t w, size_t h, filter f, bool srgb)
+{
+    return resize(float_image::from_image(src.view(), srgb),
+            w, h, f).to_image(srgb);
+}
+
+size_t image_resample::mip_levels(size_t w, size_t h)
+{
+    size_t n = 1;
+    while(w > 1 || h > 1) {
+        w = std::max<size_t>(1, w / 2);
+        h = std::max<size_t>(1, h / 2);
+        n++;
+    }
+    return n;
+}
+
+std::vector<float_image> image_resample::mip_chain(const float_image& src,
+        filter f)
+{
+    std::vector<float_image> levels;
+    levels.reserve(mip_levels(src.width(), src.height()));
+    levels.push_back(src);
+
+    while(levels.back().width() > 1 || levels.back().height() > 1) {
+        const float_image& last = levels.back();
+        float_image next = resize(last,
+                std::max<size_t>(1, last.width() / 2),
+                std::max<size_t>(1, last.height() / 2), f);
+        levels.push_back(std::move(next));
+    }
+
+    return levels;
+}
+
+std::vector<image> image_resample::mip_chain(const image& src,
+        filter f, bool srgb)
+{
+    std::vector<float_image> flevels =
+        mip_chain(float_image::from_image(src.view(), srgb), f);
+
+    std::vector<image> levels;
+    levels.reserve(flevels.size());
+    levels.push_back(src);
+    for(size_t i = 1; i < flevels.size(); i++)
+        levels.push_back(flevels[i].to_image(srgb));
+
+    return levels;
+}
+
+}
@@ -0,0 +1,107 @@
+#ifndef IMAGE_RESAMPLE_H_INCLUDED
+#define IMAGE_RESAMPLE_H_INCLUDED
+
+#include <vector>
+
+#include "image.h"
+
+namespace shrtool {
+
+/*
+ * An image of float pixels, in which filtering is done, and which is uploaded
+ * as is to float textures.
+ */
+class float_image {
+    size_t width_ = 0;
+    size_t height_ = 0;
+    std::vector<fcolor> data_;
+
+public:
+    float_image(size_t w = 0, size_t h = 0) { resize(w, h); }
+
+    size_t width() const { return width_; }
+    size_t height() const { return height_; }
+
+    fcolor* data() { return data_.data(); }
+    fcolor const* data() const { return data_.data(); }
+    fcolor* row(size_t t) { return data() + t * width_; }
+    fcolor const* row(size_t t) const { return data() + t * width_; }
+
+    fcolor& pixel(size_t l, size_t t) { return row(t)[l]; }
+    const fcolor& pixel(size_t l, size_t t) const { return row(t)[l]; }
+
+    void resize(size_t w, size_t h) {
+        width_ = w;
+        height_ = h;
+        data_.resize(w * h);
+    }
+
+    /*
+     * Color channels of 8-bit images are taken as sRGB, and kept linear in
+     * float, unless srgb is false. Alpha is always linear.
+     */
+    static float_image from_image(const const_image_view& v,
+            bool srgb = true);
+    image to_image(bool srgb = true) const;
+};
+
+/*
+ * Separable resampling of images on the CPU, rows of the image are processed
+ * on several threads. Results do not depend on the number of threads, nor on
+ * the display driver.
+ *
+ * The filter is stretched over the source pixels when minifying, so every
+ * one of them is accounted. 8-bit images are filtered in linear space.
+ */
+struct image_resample {
+    enum filter {
+        // average of the pixels covered, the usual 2x2 box for mipmaps
+        BOX,
+        BILINEAR,
+        // windowed sinc, sharper mipmaps than box with little ringing
+        KAISER,
+        LANCZOS,
+    };
+
+    static float_image resize(const float_image& src,
+            size_t w, size_t h, filter f = BILINEAR);
+    static image resize(const image& src,
+            size_t w, size_t h, filter f = BILINEAR, bool srgb = true);
+
+    /*
+     * Level 0 is a copy of the source, each of the others half of the one
+     * before it (rounded down but at least 1), down to 1x1.
+     */
+    static std::vector<float_image> mip_chain(const float_image& src,
+            filter f = BOX);
+    static std::vector<image> mip_chain(const image& src,
+            filter f = BOX, bool srgb = true);
+
+    static size_t mip_levels(size_t w, size_t h);
+};
+
+template<>
+struct texture2d_trait<float_image> {
+    typedef shrtool::raw_data_tag transfer_tag;
+    typedef float_image input_type;
+
+    static size_t width(const input_type& i) {
+        return i.width();
+    }
+
+    static size_t height(const input_type& i) {
+        return i.height();
+    }
+
+    static size_t format(const input_type& i) {
+        return RGBA_F32;
+    }
+
+    static const void* data(const input_type& i) {
+        return i.data();
+    }
+};
+
+}
+
+#endif // IMAGE_RESAMPLE_H_INCLUDED
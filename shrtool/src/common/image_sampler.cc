@@ -0,0 +1,278 @@
+#include <cmath>
+#include <algorithm>
+
+#include "image_sampler.h"
+#include "parallel.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define SAMPLER_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace shrtool {
+
+namespace {
+
+// samples of a batch given to each thread
+const size_t parallel_grain_samples = 1 << 13;
+
+////////////////////////////////////////////////////////////////////////////////
+// conversion
+
+void convert_row(const color* s, fcolor* d, size_t n)
+{
+    size_t x = 0;
+#ifdef SAMPLER_USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    // divided rather than scaled, which gives the floats of fcolor exactly
+    const __m128 denom = _mm_set1_ps(255.f);
+
+    for(; x + 4 <= n; x += 4) {
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + x));
+        __m128i lo = _mm_unpacklo_epi8(p, zero);
+        __m128i hi = _mm_unpackhi_epi8(p, zero);
+
+        _mm_storeu_ps(d[x].data.floats, _mm_div_ps(
+                    _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), denom));
+        _mm_storeu_ps(d[x + 1].data.floats, _mm_div_ps(
+                    _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), denom));
+        _mm_storeu_ps(d[x + 2].data.floats, _mm_div_ps(
+                    _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), denom));
+        _mm_storeu_ps(d[x + 3].data.floats, _mm_div_ps(
+                    _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), denom));
+    }
+#endif
+    for(; x < n; x++)
+        d[x] = s[x];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// addressing
+
+/*
+ * Texels along one axis and the weight of the second. Coordinates are
+ * brought into [0, 1] before being scaled, so no coordinate overflows.
+ */
+struct axis_taps {
+    size_t i0, i1;
+    float f;
+};
+
+inline float wrap_coord(float u, image_sampler::wrap_type w)
+{
+    if(w == image_sampler::REPEAT)
+        return u - std::floor(u);
+    return u < 0 ? 0 : u > 1 ? 1 : u;
+}
+
+inline axis_taps bilinear_taps(float u, size_t n, image_sampler::wrap_type w)
+{
+    float x = wrap_coord(u, w) * n - 0.5f;
+    float fl = std::floor(x);
+    long i = long(fl);
+
+    axis_taps a;
+    a.f = x - fl;
+    if(w == image_sampler::REPEAT) {
+        a.i0 = i < 0 ? n - 1 : std::min<size_t>(i, n - 1);
+        a.i1 = size_t(i + 1) >= n ? 0 : i + 1;
+    } else {
+        a.i0 = std::max<long>(i, 0);
+        a.i1 = std::min<size_t>(i + 1, n - 1);
+    }
+    return a;
+}
+
+inline size_t nearest_tap(float u, size_t n, image_sampler::wrap_type w)
+{
+    return std::min<size_t>(size_t(wrap_coord(u, w) * n), n - 1);
+}
+
+inline void blend(const fcolor& c00, const fcolor& c10,
+        const fcolor& c01, const fcolor& c11,
+        float fx, float fy, fcolor& out)
+{
+#ifdef SAMPLER_USE_SSE2
+    __m128 a = _mm_loadu_ps(c00.data.floats);
+    __m128 b = _mm_loadu_ps(c10.data.floats);
+    __m128 c = _mm_loadu_ps(c01.data.floats);
+    __m128 d = _mm_loadu_ps(c11.data.floats);
+    __m128 wx = _mm_set1_ps(fx);
+
+    __m128 top = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), wx));
+    __m128 bottom = _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(d, c), wx));
+    _mm_storeu_ps(out.data.floats, _mm_add_ps(top,
+                _mm_mul_ps(_mm_sub_ps(bottom, top), _mm_set1_ps(fy))));
+#else
+    for(size_t i = 0; i < 4; i++) {
+        float top = c00.data.floats[i] +
+            (c10.data.floats[i] - c00.data.floats[i]) * fx;
+        float bottom = c01.data.floats[i] +
+            (c11.data.floats[i] - c01.data.floats[i]) * fx;
+        out.data.floats[i] = top + (bottom - top) * fy;
+    }
+#endif
+}
+
+#ifdef SAMPLER_USE_SSE2
+
+inline __m128 floor_ps(__m128 x)
+{
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1)));
+}
+
+inline __m128 wrap_ps(__m128 u, image_sampler::wrap_type w)
+{
+    if(w == image_sampler::REPEAT)
+        return _mm_sub_ps(u, floor_ps(u));
+    return _mm_min_ps(_mm_max_ps(u, _mm_setzero_ps()), _mm_set1_ps(1));
+}
+
+/*
+ * Taps of four coordinates along an axis at once, the texels are fetched
+ * one by one afterwards.
+ */
+void bilinear_taps4(__m128 u, size_t n, image_sampler::wrap_type w,
+        int32_t* i0, int32_t* i1, float* f)
+{
+    __m128 x = _mm_sub_ps(_mm_mul_ps(wrap_ps(u, w), _mm_set1_ps(float(n))),
+            _mm_set1_ps(0.5f));
+    __m128 fl = floor_ps(x);
+    _mm_storeu_ps(f, _mm_sub_ps(x, fl));
+
+    __m128i i = _mm_cvttps_epi32(fl);
+    __m128i j = _mm_add_epi32(i, _mm_set1_epi32(1));
+    __m128i last = _mm_set1_epi32(int32_t(n - 1));
+    __m128i zero = _mm_setzero_si128();
+
+    // i is in [-1, n - 1] and j in [0, n] before wrapping
+    __m128i below = _mm_cmplt_epi32(i, zero);
+    __m128i beyond = _mm_cmpgt_epi32(j, last);
+    if(w == image_sampler::REPEAT) {
+        i = _mm_or_si128(_mm_andnot_si128(below, i),
+                _mm_and_si128(below, last));
+        j = _mm_andnot_si128(beyond, j);
+    } else {
+        i = _mm_andnot_si128(below, i);
+        j = _mm_or_si128(_mm_andnot_si128(beyond, j),
+                _mm_and_si128(beyond, last));
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(i0), i);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(i1), j);
+}
+
+#endif
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+float_tile_cache::float_tile_cache(const const_image_view& v) :
+    src_(v),
+    tiles_x_((v.width() + tile_size - 1) >> tile_bits),
+    tiles_y_((v.height() + tile_size - 1) >> tile_bits),
+    tiles_(tiles_x_ * tiles_y_),
+    storage_(tiles_x_ * tiles_y_)
+{
+    for(std::atomic<const fcolor*>& t : tiles_)
+        t.store(nullptr, std::memory_order_relaxed);
+}
+
+const fcolor* float_tile_cache::convert_(size_t tx, size_t ty) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    size_t i = ty * tiles_x_ + tx;
+    const fcolor* ready = tiles_[i].load(std::memory_order_relaxed);
+    if(ready) return ready;
+
+    std::unique_ptr<fcolor[]> tl(new fcolor[tile_size * tile_size]);
+    size_t l = tx << tile_bits, t = ty << tile_bits;
+    size_t w = std::min(tile_size, src_.width() - l);
+    size_t h = std::min(tile_size, src_.height() - t);
+
+    for(size_t y = 0; y < h; y++)
+        convert_row(src_.row(t + y) + l, tl.get() + (y << tile_bits), w);
+
+    storage_[i] = std::move(tl);
+    tiles_[i].store(storage_[i].get(), std::memory_order_release);
+    return storage_[i].get();
+}
+
+size_t float_tile_cache::converted_tiles() const
+{
+    size_t n = 0;
+    for(const std::atomic<const fcolor*>& t : tiles_)
+        if(t.load(std::memory_order_acquire)) n++;
+    return n;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+image_sampler::image_sampler(const const_image_view& v,
+        filter_type f, wrap_type w) :
+    cache_(v), filter_(f), wrap_(w)
+{
+    if(!v.width() || !v.height())
+        throw restriction_error("Size of image cannot be zero");
+}
+
+fcolor image_sampler::sample(float u, float v) const
+{
+    fcolor c;
+    float uv[2] = { u, v };
+    sample_range_(uv, 0, 1, &c);
+    return c;
+}
+
+void image_sampler::sample(const float* uv, size_t n, fcolor* out) const
+{
+    parallel_for(n, parallel_grain_samples, [&](size_t b, size_t e) {
+        sample_range_(uv, b, e, out);
+    });
+}
+
+void image_sampler::sample_range_(const float* uv, size_t b, size_t e,
+        fcolor* out) const
+{
+    size_t w = cache_.width(), h = cache_.height();
+
+    if(filter_ == NEAREST) {
+        for(size_t i = b; i < e; i++)
+            out[i] = cache_.pixel(nearest_tap(uv[i * 2], w, wrap_),
+                    nearest_tap(uv[i * 2 + 1], h, wrap_));
+        return;
+    }
+
+    size_t i = b;
+#ifdef SAMPLER_USE_SSE2
+    for(; i + 4 <= e; i += 4) {
+        // four pairs of u and v, split into four u and four v
+        __m128 p0 = _mm_loadu_ps(uv + i * 2);
+        __m128 p1 = _mm_loadu_ps(uv + i * 2 + 4);
+        __m128 us = _mm_shuffle_ps(p0, p1, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 vs = _mm_shuffle_ps(p0, p1, _MM_SHUFFLE(3, 1, 3, 1));
+
+        int32_t x0[4], x1[4], y0[4], y1[4];
+        float fx[4], fy[4];
+        bilinear_taps4(us, w, wrap_, x0, x1, fx);
+        bilinear_taps4(vs, h, wrap_, y0, y1, fy);
+
+        for(size_t k = 0; k < 4; k++)
+            blend(cache_.pixel(x0[k], y0[k]), cache_.pixel(x1[k], y0[k]),
+                    cache_.pixel(x0[k], y1[k]), cache_.pixel(x1[k], y1[k]),
+                    fx[k], fy[k], out[i + k]);
+    }
+#endif
+    for(; i < e; i++) {
+        axis_taps x = bilinear_taps(uv[i * 2], w, wrap_);
+        axis_taps y = bilinear_taps(uv[i * 2 + 1], h, wrap_);
+        blend(cache_.pixel(x.i0, y.i0), cache_.pixel(x.i1, y.i0),
+                cache_.pixel(x.i0, y.i1), cache_.pixel(x.i1, y.i1),
+                x.f, y.f, out[i]);
+    }
+}
+
+}
@@ -0,0 +1,105 @@
+#ifndef IMAGE_SAMPLER_H_INCLUDED
+#define IMAGE_SAMPLER_H_INCLUDED
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "image.h"
+
+namespace shrtool {
+
+/*
+ * float_tile_cache holds the pixels of an image as fcolor, converted a tile
+ * of 32x32 at a time the first time any pixel of the tile is asked for. Only
+ * the parts of a large image which are sampled are ever converted. Any
+ * thread may ask for pixels, each tile is converted once.
+ *
+ * The cache refers to the pixels of the view, it is to be made again once
+ * they change.
+ */
+class float_tile_cache {
+public:
+    static const size_t tile_bits = 5;
+    static const size_t tile_size = 1 << tile_bits;
+
+    explicit float_tile_cache(const const_image_view& v);
+
+    size_t width() const { return src_.width(); }
+    size_t height() const { return src_.height(); }
+
+    const fcolor& pixel(size_t l, size_t t) const {
+        const fcolor* tl = tile(l >> tile_bits, t >> tile_bits);
+        return tl[((t & (tile_size - 1)) << tile_bits) +
+            (l & (tile_size - 1))];
+    }
+
+    // rows of a tile are tile_size apart, whole even at the edges
+    const fcolor* tile(size_t tx, size_t ty) const {
+        const fcolor* tl = tiles_[ty * tiles_x_ + tx].load(
+                std::memory_order_acquire);
+        return tl ? tl : convert_(tx, ty);
+    }
+
+    size_t converted_tiles() const;
+
+private:
+    const fcolor* convert_(size_t tx, size_t ty) const;
+
+    const_image_view src_;
+    size_t tiles_x_ = 0;
+    size_t tiles_y_ = 0;
+    mutable std::vector<std::atomic<const fcolor*>> tiles_;
+    mutable std::vector<std::unique_ptr<fcolor[]>> storage_;
+    mutable std::mutex mutex_;
+};
+
+/*
+ * image_sampler looks up colors of an image as a texture unit does: u and v
+ * in [0, 1] span the image, texel centers are at half pixels, and beyond
+ * them coordinates repeat or clamp to the edge. Batches of coordinates are
+ * sampled four at a time, and large batches on several threads.
+ *
+ * The image is converted to float through a float_tile_cache of the sampler,
+ * it must outlive the sampler and stay unchanged.
+ */
+class image_sampler {
+public:
+    enum filter_type {
+        NEAREST,
+        BILINEAR,
+    };
+
+    enum wrap_type {
+        REPEAT,
+        CLAMP,
+    };
+
+    image_sampler(const const_image_view& v,
+            filter_type f = BILINEAR, wrap_type w = REPEAT);
+    image_sampler(const image& im,
+            filter_type f = BILINEAR, wrap_type w = REPEAT) :
+        image_sampler(im.view(), f, w) { }
+
+    filter_type filter() const { return filter_; }
+    wrap_type wrap() const { return wrap_; }
+    const float_tile_cache& cache() const { return cache_; }
+
+    fcolor sample(float u, float v) const;
+
+    // uv holds n pairs of coordinates, out takes n colors
+    void sample(const float* uv, size_t n, fcolor* out) const;
+
+private:
+    void sample_range_(const float* uv, size_t b, size_t e,
+            fcolor* out) const;
+
+    float_tile_cache cache_;
+    filter_type filter_;
+    wrap_type wrap_;
+};
+
+}
+
+#endif // IMAGE_SAMPLER_H_INCLUDED
@@ -0,0 +1,280 @@
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "image_transform.h"
+#include "parallel.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define TRANSFORM_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace shrtool {
+
+namespace {
+
+// edge of the tiles of a transposition, two of which fit in L1
+const size_t tile_size = 32;
+// rows of about this many pixels are given to each thread
+const size_t parallel_grain_pixels = 1 << 16;
+
+size_t row_grain(size_t width)
+{
+    return std::max<size_t>(1, parallel_grain_pixels / std::max<size_t>(1, width));
+}
+
+#ifdef TRANSFORM_USE_SSE2
+inline __m128i reverse4(__m128i p)
+{
+    return _mm_shuffle_epi32(p, _MM_SHUFFLE(0, 1, 2, 3));
+}
+#endif
+
+void reverse_copy_row(const color* s, color* d, size_t n)
+{
+    size_t i = 0;
+#ifdef TRANSFORM_USE_SSE2
+    for(; i + 4 <= n; i += 4) {
+        __m128i p = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(s + n - i - 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), reverse4(p));
+    }
+#endif
+    for(; i < n; i++)
+        d[i] = s[n - i - 1];
+}
+
+void reverse_row(color* r, size_t n)
+{
+    size_t l = 0, e = n;
+#ifdef TRANSFORM_USE_SSE2
+    // four from each end at a time, until they would overlap
+    for(; e - l >= 8; l += 4, e -= 4) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r + l));
+        __m128i b = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(r + e - 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(r + l), reverse4(b));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(r + e - 4), reverse4(a));
+    }
+#endif
+    std::reverse(r + l, r + e);
+}
+
+/*
+ * Row x of dst, column y, is pixel (x, y) of the view. Rows of dst are
+ * dst_stride pixels apart, which may be negative to write them upward.
+ */
+void transpose_into(const const_image_view& v,
+        color* dst, ptrdiff_t dst_stride)
+{
+    size_t w = v.width(), h = v.height();
+
+    for(size_t ty = 0; ty < h; ty += tile_size)
+    for(size_t tx = 0; tx < w; tx += tile_size) {
+        size_t ey = std::min(h, ty + tile_size);
+        size_t ex = std::min(w, tx + tile_size);
+
+        for(size_t y = ty; y < ey; y += 4)
+        for(size_t x = tx; x < ex; x += 4) {
+#ifdef TRANSFORM_USE_SSE2
+            if(y + 4 <= ey && x + 4 <= ex) {
+                __m128 r0 = _mm_loadu_ps(
+                        reinterpret_cast<const float*>(v.row(y) + x));
+                __m128 r1 = _mm_loadu_ps(
+                        reinterpret_cast<const float*>(v.row(y + 1) + x));
+                __m128 r2 = _mm_loadu_ps(
+                        reinterpret_cast<const float*>(v.row(y + 2) + x));
+                __m128 r3 = _mm_loadu_ps(
+                        reinterpret_cast<const float*>(v.row(y + 3) + x));
+                // only moves bits, the pixels are never taken as floats
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                _mm_storeu_ps(reinterpret_cast<float*>(
+                            dst + ptrdiff_t(x) * dst_stride + y), r0);
+                _mm_storeu_ps(reinterpret_cast<float*>(
+                            dst + ptrdiff_t(x + 1) * dst_stride + y), r1);
+                _mm_storeu_ps(reinterpret_cast<float*>(
+                            dst + ptrdiff_t(x + 2) * dst_stride + y), r2);
+                _mm_storeu_ps(reinterpret_cast<float*>(
+                            dst + ptrdiff_t(x + 3) * dst_stride + y), r3);
+                continue;
+            }
+#endif
+            for(size_t yy = y; yy < std::min(ey, y + 4); yy++)
+                for(size_t xx = x; xx < std::min(ex, x + 4); xx++)
+                    dst[ptrdiff_t(xx) * dst_stride + yy] = v.pixel(xx, yy);
+        }
+    }
+}
+
+void flip_v(const image_view& v)
+{
+    size_t h = v.height(), bytes = v.width() * sizeof(color);
+
+    parallel_for(h / 2, row_grain(v.width()), [&](size_t b, size_t e) {
+        // rows are swapped as bytes, through a row of the band
+        std::vector<uint8_t> tmp(bytes);
+        for(size_t t = b; t < e; t++) {
+            void* r0 = v.row(t);
+            void* r1 = v.row(h - t - 1);
+            std::memcpy(tmp.data(), r0, bytes);
+            std::memcpy(r0, r1, bytes);
+            std::memcpy(r1, tmp.data(), bytes);
+        }
+    });
+}
+
+void flip_h(const image_view& v)
+{
+    parallel_for(v.height(), row_grain(v.width()), [&](size_t b, size_t e) {
+        for(size_t t = b; t < e; t++)
+            reverse_row(v.row(t), v.width());
+    });
+}
+
+/*
+ * Pairs of tiles mirrored by the diagonal are swapped through a scratch
+ * tile, and the tiles on it are transposed through one.
+ */
+void transpose_square(const image_view& v)
+{
+    size_t n = v.width();
+    size_t tiles = (n + tile_size - 1) / tile_size;
+
+    parallel_for(tiles, 1, [&](size_t b, size_t e) {
+        std::vector<color> tmp(tile_size * tile_size);
+
+        for(size_t by = b; by < e; by++)
+        for(size_t bx = by; bx < tiles; bx++) {
+            size_t x0 = bx * tile_size, y0 = by * tile_size;
+            size_t w = std::min(tile_size, n - x0);
+            size_t h = std::min(tile_size, n - y0);
+
+            // the tile at (x0, y0), transposed, is laid as rows of the
+            // tile at (y0, x0)
+            transpose_into(v.sub(x0, y0, w, h), tmp.data(), h);
+            if(bx != by)
+                transpose_into(v.sub(y0, x0, h, w), &v.pixel(x0, y0), n);
+            for(size_t r = 0; r < w; r++)
+                std::copy(tmp.data() + r * h, tmp.data() + (r + 1) * h,
+                        &v.pixel(y0, x0 + r));
+        }
+    });
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void image_transform::apply(image& im, op o)
+{
+    im.float_cache_.reset();
+    if(!im.width() || !im.height()) return;
+
+    size_t w = im.width(), h = im.height();
+
+    if(im.shared_() && o != IDENTITY) {
+        // transformed into pixels of its own, rather than copied first
+        bool swap = swaps_axes(o);
+        std::shared_ptr<image::storage_type> p =
+            std::make_shared<image::storage_type>(w * h);
+        size_t tw = swap ? h : w, th = swap ? w : h;
+        const_image_view src = static_cast<const image&>(im).view();
+
+        parallel_for(th, std::max(tile_size, row_grain(tw)),
+                [&](size_t b, size_t e) {
+                    rows(src, o, b, e - b, p->data() + b * tw, tw);
+                });
+
+        im.underlying_ = p;
+        im.data_ = p->data();
+        im.may_share_ = false;
+        im.width_ = tw;
+        im.height_ = th;
+        return;
+    }
+
+    image_view v = im.view();
+
+    switch(o) {
+    case IDENTITY:
+        return;
+    case FLIP_H:
+        flip_h(v);
+        return;
+    case FLIP_V:
+        flip_v(v);
+        return;
+    case ROTATE_180:
+        // the whole image is one row backward
+        reverse_row(im.data(), w * h);
+        return;
+    default:
+        break;
+    }
+
+    if(w == h) {
+        transpose_square(v);
+    } else {
+        std::vector<color> tmp(w * h);
+        parallel_for(h, std::max(tile_size, row_grain(w)),
+                [&](size_t b, size_t e) {
+                    transpose_into(v.sub(0, b, w, e - b), tmp.data() + b, h);
+                });
+        std::copy(tmp.begin(), tmp.end(), im.data());
+        im.width_ = h;
+        im.height_ = w;
+    }
+
+    if(o == ROTATE_CW)
+        flip_h(im.view());
+    else if(o == ROTATE_CCW)
+        flip_v(im.view());
+}
+
+void image_transform::rows(const const_image_view& v, op o,
+        size_t t, size_t n, color* dst, size_t dst_stride)
+{
+    size_t w = v.width(), h = v.height();
+    if(t + n > (swaps_axes(o) ? w : h))
+        throw restriction_error("Out of bound");
+    if(!n) return;
+
+    switch(o) {
+    case IDENTITY:
+    case FLIP_V:
+        for(size_t i = 0; i < n; i++) {
+            const color* s = v.row(o == FLIP_V ? h - t - i - 1 : t + i);
+            std::copy(s, s + w, dst + i * dst_stride);
+        }
+        break;
+    case FLIP_H:
+    case ROTATE_180:
+        for(size_t i = 0; i < n; i++)
+            reverse_copy_row(v.row(o == ROTATE_180 ? h - t - i - 1 : t + i),
+                    dst + i * dst_stride, w);
+        break;
+    case TRANSPOSE:
+    case ROTATE_CW:
+        // rows of the result are columns of the source
+        transpose_into(v.sub(t, 0, n, h), dst, dst_stride);
+        if(o == ROTATE_CW)
+            for(size_t i = 0; i < n; i++)
+                reverse_row(dst + i * dst_stride, h);
+        break;
+    case ROTATE_CCW:
+        // columns from the right, the first of them the last row written
+        transpose_into(v.sub(w - t - n, 0, n, h),
+                dst + (n - 1) * dst_stride, -ptrdiff_t(dst_stride));
+        break;
+    }
+}
+
+void transformed_image_view::copy_to(const image_view& dest) const
+{
+    if(dest.width() != width() || dest.height() != height())
+        throw restriction_error("Size of views mismatch");
+    image_transform::rows(src_, op_, 0, height(), dest.data(), dest.stride());
+}
+
+}
@@ -0,0 +1,98 @@
+#ifndef IMAGE_TRANSFORM_H_INCLUDED
+#define IMAGE_TRANSFORM_H_INCLUDED
+
+#include <cstddef>
+
+#include "image.h"
+
+namespace shrtool {
+
+/*
+ * Flips, rotations and transposition of images, worked through in tiles and
+ * in bands of rows so both sides stay in cache. Rotations are clockwise as
+ * the image is seen, the first row being the top.
+ */
+struct image_transform {
+    enum op {
+        IDENTITY,
+        FLIP_H,
+        FLIP_V,
+        ROTATE_180,
+        TRANSPOSE,
+        ROTATE_CW,
+        ROTATE_CCW,
+    };
+
+    static bool swaps_axes(op o) { return o >= TRANSPOSE; }
+
+    /*
+     * Transforms the pixels of an image where they are. Transposing an image
+     * which is not square goes through a copy of it.
+     */
+    static void apply(image& im, op o);
+
+    /*
+     * Writes rows [t, t + n) of the transformed view into dst, of which rows
+     * are as wide as the transformed image and dst_stride pixels apart.
+     */
+    static void rows(const const_image_view& v, op o,
+            size_t t, size_t n, color* dst, size_t dst_stride);
+};
+
+/*
+ * A view which is transformed as its rows are read, at upload for instance,
+ * rather than in a pass of its own. The pixels are those of the view it is
+ * made of.
+ */
+class transformed_image_view {
+    const_image_view src_;
+    image_transform::op op_ = image_transform::IDENTITY;
+
+public:
+    transformed_image_view() { }
+    transformed_image_view(const const_image_view& v, image_transform::op o) :
+        src_(v), op_(o) { }
+
+    size_t width() const {
+        return image_transform::swaps_axes(op_) ? src_.height() : src_.width();
+    }
+    size_t height() const {
+        return image_transform::swaps_axes(op_) ? src_.width() : src_.height();
+    }
+
+    const const_image_view& source() const { return src_; }
+    image_transform::op op() const { return op_; }
+
+    void rows(size_t t, size_t n, color* dst) const {
+        image_transform::rows(src_, op_, t, n, dst, width());
+    }
+
+    void copy_to(const image_view& dest) const;
+};
+
+template<>
+struct texture2d_trait<transformed_image_view> {
+    typedef shrtool::raw_data_tag transfer_tag;
+    typedef transformed_image_view input_type;
+
+    static size_t width(const input_type& i) {
+        return i.width();
+    }
+
+    static size_t height(const input_type& i) {
+        return i.height();
+    }
+
+    static size_t format(const input_type& i) {
+        return RGBA_U8888;
+    }
+
+    // filled in bands, each of rows transformed as they are uploaded
+    static void rows(const input_type& i, size_t t, size_t n, void* dst) {
+        i.rows(t, n, static_cast<color*>(dst));
+    }
+};
+
+}
+
+#endif // IMAGE_TRANSFORM_H_INCLUDED
@@ -0,0 +1,388 @@
+#include <cstring>
+#include <functional>
+
+#include "ktx.h"
+#include "exception.h"
+
+namespace shrtool {
+
+namespace {
+
+const uint8_t ktx_identifier[12] = {
+    0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A,
+};
+
+const uint32_t ktx_endianness = 0x04030201;
+const uint32_t ktx_endianness_swapped = 0x01020304;
+const size_t ktx_header_size = 12 + 13 * 4;
+
+/*
+ * The enums of the display driver are a part of the file format, they are
+ * written as the specification of KTX lists them.
+ */
+struct ktx_format {
+    size_t format;
+    // bytes of a pixel, or of a block of 4x4 pixels when compressed
+    size_t pixel_size;
+    bool compressed;
+    uint32_t gl_type;
+    uint32_t gl_type_size;
+    uint32_t gl_format;
+    uint32_t gl_internal_format;
+    uint32_t gl_base_internal_format;
+};
+
+// compressed formats have no type nor format, and types of one byte
+const ktx_format ktx_formats[] = {
+    { RGBA_U8888, 4, false, 0x1401 /* UNSIGNED_BYTE */, 1,
+        0x1908 /* RGBA */, 0x8058 /* RGBA8 */, 0x1908 },
+    { R_F32, 4, false, 0x1406 /* FLOAT */, 4,
+        0x1903 /* RED */, 0x822E /* R32F */, 0x1903 },
+    { RG_F32, 8, false, 0x1406, 4,
+        0x8227 /* RG */, 0x8230 /* RG32F */, 0x8227 },
+    { RGB_F32, 12, false, 0x1406, 4,
+        0x1907 /* RGB */, 0x8815 /* RGB32F */, 0x1907 },
+    { RGBA_F32, 16, false, 0x1406, 4, 0x1908, 0x8814 /* RGBA32F */, 0x1908 },
+    { R_U8, 1, false, 0x1401, 1, 0x1903, 0x8229 /* R8 */, 0x1903 },
+    { RG_U88, 2, false, 0x1401, 1, 0x8227, 0x822B /* RG8 */, 0x8227 },
+    { R_F16, 2, false, 0x140B /* HALF_FLOAT */, 2,
+        0x1903, 0x822D /* R16F */, 0x1903 },
+    { RG_F16, 4, false, 0x140B, 2, 0x8227, 0x822F /* RG16F */, 0x8227 },
+    { RGBA_F16, 8, false, 0x140B, 2, 0x1908, 0x881A /* RGBA16F */, 0x1908 },
+    { RGB_F111110, 4, false, 0x8C3B /* UNSIGNED_INT_10F_11F_11F_REV */, 4,
+        0x1907, 0x8C3A /* R11F_G11F_B10F */, 0x1907 },
+    { BC1_RGBA, 8, true, 0, 1, 0,
+        0x83F1 /* COMPRESSED_RGBA_S3TC_DXT1 */, 0x1908 },
+    { BC3_RGBA, 16, true, 0, 1, 0,
+        0x83F3 /* COMPRESSED_RGBA_S3TC_DXT5 */, 0x1908 },
+    { BC4_R, 8, true, 0, 1, 0, 0x8DBB /* COMPRESSED_RED_RGTC1 */, 0x1903 },
+    { BC5_RG, 16, true, 0, 1, 0, 0x8DBD /* COMPRESSED_RG_RGTC2 */, 0x8227 },
+};
+
+const ktx_format& find_format(size_t format)
+{
+    for(const ktx_format& f : ktx_formats)
+        if(f.format == format) return f;
+    throw unsupported_error("Format is not supported by KTX writer");
+}
+
+const ktx_format* find_format(uint32_t type, uint32_t fmt, uint32_t ifmt)
+{
+    for(const ktx_format& f : ktx_formats)
+        if(f.gl_type == type && f.gl_format == fmt &&
+                f.gl_internal_format == ifmt)
+            return &f;
+    return nullptr;
+}
+
+size_t align4(size_t n) { return (n + 3) & ~size_t(3); }
+
+// bytes of a face, partial blocks of compressed formats are whole
+size_t face_size(const ktx_format& f, size_t w, size_t h)
+{
+    if(f.compressed)
+        return ((w + 3) / 4) * ((h + 3) / 4) * f.pixel_size;
+    return w * h * f.pixel_size;
+}
+
+uint32_t read_u32(const uint8_t* p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+void write_u32(std::ostream& os, uint32_t v)
+{
+    os.write(reinterpret_cast<const char*>(&v), 4);
+}
+
+void write_padding(std::ostream& os, size_t n)
+{
+    static const char zeros[4] = { 0 };
+    os.write(zeros, align4(n) - n);
+}
+
+/*
+ * Writes the file given the writer of every face, of every level, which puts
+ * exactly the bytes of the face.
+ */
+void write_ktx(std::ostream& os, const ktx_format& f,
+        size_t w, size_t h, size_t faces, size_t levels,
+        std::function<void(size_t, size_t)> write_face)
+{
+    os.write(reinterpret_cast<const char*>(ktx_identifier), 12);
+
+    uint32_t header[13] = {
+        ktx_endianness, f.gl_type, f.gl_type_size,
+        f.gl_format, f.gl_internal_format, f.gl_base_internal_format,
+        uint32_t(w), uint32_t(h), 0,
+        0, uint32_t(faces), uint32_t(levels), 0,
+    };
+    for(uint32_t v : header)
+        write_u32(os, v);
+
+    for(size_t l = 0; l < levels; l++) {
+        size_t lw = std::max<size_t>(1, w >> l);
+        size_t lh = std::max<size_t>(1, h >> l);
+        size_t fsz = face_size(f, lw, lh);
+
+        // a cubemap, which is not an array, counts a single face here
+        write_u32(os, uint32_t(faces == 6 ? fsz : fsz * faces));
+        for(size_t i = 0; i < faces; i++) {
+            write_face(l, i);
+            if(faces == 6) write_padding(os, fsz);
+        }
+        write_padding(os, fsz * faces);
+    }
+}
+
+void write_view(std::ostream& os, const const_image_view& v)
+{
+    if(v.contiguous())
+        os.write(reinterpret_cast<const char*>(v.data()),
+                v.width() * v.height() * sizeof(color));
+    else for(size_t t = 0; t < v.height(); t++)
+        os.write(reinterpret_cast<const char*>(v.row(t)),
+                v.width() * sizeof(color));
+}
+
+template<typename Image>
+void check_chain(const std::vector<Image>& levels)
+{
+    if(levels.empty())
+        throw restriction_error("No level to save");
+
+    size_t w = levels[0].width(), h = levels[0].height();
+    if(levels.size() > image_resample::mip_levels(w, h))
+        throw restriction_error("Too many mip levels");
+
+    for(size_t l = 0; l < levels.size(); l++) {
+        if(levels[l].width() != std::max<size_t>(1, w >> l) ||
+                levels[l].height() != std::max<size_t>(1, h >> l))
+            throw restriction_error("Size of mip level mismatch");
+    }
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+ktx_texture ktx_texture::open(const std::string& path)
+{
+    ktx_texture t;
+    t.file_ = std::make_shared<mapped_file>(path);
+    t.parse_();
+    return t;
+}
+
+ktx_texture ktx_texture::from_memory(std::vector<uint8_t> data)
+{
+    ktx_texture t;
+    t.file_ = std::make_shared<mapped_file>(std::move(data));
+    t.parse_();
+    return t;
+}
+
+void ktx_texture::parse_()
+{
+    const uint8_t* p = file_->data();
+    size_t size = file_->size();
+
+    if(size < ktx_header_size || std::memcmp(p, ktx_identifier, 12))
+        throw parse_error("Bad KTX file: identifier");
+
+    uint32_t hd[13];
+    for(size_t i = 0; i < 13; i++)
+        hd[i] = read_u32(p + 12 + i * 4);
+
+    if(hd[0] == ktx_endianness_swapped)
+        throw unsupported_error("KTX file of other byte order");
+    if(hd[0] != ktx_endianness)
+        throw parse_error("Bad KTX file: endianness");
+
+    const ktx_format* f = find_format(hd[1], hd[3], hd[4]);
+    if(!f)
+        throw unsupported_error("KTX file of unsupported format");
+    if(hd[8])
+        throw unsupported_error("3D KTX textures are unsupported");
+    if(!hd[6] || (hd[10] != 1 && hd[10] != 6))
+        throw parse_error("Bad KTX file: properties");
+
+    format_ = f->format;
+    width_ = hd[6];
+    height_ = std::max<uint32_t>(1, hd[7]);
+    layers_ = std::max<uint32_t>(1, hd[9]);
+    faces_ = hd[10];
+    // no level means they are to be generated, the base is there anyway
+    size_t levels = std::max<uint32_t>(1, hd[11]);
+    bool array = hd[9] != 0;
+
+    size_t pos = ktx_header_size + hd[12];
+    offsets_.clear();
+    sizes_.clear();
+
+    for(size_t l = 0; l < levels; l++) {
+        size_t fsz = face_size(*f, level_width(l), level_height(l));
+
+        if(pos + 4 > size)
+            throw parse_error("Bad KTX file: truncated");
+        size_t image_size = read_u32(p + pos);
+        pos += 4;
+
+        size_t expected = faces_ == 6 && !array ?
+            fsz : fsz * faces_ * layers_;
+        if(image_size != expected)
+            throw parse_error("Bad KTX file: size of level");
+
+        for(size_t i = 0; i < layers_ * faces_; i++) {
+            if(pos + fsz > size)
+                throw parse_error("Bad KTX file: truncated");
+
+            offsets_.push_back(pos);
+            sizes_.push_back(fsz);
+            pos += fsz;
+            if(faces_ == 6 && !array) pos = align4(pos);
+        }
+        pos = align4(pos);
+    }
+}
+
+size_t ktx_texture::level_width(size_t l) const
+{
+    return std::max<size_t>(1, width_ >> l);
+}
+
+size_t ktx_texture::level_height(size_t l) const
+{
+    return std::max<size_t>(1, height_ >> l);
+}
+
+size_t ktx_texture::image_size(size_t l) const
+{
+    return sizes_.at(l * layers_ * faces_);
+}
+
+const void* ktx_texture::data(size_t level, size_t layer, size_t face) const
+{
+    if(level >= levels() || layer >= layers_ || face >= faces_)
+        throw restriction_error("Out of bound");
+    return file_->data() + offsets_[(level * layers_ + layer) * faces_ + face];
+}
+
+void ktx_texture::save(std::ostream& os, const std::vector<image>& levels)
+{
+    check_chain(levels);
+    write_ktx(os, find_format(RGBA_U8888),
+            levels[0].width(), levels[0].height(), 1, levels.size(),
+            [&](size_t l, size_t) { write_view(os, levels[l].view()); });
+}
+
+void ktx_texture::save(std::ostream& os,
+        const std::vector<float_image>& levels)
+{
+    check_chain(levels);
+    write_ktx(os, find_format(RGBA_F32),
+            levels[0].width(), levels[0].height(), 1, levels.size(),
+            [&](size_t l, size_t) {
+                const float_image& im = levels[l];
+                os.write(reinterpret_cast<const char*>(im.data()),
+                        im.width() * im.height() * sizeof(fcolor));
+            });
+}
+
+void ktx_texture::save(std::ostream& os, size_t format,
+        size_t w, size_t h, const std::vector<const void*>& levels)
+{
+    if(levels.empty())
+        throw restriction_error("No level to save");
+    if(!w || !h)
+        throw restriction_error("Size of texture cannot be zero");
+    if(levels.size() > image_resample::mip_levels(w, h))
+        throw restriction_error("Too many mip levels");
+
+    const ktx_format& f = find_format(format);
+    write_ktx(os, f, w, h, 1, levels.size(),
+            [&](size_t l, size_t) {
+                os.write(static_cast<const char*>(levels[l]), face_size(f,
+                    std::max<size_t>(1, w >> l), std::max<size_t>(1, h >> l)));
+            });
+}
+
+void ktx_texture::save(std::ostream& os,
+        const std::vector<compressed_image>& levels)
+{
+    check_chain(levels);
+
+    std::vector<const void*> data;
+    for(const compressed_image& ci : levels) {
+        if(ci.format() != levels[0].format())
+            throw restriction_error("Format of mip level mismatch");
+        data.push_back(ci.data());
+    }
+    save(os, levels[0].format(), levels[0].width(), levels[0].height(), data);
+}
+
+void ktx_texture::save_cubemap(std::ostream& os,
+        const std::vector<std::array<const_image_view, 6>>& levels)
+{
+    if(levels.empty())
+        throw restriction_error("No level to save");
+
+    size_t edge = levels[0][0].width();
+    if(levels.size() > image_resample::mip_levels(edge, edge))
+        throw restriction_error("Too many mip levels");
+
+    for(size_t l = 0; l < levels.size(); l++) {
+        size_t le = std::max<size_t>(1, edge >> l);
+        for(const const_image_view& v : levels[l])
+            if(v.width() != le || v.height() != le)
+                throw restriction_error("Size of mip level mismatch");
+    }
+
+    write_ktx(os, find_format(RGBA_U8888), edge, edge, 6, levels.size(),
+            [&](size_t l, size_t i) { write_view(os, levels[l][i]); });
+}
+
+void ktx_texture::bake(std::ostream& os, const image& im,
+        bool cubemap, image_resample::filter f)
+{
+    if(!cubemap) {
+        save(os, image_resample::mip_chain(im, f));
+        return;
+    }
+
+    std::array<const_image_view, 6> faces = image::cubemap_faces(im);
+    size_t levels = image_resample::mip_levels(
+            faces[0].width(), faces[0].height());
+
+    // the base level is written from the source as it is
+    std::vector<std::vector<image>> chains(6);
+    std::vector<std::array<const_image_view, 6>> views(levels);
+    for(size_t i = 0; i < 6; i++) {
+        std::vector<float_image> fc = image_resample::mip_chain(
+                float_image::from_image(faces[i]), f);
+
+        views[0][i] = faces[i];
+        for(size_t l = 1; l < levels; l++)
+            chains[i].push_back(fc[l].to_image());
+        for(size_t l = 1; l < levels; l++)
+            views[l][i] = chains[i][l - 1].view();
+    }
+
+    save_cubemap(os, views);
+}
+
+void ktx_texture::bake_compressed(std::ostream& os, const image& im,
+        size_t format, image_resample::filter f)
+{
+    if(!compressed_image::is_compressed(format))
+        throw unsupported_error("Format is not compressed");
+
+    std::vector<compressed_image> levels;
+    for(const image& l : image_resample::mip_chain(im, f))
+        levels.push_back(block_compress::encode(l, format));
+    save(os, levels);
+}
+
+}
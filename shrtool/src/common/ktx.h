@@ -0,0 +1,166 @@
+#ifndef KTX_H_INCLUDED
+#define KTX_H_INCLUDED
+
+#include <memory>
+#include <vector>
+#include <array>
+#include <iostream>
+
+#include "image.h"
+#include "image_resample.h"
+#include "block_compress.h"
+#include "mapped_file.h"
+
+namespace shrtool {
+
+/*
+ * ktx_texture is a texture in the KTX 1.1 container: every mip level, array
+ * layer and cubemap face laid out in the exact format of the upload. Opening
+ * one maps the file and only reads its header, the pixels are handed to the
+ * display driver straight from the mapping, a level at a time.
+ *
+ * Formats are those of color_format, other files are rejected, and so are
+ * those of the other byte order.
+ */
+class ktx_texture {
+public:
+    ktx_texture() { }
+
+    static ktx_texture open(const std::string& path);
+    static ktx_texture from_memory(std::vector<uint8_t> data);
+
+    size_t width() const { return width_; }
+    size_t height() const { return height_; }
+    size_t layers() const { return layers_; }
+    size_t faces() const { return faces_; }
+    size_t levels() const { return offsets_.size() / (layers_ * faces_); }
+    size_t format() const { return format_; }
+    bool cubemap() const { return faces_ == 6; }
+
+    size_t level_width(size_t l) const;
+    size_t level_height(size_t l) const;
+    // bytes of one face of one layer
+    size_t image_size(size_t l) const;
+    const void* data(size_t level, size_t layer = 0, size_t face = 0) const;
+
+    /*
+     * Writers. Level 0 comes first, each level half the size of the one
+     * before it. Face levels are given in the order of texture_cubemap.
+     */
+    static void save(std::ostream& os, const std::vector<image>& levels);
+    static void save(std::ostream& os,
+            const std::vector<float_image>& levels);
+    // levels of any of the formats, tightly packed, compressed ones in blocks
+    static void save(std::ostream& os, size_t format, size_t w, size_t h,
+            const std::vector<const void*>& levels);
+    static void save(std::ostream& os,
+            const std::vector<compressed_image>& levels);
+    static void save_cubemap(std::ostream& os,
+            const std::vector<std::array<const_image_view, 6>>& levels);
+
+    /*
+     * Bakes an image with its full mip chain. A cubemap is taken from a
+     * cross or a strip of faces, as image::cubemap_faces does.
+     */
+    static void bake(std::ostream& os, const image& im,
+            bool cubemap = false,
+            image_resample::filter f = image_resample::BOX);
+    // every level encoded by block_compress in one of the BCn formats
+    static void bake_compressed(std::ostream& os, const image& im,
+            size_t format, image_resample::filter f = image_resample::BOX);
+
+    static void meta_reg_() {
+        refl::meta_manager::reg_class<ktx_texture>("ktx_texture")
+            .enable_auto_register()
+            .function("width", &ktx_texture::width)
+            .function("height", &ktx_texture::height)
+            .function("levels", &ktx_texture::levels)
+            .function("cubemap?", &ktx_texture::cubemap);
+    }
+
+private:
+    void parse_();
+
+    std::shared_ptr<mapped_file> file_;
+    size_t width_ = 0;
+    size_t height_ = 0;
+    size_t layers_ = 1;
+    size_t faces_ = 1;
+    size_t format_ = 0;
+    // of each level, layer and face, in the order of the file
+    std::vector<size_t> offsets_;
+    std::vector<size_t> sizes_;
+};
+
+template<>
+struct texture2d_trait<ktx_texture> {
+    typedef shrtool::raw_data_tag transfer_tag;
+    typedef ktx_texture input_type;
+
+    static size_t width(const input_type& i) {
+        return i.width();
+    }
+
+    static size_t height(const input_type& i) {
+        return i.height();
+    }
+
+    static size_t format(const input_type& i) {
+        return i.format();
+    }
+
+    static const void* data(const input_type& i) {
+        return i.data(0);
+    }
+
+    static std::vector<pixel_view> levels(const input_type& i) {
+        if(i.cubemap() || i.layers() > 1)
+            throw restriction_error("Not a 2D texture");
+
+        std::vector<pixel_view> v;
+        for(size_t l = 0; l < i.levels(); l++)
+            v.push_back(i.data(l));
+        return v;
+    }
+};
+
+template<>
+struct cubemap_trait<ktx_texture> {
+    typedef ktx_texture input_type;
+
+    static size_t edge(const input_type& i) {
+        return i.width();
+    }
+
+    static size_t format(const input_type& i) {
+        return i.format();
+    }
+
+    static std::array<pixel_view, 6> faces(const input_type& i) {
+        return face_level(i, 0);
+    }
+
+    static std::vector<std::array<pixel_view, 6>> face_levels(
+            const input_type& i) {
+        std::vector<std::array<pixel_view, 6>> v;
+        for(size_t l = 0; l < i.levels(); l++)
+            v.push_back(face_level(i, l));
+        return v;
+    }
+
+private:
+    static std::array<pixel_view, 6> face_level(
+            const input_type& i, size_t l) {
+        if(!i.cubemap() || i.layers() > 1)
+            throw restriction_error("Not a cubemap");
+
+        std::array<pixel_view, 6> f;
+        for(size_t j = 0; j < 6; j++)
+            f[j] = i.data(l, 0, j);
+        return f;
+    }
+};
+
+}
+
+#endif // KTX_H_INCLUDED
@@ -0,0 +1,68 @@
+#include <fstream>
+
+#include "mapped_file.h"
+#include "exception.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPPED_FILE_USE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace shrtool {
+
+mapped_file::mapped_file(const std::string& path)
+{
+#ifdef MAPPED_FILE_USE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw not_found_error("Cannot open " + path);
+
+    struct stat st;
+    if(::fstat(fd, &st) < 0) {
+        ::close(fd);
+        throw not_found_error("Cannot stat " + path);
+    }
+
+    size_ = st.st_size;
+    if(size_) {
+        void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p != MAP_FAILED) {
+            data_ = static_cast<const uint8_t*>(p);
+            mapped_ = true;
+        }
+    }
+    ::close(fd);
+
+    if(mapped_ || !size_)
+        return;
+#endif
+
+    std::ifstream fin(path, std::ios::binary);
+    if(!fin)
+        throw not_found_error("Cannot open " + path);
+
+    buffer_.assign(std::istreambuf_iterator<char>(fin),
+            std::istreambuf_iterator<char>());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+}
+
+mapped_file::mapped_file(std::vector<uint8_t> data) :
+    buffer_(std::move(data))
+{
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+}
+
+mapped_file::~mapped_file()
+{
+#ifdef MAPPED_FILE_USE_MMAP
+    if(mapped_)
+        ::munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+}
+
+}
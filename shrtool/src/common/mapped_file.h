@@ -0,0 +1,38 @@
+#ifndef MAPPED_FILE_H_INCLUDED
+#define MAPPED_FILE_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace shrtool {
+
+/*
+ * The whole content of a file, read-only, mapped into memory where the
+ * system allows it, and read into a buffer otherwise. Pages are only brought
+ * in when touched.
+ */
+class mapped_file {
+public:
+    explicit mapped_file(const std::string& path);
+    // takes over a buffer already in memory
+    explicit mapped_file(std::vector<uint8_t> data);
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool mapped() const { return mapped_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::vector<uint8_t> buffer_;
+};
+
+}
+
+#endif // MAPPED_FILE_H_INCLUDED
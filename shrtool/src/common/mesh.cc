@@ -1,14 +1,34 @@
 #include <sstream>
+#include <map>
+#include <list>
+#include <mutex>
+#include <tuple>
 
 #include "mesh.h"
 #include "exception.h"
+#include "parallel.h"
 
 namespace shrtool {
 
 using math::col3;
 using math::col4;
 
-inline void read_v(mesh_indexed& m, const std::string& str_v)
+/*
+ * Attributes are shared by the whole file and indices belong to the current
+ * group. Both are parsed in here first, then copied into the meshes in their
+ * final size, so the buffers are reused and grow only a few times per load.
+ */
+struct wavefront_scratch {
+    std::vector<col4> positions;
+    std::vector<col3> normals;
+    std::vector<col3> uvs;
+
+    std::vector<size_t> pos_indices;
+    std::vector<size_t> normal_indices;
+    std::vector<size_t> uv_indices;
+};
+
+inline void read_v(wavefront_scratch& m, const std::string& str_v)
 {
     col4 v;
     std::istringstream is(str_v);
@@ -23,10 +43,10 @@ inline void read_v(mesh_indexed& m, const std::string& str_v)
         }
     }
 
-    m.stor_positions->push_back(v);
+    m.positions.push_back(v);
 }
 
-inline void read_vt(mesh_indexed& m, const std::string& str_vt)
+inline void read_vt(wavefront_scratch& m, const std::string& str_vt)
 {
     col3 vt;
     std::istringstream is(str_vt);
@@ -41,10 +61,10 @@ inline void read_vt(mesh_indexed& m, const std::string& str_vt)
         }
     }
 
-    m.stor_uvs->push_back(vt);
+    m.uvs.push_back(vt);
 }
 
-inline void read_vn(mesh_indexed& m, const std::string& str_vn)
+inline void read_vn(wavefront_scratch& m, const std::string& str_vn)
 {
     col3 vn;
     std::istringstream is(str_vn);
@@ -55,10 +75,10 @@ inline void read_vn(mesh_indexed& m, const std::string& str_vn)
             throw parse_error("Normal vector is not 3D");
     }
 
-    m.stor_normals->push_back(vn);
+    m.normals.push_back(vn);
 }
 
-inline void read_f(mesh_indexed& m, const std::string& str_f) {
+inline void read_f(wavefront_scratch& m, const std::string& str_f) {
     // 3 choices for face element:
     //   i. v1 v2 v3 ...
     //  ii. v1//vt1 ...
@@ -112,25 +132,29 @@ inline void read_f(mesh_indexed& m, const std::string& str_f) {
         std::tie(v, vn, vt) = f;
 
         // handle negative indices
-        if(v < 0) v = m.stor_positions->size() + v; else v--;
-        if(vn < 0) vn = m.stor_normals->size() + vn; else vn--;
-        if(vt < 0) vt = m.stor_uvs->size() + vt; else vt--;
+        if(v < 0) v = m.positions.size() + v; else v--;
+        if(vn < 0) vn = m.normals.size() + vn; else vn--;
+        if(vt < 0) vt = m.uvs.size() + vt; else vt--;
 
-        m.positions.indices.push_back(v);
-        m.normals.indices.push_back(vn);
-        m.uvs.indices.push_back(vt);
+        m.pos_indices.push_back(v);
+        m.normal_indices.push_back(vn);
+        m.uv_indices.push_back(vt);
     }
 }
 
 void mesh_io_object::load_into_meshes(
-        std::istream& is, meshes_type& ms) {
-    std::string name;
+        std::istream& is, meshes_type& ms, std::shared_ptr<arena> a) {
+    wavefront_scratch scratch;
 
-    mesh_type::stor_ptr<col4> stor_positions(new std::vector<col4>);
-    mesh_type::stor_ptr<col3> stor_normals(new std::vector<col3>);
-    mesh_type::stor_ptr<col3> stor_uvs(new std::vector<col3>);
+    mesh_type::stor_ptr<col4> stor_positions(
+            new mesh_type::stor_vector<col4>(a));
+    mesh_type::stor_ptr<col3> stor_normals(
+            new mesh_type::stor_vector<col3>(a));
+    mesh_type::stor_ptr<col3> stor_uvs(
+            new mesh_type::stor_vector<col3>(a));
 
     std::string line;
+    bool open = false;
 
     auto create_mesh = [&]() {
         ms.emplace_back(false); // false to disable stor init
@@ -139,11 +163,26 @@ void mesh_io_object::load_into_meshes(
         current_mesh_.stor_positions = stor_positions;
         current_mesh_.stor_normals = stor_normals;
         current_mesh_.stor_uvs = stor_uvs;
+        open = true;
     };
 
-    auto current_mesh = [&]() -> mesh_type& {
-        if(ms.empty()) create_mesh();
-        return ms.back();
+    auto finish_mesh = [&]() {
+        mesh_type& m = ms.back();
+        m.positions.indices = mesh_type::index_container(
+                scratch.pos_indices.begin(), scratch.pos_indices.end(), a);
+        m.normals.indices = mesh_type::index_container(
+                scratch.normal_indices.begin(),
+                scratch.normal_indices.end(), a);
+        m.uvs.indices = mesh_type::index_container(
+                scratch.uv_indices.begin(), scratch.uv_indices.end(), a);
+
+        scratch.pos_indices.clear();
+        scratch.normal_indices.clear();
+        scratch.uv_indices.clear();
+    };
+
+    auto current_mesh = [&]() {
+        if(!open) create_mesh();
     };
 
     while(!is.eof() && !is.fail()) {
@@ -153,20 +192,43 @@ void mesh_io_object::load_into_meshes(
         std::getline(is, line);
 
         if(cmd == "g" || cmd == "o") {
-            if(!current_mesh().empty())
+            current_mesh();
+            if(!scratch.pos_indices.empty()) {
+                finish_mesh();
                 create_mesh();
+            }
         } else if(cmd == "v") {
-            read_v(current_mesh(), line);
+            current_mesh();
+            read_v(scratch, line);
         } else if(cmd == "vn") {
-            read_vn(current_mesh(), line);
+            current_mesh();
+            read_vn(scratch, line);
         } else if(cmd == "vt") {
-            read_vt(current_mesh(), line);
+            current_mesh();
+            read_vt(scratch, line);
         } else if(cmd == "f") {
-            read_f(current_mesh(), line);
+            current_mesh();
+            read_f(scratch, line);
         } else {
             // ignore
         }
     }
+
+    if(open) finish_mesh();
+
+    stor_positions->assign(scratch.positions.begin(), scratch.positions.end());
+    stor_normals->assign(scratch.normals.begin(), scratch.normals.end());
+    stor_uvs->assign(scratch.uvs.begin(), scratch.uvs.end());
+}
+
+// grids with fewer vertices than this are generated on the calling thread
+static const size_t parallel_gen_threshold = 1 << 16;
+
+static size_t gen_grain(size_t rows, size_t verts_per_row)
+{
+    if(rows * verts_per_row < parallel_gen_threshold)
+        return rows;
+    return std::max<size_t>(1, 4096 / std::max<size_t>(1, verts_per_row));
 }
 
 mesh_uv_sphere::mesh_uv_sphere(double radius,
@@ -174,131 +236,171 @@ mesh_uv_sphere::mesh_uv_sphere(double radius,
 {
     if(tesel_u < 3 || tesel_v < 2) return;
 
-    // generate vertices, normals, and uvs
+    const size_t row = tesel_u + 1;
+
+    // the sphere is separable: every vertex is a product of one entry from
+    // each of these tables, so only tesel_u + tesel_v + 2 sin/cos are needed
+    std::vector<double> cos_u(row), sin_u(row);
+    std::vector<double> cos_v(tesel_v + 1), sin_v(tesel_v + 1);
+
+    for(size_t u = 0; u <= tesel_u; ++u) {
+        double angle_u = double(u) / tesel_u * math::PI * 2;
+        cos_u[u] = std::cos(angle_u);
+        sin_u[u] = std::sin(angle_u);
+    }
+
     for(size_t v = 0; v <= tesel_v; ++v) {
         double angle_v = double(v) / tesel_v * math::PI;
-        double y = radius * std::cos(angle_v);
-        // this is the radius of the circle where the current plane (determined
-        // by y) intersects with the sphere.
-        double r_ = radius * std::sin(angle_v);
-
-        for(size_t u = 0; u <= tesel_u; ++u) {
-            double angle_u = double(u) / tesel_u * math::PI * 2;
-            double x = r_ * std::cos(angle_u);
-            double z = r_ * std::sin(angle_u);
-
-            stor_positions->push_back(col4{x, y, z, 1});
-            if(smooth)
-                // the normal cannot be found until triangles are generated
-                stor_normals->push_back(col3{x/radius, y/radius, z/radius});
-            stor_uvs->push_back(col3{1 - double(u) / tesel_u,
-                    double(v) / tesel_v, 1});
-
-            // take the center point of each grid in textures on polars
-            if(v == 0 || v == tesel_v)
-                stor_uvs->back()[0] = (u + 0.5) / tesel_u;
-        }
+        cos_v[v] = std::cos(angle_v);
+        sin_v[v] = std::sin(angle_v);
     }
 
-    // generate triangles
-    for(size_t v = 0; v < tesel_v; ++v) {
-        for(size_t u = 0; u < tesel_u; ++u) {
-            size_t i = v * (tesel_u + 1) + u;
-            size_t i_r = v * (tesel_u + 1) + u + 1;
-            size_t i_b = i + tesel_u + 1;
-            size_t i_rb = i_r + tesel_u + 1;
-
-            size_t non_smth_ni = 0;
-
-            if(!smooth) {
-                col4 nml =
-                    stor_positions->at(i) +
-                    stor_positions->at(i_r) +
-                    stor_positions->at(i_b) +
-                    stor_positions->at(i_rb) / 4;
-                nml /= math::norm(nml);
-                non_smth_ni = stor_normals->size();
-                stor_normals->emplace_back(nml);
-            }
+    stor_positions->resize(row * (tesel_v + 1));
+    stor_normals->resize(smooth ? row * (tesel_v + 1) : tesel_u * tesel_v);
+    stor_uvs->resize(row * (tesel_v + 1));
 
-            if(v != 0) { // not north polar
-                positions.indices.push_back(i_r);
-                positions.indices.push_back(i);
-                positions.indices.push_back(i_b);
+    col4* pos = stor_positions->data();
+    col3* nml = stor_normals->data();
+    col3* uv = stor_uvs->data();
 
-                normals.indices.push_back(!smooth ? non_smth_ni : i_r);
-                normals.indices.push_back(!smooth ? non_smth_ni : i);
-                normals.indices.push_back(!smooth ? non_smth_ni : i_b);
-
-                uvs.indices.push_back(i_r);
-                uvs.indices.push_back(i);
-                uvs.indices.push_back(i_b);
+    // generate vertices, normals, and uvs
+    parallel_for(tesel_v + 1, gen_grain(tesel_v + 1, row),
+            [&](size_t v_beg, size_t v_end) {
+        for(size_t v = v_beg; v < v_end; ++v) {
+            double y = radius * cos_v[v];
+            // this is the radius of the circle where the current plane
+            // (determined by y) intersects with the sphere.
+            double r_ = radius * sin_v[v];
+
+            for(size_t u = 0; u <= tesel_u; ++u) {
+                size_t i = v * row + u;
+                double x = r_ * cos_u[u];
+                double z = r_ * sin_u[u];
+
+                pos[i] = col4{x, y, z, 1};
+                if(smooth)
+                    // the normal cannot be found until triangles are generated
+                    nml[i] = col3{x/radius, y/radius, z/radius};
+
+                // take the center point of each grid in textures on polars
+                uv[i] = col3{v == 0 || v == tesel_v ?
+                    (u + 0.5) / tesel_u : 1 - double(u) / tesel_u,
+                    double(v) / tesel_v, 1};
             }
+        }
+    });
+
+    // both polar rows have a single triangle per grid, the others have two
+    const size_t polar_row_idx = tesel_u * 3;
+    const size_t middle_row_idx = tesel_u * 6;
 
-            if(v != tesel_v - 1) { // not south polar
-                positions.indices.push_back(i_b);
-                positions.indices.push_back(i_rb);
-                positions.indices.push_back(i_r);
+    positions.indices.resize(middle_row_idx * (tesel_v - 1));
+    normals.indices.resize(positions.indices.size());
+    uvs.indices.resize(positions.indices.size());
 
-                normals.indices.push_back(!smooth ? non_smth_ni : i_b);
-                normals.indices.push_back(!smooth ? non_smth_ni : i_rb);
-                normals.indices.push_back(!smooth ? non_smth_ni : i_r);
+    size_t* pi = positions.indices.data();
+    size_t* ni = normals.indices.data();
+    size_t* ti = uvs.indices.data();
 
-                uvs.indices.push_back(i_b);
-                uvs.indices.push_back(i_rb);
-                uvs.indices.push_back(i_r);
+    // generate triangles
+    parallel_for(tesel_v, gen_grain(tesel_v, row),
+            [&](size_t v_beg, size_t v_end) {
+        for(size_t v = v_beg; v < v_end; ++v) {
+            size_t o = v ? polar_row_idx + (v - 1) * middle_row_idx : 0;
+
+            for(size_t u = 0; u < tesel_u; ++u) {
+                size_t i = v * row + u;
+                size_t i_r = v * row + u + 1;
+                size_t i_b = i + row;
+                size_t i_rb = i_r + row;
+
+                size_t non_smth_ni = 0;
+
+                if(!smooth) {
+                    col4 n =
+                        pos[i] +
+                        pos[i_r] +
+                        pos[i_b] +
+                        pos[i_rb] / 4;
+                    n /= math::norm(n);
+                    non_smth_ni = v * tesel_u + u;
+                    nml[non_smth_ni] = col3(n);
+                }
+
+                if(v != 0) { // not north polar
+                    pi[o] = i_r; pi[o + 1] = i; pi[o + 2] = i_b;
+                    ti[o] = i_r; ti[o + 1] = i; ti[o + 2] = i_b;
+
+                    ni[o]     = !smooth ? non_smth_ni : i_r;
+                    ni[o + 1] = !smooth ? non_smth_ni : i;
+                    ni[o + 2] = !smooth ? non_smth_ni : i_b;
+                    o += 3;
+                }
+
+                if(v != tesel_v - 1) { // not south polar
+                    pi[o] = i_b; pi[o + 1] = i_rb; pi[o + 2] = i_r;
+                    ti[o] = i_b; ti[o + 1] = i_rb; ti[o + 2] = i_r;
+
+                    ni[o]     = !smooth ? non_smth_ni : i_b;
+                    ni[o + 1] = !smooth ? non_smth_ni : i_rb;
+                    ni[o + 2] = !smooth ? non_smth_ni : i_r;
+                    o += 3;
+                }
             }
         }
-    }
+    });
 }
 
 mesh_plane::mesh_plane(double w, double h,
         size_t tesel_u, size_t tesel_v)
 {
     double half_w = w / 2, half_h = h / 2;
-    for(size_t cur_u = 0; cur_u <= tesel_u; ++cur_u)
-        for(size_t cur_v = 0; cur_v <= tesel_v; ++cur_v) {
-            stor_positions->push_back(col4{
-                    double(cur_u) / tesel_u * w - half_w, 0,
-                    double(cur_v) / tesel_v * h - half_h, 1});
-            stor_normals->push_back(col3{0, 1, 0});
-            stor_uvs->push_back(col3{
-                    double(cur_u) / tesel_u,
-                    double(cur_v) / tesel_v, 1});
-        }
+    const size_t col = tesel_v + 1;
 
-    for(size_t v = 0; v < tesel_v; ++v) {
-        for(size_t u = 0; u < tesel_u; ++u) {
-            size_t i = v * (tesel_u + 1) + u;
-            size_t i_r = v * (tesel_u + 1) + u + 1;
-            size_t i_b = i + tesel_u + 1;
-            size_t i_rb = i_r + tesel_u + 1;
+    stor_positions->resize((tesel_u + 1) * col);
+    stor_normals->assign((tesel_u + 1) * col, col3{0, 1, 0});
+    stor_uvs->resize((tesel_u + 1) * col);
 
-            positions.indices.push_back(i_r);
-            positions.indices.push_back(i);
-            positions.indices.push_back(i_b);
+    col4* pos = stor_positions->data();
+    col3* uv = stor_uvs->data();
 
-            normals.indices.push_back(i_r);
-            normals.indices.push_back(i);
-            normals.indices.push_back(i_b);
+    parallel_for(tesel_u + 1, gen_grain(tesel_u + 1, col),
+            [&](size_t u_beg, size_t u_end) {
+        for(size_t cur_u = u_beg; cur_u < u_end; ++cur_u)
+            for(size_t cur_v = 0; cur_v <= tesel_v; ++cur_v) {
+                size_t i = cur_u * col + cur_v;
+                pos[i] = col4{
+                    double(cur_u) / tesel_u * w - half_w, 0,
+                    double(cur_v) / tesel_v * h - half_h, 1};
+                uv[i] = col3{
+                    double(cur_u) / tesel_u,
+                    double(cur_v) / tesel_v, 1};
+            }
+    });
 
-            uvs.indices.push_back(i_r);
-            uvs.indices.push_back(i);
-            uvs.indices.push_back(i_b);
+    positions.indices.resize(tesel_u * tesel_v * 6);
+    size_t* pi = positions.indices.data();
 
-            positions.indices.push_back(i_b);
-            positions.indices.push_back(i_rb);
-            positions.indices.push_back(i_r);
+    parallel_for(tesel_v, gen_grain(tesel_v, tesel_u + 1),
+            [&](size_t v_beg, size_t v_end) {
+        for(size_t v = v_beg; v < v_end; ++v) {
+            size_t* o = pi + v * tesel_u * 6;
 
-            normals.indices.push_back(i_b);
-            normals.indices.push_back(i_rb);
-            normals.indices.push_back(i_r);
+            for(size_t u = 0; u < tesel_u; ++u, o += 6) {
+                size_t i = v * (tesel_u + 1) + u;
+                size_t i_r = v * (tesel_u + 1) + u + 1;
+                size_t i_b = i + tesel_u + 1;
+                size_t i_rb = i_r + tesel_u + 1;
 
-            uvs.indices.push_back(i_b);
-            uvs.indices.push_back(i_rb);
-            uvs.indices.push_back(i_r);
+                o[0] = i_r; o[1] = i; o[2] = i_b;
+                o[3] = i_b; o[4] = i_rb; o[5] = i_r;
+            }
         }
-    }
+    });
+
+    // every attribute of a plane is indexed in the same way
+    normals.indices = positions.indices;
+    uvs.indices = positions.indices;
 }
 
 mesh_box::mesh_box(double l, double w, double h)
@@ -306,6 +408,13 @@ mesh_box::mesh_box(double l, double w, double h)
     static size_t gray_code[4][2] = {{0,0}, {1,0}, {1,1}, {0,1}};
     static size_t tri_gc[6] = {0, 1, 2, 2, 3, 0};
 
+    stor_positions->reserve(8);
+    stor_uvs->reserve(4);
+    stor_normals->reserve(6);
+    positions.indices.reserve(36);
+    normals.indices.reserve(36);
+    uvs.indices.reserve(36);
+
     for(int i = 0; i <= 1; i++)
     for(int j = 0; j <= 1; j++)
     for(int k = 0; k <= 1; k++)
@@ -339,5 +448,95 @@ mesh_box::mesh_box(double l, double w, double h)
     }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// generator cache
+
+namespace {
+
+enum gen_kind { GEN_UV_SPHERE, GEN_PLANE, GEN_BOX };
+
+typedef std::tuple<int, double, double, double, size_t, size_t, bool>
+    gen_key;
+
+struct gen_cache {
+    typedef std::list<gen_key> order_list;
+
+    std::mutex lock;
+    // each with its place in the order, least recently used first
+    std::map<gen_key, std::pair<mesh_indexed, order_list::iterator>> meshes;
+    order_list order;
+
+    template<typename Gen>
+    mesh_indexed fetch(const gen_key& k, Gen gen) {
+        {
+            std::lock_guard<std::mutex> g(lock);
+            auto i = meshes.find(k);
+            if(i != meshes.end()) {
+                order.splice(order.end(), order, i->second.second);
+                return i->second.first;
+            }
+        }
+
+        // generate outside the lock, big meshes take a while
+        mesh_indexed m = gen();
+
+        std::lock_guard<std::mutex> g(lock);
+        auto res = meshes.insert(std::make_pair(k,
+                    std::make_pair(std::move(m), order.end())));
+        if(res.second) {
+            res.first->second.second = order.insert(order.end(), k);
+            if(order.size() > mesh_indexed::gen_cache_capacity) {
+                meshes.erase(order.front());
+                order.pop_front();
+            }
+        }
+
+        return res.first->second.first;
+    }
+
+    static gen_cache& inst() {
+        static gen_cache c;
+        return c;
+    }
+};
+
+}
+
+mesh_indexed mesh_indexed::gen_uv_sphere(double radius,
+        size_t tesel_u, size_t tesel_v, bool smooth)
+{
+    return gen_cache::inst().fetch(
+        gen_key(GEN_UV_SPHERE, radius, 0, 0, tesel_u, tesel_v, smooth),
+        [=]() -> mesh_indexed {
+            return mesh_uv_sphere(radius, tesel_u, tesel_v, smooth);
+        });
+}
+
+mesh_indexed mesh_indexed::gen_plane(double w, double h,
+        size_t tesel_u, size_t tesel_v)
+{
+    return gen_cache::inst().fetch(
+        gen_key(GEN_PLANE, w, h, 0, tesel_u, tesel_v, false),
+        [=]() -> mesh_indexed {
+            return mesh_plane(w, h, tesel_u, tesel_v);
+        });
+}
+
+mesh_indexed mesh_indexed::gen_box(double l, double w, double h)
+{
+    return gen_cache::inst().fetch(
+        gen_key(GEN_BOX, l, w, h, 0, 0, false),
+        [=]() -> mesh_indexed {
+            return mesh_box(l, w, h);
+        });
+}
+
+void mesh_indexed::clear_gen_cache()
+{
+    gen_cache& c = gen_cache::inst();
+    std::lock_guard<std::mutex> g(c.lock);
+    c.meshes.clear();
+    c.order.clear();
 }
 
+}
@@ -8,6 +8,7 @@
 
 #include "matrix.h"
 #include "image.h"
+#include "arena.h"
 #include "traits.h"
 #include "reflection.h"
 
@@ -138,15 +139,16 @@ struct indexed_attr {
 
     typedef ContainerRef& container_type_refernce;
     typedef T value_type;
-    std::vector<size_t> indices;
+    typedef std::vector<size_t, arena_allocator<size_t>> index_container;
+    index_container indices;
 
     typedef indexed_attr_iterator<T, indexed_attr&> iterator;
     typedef indexed_attr_iterator<const T, const indexed_attr&> const_iterator;
 
     indexed_attr(ContainerRef& r) : refer(r) { }
-    indexed_attr(ContainerRef& r, const std::vector<size_t>& i) :
+    indexed_attr(ContainerRef& r, const index_container& i) :
         refer(r), indices(i) { }
-    indexed_attr(ContainerRef& r, std::vector<size_t>&& i) :
+    indexed_attr(ContainerRef& r, index_container&& i) :
         refer(r), indices(std::move(i)) { }
 
     iterator begin() { return iterator(*this, 0); }
@@ -165,8 +167,16 @@ struct indexed_attr {
 
 
 struct mesh_indexed : mesh_base<mesh_indexed> {
+    /*
+     * Storages and indices allocate from the heap unless they are given an
+     * arena_allocator bound to an arena, which loaders do to carve all the
+     * meshes of a file out of a few blocks.
+     */
     template<typename T>
-    using stor_ptr = std::shared_ptr<std::vector<T>>;
+    using stor_vector = std::vector<T, arena_allocator<T>>;
+    template<typename T>
+    using stor_ptr = std::shared_ptr<stor_vector<T>>;
+    typedef std::vector<size_t, arena_allocator<size_t>> index_container;
 
     stor_ptr<math::col4> stor_positions;
     stor_ptr<math::col3> stor_normals;
@@ -224,11 +234,11 @@ struct mesh_indexed : mesh_base<mesh_indexed> {
         bone_indices(stor_bone_indices)
     {
         if(init_stor) {
-            stor_positions.reset(new std::vector<math::col4>);
-            stor_normals.reset(new std::vector<math::col3>);
-            stor_uvs.reset(new std::vector<math::col3>);
-            stor_weights.reset(new std::vector<math::col4>);
-            stor_bone_indices.reset(new std::vector<math::col4>);
+            stor_positions.reset(new stor_vector<math::col4>);
+            stor_normals.reset(new stor_vector<math::col3>);
+            stor_uvs.reset(new stor_vector<math::col3>);
+            stor_weights.reset(new stor_vector<math::col4>);
+            stor_bone_indices.reset(new stor_vector<math::col4>);
         }
     }
 
@@ -245,7 +255,9 @@ struct mesh_indexed : mesh_base<mesh_indexed> {
         weights(stor_weights, im.weights.indices),
         bone_indices(stor_bone_indices, im.bone_indices.indices) { }
 
-    mesh_indexed(mesh_indexed&& im) :
+    // noexcept, or vectors of meshes would copy them when they grow, and
+    // the copies would lose the arena of their indices
+    mesh_indexed(mesh_indexed&& im) noexcept :
         mesh_base<mesh_indexed>(std::move(im)),
         stor_positions(std::move(im.stor_positions)),
         stor_normals(std::move(im.stor_normals)),
@@ -258,11 +270,26 @@ struct mesh_indexed : mesh_base<mesh_indexed> {
         weights(stor_weights, std::move(im.weights.indices)),
         bone_indices(stor_bone_indices, std::move(im.bone_indices.indices)) { }
 
+    /*
+     * gen_* are cached: identical parameters give meshes sharing the same
+     * storages (and copies of the same indices), just like groups loaded from
+     * one wavefront file do. Modify a storage in place only if you own every
+     * mesh that refers to it, or construct mesh_uv_sphere/mesh_plane/mesh_box
+     * directly to get a private one.
+     *
+     * The cache holds the meshes last asked for, at most gen_cache_capacity of
+     * them. A scene asks for a handful of shapes, each at a few levels of
+     * detail, so this many keep them all while bounding what an editor
+     * sweeping through parameters leaves behind.
+     */
+    static const size_t gen_cache_capacity = 32;
+
     static mesh_indexed gen_uv_sphere(double radius,
             size_t tesel_u, size_t tesel_v, bool smooth = true);
     static mesh_indexed gen_plane(double w, double h,
             size_t tesel_u, size_t tesel_v);
     static mesh_indexed gen_box(double l, double w, double h);
+    static void clear_gen_cache();
 
     static void meta_reg_() {
         refl::meta_manager::reg_class<mesh_indexed>("mesh")
@@ -275,6 +302,7 @@ struct mesh_indexed : mesh_base<mesh_indexed> {
             .function("gen_uv_sphere", gen_uv_sphere)
             .function("gen_box", gen_box)
             .function("gen_plane", gen_plane)
+            .function("clear_gen_cache", clear_gen_cache)
             .function("get_position", static_cast<math::col4& (mesh_indexed::*)(size_t, size_t)>(&mesh_indexed::get_position))
             .function("get_normals", static_cast<math::col3& (mesh_indexed::*)(size_t, size_t)>(&mesh_indexed::get_normal))
             .function("get_uv", static_cast<math::col3& (mesh_indexed::*) (size_t, size_t)>(&mesh_indexed::get_uv));
@@ -304,18 +332,6 @@ struct mesh_box : mesh_indexed {
     mesh_box(mesh_box&& mb) : mesh_indexed(std::move(mb)) { }
 };
 
-inline mesh_indexed mesh_indexed::gen_uv_sphere(double radius,
-        size_t tesel_u, size_t tesel_v, bool smooth) {
-    return mesh_uv_sphere(radius, tesel_u, tesel_v, smooth);
-}
-inline mesh_indexed mesh_indexed::gen_plane(double w, double h,
-        size_t tesel_u, size_t tesel_v) {
-    return mesh_plane(w, h, tesel_u, tesel_v);
-}
-inline mesh_indexed mesh_indexed::gen_box(double l, double w, double h) {
-    return mesh_box(l, w, h);
-}
-
 struct mesh_io_object {
     typedef mesh_indexed mesh_type;
     typedef std::vector<mesh_type> meshes_type;
@@ -324,9 +340,15 @@ struct mesh_io_object {
 
     mesh_io_object(meshes_type& ms) : meshes(&ms) { }
 
-    static meshes_type load(std::istream& is) {
+    /*
+     * With an arena, the storages and indices of the loaded meshes are
+     * allocated from it, in their final size: the file is parsed into
+     * scratch buffers reused from group to group first.
+     */
+    static meshes_type load(std::istream& is,
+            std::shared_ptr<arena> a = nullptr) {
         meshes_type ms;
-        load_into_meshes(is, ms);
+        load_into_meshes(is, ms, std::move(a));
         return std::move(ms);
     }
 
@@ -335,7 +357,8 @@ struct mesh_io_object {
         return is;
     }
 
-    static void load_into_meshes(std::istream& is, meshes_type& ms);
+    static void load_into_meshes(std::istream& is, meshes_type& ms,
+            std::shared_ptr<arena> a = nullptr);
 };
 
 template<typename T>
@@ -0,0 +1,858 @@
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <queue>
+#include <type_traits>
+
+#include "mesh_codec.h"
+#include "exception.h"
+#include "parallel.h"
+
+namespace shrtool {
+
+using math::col3;
+using math::col4;
+
+namespace {
+
+const char magic[8] = { 'S', 'H', 'R', 'M', 'E', 'S', 'H', '1' };
+const size_t block_size = 1 << 16;
+const unsigned max_code_len = 12;
+const size_t attr_kinds = 5;
+const size_t attr_dims[attr_kinds] = { 4, 3, 3, 4, 4 };
+const size_t bone_indices_kind = 4;
+const size_t npos = size_t(-1);
+
+enum block_mode : uint8_t {
+    BLOCK_RAW,
+    BLOCK_CONSTANT,
+    BLOCK_HUFFMAN,
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// byte io
+
+struct byte_writer {
+    std::vector<uint8_t>& out;
+
+    byte_writer(std::vector<uint8_t>& o) : out(o) { }
+
+    void u8(uint8_t b) { out.push_back(b); }
+
+    void varint(uint64_t v) {
+        while(v >= 0x80) {
+            out.push_back(uint8_t(v) | 0x80);
+            v >>= 7;
+        }
+        out.push_back(uint8_t(v));
+    }
+
+    void f64(double d) {
+        uint64_t b;
+        std::memcpy(&b, &d, sizeof(b));
+        for(size_t i = 0; i < 8; i++)
+            out.push_back(uint8_t(b >> (i * 8)));
+    }
+
+    void bytes(const void* p, size_t n) {
+        const uint8_t* c = static_cast<const uint8_t*>(p);
+        out.insert(out.end(), c, c + n);
+    }
+};
+
+struct byte_reader {
+    const uint8_t* p;
+    const uint8_t* end;
+
+    byte_reader(const uint8_t* b, size_t n) : p(b), end(b + n) { }
+
+    size_t remaining() const { return end - p; }
+
+    void need(size_t n) const {
+        if(remaining() < n)
+            throw parse_error("Bad compressed mesh: truncated");
+    }
+
+    uint8_t u8() { need(1); return *p++; }
+
+    uint64_t varint() {
+        uint64_t v = 0;
+        for(unsigned s = 0; s < 64; s += 7) {
+            uint8_t b = u8();
+            v |= uint64_t(b & 0x7f) << s;
+            if(!(b & 0x80)) return v;
+        }
+        throw parse_error("Bad compressed mesh: varint too long");
+    }
+
+    double f64() {
+        need(8);
+        uint64_t b = 0;
+        for(size_t i = 0; i < 8; i++)
+            b |= uint64_t(*p++) << (i * 8);
+        double d;
+        std::memcpy(&d, &b, sizeof(d));
+        return d;
+    }
+
+    const uint8_t* skip(size_t n) {
+        need(n);
+        const uint8_t* r = p;
+        p += n;
+        return r;
+    }
+};
+
+inline const uint8_t* varint_decode(const uint8_t* p, const uint8_t* end,
+        uint64_t& v)
+{
+    v = 0;
+    for(unsigned s = 0; s < 64 && p < end; s += 7) {
+        uint8_t b = *p++;
+        v |= uint64_t(b & 0x7f) << s;
+        if(!(b & 0x80)) return p;
+    }
+    throw parse_error("Bad compressed mesh: index stream");
+}
+
+template<typename U>
+inline U zigzag(U delta)
+{
+    typedef typename std::make_signed<U>::type S;
+    return U(U(delta << 1) ^ U(S(delta) >> (sizeof(U) * 8 - 1)));
+}
+
+template<typename U>
+inline U unzigzag(U z)
+{
+    return U(U(z >> 1) ^ U(0 - U(z & 1)));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// entropy stage: canonical Huffman over bytes, lengths limited to
+// max_code_len so that a single table lookup decodes a symbol
+
+void build_lengths(const uint32_t* freq, uint8_t* len)
+{
+    std::vector<uint64_t> f(freq, freq + 256);
+
+    while(true) {
+        typedef std::pair<uint64_t, int> item;
+        std::priority_queue<item, std::vector<item>, std::greater<item>> q;
+        // leaves are 0 - 255, inner nodes follow
+        int parent[512];
+        std::fill(parent, parent + 512, -1);
+
+        for(int s = 0; s < 256; s++)
+            if(f[s]) q.push(item(f[s], s));
+
+        int next = 256;
+        while(q.size() > 1) {
+            item a = q.top(); q.pop();
+            item b = q.top(); q.pop();
+            parent[a.second] = parent[b.second] = next;
+            q.push(item(a.first + b.first, next++));
+        }
+
+        unsigned max_len = 0;
+        for(int s = 0; s < 256; s++) {
+            len[s] = 0;
+            if(!f[s]) continue;
+            unsigned l = 0;
+            for(int n = s; parent[n] >= 0; n = parent[n]) l++;
+            len[s] = uint8_t(l);
+            max_len = std::max(max_len, l);
+        }
+
+        if(max_len <= max_code_len) return;
+
+        // flatten the distribution until the tree is shallow enough
+        for(int s = 0; s < 256; s++)
+            if(f[s]) f[s] = (f[s] + 1) / 2;
+    }
+}
+
+// codes are bit reversed, for a stream written from the low bit up
+void canonical_codes(const uint8_t* len, uint16_t* code)
+{
+    unsigned bl_count[max_code_len + 1] = { 0 };
+    unsigned next_code[max_code_len + 1] = { 0 };
+
+    for(int s = 0; s < 256; s++)
+        if(len[s]) bl_count[len[s]]++;
+
+    unsigned c = 0;
+    for(unsigned l = 1; l <= max_code_len; l++) {
+        c = (c + bl_count[l - 1]) << 1;
+        next_code[l] = c;
+    }
+
+    for(int s = 0; s < 256; s++) {
+        code[s] = 0;
+        if(!len[s]) continue;
+        unsigned v = next_code[len[s]]++, r = 0;
+        for(unsigned i = 0; i < len[s]; i++)
+            r |= ((v >> i) & 1) << (len[s] - 1 - i);
+        code[s] = uint16_t(r);
+    }
+}
+
+uint8_t encode_block(const uint8_t* src, size_t n, std::vector<uint8_t>& out)
+{
+    uint32_t freq[256] = { 0 };
+    for(size_t i = 0; i < n; i++)
+        freq[src[i]]++;
+
+    if(freq[src[0]] == n) {
+        out.assign(1, src[0]);
+        return BLOCK_CONSTANT;
+    }
+
+    uint8_t len[256];
+    build_lengths(freq, len);
+
+    size_t bits = 0;
+    for(int s = 0; s < 256; s++)
+        bits += size_t(freq[s]) * len[s];
+    if(128 + (bits + 7) / 8 >= n) {
+        out.assign(src, src + n);
+        return BLOCK_RAW;
+    }
+
+    uint16_t code[256];
+    canonical_codes(len, code);
+
+    out.assign(128, 0);
+    out.reserve(128 + (bits + 7) / 8 + 8);
+    for(int s = 0; s < 256; s++)
+        out[s / 2] |= len[s] << (4 * (s & 1));
+
+    uint64_t acc = 0;
+    unsigned acc_bits = 0;
+    for(size_t i = 0; i < n; i++) {
+        acc |= uint64_t(code[src[i]]) << acc_bits;
+        acc_bits += len[src[i]];
+        while(acc_bits >= 8) {
+            out.push_back(uint8_t(acc));
+            acc >>= 8;
+            acc_bits -= 8;
+        }
+    }
+    if(acc_bits) out.push_back(uint8_t(acc));
+
+    return BLOCK_HUFFMAN;
+}
+
+void decode_block(uint8_t mode, const uint8_t* src, size_t src_size,
+        uint8_t* dst, size_t n)
+{
+    if(mode == BLOCK_RAW) {
+        if(src_size != n)
+            throw parse_error("Bad compressed mesh: raw block size");
+        std::memcpy(dst, src, n);
+        return;
+    }
+
+    if(mode == BLOCK_CONSTANT) {
+        if(src_size != 1)
+            throw parse_error("Bad compressed mesh: constant block size");
+        std::memset(dst, src[0], n);
+        return;
+    }
+
+    if(mode != BLOCK_HUFFMAN || src_size < 128)
+        throw parse_error("Bad compressed mesh: block header");
+
+    uint8_t len[256];
+    for(int s = 0; s < 256; s++) {
+        len[s] = (src[s / 2] >> (4 * (s & 1))) & 0xf;
+        if(len[s] > max_code_len)
+            throw parse_error("Bad compressed mesh: code length");
+    }
+
+    uint16_t code[256];
+    canonical_codes(len, code);
+
+    // entry: symbol in the low byte, code length above, 0 for no code
+    const size_t table_size = size_t(1) << max_code_len;
+    uint16_t table[table_size];
+    std::fill(table, table + table_size, 0);
+    size_t filled = 0;
+    for(int s = 0; s < 256; s++) {
+        if(!len[s]) continue;
+        size_t step = size_t(1) << len[s];
+        filled += table_size >> len[s];
+        if(filled > table_size)
+            throw parse_error("Bad compressed mesh: oversubscribed code");
+        for(size_t i = code[s]; i < table_size; i += step)
+            table[i] = uint16_t(s | (len[s] << 8));
+    }
+
+    const uint8_t* p = src + 128;
+    const uint8_t* end = src + src_size;
+    uint64_t acc = 0;
+    unsigned acc_bits = 0;
+
+    for(size_t i = 0; i < n; i++) {
+        if(acc_bits < max_code_len) {
+            while(acc_bits <= 56 && p < end) {
+                acc |= uint64_t(*p++) << acc_bits;
+                acc_bits += 8;
+            }
+        }
+
+        uint16_t e = table[acc & (table_size - 1)];
+        unsigned l = e >> 8;
+        if(!l || l > acc_bits)
+            throw parse_error("Bad compressed mesh: corrupted block");
+        dst[i] = uint8_t(e);
+        acc >>= l;
+        acc_bits -= l;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// streams: a raw byte stream cut into independently coded blocks
+
+struct block_job {
+    uint8_t mode;
+    const uint8_t* src;
+    size_t src_size;
+    uint8_t* dst;
+    size_t dst_size;
+};
+
+void write_stream(byte_writer& w, const std::vector<uint8_t>& raw)
+{
+    size_t nblocks = (raw.size() + block_size - 1) / block_size;
+    std::vector<std::vector<uint8_t>> payloads(nblocks);
+    std::vector<uint8_t> modes(nblocks);
+
+    parallel_for(nblocks, 1, [&](size_t b, size_t e) {
+        for(size_t i = b; i < e; i++) {
+            size_t off = i * block_size;
+            modes[i] = encode_block(raw.data() + off,
+                    std::min(block_size, raw.size() - off), payloads[i]);
+        }
+    });
+
+    w.varint(raw.size());
+    for(size_t i = 0; i < nblocks; i++) {
+        w.u8(modes[i]);
+        w.varint(payloads[i].size());
+    }
+    for(size_t i = 0; i < nblocks; i++)
+        w.bytes(payloads[i].data(), payloads[i].size());
+}
+
+// only registers the blocks, they are decoded all together afterwards
+void read_stream(byte_reader& r, std::vector<uint8_t>& dst,
+        std::vector<block_job>& jobs)
+{
+    uint64_t raw_size = r.varint();
+    uint64_t nblocks = (raw_size + block_size - 1) / block_size;
+    // every block takes at least a mode byte and a size byte
+    if(nblocks > r.remaining() / 2)
+        throw parse_error("Bad compressed mesh: stream size");
+
+    dst.resize(raw_size);
+    size_t first = jobs.size();
+    for(size_t i = 0; i < nblocks; i++) {
+        block_job j;
+        j.mode = r.u8();
+        j.src_size = r.varint();
+        j.dst = dst.data() + i * block_size;
+        j.dst_size = std::min<size_t>(block_size, raw_size - i * block_size);
+        jobs.push_back(j);
+    }
+    for(size_t i = 0; i < nblocks; i++)
+        jobs[first + i].src = r.skip(jobs[first + i].src_size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// attributes: per component deltas, split into byte planes
+
+template<typename U, typename Conv>
+void pack_planes(size_t count, size_t dims, Conv conv,
+        std::vector<uint8_t>& raw)
+{
+    const size_t n = count * dims;
+    raw.resize(n * sizeof(U));
+
+    for(size_t c = 0; c < dims; c++) {
+        U prev = 0;
+        for(size_t i = 0; i < count; i++) {
+            U v = conv(c, i);
+            U z = zigzag<U>(U(v - prev));
+            prev = v;
+            size_t at = c * count + i;
+            for(size_t k = 0; k < sizeof(U); k++)
+                raw[k * n + at] = uint8_t(z >> (8 * k));
+        }
+    }
+}
+
+template<typename U, typename Store>
+void unpack_planes(size_t count, size_t dims, const uint8_t* raw, Store store)
+{
+    const size_t n = count * dims;
+
+    for(size_t c = 0; c < dims; c++) {
+        U prev = 0;
+        for(size_t i = 0; i < count; i++) {
+            size_t at = c * count + i;
+            U z = 0;
+            for(size_t k = 0; k < sizeof(U); k++)
+                z |= U(U(raw[k * n + at]) << (8 * k));
+            prev = U(prev + unzigzag<U>(z));
+            store(c, i, prev);
+        }
+    }
+}
+
+inline size_t value_bytes(mesh_codec::precision prec)
+{
+    switch(prec) {
+    case mesh_codec::EXACT: return 8;
+    case mesh_codec::SINGLE: return 4;
+    case mesh_codec::QUANTIZED: return 2;
+    }
+    throw parse_error("Bad compressed mesh: unknown precision");
+}
+
+template<typename Stor>
+void encode_storage(byte_writer& w, const Stor& s,
+        const std::vector<size_t>& order, mesh_codec::precision prec,
+        unsigned quant_bits)
+{
+    const size_t dims = Stor::value_type::rows, count = order.size();
+    std::vector<uint8_t> raw;
+
+    w.u8(prec);
+    w.varint(count);
+
+    if(prec == mesh_codec::EXACT) {
+        pack_planes<uint64_t>(count, dims, [&](size_t c, size_t i) {
+            double d = s[order[i]][c];
+            uint64_t b;
+            std::memcpy(&b, &d, sizeof(b));
+            return b;
+        }, raw);
+    } else if(prec == mesh_codec::SINGLE) {
+        pack_planes<uint32_t>(count, dims, [&](size_t c, size_t i) {
+            float f = float(s[order[i]][c]);
+            uint32_t b;
+            std::memcpy(&b, &f, sizeof(b));
+            return b;
+        }, raw);
+    } else {
+        double vmin[4], step[4];
+        double levels = double((1u << quant_bits) - 1);
+        for(size_t c = 0; c < dims; c++) {
+            double lo = 0, hi = 0;
+            for(size_t i = 0; i < count; i++) {
+                double v = s[i][c];
+                lo = i ? std::min(lo, v) : v;
+                hi = i ? std::max(hi, v) : v;
+            }
+            if(!std::isfinite(hi - lo))
+                throw restriction_error("Cannot quantize non-finite attributes");
+            vmin[c] = lo;
+            step[c] = (hi - lo) / levels;
+        }
+
+        w.u8(uint8_t(quant_bits));
+        for(size_t c = 0; c < dims; c++) {
+            w.f64(vmin[c]);
+            w.f64(step[c]);
+        }
+
+        pack_planes<uint16_t>(count, dims, [&](size_t c, size_t i) {
+            if(step[c] == 0) return uint16_t(0);
+            double q = std::round((s[order[i]][c] - vmin[c]) / step[c]);
+            return uint16_t(std::min(std::max(q, 0.0), levels));
+        }, raw);
+    }
+
+    write_stream(w, raw);
+}
+
+/*
+ * The decoder runs in three steps: parsing registers every block and queues
+ * the work left for each stream, then all blocks are entropy decoded in
+ * parallel, then the queued streams are turned into attributes and indices
+ * in parallel.
+ */
+struct decoder {
+    std::shared_ptr<arena> source;
+    std::deque<std::vector<uint8_t>> buffers;
+    std::vector<block_job> jobs;
+    std::vector<std::function<void()>> finish;
+
+    template<typename Vec>
+    mesh_indexed::stor_ptr<Vec> read_storage(byte_reader& r) {
+        const size_t dims = Vec::rows;
+        uint8_t prec_byte = r.u8();
+        if(prec_byte > mesh_codec::QUANTIZED)
+            throw parse_error("Bad compressed mesh: unknown precision");
+        mesh_codec::precision prec = mesh_codec::precision(prec_byte);
+        uint64_t count = r.varint();
+
+        std::vector<double> vmin(dims), step(dims);
+        if(prec == mesh_codec::QUANTIZED) {
+            r.u8(); // bits, only the steps matter to decoding
+            for(size_t c = 0; c < dims; c++) {
+                vmin[c] = r.f64();
+                step[c] = r.f64();
+            }
+        }
+
+        buffers.emplace_back();
+        std::vector<uint8_t>& raw = buffers.back();
+        read_stream(r, raw, jobs);
+        if(raw.size() != count * dims * value_bytes(prec))
+            throw parse_error("Bad compressed mesh: storage size");
+
+        mesh_indexed::stor_ptr<Vec> stor(new mesh_indexed::stor_vector<Vec>(
+                    count, Vec(), source));
+        mesh_indexed::stor_vector<Vec>* s = stor.get();
+        const uint8_t* data = raw.data();
+
+        finish.push_back([=]() {
+            if(prec == mesh_codec::EXACT) {
+                unpack_planes<uint64_t>(count, dims, data,
+                    [s](size_t c, size_t i, uint64_t b) {
+                        double d;
+                        std::memcpy(&d, &b, sizeof(d));
+                        (*s)[i][c] = d;
+                    });
+            } else if(prec == mesh_codec::SINGLE) {
+                unpack_planes<uint32_t>(count, dims, data,
+                    [s](size_t c, size_t i, uint32_t b) {
+                        float f;
+                        std::memcpy(&f, &b, sizeof(f));
+                        (*s)[i][c] = f;
+                    });
+            } else {
+                unpack_planes<uint16_t>(count, dims, data,
+                    [&](size_t c, size_t i, uint16_t q) {
+                        (*s)[i][c] = vmin[c] + q * step[c];
+                    });
+            }
+        });
+
+        return stor;
+    }
+
+    void read_indices(byte_reader& r, mesh_indexed::index_container& indices,
+            size_t stor_size) {
+        uint64_t count = r.varint();
+        buffers.emplace_back();
+        std::vector<uint8_t>& raw = buffers.back();
+        read_stream(r, raw, jobs);
+        // every index takes a byte at least
+        if(count > raw.size())
+            throw parse_error("Bad compressed mesh: index count");
+
+        // allocated here rather than on the worker threads, so that the
+        // arena is not contended
+        indices = mesh_indexed::index_container(count, 0, source);
+        mesh_indexed::index_container* dst = &indices;
+        const uint8_t* data = raw.data();
+        size_t data_size = raw.size();
+
+        finish.push_back([=]() {
+            const uint8_t* p = data;
+            const uint8_t* end = data + data_size;
+            uint64_t prev = 0;
+            for(size_t i = 0; i < count; i++) {
+                uint64_t z;
+                p = varint_decode(p, end, z);
+                prev += unzigzag<uint64_t>(z);
+                if(prev >= stor_size)
+                    throw parse_error("Bad compressed mesh: index out of range");
+                (*dst)[i] = prev;
+            }
+        });
+    }
+
+    void run() {
+        parallel_for(jobs.size(), 1, [this](size_t b, size_t e) {
+            for(size_t i = b; i < e; i++)
+                decode_block(jobs[i].mode, jobs[i].src, jobs[i].src_size,
+                        jobs[i].dst, jobs[i].dst_size);
+        });
+        parallel_for(finish.size(), 1, [this](size_t b, size_t e) {
+            for(size_t i = b; i < e; i++)
+                finish[i]();
+        });
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// attribute access by kind
+
+const mesh_indexed::index_container& indices_of(
+        const mesh_indexed& m, size_t k)
+{
+    switch(k) {
+    case 0: return m.positions.indices;
+    case 1: return m.normals.indices;
+    case 2: return m.uvs.indices;
+    case 3: return m.weights.indices;
+    default: return m.bone_indices.indices;
+    }
+}
+
+mesh_indexed::index_container& indices_of(mesh_indexed& m, size_t k)
+{
+    return const_cast<mesh_indexed::index_container&>(
+            indices_of(static_cast<const mesh_indexed&>(m), k));
+}
+
+const void* stor_of(const mesh_indexed& m, size_t k)
+{
+    switch(k) {
+    case 0: return m.stor_positions.get();
+    case 1: return m.stor_normals.get();
+    case 2: return m.stor_uvs.get();
+    case 3: return m.stor_weights.get();
+    default: return m.stor_bone_indices.get();
+    }
+}
+
+size_t stor_size(const void* stor, size_t k)
+{
+    if(attr_dims[k] == 4)
+        return static_cast<const mesh_indexed::stor_vector<col4>*>(
+                stor)->size();
+    return static_cast<const mesh_indexed::stor_vector<col3>*>(stor)->size();
+}
+
+struct stor_info {
+    size_t kind;
+    const void* ptr;
+    // order: new position -> old one, remap: old position -> new one
+    std::vector<size_t> order;
+    std::vector<size_t> remap;
+};
+
+}
+
+std::vector<uint8_t> mesh_codec::encode(const std::vector<mesh_indexed>& ms,
+        const options& opt)
+{
+    if(opt.prec == QUANTIZED && (opt.quant_bits < 1 || opt.quant_bits > 16))
+        throw restriction_error("Quantization bits must be within 1 to 16");
+
+    // renumber the vertices of every storage in order of first reference,
+    // following the meshes in order, so that indices are nearly increasing
+    std::vector<stor_info> stors;
+    std::map<std::pair<size_t, const void*>, size_t> stor_ids;
+
+    for(const mesh_indexed& m : ms) {
+        for(size_t k = 0; k < attr_kinds; k++) {
+            const void* ptr = stor_of(m, k);
+            if(!ptr) continue;
+
+            auto key = std::make_pair(k, ptr);
+            auto it = stor_ids.find(key);
+            if(it == stor_ids.end()) {
+                it = stor_ids.insert(std::make_pair(key, stors.size())).first;
+                stors.emplace_back();
+                stors.back().kind = k;
+                stors.back().ptr = ptr;
+                stors.back().remap.assign(stor_size(ptr, k), npos);
+                stors.back().order.reserve(stor_size(ptr, k));
+            }
+
+            stor_info& si = stors[it->second];
+            if(si.remap.empty()) continue;
+            for(size_t idx : indices_of(m, k)) {
+                if(idx >= si.remap.size())
+                    throw restriction_error("Mesh index out of range");
+                if(si.remap[idx] == npos) {
+                    si.remap[idx] = si.order.size();
+                    si.order.push_back(idx);
+                }
+            }
+        }
+    }
+
+    for(stor_info& si : stors) {
+        for(size_t old = 0; old < si.remap.size(); old++) {
+            if(si.remap[old] != npos) continue;
+            si.remap[old] = si.order.size();
+            si.order.push_back(old);
+        }
+    }
+
+    std::vector<uint8_t> out;
+    byte_writer w(out);
+    w.bytes(magic, sizeof(magic));
+
+    w.varint(stors.size());
+    for(const stor_info& si : stors) {
+        precision prec = si.kind == bone_indices_kind ? EXACT : opt.prec;
+        w.u8(uint8_t(si.kind));
+        if(attr_dims[si.kind] == 4)
+            encode_storage(w,
+                    *static_cast<const mesh_indexed::stor_vector<col4>*>(si.ptr),
+                    si.order, prec, opt.quant_bits);
+        else
+            encode_storage(w,
+                    *static_cast<const mesh_indexed::stor_vector<col3>*>(si.ptr),
+                    si.order, prec, opt.quant_bits);
+    }
+
+    w.varint(ms.size());
+    for(const mesh_indexed& m : ms) {
+        w.varint(m.name.size());
+        w.bytes(m.name.data(), m.name.size());
+
+        for(size_t k = 0; k < attr_kinds; k++) {
+            const void* ptr = stor_of(m, k);
+            if(!ptr) {
+                w.varint(0);
+                continue;
+            }
+
+            size_t id = stor_ids[std::make_pair(k, ptr)];
+            const std::vector<size_t>& remap = stors[id].remap;
+            // the wavefront loader leaves indices into empty storages for
+            // attributes a file does not have, they are meaningless
+            static const mesh_indexed::index_container no_indices;
+            const mesh_indexed::index_container& indices = remap.empty() ?
+                no_indices : indices_of(m, k);
+
+            std::vector<uint8_t> raw;
+            byte_writer iw(raw);
+            raw.reserve(indices.size() * 2);
+            uint64_t prev = 0;
+            for(size_t idx : indices) {
+                uint64_t cur = remap[idx];
+                iw.varint(zigzag<uint64_t>(cur - prev));
+                prev = cur;
+            }
+
+            w.varint(id + 1);
+            w.varint(indices.size());
+            write_stream(w, raw);
+        }
+    }
+
+    return out;
+}
+
+void mesh_codec::decode_into(const uint8_t* data, size_t size,
+        std::vector<mesh_indexed>& ms, std::shared_ptr<arena> a)
+{
+    byte_reader r(data, size);
+    if(r.remaining() < sizeof(magic) ||
+            std::memcmp(r.skip(sizeof(magic)), magic, sizeof(magic)))
+        throw parse_error("Bad compressed mesh: magic");
+
+    decoder dec;
+    dec.source = std::move(a);
+
+    uint64_t stor_count = r.varint();
+    if(stor_count > r.remaining())
+        throw parse_error("Bad compressed mesh: storage count");
+
+    std::vector<size_t> kinds(stor_count);
+    std::vector<mesh_indexed::stor_ptr<col4>> stors4(stor_count);
+    std::vector<mesh_indexed::stor_ptr<col3>> stors3(stor_count);
+    std::vector<size_t> sizes(stor_count);
+
+    for(size_t i = 0; i < stor_count; i++) {
+        kinds[i] = r.u8();
+        if(kinds[i] >= attr_kinds)
+            throw parse_error("Bad compressed mesh: attribute kind");
+        if(attr_dims[kinds[i]] == 4) {
+            stors4[i] = dec.read_storage<col4>(r);
+            sizes[i] = stors4[i]->size();
+        } else {
+            stors3[i] = dec.read_storage<col3>(r);
+            sizes[i] = stors3[i]->size();
+        }
+    }
+
+    uint64_t mesh_count = r.varint();
+    if(mesh_count > r.remaining())
+        throw parse_error("Bad compressed mesh: mesh count");
+
+    // the queued work holds pointers into these meshes
+    ms.reserve(ms.size() + mesh_count);
+
+    for(size_t i = 0; i < mesh_count; i++) {
+        ms.emplace_back(false);
+        mesh_indexed& m = ms.back();
+
+        uint64_t name_size = r.varint();
+        const uint8_t* name = r.skip(name_size);
+        m.name.assign(name, name + name_size);
+
+        for(size_t k = 0; k < attr_kinds; k++) {
+            uint64_t id = r.varint();
+            if(!id) continue;
+            id--;
+            if(id >= stor_count || kinds[id] != k)
+                throw parse_error("Bad compressed mesh: storage reference");
+
+            switch(k) {
+            case 0: m.stor_positions = stors4[id]; break;
+            case 1: m.stor_normals = stors3[id]; break;
+            case 2: m.stor_uvs = stors3[id]; break;
+            case 3: m.stor_weights = stors4[id]; break;
+            default: m.stor_bone_indices = stors4[id]; break;
+            }
+
+            dec.read_indices(r, indices_of(m, k), sizes[id]);
+        }
+    }
+
+    dec.run();
+}
+
+std::vector<mesh_indexed> mesh_codec::decode(const uint8_t* data, size_t size,
+        std::shared_ptr<arena> a)
+{
+    std::vector<mesh_indexed> ms;
+    decode_into(data, size, ms, std::move(a));
+    return std::move(ms);
+}
+
+void mesh_io_compressed::load_into_meshes(std::istream& is, meshes_type& ms,
+        std::shared_ptr<arena> a)
+{
+    std::vector<uint8_t> buf;
+
+    std::istream::pos_type beg = is.tellg();
+    if(beg != std::istream::pos_type(-1) && is.seekg(0, std::ios::end)) {
+        std::istream::pos_type end = is.tellg();
+        is.seekg(beg);
+        buf.resize(size_t(end - beg));
+        is.read(reinterpret_cast<char*>(buf.data()), buf.size());
+        if(size_t(is.gcount()) != buf.size())
+            throw parse_error("Bad compressed mesh: read failed");
+    } else {
+        is.clear();
+        buf.assign(std::istreambuf_iterator<char>(is),
+                std::istreambuf_iterator<char>());
+    }
+
+    mesh_codec::decode_into(buf.data(), buf.size(), ms, std::move(a));
+}
+
+void mesh_io_compressed::save(std::ostream& os, const meshes_type& ms,
+        const mesh_codec::options& opt)
+{
+    std::vector<uint8_t> data = mesh_codec::encode(ms, opt);
+    os.write(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+}
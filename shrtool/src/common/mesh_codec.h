@@ -0,0 +1,81 @@
+#ifndef MESH_CODEC_H_INCLUDED
+#define MESH_CODEC_H_INCLUDED
+
+#include <vector>
+#include <iostream>
+#include <cstdint>
+
+#include "mesh.h"
+
+namespace shrtool {
+
+/*
+ * mesh_codec packs a group of meshes into a compact binary blob, and back.
+ *
+ * Storages shared between meshes (like the groups of one wavefront file) are
+ * written once. Vertices of each storage are renumbered in the order they are
+ * first referred to, so the index streams become nearly increasing and are
+ * stored as zig-zag varint deltas. Attributes are delta coded per component
+ * and split into byte planes, which puts the mostly-zero high bytes together.
+ * Every stream is finally cut into blocks entropy coded with a table-driven
+ * canonical Huffman code, which decode in parallel.
+ *
+ * Storages are written in full precision by default, which is lossless.
+ * SINGLE rounds attributes to float, the precision they are uploaded in, and
+ * QUANTIZED maps each component linearly onto quant_bits over its range.
+ * Bone indices are always kept exact.
+ */
+struct mesh_codec {
+    enum precision {
+        EXACT,
+        SINGLE,
+        QUANTIZED,
+    };
+
+    struct options {
+        precision prec = EXACT;
+        // 1 to 16, for QUANTIZED only
+        unsigned quant_bits = 16;
+    };
+
+    static std::vector<uint8_t> encode(const std::vector<mesh_indexed>& ms,
+            const options& opt);
+    static std::vector<uint8_t> encode(const std::vector<mesh_indexed>& ms) {
+        return encode(ms, options());
+    }
+    // storages and indices are allocated from a if given
+    static std::vector<mesh_indexed> decode(const uint8_t* data, size_t size,
+            std::shared_ptr<arena> a = nullptr);
+    static void decode_into(const uint8_t* data, size_t size,
+            std::vector<mesh_indexed>& ms, std::shared_ptr<arena> a = nullptr);
+};
+
+struct mesh_io_compressed {
+    typedef mesh_indexed mesh_type;
+    typedef std::vector<mesh_type> meshes_type;
+
+    meshes_type* meshes;
+
+    mesh_io_compressed(meshes_type& ms) : meshes(&ms) { }
+
+    static meshes_type load(std::istream& is,
+            std::shared_ptr<arena> a = nullptr) {
+        meshes_type ms;
+        load_into_meshes(is, ms, std::move(a));
+        return std::move(ms);
+    }
+
+    std::istream& operator()(std::istream& is) {
+        load_into_meshes(is, *meshes);
+        return is;
+    }
+
+    static void load_into_meshes(std::istream& is, meshes_type& ms,
+            std::shared_ptr<arena> a = nullptr);
+    static void save(std::ostream& os, const meshes_type& ms,
+            const mesh_codec::options& opt = mesh_codec::options());
+};
+
+}
+
+#endif // MESH_CODEC_H_INCLUDED
@@ -0,0 +1,261 @@
+#include <algorithm>
+
+#include "page_cache.h"
+#include "image_resample.h"
+
+namespace shrtool {
+
+namespace {
+
+/*
+ * Half of a level, rounded up. An odd edge is repeated first, so that each
+ * texel covers exactly two of the level before it, as pages do, and the
+ * halving is a step of image_resample::mip_chain.
+ */
+float_image half_level(const float_image& f)
+{
+    size_t w = f.width() + f.width() % 2, h = f.height() + f.height() % 2;
+    if(w == f.width() && h == f.height())
+        return image_resample::resize(f, w / 2, h / 2, image_resample::BOX);
+
+    float_image even(w, h);
+    for(size_t y = 0; y < h; y++)
+        for(size_t x = 0; x < w; x++)
+            even.pixel(x, y) = f.pixel(std::min(x, f.width() - 1),
+                    std::min(y, f.height() - 1));
+    return image_resample::resize(even, w / 2, h / 2, image_resample::BOX);
+}
+
+}
+
+page_cache::page_cache(const image& im, size_t page_size,
+        size_t slots_x, size_t slots_y, size_t border) :
+    page_size_(page_size), border_(border),
+    slots_x_(slots_x), slots_y_(slots_y),
+    slots_(slots_x * slots_y)
+{
+    if(!im.width() || !im.height() || !page_size)
+        throw restriction_error("Size of image and pages cannot be zero");
+    // slots are told in a byte of the indirection
+    if(!slots_x || !slots_y || slots_x > 256 || slots_y > 256)
+        throw restriction_error("Slots of the atlas must be 1 to 256 a side");
+
+    // down to a single page, which any atlas holds
+    levels_.push_back(im);
+    if(im.width() > page_size || im.height() > page_size) {
+        float_image f = float_image::from_image(im.view());
+        while(f.width() > page_size || f.height() > page_size) {
+            f = half_level(f);
+            levels_.push_back(f.to_image());
+        }
+    }
+
+    indirection_.assign(pages_x(0) * pages_y(0), color(0, 0, 0, 0));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// requests
+
+void page_cache::request_(page_id p)
+{
+    // coarser pages are wanted as well, stop where they already are
+    for(; p.level < levels(); p.level++, p.x /= 2, p.y /= 2)
+        if(!wanted_.insert(key_(p)).second) break;
+}
+
+void page_cache::request(const page_id& p)
+{
+    if(!valid_(p))
+        throw restriction_error("Page out of range");
+    request_(p);
+}
+
+void page_cache::request_area(float u0, float v0, float u1, float v1,
+        size_t level)
+{
+    size_t l = std::min(level, levels() - 1);
+    size_t w = levels_[l].width(), h = levels_[l].height();
+
+    auto texel = [](float u, size_t n) {
+        u = u < 0 ? 0 : u > 1 ? 1 : u;
+        return std::min<size_t>(size_t(u * n), n - 1);
+    };
+
+    size_t x0 = texel(std::min(u0, u1), w), x1 = texel(std::max(u0, u1), w);
+    size_t y0 = texel(std::min(v0, v1), h), y1 = texel(std::max(v0, v1), h);
+
+    for(size_t y = y0 / page_size_; y <= y1 / page_size_; y++)
+        for(size_t x = x0 / page_size_; x <= x1 / page_size_; x++)
+            request_(page_id(l, x, y));
+}
+
+void page_cache::request_feedback(const color* fb, size_t n)
+{
+    // neighbouring pixels are mostly of the same page
+    uint32_t last = 0;
+
+    for(size_t i = 0; i < n; i++) {
+        const color& c = fb[i];
+        if(c.data.bytes[3] != 0xff || c.data.rgba == last) continue;
+        last = c.data.rgba;
+
+        page_id p(c.data.bytes[2], c.data.bytes[0], c.data.bytes[1]);
+        if(valid_(p)) request_(p);
+    }
+}
+
+color page_cache::feedback_color(const page_id& p)
+{
+    if(p.x > 0xff || p.y > 0xff || p.level > 0xff)
+        throw restriction_error("Page cannot be told in feedback");
+    return color(p.x, p.y, p.level, 0xff);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// residency
+
+size_t page_cache::find_slot_() const
+{
+    if(used_slots_ < slots_.size())
+        return used_slots_;
+
+    // least recently wanted, of those not wanted in this frame
+    size_t found = size_t(-1);
+    for(size_t i = 0; i < slots_.size(); i++) {
+        const slot& s = slots_[i];
+        if(s.pinned || s.last_used >= frame_) continue;
+        if(found == size_t(-1) || s.last_used < slots_[found].last_used)
+            found = i;
+    }
+
+    return found;
+}
+
+std::vector<page_cache::placement> page_cache::update(size_t max_loads)
+{
+    frame_++;
+
+    size_t top = levels() - 1;
+    for(size_t y = 0; y < pages_y(top); y++)
+        for(size_t x = 0; x < pages_x(top); x++)
+            wanted_.insert(key_(page_id(top, x, y)));
+
+    std::vector<page_id> missing;
+    for(uint64_t k : wanted_) {
+        auto i = resident_.find(k);
+        if(i != resident_.end())
+            slots_[i->second].last_used = frame_;
+        else
+            missing.push_back(page_(k));
+    }
+    wanted_.clear();
+
+    // coarse pages first, which stand in for the finer ones missing
+    std::sort(missing.begin(), missing.end(),
+            [](const page_id& a, const page_id& b) {
+                if(a.level != b.level) return a.level > b.level;
+                if(a.y != b.y) return a.y < b.y;
+                return a.x < b.x;
+            });
+
+    std::vector<placement> placed;
+    std::vector<page_id> changed;
+
+    for(const page_id& p : missing) {
+        if(placed.size() >= max_loads) break;
+
+        size_t i = find_slot_();
+        if(i == size_t(-1)) break;
+
+        slot& s = slots_[i];
+        if(i < used_slots_) {
+            resident_.erase(s.key);
+            changed.push_back(page_(s.key));
+        } else {
+            used_slots_++;
+        }
+
+        s.key = key_(p);
+        s.last_used = frame_;
+        s.pinned = p.level == top;
+        resident_[s.key] = i;
+
+        changed.push_back(p);
+        placed.push_back(placement { p, i % slots_x_, i / slots_x_ });
+    }
+
+    for(const page_id& p : changed)
+        refresh_cells_(p);
+
+    return placed;
+}
+
+bool page_cache::resident(const page_id& p) const
+{
+    return resident_.count(key_(p)) > 0;
+}
+
+void page_cache::refresh_cells_(const page_id& p)
+{
+    size_t w = pages_x(0), h = pages_y(0);
+    size_t x0 = p.x << p.level, y0 = p.y << p.level;
+    size_t x1 = std::min(w, (p.x + 1) << p.level);
+    size_t y1 = std::min(h, (p.y + 1) << p.level);
+
+    for(size_t y = y0; y < y1; y++)
+    for(size_t x = x0; x < x1; x++) {
+        color c(0, 0, 0, 0);
+        for(size_t l = 0; l < levels(); l++) {
+            auto i = resident_.find(key_(page_id(l, x >> l, y >> l)));
+            if(i == resident_.end()) continue;
+            c = color(i->second % slots_x_, i->second / slots_x_, l, 0xff);
+            break;
+        }
+        indirection_[y * w + x] = c;
+    }
+
+    if(dirty_top_ >= dirty_bottom_) {
+        dirty_top_ = y0;
+        dirty_bottom_ = y1;
+    } else {
+        dirty_top_ = std::min(dirty_top_, y0);
+        dirty_bottom_ = std::max(dirty_bottom_, y1);
+    }
+}
+
+std::pair<size_t, size_t> page_cache::take_dirty_rows()
+{
+    std::pair<size_t, size_t> rows(dirty_top_, dirty_bottom_);
+    dirty_top_ = dirty_bottom_ = 0;
+    return rows;
+}
+
+void page_cache::copy_page(const page_id& p, const image_view& dst) const
+{
+    if(!valid_(p))
+        throw restriction_error("Page out of range");
+    size_t n = slot_size();
+    if(dst.width() != n || dst.height() != n)
+        throw restriction_error("Size of views mismatch");
+
+    const_image_view src = levels_[p.level].view();
+    auto clamp = [](long v, size_t e) {
+        return v < 0 ? 0 : std::min<size_t>(v, e - 1);
+    };
+
+    long x0 = long(p.x * page_size_) - long(border_);
+    long y0 = long(p.y * page_size_) - long(border_);
+
+    std::vector<size_t> cols(n);
+    for(size_t i = 0; i < n; i++)
+        cols[i] = clamp(x0 + long(i), src.width());
+
+    for(size_t j = 0; j < n; j++) {
+        const color* s = src.row(clamp(y0 + long(j), src.height()));
+        color* d = dst.row(j);
+        for(size_t i = 0; i < n; i++)
+            d[i] = s[cols[i]];
+    }
+}
+
+}
@@ -0,0 +1,153 @@
+#ifndef PAGE_CACHE_H_INCLUDED
+#define PAGE_CACHE_H_INCLUDED
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "image.h"
+
+namespace shrtool {
+
+/*
+ * page_cache decides which pages of a large image are resident, without any
+ * display driver, so that it can be driven by a feedback stream made up on
+ * the CPU.
+ *
+ * The image and a mip pyramid of it are split into pages of page_size
+ * texels. Each frame, the pages seen are requested, by the feedback of a
+ * pass or by an estimate of the area in view, and update places those
+ * missing into the slots of a physical atlas, coarse levels first, evicting
+ * the pages least recently requested. The coarsest level is always resident
+ * so that every part of the image has something to show.
+ *
+ * The indirection table has a texel for each page of level 0, telling the
+ * slot and level of the finest resident page covering it, as
+ * (slot x, slot y, level, 255), or nothing if alpha is 0.
+ */
+class page_cache {
+public:
+    struct page_id {
+        size_t level = 0;
+        size_t x = 0;
+        size_t y = 0;
+
+        page_id() { }
+        page_id(size_t l, size_t px, size_t py) : level(l), x(px), y(py) { }
+
+        bool operator==(const page_id& p) const {
+            return level == p.level && x == p.x && y == p.y;
+        }
+    };
+
+    struct placement {
+        page_id page;
+        size_t slot_x;
+        size_t slot_y;
+    };
+
+    /*
+     * Levels are halved, rounded up, while larger than a page, so the
+     * coarsest one is a single page. Pages are stored in slots of slot_size texels, with a border of
+     * texels of their neighbours around them for filtering.
+     */
+    page_cache(const image& im, size_t page_size,
+            size_t slots_x, size_t slots_y, size_t border = 1);
+
+    size_t page_size() const { return page_size_; }
+    size_t border() const { return border_; }
+    size_t slot_size() const { return page_size_ + border_ * 2; }
+    size_t slots_x() const { return slots_x_; }
+    size_t slots_y() const { return slots_y_; }
+
+    size_t levels() const { return levels_.size(); }
+    const image& level(size_t l) const { return levels_.at(l); }
+    size_t pages_x(size_t l) const {
+        return (levels_.at(l).width() + page_size_ - 1) / page_size_;
+    }
+    size_t pages_y(size_t l) const {
+        return (levels_.at(l).height() + page_size_ - 1) / page_size_;
+    }
+
+    // the page and those coarser covering it are wanted in this frame
+    void request(const page_id& p);
+    // pages of a level covering a rect of texture coordinates
+    void request_area(float u0, float v0, float u1, float v1, size_t level);
+    /*
+     * Pixels of a feedback pass, each of a page seen encoded as
+     * feedback_color. Pixels of other values are ignored.
+     */
+    void request_feedback(const color* fb, size_t n);
+
+    // (x, y, level, 255), at most 256 pages a side
+    static color feedback_color(const page_id& p);
+
+    /*
+     * Places up to max_loads pages wanted since the last update, each in a
+     * slot of which the page is to be uploaded by the caller, and updates
+     * the indirection table. No page wanted in this frame is evicted.
+     */
+    std::vector<placement> update(size_t max_loads);
+
+    bool resident(const page_id& p) const;
+    size_t resident_pages() const { return resident_.size(); }
+    size_t frame() const { return frame_; }
+
+    // the texels of a slot, of which the edges are clamped to the level
+    void copy_page(const page_id& p, const image_view& dst) const;
+
+    size_t indirection_width() const { return pages_x(0); }
+    size_t indirection_height() const { return pages_y(0); }
+    const color* indirection() const { return indirection_.data(); }
+
+    /*
+     * Rows [first, second) of the indirection changed since this was last
+     * called, which are to be uploaded.
+     */
+    std::pair<size_t, size_t> take_dirty_rows();
+
+private:
+    struct slot {
+        uint64_t key = 0;
+        size_t last_used = 0;
+        bool pinned = false;
+    };
+
+    uint64_t key_(const page_id& p) const {
+        return uint64_t(p.level) << 48 | uint64_t(p.y) << 24 | p.x;
+    }
+    page_id page_(uint64_t k) const {
+        return page_id(k >> 48, k & 0xffffff, (k >> 24) & 0xffffff);
+    }
+    bool valid_(const page_id& p) const {
+        return p.level < levels() &&
+            p.x < pages_x(p.level) && p.y < pages_y(p.level);
+    }
+
+    void request_(page_id p);
+    size_t find_slot_() const;
+    // the cells of level 0 covered by the page, in the indirection
+    void refresh_cells_(const page_id& p);
+
+    size_t page_size_;
+    size_t border_;
+    size_t slots_x_;
+    size_t slots_y_;
+    std::vector<image> levels_;
+
+    std::vector<slot> slots_;
+    size_t used_slots_ = 0;
+    std::unordered_map<uint64_t, size_t> resident_;
+    std::unordered_set<uint64_t> wanted_;
+    size_t frame_ = 0;
+
+    std::vector<color> indirection_;
+    size_t dirty_top_ = 0;
+    size_t dirty_bottom_ = 0;
+};
+
+}
+
+#endif // PAGE_CACHE_H_INCLUDED
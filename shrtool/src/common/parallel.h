@@ -0,0 +1,62 @@
+#ifndef PARALLEL_H_INCLUDED
+#define PARALLEL_H_INCLUDED
+
+#include <thread>
+#include <vector>
+#include <exception>
+#include <algorithm>
+
+namespace shrtool {
+
+inline size_t hardware_concurrency()
+{
+    size_t n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+/*
+ * parallel_for splits [0, n) into contiguous chunks of at least `grain`
+ * elements and calls f(begin, end) for each of them on its own thread. The
+ * calling thread takes the first chunk itself, so a range smaller than two
+ * grains never spawns a thread at all. An exception thrown by any chunk is
+ * rethrown here after all the threads have joined.
+ */
+template<typename Func>
+void parallel_for(size_t n, size_t grain, Func f)
+{
+    if(!n) return;
+    if(!grain) grain = 1;
+
+    size_t chunks = std::min(hardware_concurrency(), (n + grain - 1) / grain);
+    if(chunks <= 1) {
+        f(size_t(0), n);
+        return;
+    }
+
+    size_t per_chunk = (n + chunks - 1) / chunks;
+    std::vector<std::thread> workers;
+    std::vector<std::exception_ptr> errors(chunks);
+
+    for(size_t c = 1; c < chunks; c++) {
+        size_t b = c * per_chunk, e = std::min(n, b + per_chunk);
+        if(b >= e) break;
+
+        workers.emplace_back([&f, &errors, b, e, c]() {
+            try { f(b, e); }
+            catch(...) { errors[c] = std::current_exception(); }
+        });
+    }
+
+    try { f(size_t(0), std::min(n, per_chunk)); }
+    catch(...) { errors[0] = std::current_exception(); }
+
+    for(std::thread& t : workers)
+        t.join();
+
+    for(std::exception_ptr& e : errors)
+        if(e) std::rethrow_exception(e);
+}
+
+}
+
+#endif // PARALLEL_H_INCLUDED
@@ -26,6 +26,17 @@ struct instance;
 struct meta {
     friend struct meta_manager;
 
+    /*
+     * The functions enable_serialize registers by name, as plain pointers
+     * taking the address of the object, for those laying out many objects
+     * over and over without a call by name for each.
+     */
+    struct serializer {
+        size_t (*size)(const void*) = nullptr;
+        size_t (*align)(const void*) = nullptr;
+        void (*copy)(const void*, void*) = nullptr;
+    };
+
 protected:
     typedef std::function<instance(instance*[], size_t n)> fun_type;
 
@@ -33,14 +44,20 @@ protected:
     const std::type_info& type_info;
     std::map<std::string, fun_type> functions;
     const meta* base_meta_ = nullptr;
+    serializer serializer_;
 
 public:
     const meta* get_base() const { return base_meta_; }
 
+    // null unless the type is serializable
+    const serializer* get_serializer() const {
+        return serializer_.copy ? &serializer_ : nullptr;
+    }
+
     meta(std::string n, const std::type_info& ti) :
         name_(std::move(n)), type_info(ti) { }
     meta(meta&& m) : name_(std::move(m.name_)), type_info(m.type_info),
-        functions(std::move(m.functions)) { }
+        functions(std::move(m.functions)), serializer_(m.serializer_) { }
     meta(const meta& m) = delete; // no copy is permitted
 
     instance apply(const std::string& name, instance* i[], size_t n) const;
@@ -185,6 +202,10 @@ struct typed_meta : meta {
         function("__align", &item_trait_adapter<T, size_t, size_t>::align);
         function("__raw_into", &item_trait_adapter<T, size_t, size_t>::copy);
         function("__glsl_type_name", &item_trait_adapter<T, size_t, size_t>::glsl_type_name);
+
+        serializer_.size = &serialize_size_<Enable>;
+        serializer_.align = &serialize_align_<Enable>;
+        serializer_.copy = &serialize_copy_<Enable>;
         return *this;
     }
 
@@ -223,6 +244,24 @@ private:
         return a == b;
     }
 
+    template<bool Enable = true>
+    static size_t serialize_size_(const void* o) {
+        return item_trait_adapter<T, size_t, size_t>::size(
+                *static_cast<const T*>(o));
+    }
+
+    template<bool Enable = true>
+    static size_t serialize_align_(const void* o) {
+        return item_trait_adapter<T, size_t, size_t>::align(
+                *static_cast<const T*>(o));
+    }
+
+    template<bool Enable = true>
+    static void serialize_copy_(const void* o, void* buf) {
+        item_trait_adapter<T, size_t, size_t>::copy(
+                *static_cast<const T*>(o), buf);
+    }
+
     template<bool Enable = true>
     static std::string print_(const T& o) {
         std::stringstream ss;
@@ -325,6 +364,15 @@ struct meta_manager : generic_singleton<meta_manager> {
         reg_class<math::dxmat>("matrix")
             .enable_clone()
             .enable_serialize();
+        reg_class<std::vector<int>>("int-array")
+            .enable_clone()
+            .enable_serialize();
+        reg_class<std::vector<float>>("float-array")
+            .enable_clone()
+            .enable_serialize();
+        reg_class<std::vector<math::fxmat>>("fmatrix-array")
+            .enable_clone()
+            .enable_serialize();
 
         enable_cast<int, size_t>();
         enable_cast<int, float>();
@@ -378,6 +426,7 @@ typed_meta<T>& typed_meta<T>::enable_base()
 
 struct instance_stor {
     virtual ~instance_stor() { }
+    virtual const void* address() const = 0;
 };
 
 template<typename T>
@@ -388,6 +437,7 @@ struct typed_instance_stor : instance_stor {
     typed_instance_stor(const T& rhs) : data(rhs) { }
 
     virtual ~typed_instance_stor() { }
+    virtual const void* address() const override { return &data; }
 
     T data { };
 };
@@ -437,6 +487,12 @@ struct instance {
     instance& operator=(const instance& i) = delete;
 
     bool is_null() const { return !stor.get(); }
+
+    /*
+     * Of the object held, which stays where it is as long as the instance
+     * holds it. For a pointer, that of the pointer.
+     */
+    const void* address() const { return stor ? stor->address() : nullptr; }
     bool is_pointer() const { return m->is_same<void*>(); }
 
     const meta& get_meta() const { return *m; }
@@ -0,0 +1,42 @@
+#include "thread_pool.h"
+
+namespace shrtool {
+
+thread_pool::thread_pool(size_t threads)
+{
+    if(!threads) threads = 1;
+    for(size_t i = 0; i < threads; i++)
+        workers_.emplace_back([this]() { run_(); });
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+
+    for(std::thread& t : workers_)
+        t.join();
+}
+
+void thread_pool::run_()
+{
+    for(;;) {
+        std::function<void()> task;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+            if(tasks_.empty()) return;
+
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+
+        task();
+    }
+}
+
+}
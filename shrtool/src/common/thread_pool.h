@@ -0,0 +1,62 @@
+#ifndef THREAD_POOL_H_INCLUDED
+#define THREAD_POOL_H_INCLUDED
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <vector>
+
+#include "parallel.h"
+
+namespace shrtool {
+
+/*
+ * thread_pool runs tasks on a fixed set of threads, in the order they are
+ * submitted, and hands back their results as futures, exceptions included.
+ * Tasks still queued when the pool goes away are run before it returns.
+ */
+class thread_pool {
+public:
+    explicit thread_pool(size_t threads = hardware_concurrency());
+    ~thread_pool();
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    size_t size() const { return workers_.size(); }
+
+    template<typename Func>
+    auto submit(Func f) -> std::future<decltype(f())> {
+        typedef decltype(f()) result_type;
+
+        // std::function is to be copyable, which a packaged_task is not
+        auto task = std::make_shared<std::packaged_task<result_type()>>(
+                std::move(f));
+        std::future<result_type> res = task->get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace_back([task]() { (*task)(); });
+        }
+        cv_.notify_one();
+
+        return res;
+    }
+
+private:
+    void run_();
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+};
+
+}
+
+#endif // THREAD_POOL_H_INCLUDED
@@ -2,7 +2,10 @@
 #define RES_TRAIT_INCLUDED
 
 #include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
+#include <array>
 
 namespace shrtool {
 
@@ -95,6 +98,70 @@ struct item_trait_adapter<T,
     }
 };
 
+/*
+ * Arrays are laid out as std140 does, for the uniform blocks they are defined
+ * in: each element is apart from the next by its size rounded up to its
+ * align, and then to 16 bytes, which the array is aligned to as well.
+ */
+template<typename T, size_t N>
+struct item_trait<std::array<T, N>>
+{
+    typedef uint8_t value_type;
+    static constexpr size_t align() {
+        return (item_trait<T>::align() + 15) / 16 * 16;
+    }
+    static constexpr size_t stride() {
+        return (item_trait<T>::size() + align() - 1) / align() * align();
+    }
+    static constexpr size_t size() {
+        return N * stride();
+    }
+
+    static void copy(const std::array<T, N>& a, value_type* buf) {
+        for(size_t i = 0; i < N; i++)
+            item_trait<T>::copy(a[i], reinterpret_cast<
+                typename item_trait<T>::value_type*>(buf + i * stride()));
+    }
+
+    static std::string glsl_type_name() {
+        return std::string(item_trait<T>::glsl_type_name()) +
+            "[" + std::to_string(N) + "]";
+    }
+};
+
+/*
+ * An unsized array, the last member of a storage block. Elements are all of
+ * the shape of the first one.
+ */
+template<typename T>
+struct item_trait<std::vector<T>>
+{
+    typedef uint8_t value_type;
+    typedef item_trait_adapter<T, size_t, size_t> elem_trait;
+
+    static size_t stride(const std::vector<T>& v) {
+        if(v.empty()) return 0;
+        size_t a = elem_trait::align(v[0]);
+        return (elem_trait::size(v[0]) + a - 1) / a * a;
+    }
+    static size_t size(const std::vector<T>& v) {
+        return v.size() * stride(v);
+    }
+    static size_t align(const std::vector<T>& v) {
+        return v.empty() ? sizeof(float) : elem_trait::align(v[0]);
+    }
+
+    static void copy(const std::vector<T>& v, value_type* buf) {
+        size_t s = stride(v);
+        for(size_t i = 0; i < v.size(); i++)
+            elem_trait::copy(v[i], buf + i * s);
+    }
+
+    static std::string glsl_type_name(const std::vector<T>& v) {
+        return elem_trait::glsl_type_name(v.empty() ? T() : v[0]) + "[]";
+    }
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 
 struct raw_data_tag { };
@@ -146,6 +213,9 @@ struct prop_trait {
      * For indirect
      */
     // static void copy(const input_type& i, value_type* o);
+    /* optional, so that only the bytes changed are written */
+    // static byte_ranges dirty_ranges(const input_type& i);
+    // static void copy_changed(const input_type& i, value_type* o);
 };
 
 template<typename InputType, typename Enable = void>
@@ -170,6 +240,19 @@ struct texture2d_trait {
     //}
 };
 
+template<typename InputType, typename Enable = void>
+struct cubemap_trait {
+    //typedef InputType input_type;
+
+    //static size_t edge(const input_type& i);
+    //static size_t format(const input_type& i);
+
+    /*
+     * POS_X, NEG_X, POS_Y, NEG_Y, POS_Z, NEG_Z
+     */
+    //static std::array<pixel_view, 6> faces(const input_type& i);
+};
+
 template<typename InputType, typename Enable = void>
 struct shader_trait {
     //typedef InputType input_type;
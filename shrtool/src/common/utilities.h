@@ -81,6 +81,39 @@ enum color_format : size_t {
     RG_F32,
     RGB_F32,
     RGBA_F32,
+    // of the same values as texture::format, which has a depth format between
+    R_U8 = 134,
+    RG_U88,
+    R_F16,
+    RG_F16,
+    RGBA_F16,
+    // packed floats of 11, 11 and 10 bits, no sign
+    RGB_F111110,
+
+    // compressed in blocks of 4x4 pixels
+    BC1_RGBA = 192,
+    BC3_RGBA,
+    BC4_R,
+    BC5_RG,
+};
+
+/*
+ * Pixels of a rect laid in a larger image, as the unpacking state of the
+ * display driver describes them: rows are row_length pixels apart, and the
+ * rect begins skip_rows rows and skip_pixels pixels after data. A zero
+ * row_length means the rows are tightly packed.
+ */
+struct pixel_view {
+    const void* data = nullptr;
+    size_t row_length = 0;
+    size_t skip_pixels = 0;
+    size_t skip_rows = 0;
+
+    pixel_view() { }
+    pixel_view(const void* d, size_t rl = 0, size_t sp = 0, size_t sr = 0) :
+        data(d), row_length(rl), skip_pixels(sp), skip_rows(sr) { }
+
+    bool packed() const { return !row_length && !skip_pixels && !skip_rows; }
 };
 
 struct color {
@@ -2,6 +2,7 @@
 #define UTILS_H_INCLUDED
 
 #include <type_traits>
+#include <cstdint>
 #include <algorithm>
 #include <sstream>
 #include <vector>
@@ -13,6 +14,58 @@
 
 namespace shrtool {
 
+/*
+ * Byte ranges of a property changed since it was last applied, so that only
+ * those are uploaded. They are kept sorted, and merged as they are added with
+ * those less than merge_gap bytes apart: a write for each of many scattered
+ * floats costs more than the bytes between them.
+ */
+class byte_ranges {
+public:
+    typedef std::pair<size_t, size_t> range; // [first, second)
+    static constexpr size_t merge_gap = 64;
+
+    void add(size_t b, size_t e) {
+        if(all_ || b >= e) return;
+
+        auto i = std::lower_bound(ranges_.begin(), ranges_.end(), b,
+                [](const range& r, size_t v) { return r.second + merge_gap < v; });
+        auto j = i;
+        for(; j != ranges_.end() && j->first <= e + merge_gap; ++j) {
+            b = std::min(b, j->first);
+            e = std::max(e, j->second);
+        }
+
+        i = ranges_.erase(i, j);
+        ranges_.insert(i, range(b, e));
+    }
+
+    void add_all() {
+        all_ = true;
+        ranges_.clear();
+    }
+
+    void clear() {
+        all_ = false;
+        ranges_.clear();
+    }
+
+    // the whole property, of which no range is told
+    bool all() const { return all_; }
+    bool empty() const { return !all_ && ranges_.empty(); }
+    const std::vector<range>& ranges() const { return ranges_; }
+
+    size_t bytes() const {
+        size_t n = 0;
+        for(const range& r : ranges_) n += r.second - r.first;
+        return n;
+    }
+
+private:
+    std::vector<range> ranges_;
+    bool all_ = false;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // universal_property
 
@@ -44,16 +97,26 @@ struct universal_property : universal_property<Args...>
     static constexpr size_t count = parent_type::count + 1;
 
     universal_property& operator!() {
-        parent_type::changed_ = true;
+        parent_type::changed_items_ = ~uint64_t(0);
         return *this;
     }
+
+    // the items of this property are those told, not only those of the parent
+    byte_ranges dirty_ranges() const {
+        return property_dirty_ranges(*this);
+    }
 };
 
 template<typename T>
 struct universal_property<T>
 {
 protected:
-    bool changed_;
+    /*
+     * A bit for each item, set as it is changed: the item with n items after
+     * it, itself included, has the bit n - 1, which is the same for whichever
+     * of the nested properties it is taken as an item of.
+     */
+    uint64_t changed_items_ = ~uint64_t(0);
 
 public:
     typedef void parent_type;
@@ -72,17 +135,33 @@ public:
     value_type data;
     static constexpr size_t count = 1;
 
-    universal_property operator!() {
-        changed_ = true;
+    universal_property& operator!() {
+        changed_items_ = ~uint64_t(0);
         return *this;
     }
 
+    void mark_item_changed(size_t bit) {
+        changed_items_ |= uint64_t(1) << bit;
+    }
+
+    bool item_changed(size_t bit) const {
+        return (changed_items_ >> bit) & 1;
+    }
+
+    uint64_t changed_items() const {
+        return changed_items_;
+    }
+
     void mark_applied() {
-        changed_ = false;
+        changed_items_ = 0;
     }
 
     bool is_changed() const {
-        return changed_;
+        return changed_items_ != 0;
+    }
+
+    byte_ranges dirty_ranges() const {
+        return property_dirty_ranges(*this);
     }
 };
 
@@ -165,6 +244,18 @@ constexpr size_t property_size(const UniProp&)
         universal_property_item<UniProp::count - 1, UniProp>::trait::size();
 }
 
+/*
+ * "vec4[]" and "lights" make "vec4 lights[]", the way arrays are declared
+ */
+inline std::string glsl_member_definition__(
+        const std::string& type, const std::string& name)
+{
+    size_t b = type.find('[');
+    if(b == std::string::npos)
+        return type + " " + name;
+    return type.substr(0, b) + " " + name + type.substr(b);
+}
+
 template<typename UniProp>
 std::string item_list_definition__() { return ""; }
 
@@ -172,9 +263,9 @@ template<typename UniProp, typename ...Args>
 std::string item_list_definition__(
         std::string head, Args ...names)
 {
-    return std::string("    ") +
-        universal_property_item<0, UniProp>::trait::glsl_type_name() +
-        " " + head + ";\n" +
+    return "    " + glsl_member_definition__(
+            universal_property_item<0, UniProp>::trait::glsl_type_name(),
+            head) + ";\n" +
         item_list_definition__<typename UniProp::parent_type>(names...);
 }
 
@@ -198,6 +289,71 @@ constexpr size_t item_offset() {
     return item_offset__<I, StartAt, UniProp>::value;
 }
 
+/*
+ * Like item_get, but the item is marked changed, so that it alone is
+ * uploaded without marking the whole property.
+ */
+template<size_t I, typename ...Args>
+typename universal_property_item<
+    I, universal_property<Args...>>::value_type &
+item_modify(universal_property<Args...>& up)
+{
+    typedef universal_property<Args...> up_t;
+    typedef typename universal_property_item<I, up_t>::prop_type tail;
+    static_assert(I < up_t::count, "Item out of range");
+    static_assert(up_t::count <= 64, "Changes of items are told in 64 bits");
+
+    up.mark_item_changed(tail::count - 1);
+    return static_cast<tail&>(up).data;
+}
+
+template<size_t I, typename ...Args, typename V>
+void item_set(universal_property<Args...>& up, V&& v)
+{
+    item_modify<I>(up) = std::forward<V>(v);
+}
+
+template<size_t I, typename ...Args>
+bool item_changed(const universal_property<Args...>& up)
+{
+    typedef typename universal_property_item<
+        I, universal_property<Args...>>::prop_type tail;
+    return up.item_changed(tail::count - 1);
+}
+
+template<typename UniProp>
+void item_ranges__(const void*, byte_ranges&) { }
+
+template<typename UniProp, typename Tail>
+void item_ranges__(const Tail* t, byte_ranges& r)
+{
+    constexpr size_t I = UniProp::count - Tail::count;
+    typedef item_trait<typename Tail::value_type> trait;
+
+    if(t->item_changed(Tail::count - 1)) {
+        size_t off = item_offset<I, UniProp>();
+        r.add(off, off + trait::size());
+    }
+    item_ranges__<UniProp>(
+            static_cast<const typename Tail::parent_type*>(t), r);
+}
+
+// the bytes of the items changed since applied
+template<typename ...Args>
+byte_ranges property_dirty_ranges(const universal_property<Args...>& up)
+{
+    typedef universal_property<Args...> up_t;
+    byte_ranges r;
+
+    uint64_t all = up_t::count < 64 ?
+        (uint64_t(1) << up_t::count) - 1 : ~uint64_t(0);
+    if((up.changed_items() & all) == all)
+        r.add_all();
+    else
+        item_ranges__<up_t>(&up, r);
+    return r;
+}
+
 
 template<typename ...Args>
 struct prop_trait<universal_property<Args...>> {
@@ -207,17 +363,19 @@ struct prop_trait<universal_property<Args...>> {
 
 private:
     template<size_t OrgI>
-    static void copy__(const void* up, uint8_t* o) { /* do nothing */ }
+    static void copy__(const void* up, uint8_t* o, bool) { /* do nothing */ }
 
     template<size_t OrgI, typename UniProp>
-    static void copy__(const UniProp* up, uint8_t* o) {
+    static void copy__(const UniProp* up, uint8_t* o, bool changed_only = false) {
         typedef item_trait<typename UniProp::value_type> trait;
         uint8_t* off_o = o + item_offset<OrgI, input_type>();
 
-        trait::copy(up->data,
-            reinterpret_cast<typename trait::value_type*>(off_o));
+        if(!changed_only || up->item_changed(UniProp::count - 1))
+            trait::copy(up->data,
+                reinterpret_cast<typename trait::value_type*>(off_o));
 
-        copy__<OrgI + 1>((const typename UniProp::parent_type*)up, o);
+        copy__<OrgI + 1>((const typename UniProp::parent_type*)up, o,
+                changed_only);
     }
 
 public:
@@ -229,10 +387,19 @@ public:
         copy__<0, input_type>(&i, o);
     }
 
+    // the items changed, at their offsets, the others are left as they are
+    static void copy_changed(const input_type& i, uint8_t* o) {
+        copy__<0, input_type>(&i, o, true);
+    }
+
     static bool is_changed(const input_type& i) {
         return i.is_changed();
     }
 
+    static byte_ranges dirty_ranges(const input_type& i) {
+        return i.dirty_ranges();
+    }
+
     static void mark_applied(input_type& i) {
         i.mark_applied();
     }
@@ -252,12 +419,20 @@ struct dynamic_property {
     }
     dynamic_property(dynamic_property&& dp) :
             storage(std::move(dp.storage)),
-            offsets_(std::move(dp.offsets_)) {
+            offsets_(std::move(dp.offsets_)),
+            ends_(std::move(dp.ends_)),
+            plan_(std::move(dp.plan_)),
+            size_in_bytes_(dp.size_in_bytes_),
+            dirty_(std::move(dp.dirty_)),
+            dirty_items_(std::move(dp.dirty_items_)) {
         std::swap(is_changed_, dp.is_changed_);
         std::swap(offset_changed_, dp.offset_changed_);
     }
 
+    // instances may be replaced through it, the layout is made again
     std::vector<refl::instance>& underlying() {
+        offset_changed_ = true;
+        operator!();
         return storage;
     }
 
@@ -305,7 +480,7 @@ struct dynamic_property {
             throw restriction_error("Not serializable.");
 
         offset_changed_ = true;
-        is_changed_ = true;
+        touch(idx);
     }
 
     void set_instance(size_t idx, refl::instance&& ins) {
@@ -314,39 +489,43 @@ struct dynamic_property {
         storage.at(idx) = std::move(ins);
 
         offset_changed_ = true;
+        touch(idx);
+    }
+
+    // the item is changed in place, as through get
+    void touch(size_t idx) {
+        if(idx >= storage.size())
+            throw restriction_error("Index out of range");
+        dirty_items_.push_back(idx);
         is_changed_ = true;
     }
 
     std::string definition(const std::string& name,
             const std::vector<std::string>& l) const {
-        int i = 0;
-        std::string def = "uniform " + name + " {\n";
-        for(const std::string& s : l) {
-            if(storage[i].is_null()) {
-                i += 1; continue;
-            }
+        return definition_("uniform " + name, l);
+    }
 
-            def += "    ";
-            def += storage[i].call("__glsl_type_name").get<std::string>();
-            def += " " + s + ";\n";
-            i += 1;
-        }
-        def += "};";
+    std::string definition(const std::string& name) const {
+        return definition(name, default_names_());
+    }
 
-        return def;
+    /*
+     * As a shader storage block, of std430, which may end with an array
+     * unsized in GLSL. An array grown or shrunk is to be set again, for the
+     * layout to follow.
+     */
+    std::string storage_definition(const std::string& name,
+            const std::vector<std::string>& l) const {
+        return definition_("layout (std430) buffer " + name, l);
     }
 
-    std::string definition(const std::string& name) const {
-        std::vector<std::string> items(size(), "items_");
-        for(size_t i = 0; i < size(); i++)
-            items[i] += std::to_string(i);
-        return definition(name, items);
+    std::string storage_definition(const std::string& name) const {
+        return storage_definition(name, default_names_());
     }
 
     size_t size_in_bytes() const {
-        update_offsets_();
-        return offsets_.back() +
-            storage.back().call("__size").get<size_t>();
+        check_layout_();
+        return size_in_bytes_;
     }
 
     size_t size() const {
@@ -354,19 +533,47 @@ struct dynamic_property {
     }
 
     void copy(uint8_t* buf) const {
-        update_offsets_();
-        uint8_t* off = buf;
-        for(size_t i = 0; i < storage.size(); i++) {
-            off = buf + offsets_[i];
-            storage[i].call("__raw_into", refl::instance::make((void*)off));
+        check_layout_();
+        for(const pack_item& p : plan_)
+            p.copy(p.object, buf + p.offset);
+    }
+
+    // copies only the items in the dirty ranges, over those copied before
+    void copy_changed(uint8_t* buf) const {
+        const byte_ranges& d = dirty_ranges();
+        if(d.all()) return copy(buf);
+
+        auto r = d.ranges().begin();
+        for(const pack_item& p : plan_) {
+            while(r != d.ranges().end() && r->second <= p.offset) ++r;
+            if(r == d.ranges().end()) break;
+            if(r->first < p.end)
+                p.copy(p.object, buf + p.offset);
         }
     }
 
+    /*
+     * Bytes of the items set or touched since applied. Should the layout
+     * change, as items of other sizes are set, all are.
+     */
+    const byte_ranges& dirty_ranges() const {
+        check_layout_();
+        for(size_t i : dirty_items_)
+            dirty_.add(offsets_[i], ends_[i]);
+        dirty_items_.clear();
+        return dirty_;
+    }
+
     bool is_changed() const { return is_changed_; }
-    void mark_applied() { is_changed_ = false; }
+    void mark_applied() {
+        is_changed_ = false;
+        dirty_.clear();
+        dirty_items_.clear();
+    }
 
     dynamic_property& operator!() {
         is_changed_ = true;
+        dirty_.add_all();
         return *this;
     }
 
@@ -378,7 +585,9 @@ struct dynamic_property {
             .function("get", &dynamic_property::get_instance)
             .function("set", &dynamic_property::set_instance)
             .function("set_float", &dynamic_property::set<float>)
+            .function("touch", &dynamic_property::touch)
             .function("definition", static_cast<std::string(dynamic_property::*)(const std::string&)const>(&dynamic_property::definition))
+            .function("storage_definition", static_cast<std::string(dynamic_property::*)(const std::string&)const>(&dynamic_property::storage_definition))
             .function("append", &dynamic_property::append_instance)
             .function("append-float", &dynamic_property::append<float>)
             .function("size_in_bytes", &dynamic_property::size_in_bytes)
@@ -386,37 +595,111 @@ struct dynamic_property {
     }
 
 protected:
+    /*
+     * An item as it is laid out, resolved once the layout changes: values
+     * are copied from where their instances hold them, without a call by
+     * name for each.
+     */
+    struct pack_item {
+        const void* object;
+        size_t offset;
+        size_t end;
+        size_t (*size)(const void*);
+        void (*copy)(const void*, void*);
+    };
+
+    /*
+     * Only the last item may be an unsized array, which may grow or shrink in
+     * place through get. Its size is checked each time the layout is used,
+     * and the layout made again once it differs.
+     */
+    void check_layout_() const {
+        if(!offset_changed_ && !plan_.empty()) {
+            const pack_item& p = plan_.back();
+            if(p.size(p.object) != p.end - p.offset)
+                offset_changed_ = true;
+        }
+        update_offsets_();
+    }
+
+    std::string definition_(const std::string& head,
+            const std::vector<std::string>& l) const {
+        int i = 0;
+        std::string def = head + " {\n";
+        for(const std::string& s : l) {
+            if(storage[i].is_null()) {
+                i += 1; continue;
+            }
+
+            def += "    " + glsl_member_definition__(
+                storage[i].call("__glsl_type_name").get<std::string>(),
+                s) + ";\n";
+            i += 1;
+        }
+        def += "};";
+
+        return def;
+    }
+
+    std::vector<std::string> default_names_() const {
+        std::vector<std::string> items(size(), "items_");
+        for(size_t i = 0; i < size(); i++)
+            items[i] += std::to_string(i);
+        return items;
+    }
+
     void update_offsets_() const {
         if(!offset_changed_) return;
 
         size_t cur_off = 0;
         int i = 0;
-        offsets_.resize(size());
+        std::vector<size_t> old_offsets(size()), old_ends(size());
+        old_offsets.swap(offsets_);
+        old_ends.swap(ends_);
+        plan_.clear();
 
         for(const refl::instance& ins : storage) {
             if(ins.is_null()) {
-                offsets_[i] = cur_off;
+                offsets_[i] = ends_[i] = cur_off;
                 i += 1; continue;
             }
 
-            size_t align = ins.call("__align").get<size_t>();
-            size_t sz = ins.call("__size").get<size_t>();
+            const refl::meta::serializer* s = ins.get_meta().get_serializer();
+            if(!s) throw restriction_error("Not serializable.");
+
+            const void* o = ins.address();
+            size_t align = s->align(o);
+            size_t sz = s->size(o);
             cur_off = cur_off % align == 0 ? cur_off :
                 (cur_off / align + 1) * align;
             offsets_[i] = cur_off;
+            plan_.push_back(pack_item {
+                    o, cur_off, cur_off + sz, s->size, s->copy });
 
             cur_off += sz;
+            ends_[i] = cur_off;
             i += 1;
         }
 
+        // items moved, the buffer is to be written anew
+        if(offsets_ != old_offsets || ends_ != old_ends)
+            dirty_.add_all();
+
+        size_in_bytes_ = cur_off;
         offset_changed_ = false;
     }
 
     std::vector<refl::instance> storage;
 
     mutable std::vector<size_t> offsets_;
+    mutable std::vector<size_t> ends_;
+    mutable std::vector<pack_item> plan_;
+    mutable size_t size_in_bytes_ = 0;
     mutable bool offset_changed_ = true;
     bool is_changed_ = true;
+
+    mutable byte_ranges dirty_;
+    mutable std::vector<size_t> dirty_items_;
 };
 
 template<>
@@ -427,11 +710,18 @@ struct prop_trait<dynamic_property> {
 
     static size_t size(const input_type& i) { return i.size_in_bytes(); }
     static void copy(const input_type& i, uint8_t* o) { i.copy(o); }
+    static void copy_changed(const input_type& i, uint8_t* o) {
+        i.copy_changed(o);
+    }
 
     static bool is_changed(const input_type& i) {
         return i.is_changed();
     }
 
+    static const byte_ranges& dirty_ranges(const input_type& i) {
+        return i.dirty_ranges();
+    }
+
     static void mark_applied(input_type& i) {
         i.mark_applied();
     }
@@ -26,6 +26,7 @@
 
 #include <functional>
 #include <iostream>
+#include <vector>
 
 #include "shading.h"
 #include "common/traits.h"
@@ -163,6 +164,57 @@ struct prop_provider_updater<raw_data_tag> {
     }
 };
 
+/*
+ * Only the items changed are to be copied over the stage, where the traits
+ * tell how.
+ */
+template<typename Trait, typename InputType, typename T>
+auto copy_changed_(const InputType& i, T* o, int)
+    -> decltype(Trait::copy_changed(i, o), void()) {
+    Trait::copy_changed(i, o);
+}
+
+template<typename Trait, typename InputType, typename T>
+void copy_changed_(const InputType& i, T* o, long) {
+    Trait::copy(i, o);
+}
+
+/*
+ * Inputs of which the traits tell the byte ranges changed have only those
+ * written into a buffer already holding the rest, unless they are so many
+ * that writing it all costs as much. Ranges are written from the stage of the
+ * buffer, holding all the bytes last written, so that items in between
+ * changed ones, merged into their ranges, are written as they are.
+ */
+template<typename Trait, typename InputType, typename OutputType>
+auto write_dirty_(InputType& i, OutputType& o, int)
+    -> decltype(Trait::dirty_ranges(i), bool()) {
+    size_t sz = Trait::size(i);
+    if(o.vacuum() || o.size() != sz) return false;
+
+    const auto& d = Trait::dirty_ranges(i);
+    if(d.all() || d.bytes() * 2 > sz) return false;
+
+    render_assets::write_stage& st = o.stage();
+    bool whole = !st.valid || st.bytes.size() != sz;
+    st.bytes.resize(sz);
+    auto p = reinterpret_cast<
+        decltype(optional_value_type<Trait>(0))>(st.bytes.data());
+    if(whole) Trait::copy(i, p);
+    else copy_changed_<Trait>(i, p, 0);
+    st.valid = true;
+
+    for(const auto& r : d.ranges())
+        o.write_range_raw(st.bytes.data() + r.first,
+                r.first, r.second - r.first);
+    return true;
+}
+
+template<typename Trait, typename InputType, typename OutputType>
+bool write_dirty_(InputType& i, OutputType& o, long) {
+    return false;
+}
+
 template<>
 struct prop_provider_updater<indirect_tag> {
     typedef render_assets::property_buffer output_type;
@@ -172,6 +224,11 @@ struct prop_provider_updater<indirect_tag> {
     static void update(input_type& i, output_type& o, bool anew) {
         if(!anew && !optional_is_changed(i, 0)) return;
 
+        if(!anew && write_dirty_<Trait>(i, o, 0)) {
+            optional_mark_applied(i, 0);
+            return;
+        }
+
         void* p = o.start_map(render_assets::buffer::WRITE,
                 Trait::size(i));
         Trait::copy(i, reinterpret_cast<
@@ -195,8 +252,126 @@ struct provider<InputType, render_assets::property_buffer> {
     }
 };
 
+/*
+ * Written as property buffers are. The layout of dynamic and universal
+ * properties is that of std430 as well, so they fill storage blocks alike.
+ */
+template<typename InputType>
+struct provider<InputType, render_assets::storage_buffer> {
+    typedef render_assets::storage_buffer output_type;
+    typedef InputType input_type;
+
+    DEF_LOAD_FUNC
+
+    template<typename Trait = prop_trait<input_type>>
+    static void update(input_type& i, output_type& o, bool anew) {
+        prop_provider_updater<typename Trait::transfer_tag>
+            ::update(i, o, anew);
+    }
+};
+
+/*
+ * Properties placed in a shared arena, sized as their buffers would be.
+ */
+template<typename InputType>
+struct provider<InputType, render_assets::property_range> {
+    typedef render_assets::property_range output_type;
+    typedef InputType input_type;
+
+    static output_type load(input_type& i, render_assets::uniform_arena& a) {
+        output_type new_(&a);
+        update(i, new_, true);
+        return new_;
+    }
+
+    template<typename Trait = prop_trait<input_type>>
+    static void update(input_type& i, output_type& o, bool anew) {
+        if(!anew && !optional_is_changed(i, 0)) return;
+
+        if(anew || !write_dirty_<Trait>(i, o, 0))
+            write_(i, o, typename Trait::transfer_tag());
+        optional_mark_applied(i, 0);
+    }
+
+private:
+    template<typename Trait = prop_trait<input_type>>
+    static void write_(input_type& i, output_type& o, raw_data_tag) {
+        o.write_raw(Trait::data(i),
+                Trait::size(i) * sizeof(*Trait::data(i)));
+    }
+
+    template<typename Trait = prop_trait<input_type>>
+    static void write_(input_type& i, output_type& o, indirect_tag) {
+        // the stage, kept for the ranges written next
+        std::vector<uint8_t>& stage = o.stage().bytes;
+        stage.resize(Trait::size(i));
+        Trait::copy(i, reinterpret_cast<
+                decltype(optional_value_type<Trait>(0))>(stage.data()));
+        o.write_raw(stage.data(), stage.size());
+        o.stage().valid = true;
+    }
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 
+/*
+ * Inputs of which the traits give all the mip levels are filled level by
+ * level, the others from their base level.
+ */
+template<typename Trait, typename InputType>
+auto texture_fill_(InputType& i, render_assets::texture2d& p, int)
+    -> decltype(Trait::levels(i), void()) {
+    p.fill_levels(Trait::levels(i),
+            render_assets::texture::format(Trait::format(i)));
+}
+
+/*
+ * And those of which the traits write rows on demand, a band at a time.
+ */
+template<typename Trait, typename InputType>
+auto texture_fill_(InputType& i, render_assets::texture2d& p, int)
+    -> decltype(Trait::rows(i, 0, 0, nullptr), void()) {
+    p.fill_rows([&i](size_t t, size_t n, void* dst) {
+                Trait::rows(i, t, n, dst);
+            }, render_assets::texture::format(Trait::format(i)));
+}
+
+template<typename Trait, typename InputType>
+void texture_fill_(InputType& i, render_assets::texture2d& p, long) {
+    p.fill(Trait::data(i),
+            render_assets::texture::format(Trait::format(i)));
+}
+
+template<typename Trait, typename InputType>
+auto texture_fill_(InputType& i, render_assets::texture_cubemap& p, int)
+    -> decltype(Trait::face_levels(i), void()) {
+    p.fill_face_levels(Trait::face_levels(i),
+            render_assets::texture::format(Trait::format(i)));
+}
+
+template<typename Trait, typename InputType>
+void texture_fill_(InputType& i, render_assets::texture_cubemap& p, long) {
+    p.fill_faces(Trait::faces(i),
+            render_assets::texture::format(Trait::format(i)));
+}
+
+/*
+ * Inputs which may not be ready, like images still being decoded, are
+ * uploaded at the first update after they are, the texture staying vacuum
+ * until then. Any other input is uploaded anew only.
+ */
+template<typename Trait, typename InputType>
+auto texture_due_(const InputType& i, const render_assets::texture& p,
+        bool anew, int) -> decltype(Trait::ready(i)) {
+    return (anew || p.vacuum()) && Trait::ready(i);
+}
+
+template<typename Trait, typename InputType>
+bool texture_due_(const InputType& i, const render_assets::texture& p,
+        bool anew, long) {
+    return anew;
+}
+
 template<typename InputType>
 struct provider<InputType, render_assets::texture2d> {
     typedef render_assets::texture2d output_type;
@@ -206,11 +381,10 @@ struct provider<InputType, render_assets::texture2d> {
 
     template<typename Trait = texture2d_trait<input_type>>
     static void update(input_type& i, output_type& p, bool anew) {
-        if(anew) {
+        if(texture_due_<Trait>(i, p, anew, 0)) {
             p.set_width(Trait::width(i));
             p.set_height(Trait::height(i));
-            p.fill(Trait::data(i),
-                    render_assets::texture::format(Trait::format(i)));
+            texture_fill_<Trait>(i, p, 0);
         }
     }
 };
@@ -222,14 +396,12 @@ struct provider<InputType, render_assets::texture_cubemap> {
 
     DEF_LOAD_FUNC
 
-    // inherit texture2d_trait is enough, at present
-    template<typename Trait = texture2d_trait<input_type>>
+    template<typename Trait = cubemap_trait<input_type>>
     static void update(input_type& i, output_type& p, bool anew) {
         if(anew) {
-            p.set_width(Trait::width(i));
-            p.set_height(Trait::height(i) / 6);
-            p.fill(Trait::data(i),
-                    render_assets::texture::format(Trait::format(i)));
+            p.set_width(Trait::edge(i));
+            p.set_height(Trait::edge(i));
+            texture_fill_<Trait>(i, p, 0);
         }
     }
 };
@@ -1,5 +1,6 @@
 #include <GL/glew.h>
 #include <unordered_map>
+#include <algorithm>
 
 #include "render_assets.h"
 #include "common/exception.h"
@@ -15,6 +16,14 @@ DEF_ENUM_MAP(em_format_component_, texture::format, GLenum, ({
         { texture::RGB_F32, GL_RGB },
         { texture::RGBA_F32, GL_RGBA },
         { texture::DEPTH_F32, GL_DEPTH_COMPONENT },
+        { texture::R_U8, GL_RED },
+        { texture::RG_U88, GL_RG },
+        { texture::R_F16, GL_RED },
+        { texture::RG_F16, GL_RG },
+        { texture::RGBA_F16, GL_RGBA },
+        { texture::RGB_F111110, GL_RGB },
+        { texture::DEPTH_U16, GL_DEPTH_COMPONENT },
+        { texture::DEPTH_U24, GL_DEPTH_COMPONENT },
     }))
 
 DEF_ENUM_MAP(em_format_type_, texture::format, GLenum, ({
@@ -24,6 +33,14 @@ DEF_ENUM_MAP(em_format_type_, texture::format, GLenum, ({
         { texture::RGB_F32, GL_FLOAT },
         { texture::RGBA_F32, GL_FLOAT },
         { texture::DEPTH_F32, GL_FLOAT },
+        { texture::R_U8, GL_UNSIGNED_BYTE },
+        { texture::RG_U88, GL_UNSIGNED_BYTE },
+        { texture::R_F16, GL_HALF_FLOAT },
+        { texture::RG_F16, GL_HALF_FLOAT },
+        { texture::RGBA_F16, GL_HALF_FLOAT },
+        { texture::RGB_F111110, GL_UNSIGNED_INT_10F_11F_11F_REV },
+        { texture::DEPTH_U16, GL_UNSIGNED_SHORT },
+        { texture::DEPTH_U24, GL_UNSIGNED_INT },
     }))
 
 DEF_ENUM_MAP(em_format_, texture::format, GLenum, ({
@@ -33,8 +50,35 @@ DEF_ENUM_MAP(em_format_, texture::format, GLenum, ({
         { texture::RGB_F32, GL_RGB32F },
         { texture::RGBA_F32, GL_RGBA32F },
         { texture::DEPTH_F32, GL_DEPTH_COMPONENT32F },
+        { texture::R_U8, GL_R8 },
+        { texture::RG_U88, GL_RG8 },
+        { texture::R_F16, GL_R16F },
+        { texture::RG_F16, GL_RG16F },
+        { texture::RGBA_F16, GL_RGBA16F },
+        { texture::RGB_F111110, GL_R11F_G11F_B10F },
+        { texture::DEPTH_U16, GL_DEPTH_COMPONENT16 },
+        { texture::DEPTH_U24, GL_DEPTH_COMPONENT24 },
+        { texture::BC1_RGBA, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT },
+        { texture::BC3_RGBA, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT },
+        { texture::BC4_R, GL_COMPRESSED_RED_RGTC1 },
+        { texture::BC5_RG, GL_COMPRESSED_RG_RGTC2 },
     }))
 
+// bytes of a block of 4x4 texels, 0 for formats not compressed
+size_t format_block_size_(texture::format fmt)
+{
+    switch(fmt) {
+    case texture::BC1_RGBA: case texture::BC4_R: return 8;
+    case texture::BC3_RGBA: case texture::BC5_RG: return 16;
+    default: return 0;
+    }
+}
+
+size_t compressed_size_(texture::format fmt, size_t w, size_t h, size_t d = 1)
+{
+    return ((w + 3) / 4) * ((h + 3) / 4) * d * format_block_size_(fmt);
+}
+
 DEF_ENUM_MAP(em_format_size_, texture::format, size_t, ({
         // TODO: if larger color format in added, insure texture read not to
         // cause segmentation fault
@@ -44,6 +88,15 @@ DEF_ENUM_MAP(em_format_size_, texture::format, size_t, ({
         { texture::RGB_F32, 12 },
         { texture::RGBA_F32, 16 },
         { texture::DEPTH_F32, 4 },
+        { texture::R_U8, 1 },
+        { texture::RG_U88, 2 },
+        { texture::R_F16, 2 },
+        { texture::RG_F16, 4 },
+        { texture::RGBA_F16, 8 },
+        { texture::RGB_F111110, 4 },
+        { texture::DEPTH_U16, 2 },
+        // taken as 32-bit normalized integers
+        { texture::DEPTH_U24, 4 },
     }))
 
 DEF_ENUM_MAP(em_buffer_usage_, uint32_t, GLenum, ({
@@ -110,8 +163,80 @@ GLenum get_texture_type(const texture& t)
     }
 }
 
-void generic_fill(texture& t, const void* data, texture::format fmt,
-        GLenum tex_type, GLenum bind_tex_type, size_t dim, bool opt = true)
+/*
+ * Sets the unpacking state for a view for the lifetime of the object, and
+ * puts back the default one, tightly packed, after.
+ */
+struct unpack_scope {
+    bool set;
+    // rows of narrow pixels are as tightly packed as any other, rather than
+    // aligned to 4 bytes as the driver takes them by default
+    bool narrow;
+
+    unpack_scope(const pixel_view& v, texture::format fmt) :
+            set(v.data && !v.packed()),
+            narrow(v.data && em_format_size_(fmt) % 4) {
+        if(narrow) glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        if(!set) return;
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, v.row_length);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, v.skip_pixels);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, v.skip_rows);
+    }
+
+    ~unpack_scope() {
+        if(narrow) glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        if(!set) return;
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    }
+};
+
+/*
+ * Compressed textures take data compressed as they are, without any
+ * conversion or unpacking state.
+ */
+void check_compressed_data(const texture& t, texture::format fmt,
+        const pixel_view& data)
+{
+    if(fmt != t.get_internal_format())
+        throw restriction_error("Compressed textures must be filled with "
+                "data of the same format");
+    if(!data.packed())
+        throw restriction_error("Compressed data must be tightly packed");
+}
+
+// a level of a 2D texture, or a face of a cubemap, of the size given
+void tex_image_2d(const texture& t, GLenum tex_type, size_t level,
+        size_t w, size_t h, const pixel_view& data, texture::format fmt)
+{
+    texture::format ifmt = t.get_internal_format();
+
+    if(format_block_size_(ifmt)) {
+        check_compressed_data(t, fmt, data);
+        glCompressedTexImage2D(tex_type, level, em_format_(ifmt), w, h, 0,
+                compressed_size_(ifmt, w, h), data.data);
+        return;
+    }
+
+    unpack_scope unpack(data, fmt);
+    glTexImage2D(
+        tex_type, level,
+        em_format_(ifmt),
+        w, h, 0,
+        em_format_component_(fmt),
+        em_format_type_(fmt),
+        data.data
+    );
+}
+
+// bytes of a band of rows, which stays in cache between its writer and the
+// upload
+const size_t fill_band_size = 1 << 18;
+
+// settles the internal format of a texture yet to be created, and gives the
+// format of the data
+texture::format resolve_fill_format(texture& t, texture::format fmt)
 {
     if(t.vacuum()) {
         if(!t.get_width() * t.get_height() * t.get_depth())
@@ -124,45 +249,67 @@ void generic_fill(texture& t, const void* data, texture::format fmt,
         }
     }
 
-    glBindTexture(bind_tex_type, t.id());
-
     if(fmt == texture::DEFAULT_FMT)
         fmt = t.get_internal_format();
+    return fmt;
+}
 
-    if(dim == 1)
-        glTexImage1D(
-            tex_type, t.get_level(),
-            em_format_(t.get_internal_format()),
-            t.get_width(), 0,
-            em_format_component_(fmt),
-            em_format_type_(fmt),
-            data
-        );
-    else if(dim == 2)
-        glTexImage2D(
-            tex_type, t.get_level(),
-            em_format_(t.get_internal_format()),
-            t.get_width(), t.get_height(), 0,
-            em_format_component_(fmt),
-            em_format_type_(fmt),
-            data
-        );
-    else if(dim == 3)
-        glTexImage3D(
+void generic_fill(texture& t, const pixel_view& data, texture::format fmt,
+        GLenum tex_type, GLenum bind_tex_type, size_t dim, bool opt = true)
+{
+    fmt = resolve_fill_format(t, fmt);
+    glBindTexture(bind_tex_type, t.id());
+
+    bool compressed = format_block_size_(t.get_internal_format());
+
+    if(dim == 2) {
+        tex_image_2d(t, tex_type, t.get_level(),
+                t.get_width(), t.get_height(), data, fmt);
+    } else if(compressed && dim == 3) {
+        check_compressed_data(t, fmt, data);
+        glCompressedTexImage3D(
             tex_type, t.get_level(),
             em_format_(t.get_internal_format()),
             t.get_width(), t.get_height(), t.get_depth(), 0,
-            em_format_component_(fmt),
-            em_format_type_(fmt),
-            data
+            compressed_size_(t.get_internal_format(),
+                t.get_width(), t.get_height(), t.get_depth()),
+            data.data
         );
+    } else if(compressed) {
+        throw unsupported_error("Compressed textures of this dimension");
+    } else {
+        // tex_image_2d sets the unpacking state of its own
+        unpack_scope unpack(data, fmt);
+
+        if(dim == 1)
+            glTexImage1D(
+                tex_type, t.get_level(),
+                em_format_(t.get_internal_format()),
+                t.get_width(), 0,
+                em_format_component_(fmt),
+                em_format_type_(fmt),
+                data.data
+            );
+        else
+            glTexImage3D(
+                tex_type, t.get_level(),
+                em_format_(t.get_internal_format()),
+                t.get_width(), t.get_height(), t.get_depth(), 0,
+                em_format_component_(fmt),
+                em_format_type_(fmt),
+                data.data
+            );
+    }
 
     if(opt) {
         glTexParameteri(bind_tex_type, GL_TEXTURE_MAG_FILTER,
                 em_filter_type_(t.get_filter()));
         glTexParameteri(bind_tex_type, GL_TEXTURE_MIN_FILTER,
                 em_filter_type_(t.get_filter()));
-        glGenerateMipmap(bind_tex_type);
+        // nothing to build mipmaps from when only reserved, and compressed
+        // formats cannot be rendered into
+        if(data.data && !compressed)
+            glGenerateMipmap(bind_tex_type);
     }
 
     glBindTexture(bind_tex_type, GL_NONE);
@@ -171,7 +318,7 @@ void generic_fill(texture& t, const void* data, texture::format fmt,
 void generic_fill_rect(texture& t,
         size_t offx, size_t offy, size_t offz,
         size_t w, size_t h, size_t d,
-        const void* data, texture::format fmt, GLenum tex_type, size_t dim)
+        const pixel_view& data, texture::format fmt, GLenum tex_type, size_t dim)
 {
     if(t.vacuum())
         throw restriction_error("Texture is not yet initailized.");
@@ -181,13 +328,32 @@ void generic_fill_rect(texture& t,
     if(fmt == texture::DEFAULT_FMT)
         fmt = t.get_internal_format();
 
+    texture::format ifmt = t.get_internal_format();
+    if(format_block_size_(ifmt)) {
+        check_compressed_data(t, fmt, data);
+        if(offx % 4 || offy % 4)
+            throw restriction_error("Compressed rects must align to blocks");
+
+        if(dim == 2)
+            glCompressedTexSubImage2D(tex_type, t.get_level(),
+                offx, offy, w, h, em_format_(ifmt),
+                compressed_size_(ifmt, w, h), data.data);
+        else if(dim == 3)
+            glCompressedTexSubImage3D(tex_type, t.get_level(),
+                offx, offy, offz, w, h, d, em_format_(ifmt),
+                compressed_size_(ifmt, w, h, d), data.data);
+        return;
+    }
+
+    unpack_scope unpack(data, fmt);
+
     if(dim == 1)
         glTexSubImage1D(
             tex_type, t.get_level(),
             offx, w,
             em_format_component_(fmt),
             em_format_type_(fmt),
-            data
+            data.data
         );
     else if(dim == 2)
         glTexSubImage2D(
@@ -195,7 +361,7 @@ void generic_fill_rect(texture& t,
             offx, offy, w, h,
             em_format_component_(fmt),
             em_format_type_(fmt),
-            data
+            data.data
         );
     else if(dim == 3)
         glTexSubImage3D(
@@ -203,7 +369,7 @@ void generic_fill_rect(texture& t,
             offx, offy, offz, w, h, d,
             em_format_component_(fmt),
             em_format_type_(fmt),
-            data
+            data.data
         );
 }
 
@@ -217,12 +383,22 @@ void generic_read(texture& t,
         fmt = t.get_internal_format();
 
     glBindTexture(bind_tex_type, t.id());
-    glGetTexImage(tex_type, 0,
-            em_format_component_(fmt), em_format_type_(fmt), data);
+    if(format_block_size_(fmt)) {
+        if(fmt != t.get_internal_format())
+            throw restriction_error("Compressed textures can only be read "
+                    "in their own format");
+        glGetCompressedTexImage(tex_type, 0, data);
+    } else {
+        bool narrow = em_format_size_(fmt) % 4;
+        if(narrow) glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glGetTexImage(tex_type, 0,
+                em_format_component_(fmt), em_format_type_(fmt), data);
+        if(narrow) glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    }
     glBindTexture(bind_tex_type, GL_NONE);
 }
 
-void texture::fill(const void* data, format fmt) {
+void texture::fill(const pixel_view& data, format fmt) {
     GLenum tex_type = get_texture_type(*this);
 
     if(get_depth() == 1)
@@ -234,7 +410,7 @@ void texture::fill(const void* data, format fmt) {
 void texture::fill_rect(
         size_t offx, size_t offy, size_t offz,
         size_t w, size_t h, size_t d,
-        const void* data, format fmt)
+        const pixel_view& data, format fmt)
 {
     GLenum tex_type = get_texture_type(*this);
     glBindTexture(tex_type, id());
@@ -247,6 +423,69 @@ void texture::fill_rect(
     glBindTexture(tex_type, GL_NONE);
 }
 
+// filters and levels of a texture bound, of which the levels are all given
+void set_level_params(const texture& t, GLenum bind_tex_type, size_t levels)
+{
+    glTexParameteri(bind_tex_type, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(bind_tex_type, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameteri(bind_tex_type, GL_TEXTURE_MAG_FILTER,
+            em_filter_type_(t.get_filter()));
+    glTexParameteri(bind_tex_type, GL_TEXTURE_MIN_FILTER,
+            t.get_filter() == texture::NEAREST ? GL_NEAREST_MIPMAP_NEAREST :
+            GL_LINEAR_MIPMAP_LINEAR);
+}
+
+void texture::fill_levels(const std::vector<pixel_view>& levels, format fmt)
+{
+    if(levels.empty())
+        throw restriction_error("No level to fill");
+    if(get_trait() != NONE || get_depth() != 1)
+        throw unsupported_error("Only 2D textures can be filled by levels");
+
+    fmt = resolve_fill_format(*this, fmt);
+    glBindTexture(GL_TEXTURE_2D, id());
+
+    for(size_t l = 0; l < levels.size(); l++) {
+        tex_image_2d(*this, GL_TEXTURE_2D, l,
+                std::max<size_t>(1, get_width() >> l),
+                std::max<size_t>(1, get_height() >> l), levels[l], fmt);
+    }
+
+    set_level_params(*this, GL_TEXTURE_2D, levels.size());
+    glBindTexture(GL_TEXTURE_2D, GL_NONE);
+}
+
+void texture::fill_rows(
+        const std::function<void(size_t, size_t, void*)>& rows, format fmt)
+{
+    if(get_trait() != NONE || get_depth() != 1)
+        throw unsupported_error("Only 2D textures can be filled by rows");
+
+    fmt = resolve_fill_format(*this, fmt);
+    if(format_block_size_(fmt))
+        throw unsupported_error("Compressed textures cannot be filled by rows");
+
+    bool anew = vacuum();
+    if(anew) reserve(fmt);
+
+    size_t row_size = em_format_size_(fmt) * get_width();
+    size_t band = std::max<size_t>(1, fill_band_size / row_size);
+    std::vector<uint8_t> buf(band * row_size);
+
+    for(size_t t = 0; t < get_height(); t += band) {
+        size_t n = std::min(band, get_height() - t);
+        rows(t, n, buf.data());
+        fill_rect(0, t, 0, get_width(), n, 1, buf.data(), fmt);
+    }
+
+    // as fill does with the data given when the texture is made
+    if(anew) {
+        glBindTexture(GL_TEXTURE_2D, id());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, GL_NONE);
+    }
+}
+
 void texture::read(void* data, texture::format fmt)
 {
     GLenum tex_type = get_texture_type(*this);
@@ -258,8 +497,9 @@ void texture::bind_to(int tex_bind) const
     if(tex_bind < 0)
         glBindTexture(get_texture_type(*this), GL_NONE);
     else {
+        // one yet to be filled is left so, and samples as none
         glActiveTexture(GL_TEXTURE0 + tex_bind);
-        glBindTexture(get_texture_type(*this), id());
+        glBindTexture(get_texture_type(*this), vacuum() ? GL_NONE : id());
     }
 }
 
@@ -274,33 +514,73 @@ void texture::attach_to(size_t tex_attachment)
     glBindTexture(tex_type, GL_NONE);
 }
 
-void texture_cubemap::fill(const void* data, format fmt) {
+void texture_cubemap::fill(const pixel_view& data, format fmt) {
+    // the faces are rows apart, which leaves the row length as it is
+    std::array<pixel_view, 6> faces;
+    for(size_t i = 0; i < 6; i++) {
+        faces[i] = data;
+        faces[i].skip_rows += i * get_height();
+    }
+
+    fill_faces(faces, fmt);
+}
+
+void texture_cubemap::fill_faces(
+        const std::array<pixel_view, 6>& faces, format fmt) {
     if(get_depth() != 6)
         throw restriction_error("Cubemap must has a depth of 6");
 
-    const uint8_t* ptr_data = (const uint8_t*) data;
-    size_t size = em_format_size_(fmt) * get_width() * get_height();
-
     for(size_t i = 0; i < 6; i++) {
-        // increase data pointer, except that data is null
-        generic_fill(*this, data ? ptr_data + i * size : data,
-                fmt, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                GL_TEXTURE_CUBE_MAP, 2, i == 5);
+        generic_fill(*this, faces[i], fmt, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
+                GL_TEXTURE_CUBE_MAP, 2, false);
     }
 
     glBindTexture(GL_TEXTURE_CUBE_MAP, id());
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER,
+            em_filter_type_(get_filter()));
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER,
+            em_filter_type_(get_filter()));
     glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S,  
             GL_CLAMP_TO_EDGE);  
     glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T,  
             GL_CLAMP_TO_EDGE);  
-    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    if(faces[0].data && !format_block_size_(get_internal_format()))
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, GL_NONE);
+}
+
+void texture_cubemap::fill_face_levels(
+        const std::vector<std::array<pixel_view, 6>>& levels, format fmt)
+{
+    if(levels.empty())
+        throw restriction_error("No level to fill");
+    if(get_depth() != 6)
+        throw restriction_error("Cubemap must has a depth of 6");
+
+    fmt = resolve_fill_format(*this, fmt);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, id());
+
+    for(size_t l = 0; l < levels.size(); l++) {
+        for(size_t i = 0; i < 6; i++) {
+            tex_image_2d(*this, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, l,
+                    std::max<size_t>(1, get_width() >> l),
+                    std::max<size_t>(1, get_height() >> l),
+                    levels[l][i], fmt);
+        }
+    }
+
+    set_level_params(*this, GL_TEXTURE_CUBE_MAP, levels.size());
+    glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S,
+            GL_CLAMP_TO_EDGE);
+    glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T,
+            GL_CLAMP_TO_EDGE);
     glBindTexture(GL_TEXTURE_CUBE_MAP, GL_NONE);
 }
 
 void texture_cubemap::fill_rect(
         size_t offx, size_t offy, size_t offz,
         size_t w, size_t h, size_t d,
-        const void* data, format fmt)
+        const pixel_view& data, format fmt)
 {
     if(get_depth() != 6)
         throw restriction_error("Cubemap must has a depth of 6");
@@ -318,8 +598,13 @@ void texture_cubemap::read(void* data, texture::format fmt)
     if(get_depth() != 6)
         throw restriction_error("Cubemap must has a depth of 6");
 
+    if(fmt == texture::DEFAULT_FMT)
+        fmt = get_internal_format();
+
     uint8_t* ptr_data = (uint8_t*) data;
-    size_t size = em_format_size_(fmt) * get_width() * get_height();
+    size_t size = format_block_size_(fmt) ?
+        compressed_size_(fmt, get_width(), get_height()) :
+        em_format_size_(fmt) * get_width() * get_height();
 
     for(size_t i = 0; i < 6; i++) {
         generic_read(*this, ptr_data + size * i, fmt,
@@ -341,6 +626,42 @@ void texture_cubemap::attach_to(size_t tex_attachment)
 
 ////////////////////////////////////////////////////////////////////////////////
 
+id_type renderbuffer::create_object() const
+{
+    GLuint i;
+    glGenRenderbuffers(1, &i);
+    return i;
+}
+
+void renderbuffer::destroy_object(id_type i) const
+{
+    glDeleteRenderbuffers(1, &i);
+}
+
+void renderbuffer::reserve()
+{
+    if(get_internal_format() == texture::DEFAULT_FMT)
+        set_internal_format(texture::RGBA_U8888);
+    if(format_block_size_(get_internal_format()))
+        throw restriction_error("Renderbuffers cannot be compressed");
+
+    glBindRenderbuffer(GL_RENDERBUFFER, id());
+    glRenderbufferStorage(GL_RENDERBUFFER,
+            em_format_(get_internal_format()), get_width(), get_height());
+    glBindRenderbuffer(GL_RENDERBUFFER, GL_NONE);
+}
+
+void renderbuffer::attach_to(size_t attachment)
+{
+    if(vacuum())
+        reserve();
+
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment,
+            GL_RENDERBUFFER, id());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 void buffer::size(size_t sz) {
     if(!vacuum() && size_ != sz)
         throw restriction_error("Buffer size cannot be changed");
@@ -358,15 +679,42 @@ void vertex_attr_buffer::write_raw(const void* data, size_t sz) {
     glBindBuffer(GL_ARRAY_BUFFER, GL_NONE);
 }
 
+unsigned property_buffer::target() const {
+    return GL_UNIFORM_BUFFER;
+}
+
+unsigned storage_buffer::target() const {
+    return GL_SHADER_STORAGE_BUFFER;
+}
+
 void property_buffer::write_raw(const void* data, size_t sz) {
-    if(sz) size(sz);
+    reserve_(sz);
     if(!size())
         throw restriction_error("Buffer has zero size");
 
-    glBindBuffer(GL_UNIFORM_BUFFER, id());
-    glBufferData(GL_UNIFORM_BUFFER, size(), data,
+    glBindBuffer(target(), id());
+    glBufferData(target(), size(), data,
             em_buffer_usage_(transfer_mode() | access()));
-    glBindBuffer(GL_UNIFORM_BUFFER, GL_NONE);
+    glBindBuffer(target(), GL_NONE);
+    first_map = false;
+    stage_.valid = false;
+}
+
+void property_buffer::write_range_raw(const void* data,
+        size_t offset, size_t sz) {
+    if(!size())
+        throw restriction_error("Buffer has zero size");
+    if(offset + sz > size())
+        throw restriction_error("Range to write out of buffer");
+
+    glBindBuffer(target(), id());
+    if(first_map) {
+        glBufferData(target(), size(), NULL,
+            em_buffer_usage_(transfer_mode() | access()));
+        first_map = false;
+    }
+    glBufferSubData(target(), offset, sz, data);
+    glBindBuffer(target(), GL_NONE);
 }
 
 void property_buffer::read_raw(void* data, size_t sz) {
@@ -374,9 +722,9 @@ void property_buffer::read_raw(void* data, size_t sz) {
         throw restriction_error("Size to read too large");
     if(!sz) sz = size();
 
-    glBindBuffer(GL_UNIFORM_BUFFER, id());
-    glGetBufferSubData(GL_UNIFORM_BUFFER, 0, sz, data);
-    glBindBuffer(GL_UNIFORM_BUFFER, GL_NONE);
+    glBindBuffer(target(), id());
+    glGetBufferSubData(target(), 0, sz, data);
+    glBindBuffer(target(), GL_NONE);
 }
 
 void vertex_attr_buffer::read_raw(void* data, size_t sz) {
@@ -418,19 +766,20 @@ void vertex_attr_buffer::stop_map() {
 
 
 void* property_buffer::start_map(buffer_access bt, size_t sz) {
-    if(sz) size(sz);
+    reserve_(sz);
     if(!size())
         throw restriction_error("Buffer has zero size");
 
-    glBindBuffer(GL_UNIFORM_BUFFER, id());
+    glBindBuffer(target(), id());
     if(first_map) {
-        glBufferData(GL_UNIFORM_BUFFER, size(), NULL,
+        glBufferData(target(), size(), NULL,
             em_buffer_usage_(transfer_mode() | access()));
         first_map = false;
     }
-    void* ptr = glMapBuffer(GL_UNIFORM_BUFFER, em_buffer_access_(bt));
+    stage_.valid = false;
+    void* ptr = glMapBuffer(target(), em_buffer_access_(bt));
     mapping_state_ = bt;
-    glBindBuffer(GL_UNIFORM_BUFFER, GL_NONE);
+    glBindBuffer(target(), GL_NONE);
 
     if(!ptr)
         throw driver_error("Failed to map");
@@ -438,10 +787,549 @@ void* property_buffer::start_map(buffer_access bt, size_t sz) {
 }
 
 void property_buffer::stop_map() {
+    glBindBuffer(target(), id());
+    glUnmapBuffer(target());
+    glBindBuffer(target(), GL_NONE);
+    mapping_state_ = NO_ACCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// waits until the GPU has passed a fence put before, and deletes it
+void wait_fence_(void*& fence)
+{
+    GLsync f = GLsync(fence);
+    if(!f) return;
+
+    for(;;) {
+        GLenum r = glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT,
+                1000000000);
+        if(r == GL_ALREADY_SIGNALED || r == GL_CONDITION_SATISFIED)
+            break;
+        if(r == GL_WAIT_FAILED)
+            throw driver_error("Failed to wait for a fence");
+    }
+    glDeleteSync(f);
+    fence = nullptr;
+}
+
+uniform_ring::uniform_ring(size_t region_size, size_t frames,
+        bool persistent) :
+    region_size_(region_size), persistent_(persistent),
+    fences_(frames, nullptr)
+{
+    if(!region_size || !frames)
+        throw restriction_error("Ring cannot be of zero size");
+}
+
+uniform_ring::~uniform_ring()
+{
+    for(void* f : fences_)
+        if(f) glDeleteSync(GLsync(f));
+}
+
+id_type uniform_ring::create_object() const
+{
+    GLuint i;
+    glGenBuffers(1, &i);
+    return i;
+}
+
+void uniform_ring::destroy_object(id_type i) const
+{
+    // a buffer still mapped is unmapped as it is deleted
+    glDeleteBuffers(1, &i);
+}
+
+bool uniform_ring::persistent_supported()
+{
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if(major > 4 || (major == 4 && minor >= 4))
+        return true;
+
+    GLint n = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+    for(GLint i = 0; i < n; i++) {
+        const char* e = (const char*) glGetStringi(GL_EXTENSIONS, i);
+        if(e && std::string(e) == "GL_ARB_buffer_storage")
+            return true;
+    }
+    return false;
+}
+
+void uniform_ring::reserve_()
+{
+    GLint align = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+    alignment_ = std::max<GLint>(align, 1);
+    region_size_ = (region_size_ + alignment_ - 1) / alignment_ * alignment_;
+    persistent_ = persistent_ && persistent_supported();
+
+    size_t total = region_size_ * frames();
+    glBindBuffer(GL_UNIFORM_BUFFER, id());
+    if(persistent_) {
+        GLbitfield flags = GL_MAP_WRITE_BIT |
+            GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_UNIFORM_BUFFER, total, NULL, flags);
+        mapped_ = static_cast<uint8_t*>(
+                glMapBufferRange(GL_UNIFORM_BUFFER, 0, total, flags));
+        if(!mapped_) {
+            glBindBuffer(GL_UNIFORM_BUFFER, GL_NONE);
+            throw driver_error("Failed to map");
+        }
+    } else {
+        glBufferData(GL_UNIFORM_BUFFER, total, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, GL_NONE);
+}
+
+void uniform_ring::begin_frame()
+{
+    if(in_frame_)
+        throw restriction_error("Frame has begun");
+    if(!alignment_) reserve_();
+
+    region_ = frame_ % frames();
+    wait_fence_(fences_[region_]);
+
+    head_ = region_ * region_size_;
+    in_frame_ = true;
+}
+
+void uniform_ring::end_frame()
+{
+    if(!in_frame_)
+        throw restriction_error("Frame has not begun");
+
+    fences_[region_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame_++;
+    in_frame_ = false;
+}
+
+size_t uniform_ring::allocate_(size_t sz)
+{
+    if(!in_frame_)
+        throw restriction_error("Frame has not begun");
+    if(used() + sz > region_size_)
+        throw restriction_error("Region of the frame is full");
+
+    size_t off = head_;
+    head_ += (sz + alignment_ - 1) / alignment_ * alignment_;
+    head_ = std::min(head_, (region_ + 1) * region_size_);
+    return off;
+}
+
+void* uniform_ring::map_(size_t offset, size_t sz)
+{
+    if(persistent_)
+        return mapped_ + offset;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, id());
+    void* p = glMapBufferRange(GL_UNIFORM_BUFFER, offset, sz,
+            GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+            GL_MAP_INVALIDATE_RANGE_BIT);
+    glBindBuffer(GL_UNIFORM_BUFFER, GL_NONE);
+
+    if(!p)
+        throw driver_error("Failed to map");
+    return p;
+}
+
+void uniform_ring::unmap_()
+{
+    if(persistent_) return;
+
     glBindBuffer(GL_UNIFORM_BUFFER, id());
     glUnmapBuffer(GL_UNIFORM_BUFFER);
     glBindBuffer(GL_UNIFORM_BUFFER, GL_NONE);
-    mapping_state_ = NO_ACCESS;
+}
+
+size_t uniform_ring::push(const void* data, size_t sz)
+{
+    size_t off = allocate_(sz);
+    std::copy_n(static_cast<const uint8_t*>(data), sz,
+            static_cast<uint8_t*>(map_(off, sz)));
+    unmap_();
+    return off;
+}
+
+void uniform_ring::bind(size_t binding, size_t offset, size_t sz) const
+{
+    if(!alignment_ || offset % alignment_ ||
+            offset + sz > region_size_ * frames())
+        throw restriction_error("Range out of the ring");
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, id(), offset, sz);
+}
+
+void uniform_ring::read_raw(void* data, size_t offset, size_t sz) const
+{
+    if(offset + sz > region_size_ * frames())
+        throw restriction_error("Range out of the ring");
+
+    glBindBuffer(GL_UNIFORM_BUFFER, id());
+    glGetBufferSubData(GL_UNIFORM_BUFFER, offset, sz, data);
+    glBindBuffer(GL_UNIFORM_BUFFER, GL_NONE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// slices start at offsets aligned for texels of any format
+const size_t stream_slice_align = 64;
+
+texture_stream::texture_stream(size_t slice_size, size_t slices,
+        bool persistent) :
+    slice_size_(slice_size), persistent_(persistent),
+    fences_(slices, nullptr), taken_(slices, false)
+{
+    if(!slice_size || !slices)
+        throw restriction_error("Stream cannot be of zero size");
+}
+
+texture_stream::~texture_stream()
+{
+    for(void* f : fences_)
+        if(f) glDeleteSync(GLsync(f));
+}
+
+id_type texture_stream::create_object() const
+{
+    GLuint i;
+    glGenBuffers(1, &i);
+    return i;
+}
+
+void texture_stream::destroy_object(id_type i) const
+{
+    glDeleteBuffers(1, &i);
+}
+
+void texture_stream::reserve_()
+{
+    slice_size_ = (slice_size_ + stream_slice_align - 1) /
+        stream_slice_align * stream_slice_align;
+    persistent_ = persistent_ && uniform_ring::persistent_supported();
+
+    size_t total = slice_size_ * slices();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, id());
+    if(persistent_) {
+        GLbitfield flags = GL_MAP_WRITE_BIT |
+            GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, total, NULL, flags);
+        mapped_ = static_cast<uint8_t*>(
+                glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, total, flags));
+        if(!mapped_) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, GL_NONE);
+            throw driver_error("Failed to map");
+        }
+    } else {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, total, NULL, GL_STREAM_DRAW);
+        staging_.resize(total);
+        mapped_ = staging_.data();
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, GL_NONE);
+    reserved_ = true;
+}
+
+size_t texture_stream::acquire()
+{
+    if(!reserved_) reserve_();
+
+    size_t s = next_ % slices();
+    if(taken_[s])
+        throw restriction_error("Slices are all taken");
+    wait_fence_(fences_[s]);
+
+    taken_[s] = true;
+    next_++;
+    return s;
+}
+
+void* texture_stream::data(size_t slice) const
+{
+    if(slice >= slices() || !taken_[slice])
+        throw restriction_error("Slice is not taken");
+    return mapped_ + slice * slice_size_;
+}
+
+/*
+ * Binds a pixel unpack buffer for the lifetime of the object, so that data
+ * given for textures are offsets into it. Rows in it are tightly packed,
+ * narrow ones as well.
+ */
+struct unpack_buffer_scope {
+    bool narrow;
+
+    unpack_buffer_scope(id_type i, bool n) : narrow(n) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, i);
+        if(narrow) glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    }
+
+    ~unpack_buffer_scope() {
+        if(narrow) glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, GL_NONE);
+    }
+};
+
+void texture_stream::upload(size_t slice, texture& t,
+        size_t offx, size_t offy, size_t offz,
+        size_t w, size_t h, size_t d, texture::format fmt)
+{
+    uint8_t* p = static_cast<uint8_t*>(data(slice));
+    if(fmt == texture::DEFAULT_FMT)
+        fmt = t.get_internal_format();
+
+    bool compressed = format_block_size_(fmt);
+    size_t sz = compressed ? compressed_size_(fmt, w, h, d) :
+        em_format_size_(fmt) * w * h * d;
+    if(sz > slice_size_)
+        throw restriction_error("Rect is larger than a slice");
+
+    size_t off = slice * slice_size_;
+    {
+        unpack_buffer_scope unpack(id(),
+                !compressed && em_format_size_(fmt) % 4);
+        if(!persistent_)
+            glBufferSubData(GL_PIXEL_UNPACK_BUFFER, off, sz, p);
+        t.fill_rect(offx, offy, offz, w, h, d,
+                reinterpret_cast<const void*>(off), fmt);
+    }
+
+    fences_[slice] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    taken_[slice] = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uniform_arena::~uniform_arena()
+{
+    for(block& b : blocks_)
+        glDeleteBuffers(1, &b.id);
+}
+
+const uniform_arena::range& uniform_arena::range_(handle h) const
+{
+    if(h >= ranges_.size() || !ranges_[h].live)
+        throw restriction_error("Range is not in the arena");
+    return ranges_[h];
+}
+
+bool uniform_arena::place_(size_t b, range& r)
+{
+    block& blk = blocks_[b];
+    for(auto i = blk.holes.begin(); i != blk.holes.end(); ++i) {
+        if(i->second < r.padded) continue;
+
+        r.block = b;
+        r.offset = i->first;
+        i->first += r.padded;
+        i->second -= r.padded;
+        if(!i->second) blk.holes.erase(i);
+        blk.free -= r.padded;
+        return true;
+    }
+    return false;
+}
+
+uniform_arena::handle uniform_arena::allocate(size_t sz)
+{
+    if(!alignment_) {
+        GLint align = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+        alignment_ = std::max<GLint>(align, 1);
+    }
+
+    range r { 0, 0, sz, std::max<size_t>(
+            (sz + alignment_ - 1) / alignment_ * alignment_, alignment_), true };
+
+    bool placed = false;
+    for(size_t b = 0; !placed && b < blocks_.size(); b++)
+        placed = place_(b, r);
+
+    // room enough, but only in pieces
+    for(size_t b = 0; !placed && b < blocks_.size(); b++) {
+        if(blocks_[b].free < r.padded) continue;
+        compact_(b);
+        placed = place_(b, r);
+    }
+
+    if(!placed) {
+        block blk;
+        blk.size = std::max(block_size_, r.padded);
+        blk.free = blk.size;
+        blk.holes.emplace_back(0, blk.size);
+        glGenBuffers(1, &blk.id);
+        glBindBuffer(GL_UNIFORM_BUFFER, blk.id);
+        glBufferData(GL_UNIFORM_BUFFER, blk.size, NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, GL_NONE);
+
+        blocks_.push_back(std::move(blk));
+        place_(blocks_.size() - 1, r);
+    }
+
+    used_ += r.padded;
+
+    handle h;
+    if(!free_handles_.empty()) {
+        h = free_handles_.back();
+        free_handles_.pop_back();
+        ranges_[h] = r;
+    } else {
+        h = ranges_.size();
+        ranges_.push_back(r);
+    }
+    return h;
+}
+
+void uniform_arena::release(handle h)
+{
+    range_(h);
+    range& r = ranges_[h];
+    block& blk = blocks_[r.block];
+
+    // the hole is merged with those it touches
+    auto i = std::lower_bound(blk.holes.begin(), blk.holes.end(),
+            std::make_pair(r.offset, size_t(0)));
+    size_t b = r.offset, e = r.offset + r.padded;
+    if(i != blk.holes.end() && i->first == e) {
+        e += i->second;
+        i = blk.holes.erase(i);
+    }
+    if(i != blk.holes.begin() && (i - 1)->first + (i - 1)->second == b) {
+        --i;
+        b = i->first;
+        i = blk.holes.erase(i);
+    }
+    blk.holes.insert(i, std::make_pair(b, e - b));
+
+    blk.free += r.padded;
+    used_ -= r.padded;
+    r.live = false;
+    free_handles_.push_back(h);
+}
+
+void uniform_arena::compact_(size_t b)
+{
+    block& blk = blocks_[b];
+
+    std::vector<range*> live;
+    for(range& r : ranges_)
+        if(r.live && r.block == b) live.push_back(&r);
+    std::sort(live.begin(), live.end(),
+            [](const range* x, const range* y) { return x->offset < y->offset; });
+
+    // copied into a new buffer, as ranges of one may not overlap
+    GLuint id;
+    glGenBuffers(1, &id);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+    glBufferData(GL_COPY_WRITE_BUFFER, blk.size, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_COPY_READ_BUFFER, blk.id);
+
+    size_t cur = 0;
+    for(range* r : live) {
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                r->offset, cur, r->padded);
+        r->offset = cur;
+        cur += r->padded;
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, GL_NONE);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, GL_NONE);
+    glDeleteBuffers(1, &blk.id);
+
+    blk.id = id;
+    blk.holes.clear();
+    if(cur < blk.size)
+        blk.holes.emplace_back(cur, blk.size - cur);
+}
+
+void uniform_arena::compact()
+{
+    for(size_t b = 0; b < blocks_.size(); b++) {
+        const block& blk = blocks_[b];
+        bool packed = blk.holes.empty() || (blk.holes.size() == 1 &&
+                blk.holes[0].first + blk.holes[0].second == blk.size);
+        if(!packed) compact_(b);
+    }
+}
+
+void uniform_arena::write(handle h, const void* data,
+        size_t offset, size_t sz)
+{
+    const range& r = range_(h);
+    if(offset + sz > r.size)
+        throw restriction_error("Range to write out of buffer");
+
+    glBindBuffer(GL_UNIFORM_BUFFER, blocks_[r.block].id);
+    glBufferSubData(GL_UNIFORM_BUFFER, r.offset + offset, sz, data);
+    glBindBuffer(GL_UNIFORM_BUFFER, GL_NONE);
+}
+
+void uniform_arena::read(handle h, void* data) const
+{
+    const range& r = range_(h);
+    glBindBuffer(GL_UNIFORM_BUFFER, blocks_[r.block].id);
+    glGetBufferSubData(GL_UNIFORM_BUFFER, r.offset, r.size, data);
+    glBindBuffer(GL_UNIFORM_BUFFER, GL_NONE);
+}
+
+void uniform_arena::bind(size_t binding, handle h) const
+{
+    const range& r = range_(h);
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding,
+            blocks_[r.block].id, r.offset, r.size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void property_range::reset()
+{
+    if(arena_ && size_) arena_->release(handle_);
+    size_ = 0;
+    stage_.valid = false;
+}
+
+void property_range::reserve(size_t sz)
+{
+    if(!arena_)
+        throw restriction_error("Range has no arena");
+    if(!sz)
+        throw restriction_error("Buffer has zero size");
+    if(sz == size_) return;
+
+    reset();
+    handle_ = arena_->allocate(sz);
+    size_ = sz;
+}
+
+void property_range::write_raw(const void* data, size_t sz)
+{
+    reserve(sz);
+    stage_.valid = false;
+    arena_->write(handle_, data, 0, sz);
+}
+
+void property_range::write_range_raw(const void* data,
+        size_t offset, size_t sz)
+{
+    if(vacuum())
+        throw restriction_error("Buffer has zero size");
+    arena_->write(handle_, data, offset, sz);
+}
+
+void property_range::read_raw(void* data) const
+{
+    if(vacuum())
+        throw restriction_error("Buffer has zero size");
+    arena_->read(handle_, data);
+}
+
+void property_range::bind(size_t binding) const
+{
+    if(vacuum())
+        throw restriction_error("Buffer has zero size");
+    arena_->bind(binding, handle_);
 }
 
 } // render_assets
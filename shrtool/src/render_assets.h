@@ -2,10 +2,12 @@
 #define RENDER_ASSETS_H_INCLUDED
 
 #include <utility>
+#include <array>
 #include <string>
 #include <vector>
 #include <type_traits>
 #include <memory>
+#include <functional>
 #include <unordered_map>
 
 #include "common/reflection.h"
@@ -90,6 +92,22 @@ public:
         RGB_F32,
         RGBA_F32,
         DEPTH_F32,
+        R_U8,
+        RG_U88,
+        R_F16,
+        RG_F16,
+        RGBA_F16,
+        // packed floats of 11, 11 and 10 bits, no sign
+        RGB_F111110,
+        DEPTH_U16,
+        DEPTH_U24,
+
+        // compressed in blocks of 4x4 texels, filled with data compressed
+        // in the same format, as block_compress encodes it
+        BC1_RGBA = 192,
+        BC3_RGBA,
+        BC4_R,
+        BC5_RG,
     };
 
     enum traits {
@@ -122,32 +140,49 @@ public:
     texture(size_t width, size_t height, size_t depth, format ifmt = DEFAULT_FMT)
         : width_(width), height_(height), depth_(depth), internal_format_(ifmt) { }
 
-    virtual void fill(const void* data, format fmt = DEFAULT_FMT);
+    // data may be a view into a larger image, which is uploaded in place
+    virtual void fill(const pixel_view& data, format fmt = DEFAULT_FMT);
     void reserve(format fmt = DEFAULT_FMT) { fill(nullptr, fmt); }
 
     virtual void fill_rect(
             size_t offx, size_t offy, size_t offz,
             size_t w, size_t h, size_t d,
-            const void* data, format fmt = DEFAULT_FMT);
+            const pixel_view& data, format fmt = DEFAULT_FMT);
     void fill_rect(
             size_t w, size_t h, size_t d,
-            const void* data, format fmt = DEFAULT_FMT) {
+            const pixel_view& data, format fmt = DEFAULT_FMT) {
         fill_rect(0, 0, 0, w, h, d, data, fmt);
     }
     void fill_rect(
             size_t offx, size_t offy, size_t w, size_t h,
-            const void* data, format fmt = DEFAULT_FMT) {
+            const pixel_view& data, format fmt = DEFAULT_FMT) {
         fill_rect(offx, offy, 0, w, h, 1, data, fmt);
     }
     void fill_rect(const rect& r,
-            const void* data, format fmt = DEFAULT_FMT) {
+            const pixel_view& data, format fmt = DEFAULT_FMT) {
         fill_rect(r.tl[0], r.tl[1], r.width(), r.height(), data, fmt);
     }
     void fill_rect(size_t w, size_t h,
-            const void* data, format fmt = DEFAULT_FMT) {
+            const pixel_view& data, format fmt = DEFAULT_FMT) {
         fill_rect(0, 0, w, h, data, fmt);
     }
 
+    /*
+     * Uploads a full mip chain baked on the CPU, level 0 first, each level
+     * half the size of the one before it. Nothing is generated by the driver.
+     * 2D textures only.
+     */
+    void fill_levels(const std::vector<pixel_view>& levels,
+            format fmt = DEFAULT_FMT);
+
+    /*
+     * Fills a 2D texture a band of rows at a time, rows(t, n, dst) writing
+     * rows [t, t + n) just before they are uploaded. Data made as it is read,
+     * like that of a transformed image, never exists as a whole.
+     */
+    void fill_rows(const std::function<void(size_t, size_t, void*)>& rows,
+            format fmt = DEFAULT_FMT);
+
     virtual void read(void* data, format fmt = DEFAULT_FMT);
 
     // the parameters of these functions have no direct relationship with the
@@ -208,12 +243,21 @@ public:
     }
 
     virtual void attach_to(size_t tex_attachment) override;
-    virtual void fill(const void* data, format fmt = DEFAULT_FMT) override;
+    // data is the six faces stacked from top to bottom
+    virtual void fill(const pixel_view& data, format fmt = DEFAULT_FMT) override;
+    // each face from its own view, like those of a cross layout
+    void fill_faces(const std::array<pixel_view, 6>& faces,
+            format fmt = DEFAULT_FMT);
+    // the faces of each level of a full mip chain, as texture::fill_levels
+    void fill_face_levels(
+            const std::vector<std::array<pixel_view, 6>>& levels,
+            format fmt = DEFAULT_FMT);
 
     virtual void fill_rect(
             size_t offx, size_t offy, size_t offz,
             size_t w, size_t h, size_t d,
-            const void* data, format fmt = DEFAULT_FMT) override;
+            const pixel_view& data, format fmt = DEFAULT_FMT) override;
+    using texture::fill_rect;
 
     virtual void read(void* data, format fmt = DEFAULT_FMT) override;
 
@@ -226,6 +270,41 @@ public:
     }
 };
 
+/*
+ * renderbuffer is the storage of an attachment which is rendered into but
+ * never sampled, like the depth of a pass of which only colors are used.
+ * Without the need to be sampled, the driver may lay it out as it likes.
+ */
+class renderbuffer : public lazy_id_object_<renderbuffer> {
+public:
+    id_type create_object() const;
+    void destroy_object(id_type i) const;
+
+    LAZEOBJ_SCALAR_PROP(size_t, width, 0)
+    LAZEOBJ_SCALAR_PROP(size_t, height, 0)
+    LAZEOBJ_SCALAR_PROP(texture::format, internal_format, texture::DEFAULT_FMT)
+
+public:
+    renderbuffer(renderbuffer&& rb) = default;
+    renderbuffer(size_t width = 0, size_t height = 0,
+            texture::format ifmt = texture::DEFAULT_FMT)
+        : width_(width), height_(height), internal_format_(ifmt) { }
+
+    void reserve();
+    void attach_to(size_t attachment);
+
+    static void meta_reg_() {
+        refl::meta_manager::reg_class<renderbuffer>("renderbuffer")
+            .enable_construct<size_t, size_t>()
+            .enable_construct<size_t, size_t, texture::format>()
+            .enable_auto_register()
+            .function("get_width", &renderbuffer::get_width)
+            .function("get_height", &renderbuffer::get_height)
+            .function("get_format", &renderbuffer::get_internal_format)
+            .function("reserve", &renderbuffer::reserve);
+    }
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 
 namespace element_type {
@@ -332,8 +411,25 @@ public:
     void stop_map() override;
 };
 
+/*
+ * The bytes of a property as last written into its buffer, kept so that only
+ * the items changed since are copied over them. Ranges written from it hold
+ * the bytes of the items they span but not changed as they are.
+ */
+struct write_stage {
+    std::vector<uint8_t> bytes;
+    // whether the bytes are those in the buffer
+    bool valid = false;
+};
+
 class property_buffer : public buffer {
+protected:
     bool first_map = true;
+    write_stage stage_;
+
+    // the GL binding point the buffer is written through
+    virtual unsigned target() const;
+    virtual void reserve_(size_t sz) { if(sz) size(sz); }
 
 public:
     template<typename T>
@@ -350,6 +446,279 @@ public:
     using buffer::start_map;
     void* start_map(buffer_access bt, size_t sz = 0) override;
     void stop_map() override;
+
+    // writes part of a buffer of which the size is known, leaving the rest
+    void write_range_raw(const void* data, size_t offset, size_t sz);
+
+    write_stage& stage() { return stage_; }
+};
+
+/*
+ * A shader storage buffer, of properties laid out as std430. Unlike uniform
+ * blocks, storage blocks may end with an unsized array, so writing or mapping
+ * it with another size specifies its storage again.
+ */
+class storage_buffer : public property_buffer {
+protected:
+    unsigned target() const override;
+    void reserve_(size_t sz) override {
+        if(!sz || sz == size_) return;
+        size_ = sz;
+        first_map = true;
+    }
+
+public:
+    using property_buffer::property_buffer;
+};
+
+/*
+ * A ring of uniform data written anew each frame, as transforms and
+ * materials of many draws are. The buffer has a region for each of the
+ * frames in flight; data pushed in a frame is placed in its region and bound
+ * by range. A fence is put at the end of each frame, and its region is not
+ * written again before the fence is passed, so the driver never waits for
+ * the GPU to be done with data being replaced.
+ *
+ * Where buffer storage is supported, the buffer is mapped once, persistent
+ * and coherent. Elsewhere, or when it is not wanted, each push maps its
+ * range unsynchronized, which the fences make safe as well.
+ */
+class uniform_ring : public lazy_id_object_<uniform_ring> {
+public:
+    uniform_ring(size_t region_size, size_t frames = 3,
+            bool persistent = true);
+    uniform_ring(uniform_ring&& r) = default;
+    ~uniform_ring();
+
+    // waits until the region of the next frame is free
+    void begin_frame();
+    void end_frame();
+
+    // places data in the region of the frame, and returns its offset
+    size_t push(const void* data, size_t sz);
+
+    template<typename T, typename Trait = prop_trait<T>>
+    size_t push_property(const T& i) {
+        size_t sz = Trait::size(i);
+        size_t off = allocate_(sz);
+        Trait::copy(i, reinterpret_cast<
+                typename Trait::value_type*>(map_(off, sz)));
+        unmap_();
+        return off;
+    }
+
+    void bind(size_t binding, size_t offset, size_t sz) const;
+    void read_raw(void* data, size_t offset, size_t sz) const;
+
+    // whether buffer storage is supported by the driver
+    static bool persistent_supported();
+
+    bool persistent() const { return persistent_; }
+    size_t region_size() const { return region_size_; }
+    size_t frames() const { return fences_.size(); }
+    size_t alignment() const { return alignment_; }
+    // bytes pushed in the frame so far, padding included
+    size_t used() const { return head_ - region_ * region_size_; }
+
+    id_type create_object() const;
+    void destroy_object(id_type i) const;
+
+protected:
+    void reserve_();
+    size_t allocate_(size_t sz);
+    void* map_(size_t offset, size_t sz);
+    void unmap_();
+
+    size_t region_size_;
+    size_t alignment_ = 0;
+    bool persistent_;
+    bool in_frame_ = false;
+
+    uint8_t* mapped_ = nullptr;
+    size_t region_ = 0;
+    size_t head_ = 0;
+    size_t frame_ = 0;
+    // GLsync of each region, put at the end of the frame it was last used
+    std::vector<void*> fences_;
+};
+
+/*
+ * A ring of slices of a pixel unpack buffer, which streamed texture updates,
+ * like video frames, are staged in. A slice is acquired on the GL thread,
+ * its memory written by any thread, and uploaded on the GL thread again: the
+ * driver copies from the buffer into the texture as the GPU gets to it, and
+ * does not block the thread. A fence is put after each upload, and the slice
+ * is not given again before it is passed.
+ *
+ * Where buffer storage is supported, the buffer is mapped once, persistent
+ * and coherent. Elsewhere, slices are client memory, written into the buffer
+ * as they are uploaded.
+ */
+class texture_stream : public lazy_id_object_<texture_stream> {
+public:
+    texture_stream(size_t slice_size, size_t slices = 3,
+            bool persistent = true);
+    texture_stream(texture_stream&& s) = default;
+    ~texture_stream();
+
+    // waits until the copies from the next slice are done, and takes it
+    size_t acquire();
+    // memory of a slice taken, texels tightly packed from its start
+    void* data(size_t slice) const;
+
+    // copies texels of a slice into a rect of the texture, and gives it back
+    void upload(size_t slice, texture& t,
+            size_t offx, size_t offy, size_t offz,
+            size_t w, size_t h, size_t d,
+            texture::format fmt = texture::DEFAULT_FMT);
+    void upload(size_t slice, texture& t,
+            size_t offx, size_t offy, size_t w, size_t h,
+            texture::format fmt = texture::DEFAULT_FMT) {
+        upload(slice, t, offx, offy, 0, w, h, 1, fmt);
+    }
+    void upload(size_t slice, texture& t,
+            texture::format fmt = texture::DEFAULT_FMT) {
+        upload(slice, t, 0, 0, 0,
+                t.get_width(), t.get_height(), t.get_depth(), fmt);
+    }
+
+    bool persistent() const { return persistent_; }
+    size_t slice_size() const { return slice_size_; }
+    size_t slices() const { return fences_.size(); }
+
+    id_type create_object() const;
+    void destroy_object(id_type i) const;
+
+protected:
+    void reserve_();
+
+    size_t slice_size_;
+    bool persistent_;
+    bool reserved_ = false;
+
+    uint8_t* mapped_ = nullptr;
+    std::vector<uint8_t> staging_;
+    size_t next_ = 0;
+    // GLsync of each slice, put after its last upload
+    std::vector<void*> fences_;
+    std::vector<bool> taken_;
+};
+
+/*
+ * Uniform blocks of many objects, placed in a few large buffers rather than
+ * each in a buffer of its own, and bound by range. Ranges are aligned as the
+ * driver binds them. Those released leave holes which are reused, and when a
+ * range fits in no hole of a buffer which has room enough, the ranges of the
+ * buffer are packed at its front again.
+ *
+ * Ranges are told by handles, for their offsets change as they are packed:
+ * bind them anew before each draw.
+ */
+class uniform_arena {
+public:
+    typedef size_t handle;
+
+    uniform_arena(size_t block_size = 1 << 16) : block_size_(block_size) { }
+    uniform_arena(const uniform_arena&) = delete;
+    uniform_arena& operator=(const uniform_arena&) = delete;
+    ~uniform_arena();
+
+    handle allocate(size_t sz);
+    void release(handle h);
+
+    void write(handle h, const void* data, size_t offset, size_t sz);
+    void read(handle h, void* data) const;
+    void bind(size_t binding, handle h) const;
+
+    size_t offset(handle h) const { return range_(h).offset; }
+    size_t size(handle h) const { return range_(h).size; }
+    id_type buffer_id(handle h) const { return blocks_[range_(h).block].id; }
+
+    // packs the ranges of every buffer with holes between them
+    void compact();
+
+    size_t blocks() const { return blocks_.size(); }
+    // bytes of the ranges, padded to the alignment
+    size_t used() const { return used_; }
+    size_t alignment() const { return alignment_; }
+
+protected:
+    struct block {
+        id_type id;
+        size_t size;
+        size_t free;
+        // offsets and sizes, sorted
+        std::vector<std::pair<size_t, size_t>> holes;
+    };
+
+    struct range {
+        size_t block;
+        size_t offset;
+        size_t size;
+        size_t padded;
+        bool live;
+    };
+
+    const range& range_(handle h) const;
+    bool place_(size_t b, range& r);
+    void compact_(size_t b);
+
+    size_t block_size_;
+    size_t alignment_ = 0;
+    size_t used_ = 0;
+
+    std::vector<block> blocks_;
+    std::vector<range> ranges_;
+    std::vector<handle> free_handles_;
+};
+
+/*
+ * A range of an arena holding a property, released with it. It is sized as
+ * it is written, and placed anew should the size change.
+ */
+class property_range {
+public:
+    property_range(uniform_arena* a = nullptr) : arena_(a) { }
+    property_range(const property_range&) = delete;
+    property_range(property_range&& r) : arena_(r.arena_), handle_(r.handle_),
+            size_(r.size_), stage_(std::move(r.stage_)) {
+        r.size_ = 0;
+        r.stage_.valid = false;
+    }
+    property_range& operator=(property_range&& r) {
+        std::swap(arena_, r.arena_);
+        std::swap(handle_, r.handle_);
+        std::swap(size_, r.size_);
+        std::swap(stage_, r.stage_);
+        return *this;
+    }
+    ~property_range() { reset(); }
+
+    uniform_arena* arena() const { return arena_; }
+    void arena(uniform_arena* a) {
+        reset();
+        arena_ = a;
+    }
+
+    bool vacuum() const { return size_ == 0; }
+    size_t size() const { return size_; }
+    uniform_arena::handle get_handle() const { return handle_; }
+
+    void reserve(size_t sz);
+    void reset();
+
+    void write_raw(const void* data, size_t sz);
+    void write_range_raw(const void* data, size_t offset, size_t sz);
+    void read_raw(void* data) const;
+    void bind(size_t binding) const;
+
+    write_stage& stage() { return stage_; }
+
+protected:
+    uniform_arena* arena_;
+    uniform_arena::handle handle_ = 0;
+    size_t size_ = 0;
+    write_stage stage_;
 };
 
 }
@@ -52,9 +52,25 @@ void queue_render_task::sort() {
 
 void shader_render_task::set_property(const std::string& name,
         render_assets::property_buffer& p) {
+    prop_range_.erase(name);
+    prop_storage_.erase(name);
     prop_[name] = &p;
 }
 
+void shader_render_task::set_property(const std::string& name,
+        render_assets::property_range& p) {
+    prop_.erase(name);
+    prop_storage_.erase(name);
+    prop_range_[name] = &p;
+}
+
+void shader_render_task::set_storage_property(const std::string& name,
+        render_assets::storage_buffer& p) {
+    prop_.erase(name);
+    prop_range_.erase(name);
+    prop_storage_[name] = &p;
+}
+
 void shader_render_task::set_texture_property(const std::string& name,
         render_assets::texture& p) {
     prop_tex_[name] = &p;
@@ -69,6 +85,11 @@ void shader_render_task::render() const {
         shr_->property(e.first, *e.second);
     for(auto& e : prop_)
         shr_->property(e.first, *e.second);
+    // bound anew each time, as their ranges move when the arena is packed
+    for(auto& e : prop_range_)
+        shr_->property(e.first, *e.second);
+    for(auto& e : prop_storage_)
+        shr_->property(e.first, *e.second);
 
     shr_->target(*target_);
 
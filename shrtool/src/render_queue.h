@@ -148,6 +148,8 @@ class shader_render_task : public render_task {
     render_target* target_;
     vertex_attr_vector* attr_ = nullptr;
     std::map<std::string, render_assets::property_buffer*> prop_;
+    std::map<std::string, render_assets::property_range*> prop_range_;
+    std::map<std::string, render_assets::storage_buffer*> prop_storage_;
     std::map<std::string, render_assets::texture*> prop_tex_;
 
     PROPERTY_RW(size_t, render_count);
@@ -170,10 +172,16 @@ public:
         target_ = &render_target::screen;
         attr_ = nullptr;
         prop_.clear();
+        prop_range_.clear();
+        prop_storage_.clear();
     }
 
     void set_property(const std::string& name,
             render_assets::property_buffer& p);
+    void set_property(const std::string& name,
+            render_assets::property_range& p);
+    void set_storage_property(const std::string& name,
+            render_assets::storage_buffer& p);
     void set_texture_property(const std::string& name,
             render_assets::texture& p);
 
@@ -185,6 +193,8 @@ public:
 #include "shader_parser.h"
 #include "properties.h"
 #include "common/mesh.h"
+#include "common/image_loader.h"
+#include "common/ktx.h"
 
 namespace shrtool {
 
@@ -203,12 +213,18 @@ namespace shrtool {
 class provided_render_task : public shader_render_task {
 public:
     struct provider_bindings {
+        // holds the properties, and outlives them
+        render_assets::uniform_arena arena;
+
         std::map<size_t, shader> shader_bindings;
         std::map<size_t, render_target> target_bindings;
         std::map<size_t, vertex_attr_vector> attr_bindings;
         std::map<size_t, render_assets::texture2d> texture2d_bindings;
         std::map<size_t, render_assets::texture_cubemap> texture_cubemap_bindings;
-        std::map<size_t, render_assets::property_buffer> property_bindings;
+        std::map<size_t, render_assets::property_range> property_bindings;
+        // of each object in property_bindings, the tasks setting it
+        std::map<size_t, size_t> property_users;
+        std::map<size_t, render_assets::storage_buffer> storage_bindings;
 
         template<typename Prov, typename T, typename Bindings>
         static typename Prov::output_type& set_binding(
@@ -223,6 +239,34 @@ public:
             return res->second;
         }
 
+        render_assets::property_range& property_binding(const void* obj) {
+            size_t hashcode = reinterpret_cast<size_t>(obj);
+            auto res = property_bindings.find(hashcode);
+            if(res == property_bindings.end())
+                res = property_bindings.emplace(hashcode,
+                        render_assets::property_range(&arena)).first;
+            return res->second;
+        }
+
+        // a task sets the object, its binding is kept until it is released
+        render_assets::property_range& acquire_property(const void* obj) {
+            property_users[reinterpret_cast<size_t>(obj)] += 1;
+            return property_binding(obj);
+        }
+
+        /*
+         * The range of the object is given back to the arena, once no task
+         * sets the object any more.
+         */
+        void release_property(const void* obj) {
+            size_t hashcode = reinterpret_cast<size_t>(obj);
+            auto u = property_users.find(hashcode);
+            if(u == property_users.end() || --u->second)
+                return;
+            property_users.erase(u);
+            property_bindings.erase(hashcode);
+        }
+
         std::map<size_t, render_assets::texture2d>& get_binding(
                 render_assets::texture2d*) {
             return texture2d_bindings;
@@ -241,9 +285,34 @@ private:
     std::function<void()> target_updater;
     std::function<void()> attr_updater;
     std::map<std::string, std::function<void()>> prop_updater;
+    // objects of the properties bound by range, released when replaced
+    std::map<std::string, const void*> prop_obj_;
+
+    void release_property_(const std::string& name) {
+        auto i = prop_obj_.find(name);
+        if(i == prop_obj_.end()) return;
+        const void* obj = i->second;
+        prop_obj_.erase(i);
+        prop_updater.erase(name);
+        pb_.release_property(obj);
+    }
 
 public:
     provided_render_task(provider_bindings& pb) : pb_(pb) { }
+    provided_render_task(const provided_render_task& t) :
+            shader_render_task(t), pb_(t.pb_),
+            shader_updater(t.shader_updater),
+            target_updater(t.target_updater),
+            attr_updater(t.attr_updater),
+            prop_updater(t.prop_updater),
+            prop_obj_(t.prop_obj_) {
+        for(auto& e : prop_obj_)
+            pb_.acquire_property(e.second);
+    }
+    ~provided_render_task() {
+        for(auto& e : prop_obj_)
+            pb_.release_property(e.second);
+    }
 
     using shader_render_task::set_shader;
     template<typename T, typename Enabled = typename std::enable_if<
@@ -268,14 +337,46 @@ public:
         };
     }
 
-    using shader_render_task::set_property;
+    // the range of an object set by the name before is released
+    void set_property(const std::string& name,
+            render_assets::property_buffer& p) {
+        release_property_(name);
+        shader_render_task::set_property(name, p);
+    }
+
+    void set_property(const std::string& name,
+            render_assets::property_range& p) {
+        release_property_(name);
+        shader_render_task::set_property(name, p);
+    }
+
     template<typename T>
     void set_property(const std::string& name, T& obj) {
-        render_assets::property_buffer& r = provider_bindings::set_binding
-            <provider<T, render_assets::property_buffer>>(obj, pb_.property_bindings);
+        // acquired before the one replaced goes, in case it is the same
+        render_assets::property_range& r = pb_.acquire_property(&obj);
+        if(r.vacuum())
+            provider<T, render_assets::property_range>::update(obj, r, true);
         set_property(name, r);
+        prop_obj_[name] = &obj;
+        prop_updater[name] = [&obj, &r]() {
+            provider<T, render_assets::property_range>::update(obj, r, false);
+        };
+    }
+
+    void set_storage_property(const std::string& name,
+            render_assets::storage_buffer& p) {
+        release_property_(name);
+        shader_render_task::set_storage_property(name, p);
+    }
+
+    template<typename T>
+    void set_storage_property(const std::string& name, T& obj) {
+        render_assets::storage_buffer& r = provider_bindings::set_binding
+            <provider<T, render_assets::storage_buffer>>(
+                    obj, pb_.storage_bindings);
+        set_storage_property(name, r);
         prop_updater[name] = [&obj, &r]() {
-            provider<T, render_assets::property_buffer>::update(obj, r, false);
+            provider<T, render_assets::storage_buffer>::update(obj, r, false);
         };
     }
 
@@ -306,9 +407,13 @@ public:
             .function("set_property", &provided_render_task::set_property<dynamic_property>)
             .function("set_property_camera", &provided_render_task::set_property<camera>)
             .function("set_property_transfrm", &provided_render_task::set_property<transfrm>)
+            .function("set_storage_property", &provided_render_task::set_storage_property<dynamic_property>)
             .function("set_attributes", &provided_render_task::set_attributes<mesh_indexed>)
             .function("set_texture2d_image", &provided_render_task::set_texture_property<render_assets::texture2d, image>)
+            .function("set_texture2d_async_image", &provided_render_task::set_texture_property<render_assets::texture2d, async_image>)
             .function("set_texture_cubemap_image", &provided_render_task::set_texture_property<render_assets::texture_cubemap, image>)
+            .function("set_texture2d_ktx", &provided_render_task::set_texture_property<render_assets::texture2d, ktx_texture>)
+            .function("set_texture_cubemap_ktx", &provided_render_task::set_texture_property<render_assets::texture_cubemap, ktx_texture>)
             .function("set_texture", static_cast<void(provided_render_task::*)(const std::string&, render_assets::texture&)>(&provided_render_task::set_texture_property))
             .function("set_target", static_cast<void(provided_render_task::*)(render_target&)>(&provided_render_task::set_target));
     }
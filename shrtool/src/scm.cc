@@ -5,7 +5,11 @@
 
 #include "scm.h"
 #include "common/image.h"
+#include "common/ktx.h"
+#include "common/image_loader.h"
 #include "common/mesh.h"
+#include "common/bvh.h"
+#include "common/mesh_codec.h"
 #include "properties.h"
 #include "render_assets.h"
 #include "render_queue.h"
@@ -65,6 +69,18 @@ DEF_ENUM_MAP(em_scm_enum_tranform__, std::string, size_t, ({
         { "rgb-f32", render_assets::texture::RGB_F32 },
         { "rgba-f32", render_assets::texture::RGBA_F32 },
         { "depth-f32", render_assets::texture::DEPTH_F32 },
+        { "r-u8", render_assets::texture::R_U8 },
+        { "rg-u88", render_assets::texture::RG_U88 },
+        { "r-f16", render_assets::texture::R_F16 },
+        { "rg-f16", render_assets::texture::RG_F16 },
+        { "rgba-f16", render_assets::texture::RGBA_F16 },
+        { "rgb-f111110", render_assets::texture::RGB_F111110 },
+        { "depth-u16", render_assets::texture::DEPTH_U16 },
+        { "depth-u24", render_assets::texture::DEPTH_U24 },
+        { "bc1-rgba", render_assets::texture::BC1_RGBA },
+        { "bc3-rgba", render_assets::texture::BC3_RGBA },
+        { "bc4-r", render_assets::texture::BC4_R },
+        { "bc5-rg", render_assets::texture::BC5_RG },
         { "default-fmt", render_assets::texture::DEFAULT_FMT },
     }))
 
@@ -96,11 +112,56 @@ struct builtin {
         return image_io_netpbm::load(fin);
     }
 
+    static async_image image_from_ppm_async(const std::string& fn) {
+        return image_loader::global().load(fn, image_io_netpbm::load);
+    }
+
+    // of whichever format the file is in
+    static image image_from_file(const std::string& fn) {
+        std::ifstream fin(fn, std::ios::binary);
+        if(!fin) throw not_found_error("Cannot open image file " + fn);
+        return image::load(fin);
+    }
+
+    static async_image image_from_file_async(const std::string& fn) {
+        return image_loader::global().load(fn);
+    }
+
+    static bool async_image_ready(const async_image& im) {
+        return im.ready();
+    }
+
+    static image async_image_wait(const async_image& im) {
+        return im.wait();
+    }
+
     static void image_save_ppm(const image& im, const std::string& fn) {
         std::ofstream fout(fn);
         return image_io_netpbm::save_image(fout, im);
     }
 
+    static void image_save_qoi(const image& im, const std::string& fn) {
+        std::ofstream fout(fn, std::ios::binary);
+        return image_io_qoi::save_image(fout, im);
+    }
+
+    static void image_bake_ktx(const image& im, const std::string& fn,
+            bool cubemap) {
+        std::ofstream fout(fn, std::ios::binary);
+        ktx_texture::bake(fout, im, cubemap);
+    }
+
+    static void image_bake_ktx_compressed(const image& im,
+            const std::string& fn, render_assets::texture::format fmt) {
+        std::ofstream fout(fn, std::ios::binary);
+        ktx_texture::bake_compressed(fout, im, fmt);
+    }
+
+    // mapped, its levels are uploaded from the file as they are
+    static ktx_texture ktx_from_file(const std::string& fn) {
+        return ktx_texture::open(fn);
+    }
+
     static image texture_to_image(render_assets::texture& tex,
             render_assets::texture::format fmt) {
         if(fmt != render_assets::texture::RGBA_U8888) throw unsupported_error(
@@ -112,8 +173,27 @@ struct builtin {
 
     static scm_t meshes_from_wavefront(const std::string& fn) {
         std::ifstream fin(fn);
-        std::vector<mesh_indexed> meshes = mesh_io_object::load(fin);
+        // all meshes of the file go away together
+        return meshes_to_scm(mesh_io_object::load(fin,
+                    std::make_shared<arena>()));
+    }
 
+    static scm_t meshes_from_compressed(const std::string& fn) {
+        std::ifstream fin(fn, std::ios::binary);
+        return meshes_to_scm(mesh_io_compressed::load(fin,
+                    std::make_shared<arena>()));
+    }
+
+    static void wavefront_to_compressed(const std::string& src,
+            const std::string& dst, bool quantize) {
+        std::ifstream fin(src);
+        std::ofstream fout(dst, std::ios::binary);
+        mesh_codec::options opt;
+        if(quantize) opt.prec = mesh_codec::QUANTIZED;
+        mesh_io_compressed::save(fout, mesh_io_object::load(fin), opt);
+    }
+
+    static scm_t meshes_to_scm(std::vector<mesh_indexed>&& meshes) {
         SCM vec = scm_make_vector(scm_from_size_t(meshes.size()),
                 SCM_UNDEFINED);
         for(size_t i = 0; i < meshes.size(); i++) {
@@ -183,7 +263,16 @@ struct builtin {
             .enable_auto_register()
             .function("shader_from_config", shader_from_config)
             .function("image_from_ppm", image_from_ppm)
+            .function("image_from_ppm_async", image_from_ppm_async)
+            .function("image_from_file", image_from_file)
+            .function("image_from_file_async", image_from_file_async)
+            .function("ready?", async_image_ready)
+            .function("wait", async_image_wait)
             .function("image_save_ppm", image_save_ppm)
+            .function("image_save_qoi", image_save_qoi)
+            .function("image_bake_ktx", image_bake_ktx)
+            .function("image_bake_ktx_compressed", image_bake_ktx_compressed)
+            .function("ktx_from_file", ktx_from_file)
             .function("texture_to_image", texture_to_image)
             .function("make_propset", make_propset)
             .function("make_shading_rtask", make_shading_rtask)
@@ -191,6 +280,8 @@ struct builtin {
             .function("instance_search_function", &instance_search_function)
             .function("instance_get_type", &instance_get_type)
             .function("meshes_from_wavefront", meshes_from_wavefront)
+            .function("meshes_from_compressed", meshes_from_compressed)
+            .function("wavefront_to_compressed", wavefront_to_compressed)
             .function("set_log_level", logger_manager::set_current_level);
     }
 };
@@ -474,8 +565,21 @@ void parse_layout(SCM layout_list, std::vector<layout::type_name_pair>& l)
                 scm_symbol_to_string(scm_car(cur)));
         const char* n = scm_to_latin1_string(scm_cdr(cur));
 
-        l.push_back(std::make_pair(
-                em_scm_sym_type_name__(t), n));
+        // as "col4-array", an unsized array of the type
+        std::string ts(t);
+        const std::string suffix = "-array";
+        layout::item_type it;
+        if(ts.size() > suffix.size() && ts.compare(
+                    ts.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            it = em_scm_sym_type_name__(
+                    ts.substr(0, ts.size() - suffix.size()));
+            if(it >= layout::TEX2D)
+                throw unsupported_error("Textures cannot be in arrays.");
+            it = layout::item_type(it | layout::ARRAY);
+        } else
+            it = em_scm_sym_type_name__(ts);
+
+        l.push_back(std::make_pair(it, n));
 
         if(scm_is_null(tail)) break;
     }
@@ -1,5 +1,6 @@
 #include "shader_parser.h"
 #include "iostream"
+#include <cctype>
 #include "common/exception.h"
 #include "scm.h"
 
@@ -17,10 +18,48 @@ DEF_ENUM_MAP(em_glsl_type_name__, layout::item_type, const char*, ({
         { layout::TEXCUBEMAP, "samplerCube" },
     }))
 
+/*
+ * The plain C++ members items are held as in generated structs, of the size
+ * and align std140 gives them
+ */
+struct struct_item_info__ {
+    const char* type;
+    size_t count;
+    size_t size;
+    size_t align;
+};
+
+DEF_ENUM_MAP(em_struct_item_info__, layout::item_type, struct_item_info__, ({
+        { layout::COLOR, { "float", 4, item_trait<math::fcol4>::size(),
+            item_trait<math::fcol4>::align() } },
+        { layout::COL2, { "float", 2, item_trait<math::fcol2>::size(),
+            item_trait<math::fcol2>::align() } },
+        { layout::COL3, { "float", 3, item_trait<math::fcol3>::size(),
+            item_trait<math::fcol3>::align() } },
+        { layout::COL4, { "float", 4, item_trait<math::fcol4>::size(),
+            item_trait<math::fcol4>::align() } },
+        { layout::MAT4, { "float", 16, item_trait<math::fmat4>::size(),
+            item_trait<math::fmat4>::align() } },
+        { layout::INT, { "int32_t", 1, item_trait<int>::size(),
+            item_trait<int>::align() } },
+        { layout::FLOAT, { "float", 1, item_trait<float>::size(),
+            item_trait<float>::align() } },
+    }))
+
+// names of groups and shaders, as "blinn-phong", made C++ identifiers
+static std::string cpp_identifier__(const std::string& n)
+{
+    std::string id(n);
+    for(char& c : id)
+        if(!isalnum(c)) c = '_';
+    if(id.empty() || isdigit(id[0])) id = "_" + id;
+    return id;
+}
 
 std::string layout::glsl_type_name(layout::item_type t)
 {
-    return em_glsl_type_name__(t);
+    return em_glsl_type_name__(is_array(t) ?
+            item_type(t & ~ARRAY) : t);
 }
 
 const sub_shader_info* shader_info::get_sub_shader_by_type(
@@ -64,22 +103,27 @@ std::string layout::make_source_as_attr() const
 
 std::string layout::make_source_as_prop(const std::string& n) const
 {
-    std::string src = "uniform " + n + " {\n";
+    std::string src;
     std::vector<const type_name_pair*> textures;
 
-    bool empty = true;
+    bool empty = true, storage = false;
 
     for(auto& li : value) {
         if(li.first >= TEX2D) {
             textures.push_back(&li);
             continue;
         }
+        if(storage)
+            throw restriction_error("Unsized array in " + n +
+                    " is not its last item");
 
         empty = false;
+        storage = is_array(li.first);
         src += "    " + layout::glsl_type_name(li.first) +
-            " " + li.second + ";\n";
+            " " + li.second + (storage ? "[]" : "") + ";\n";
     }
-    src += "};\n";
+    src = (storage ? "layout (std430) buffer " : "uniform ") +
+        n + " {\n" + src + "};\n";
     src = empty ? "" : src;
 
     for(auto* li : textures) {
@@ -89,6 +133,111 @@ std::string layout::make_source_as_prop(const std::string& n) const
     return src;
 }
 
+bool layout::has_array() const
+{
+    for(auto& li : value)
+        if(is_array(li.first)) return true;
+    return false;
+}
+
+std::string layout::make_source_as_struct(const std::string& n) const
+{
+    std::string id = cpp_identifier__(n);
+    std::string src = "struct " + id + " {\n", asserts;
+    size_t cur_off = 0, pads = 0;
+
+    for(auto& li : value) {
+        if(li.first >= TEX2D) continue;
+        if(is_array(li.first))
+            throw unsupported_error("Unsized array " + li.second +
+                    " has no struct of std140");
+
+        struct_item_info__ info = em_struct_item_info__(li.first);
+        size_t off = (cur_off + info.align - 1) / info.align * info.align;
+        if(off > cur_off)
+            src += "    uint8_t pad" + std::to_string(pads++) + "_[" +
+                std::to_string(off - cur_off) + "];\n";
+
+        src += std::string("    ") + info.type + " " + li.second +
+            (info.count > 1 ? "[" + std::to_string(info.count) + "]" : "") +
+            ";\n";
+        asserts += "static_assert(offsetof(" + id + ", " + li.second +
+            ") == " + std::to_string(off) + ",\n    \"" + id + "::" +
+            li.second + " is not at its std140 offset\");\n";
+        cur_off = off + info.size;
+    }
+
+    if(!cur_off) return "";
+
+    // blocks are as large as a multiple of a vec4
+    size_t sz = (cur_off + 15) / 16 * 16;
+    if(sz > cur_off)
+        src += "    uint8_t pad" + std::to_string(pads++) + "_[" +
+            std::to_string(sz - cur_off) + "];\n";
+    src += "};\n";
+    asserts += "static_assert(sizeof(" + id + ") == " + std::to_string(sz) +
+        ",\n    \"" + id + " is not of its std140 size\");\n";
+
+    return src + asserts;
+}
+
+std::string shader_parser::make_struct_header(
+        const std::vector<shader_info>& shaders)
+{
+    std::string structs, traits;
+
+    for(const shader_info& si : shaders) {
+        std::string ns = cpp_identifier__(si.name);
+        std::string src;
+
+        for(auto& p : si.property_groups) {
+            // storage groups are filled by dynamic properties
+            if(p.second.has_array()) continue;
+            std::string s = p.second.make_source_as_struct(p.first);
+            if(s.empty()) continue;
+            src += "\n" + s;
+
+            std::string t = "props::" + ns + "::" + cpp_identifier__(p.first);
+            traits += "\ntemplate<>\n"
+                "struct prop_trait<" + t + "> {\n"
+                "    typedef " + t + " input_type;\n"
+                "    typedef shrtool::raw_data_tag transfer_tag;\n"
+                "    typedef uint8_t value_type;\n"
+                "\n"
+                "    static size_t size(const input_type&) {\n"
+                "        return sizeof(input_type);\n"
+                "    }\n"
+                "    static const uint8_t* data(const input_type& i) {\n"
+                "        return reinterpret_cast<const uint8_t*>(&i);\n"
+                "    }\n"
+                "\n"
+                "    // structs keep no record of changes\n"
+                "    static bool is_changed(const input_type&) { return true; }\n"
+                "    static void mark_applied(input_type&) { }\n"
+                "};\n";
+        }
+
+        if(!src.empty())
+            structs += "\nnamespace " + ns + " {\n" + src + "\n}\n";
+    }
+
+    return "// Generated from shader definitions. Do not edit.\n"
+        "\n"
+        "#ifndef SHADER_PROPS_H_INCLUDED\n"
+        "#define SHADER_PROPS_H_INCLUDED\n"
+        "\n"
+        "#include <cstddef>\n"
+        "#include <cstdint>\n"
+        "\n"
+        "#include \"common/traits.h\"\n"
+        "\n"
+        "namespace shrtool {\n"
+        "\n"
+        "namespace props {\n" + structs + "\n}\n" + traits + "\n}\n"
+        "\n"
+        "#endif // SHADER_PROPS_H_INCLUDED\n";
+}
+
 std::string sub_shader_info::make_source(const shader_info& parent) const
 {
     std::string src;
@@ -26,6 +26,8 @@ public:
         MAT4,
         INT,
         FLOAT,
+        // or'ed with a type above, an unsized array of it
+        ARRAY = 512,
         TEX2D = 1024,
         TEXCUBEMAP
     };
@@ -40,13 +42,26 @@ public:
     layout(layout&& l) : value(std::move(l.value)) { }
 
     static std::string glsl_type_name(item_type t);
+    static bool is_array(item_type t) { return t < TEX2D && (t & ARRAY); }
 
     const type_name_pair& operator[](size_t i) const {
         return value[i];
     }
 
     std::string make_source_as_attr() const;
+    /*
+     * A uniform block, or a std430 storage block when the group has an
+     * unsized array, which is then to be its last item but textures
+     */
     std::string make_source_as_prop(const std::string& n) const;
+
+    bool has_array() const;
+    /*
+     * A plain C++ struct of the block, padded as std140 lays it out, with
+     * its offsets checked at compile time. Textures are left out, and an
+     * empty string is made when nothing is left.
+     */
+    std::string make_source_as_struct(const std::string& n) const;
 };
 
 struct shader_info;
@@ -104,6 +119,14 @@ struct shader_parser {
     }
 
     static void load_shader(std::istream& is, shader_info& s);
+
+    /*
+     * A header of the structs of the property groups of the shaders, in
+     * namespaces named after them, with their prop_trait, so that they are
+     * provided as property buffers written at once.
+     */
+    static std::string make_struct_header(
+            const std::vector<shader_info>& shaders);
 };
 
 template<>
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <chrono>
 #include <regex>
+#include <set>
 
 #include "common/exception.h"
 #include "shading.h"
@@ -100,11 +101,22 @@ void render_target::attach_texture(
     if(this == &screen)
         throw restriction_error("You cannot attach any "
                 "texture to the screen.");
+
+    // checked before anything is changed, the one at ba is replaced anyway
+    bool cubemap = tex.get_trait() & texture::CUBEMAP;
+    if(cubemap) {
+        for(auto& e : rb_attachments_)
+            if(e.first != ba)
+                throw restriction_error("Renderbuffers cannot be shared by "
+                        "the faces of a cubemap");
+    }
+
     tex_attachments_[ba] = &tex;
+    rb_attachments_.erase(ba);
 
     auto att = em_buffer_attachment_(ba);
 
-    if((tex.get_trait() & texture::CUBEMAP) == 0) {
+    if(!cubemap) {
         glBindFramebuffer(GL_FRAMEBUFFER, id());
         tex.attach_to(att);
         glBindFramebuffer(GL_FRAMEBUFFER, GL_NONE);
@@ -133,6 +145,25 @@ void render_target::attach_texture(
     set_viewport(rect::from_size(tex.get_width(), tex.get_height()));
 }
 
+void render_target::attach_renderbuffer(
+        render_target::buffer_attachment ba,
+        render_assets::renderbuffer &rb) {
+    if(this == &screen)
+        throw restriction_error("You cannot attach any "
+                "renderbuffer to the screen.");
+    if(has_multiple_pass())
+        throw restriction_error("Renderbuffers cannot be shared by "
+                "the faces of a cubemap");
+    rb_attachments_[ba] = &rb;
+    tex_attachments_.erase(ba);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, id());
+    rb.attach_to(em_buffer_attachment_(ba));
+    glBindFramebuffer(GL_FRAMEBUFFER, GL_NONE);
+
+    set_viewport(rect::from_size(rb.get_width(), rb.get_height()));
+}
+
 void render_target::apply_properties() const
 {
     const auto& vp = get_viewport();
@@ -176,8 +207,12 @@ void render_target::apply_properties() const
 
     if(!is_screen()) {
         std::vector<GLuint> dbs;
-        for(auto e : tex_attachments_) {
-            auto att = em_buffer_attachment_(e.first);
+        std::set<buffer_attachment> atts;
+        for(auto e : tex_attachments_) atts.insert(e.first);
+        for(auto e : rb_attachments_) atts.insert(e.first);
+
+        for(auto a : atts) {
+            auto att = em_buffer_attachment_(a);
             if(att >= GL_COLOR_ATTACHMENT0 &&
                 att <= GL_COLOR_ATTACHMENT0 + 16) { // max number gl allows
                 dbs.push_back(att);
@@ -235,15 +270,19 @@ void shader::property_binding(const std::string& name, size_t binding) {
     property_binding_[name] = binding;
 }
 
-size_t shader::property(const std::string& name,
-        const render_assets::property_buffer& buf) {
+size_t shader::property_binding(const std::string& name) {
     auto i = property_binding_.find(name);
-    size_t binding = max_binding_index_ + 1;
-
     if(i != property_binding_.end())
-        binding = i->second;
-    else property_binding(name, binding);
+        return i->second;
 
+    size_t binding = max_binding_index_ + 1;
+    property_binding(name, binding);
+    return binding;
+}
+
+size_t shader::property(const std::string& name,
+        const render_assets::property_buffer& buf) {
+    size_t binding = property_binding(name);
     property(binding, buf);
 
     return binding;
@@ -258,6 +297,72 @@ void shader::property(size_t binding,
     glUseProgram(GL_NONE);
 }
 
+void shader::storage_binding(const std::string& name, size_t binding) {
+    if(storage_binding_.find(name) != storage_binding_.end())
+        throw shader_error("Storage block " + name + " has bound.");
+
+    GLuint idx = glGetProgramResourceIndex(id(),
+            GL_SHADER_STORAGE_BLOCK, name.c_str());
+    if(idx == GL_INVALID_INDEX)
+        warning_log << "Unable to find storage block " << name << std::endl;
+    else
+        glShaderStorageBlockBinding(id(), idx, binding);
+
+    if(binding > max_storage_index_) max_storage_index_ = binding;
+    storage_binding_[name] = binding;
+}
+
+size_t shader::storage_binding(const std::string& name) {
+    auto i = storage_binding_.find(name);
+    if(i != storage_binding_.end())
+        return i->second;
+
+    size_t binding = max_storage_index_ + 1;
+    storage_binding(name, binding);
+    return binding;
+}
+
+size_t shader::property(const std::string& name,
+        const render_assets::storage_buffer& buf) {
+    size_t binding = storage_binding(name);
+    property(binding, buf);
+
+    return binding;
+}
+
+void shader::property(size_t binding,
+        const render_assets::storage_buffer& buf) {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buf.id());
+}
+
+size_t shader::property(const std::string& name,
+        const render_assets::property_range& range) {
+    size_t binding = property_binding(name);
+    property(binding, range);
+
+    return binding;
+}
+
+void shader::property(size_t binding,
+        const render_assets::property_range& range) {
+    range.bind(binding);
+}
+
+size_t shader::property(const std::string& name,
+        const render_assets::uniform_ring& ring,
+        size_t offset, size_t sz) {
+    size_t binding = property_binding(name);
+    property(binding, ring, offset, sz);
+
+    return binding;
+}
+
+void shader::property(size_t binding,
+        const render_assets::uniform_ring& ring,
+        size_t offset, size_t sz) {
+    ring.bind(binding, offset, sz);
+}
+
 size_t shader::property(const std::string& name,
         const render_assets::texture& tex) {
     const char* c_name = name.c_str();
@@ -63,6 +63,7 @@ public:
 protected:
     rect viewport_;
     std::map<buffer_attachment, render_assets::texture*> tex_attachments_;
+    std::map<buffer_attachment, render_assets::renderbuffer*> rb_attachments_;
     std::vector<id_type> sub_targets_;
 
 public:
@@ -78,6 +79,12 @@ public:
         draw_face_(BOTH_FACE), blend_func_(OVERRIDE_BLEND) { }
 
     void attach_texture(buffer_attachment ba, render_assets::texture& tex);
+    /*
+     * A renderbuffer for attachments never sampled. It is a single surface,
+     * so it cannot be shared by the passes of a cubemap target.
+     */
+    void attach_renderbuffer(buffer_attachment ba,
+            render_assets::renderbuffer& rb);
 
     void apply_properties() const;
     void clear_buffer(buffer_attachment ba) const;
@@ -104,7 +111,8 @@ public:
     }
 
     bool is_screen() const {
-        return tex_attachments_.empty() && vacuum();
+        return tex_attachments_.empty() && rb_attachments_.empty() &&
+            vacuum();
     }
 
     bool has_multiple_pass() const {
@@ -135,7 +143,9 @@ public:
             .function("set_blend_func", &render_target::set_blend_func)
             .function("get_blend_func", &render_target::get_blend_func)
             .function("is_screen", &render_target::is_screen)
-            .function("attach_texture", &render_target::attach_texture);
+            .function("attach_texture", &render_target::attach_texture)
+            .function("attach_renderbuffer",
+                    &render_target::attach_renderbuffer);
     }
 
     // This is a global screen. Its viewport will always be maintained at the
@@ -159,11 +169,18 @@ public:
 
 protected:
     void property_binding(const std::string& name, size_t binding);
+    // the binding of the name, allocated for it at first
+    size_t property_binding(const std::string& name);
+    // storage blocks are bound in a space of their own
+    void storage_binding(const std::string& name, size_t binding);
+    size_t storage_binding(const std::string& name);
 
     std::unordered_map<shader_type, sub_shader_ptr> sub_shaders_;
 
     size_t max_binding_index_ = 0;
     std::map<std::string, size_t> property_binding_;
+    size_t max_storage_index_ = 0;
+    std::map<std::string, size_t> storage_binding_;
     std::map<size_t, const render_assets::texture*> textures_binding_;
 
     render_target* target_;
@@ -188,6 +205,22 @@ public:
             const render_assets::property_buffer& buf);
     void property(size_t binding,
             const render_assets::property_buffer& buf);
+    // a storage block, by the name of its block
+    size_t property(const std::string& name,
+            const render_assets::storage_buffer& buf);
+    void property(size_t binding,
+            const render_assets::storage_buffer& buf);
+    size_t property(const std::string& name,
+            const render_assets::property_range& range);
+    void property(size_t binding,
+            const render_assets::property_range& range);
+    // a range of a ring, as pushed in this frame
+    size_t property(const std::string& name,
+            const render_assets::uniform_ring& ring,
+            size_t offset, size_t sz);
+    void property(size_t binding,
+            const render_assets::uniform_ring& ring,
+            size_t offset, size_t sz);
     size_t property(const std::string& name,
             const render_assets::texture& tex);
     void property(size_t binding,
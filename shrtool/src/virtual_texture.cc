@@ -0,0 +1,42 @@
+#include "virtual_texture.h"
+
+namespace shrtool {
+
+using namespace render_assets;
+
+virtual_texture::virtual_texture(const image& im, size_t page_size,
+        size_t slots_x, size_t slots_y) :
+    pages_(im, page_size, slots_x, slots_y),
+    atlas_(slots_x * pages_.slot_size(), slots_y * pages_.slot_size(),
+            texture::RGBA_U8888),
+    indirection_(pages_.indirection_width(), pages_.indirection_height(),
+            texture::RGBA_U8888),
+    scratch_(pages_.slot_size(), pages_.slot_size())
+{
+    indirection_.set_filter(texture::NEAREST);
+}
+
+size_t virtual_texture::update(size_t max_uploads)
+{
+    if(atlas_.vacuum()) atlas_.reserve();
+    if(indirection_.vacuum()) indirection_.reserve();
+
+    size_t n = pages_.slot_size();
+    std::vector<page_cache::placement> placed = pages_.update(max_uploads);
+
+    for(const page_cache::placement& p : placed) {
+        pages_.copy_page(p.page, scratch_.view());
+        atlas_.fill_rect(p.slot_x * n, p.slot_y * n, n, n, scratch_.data());
+    }
+
+    std::pair<size_t, size_t> rows = pages_.take_dirty_rows();
+    if(rows.first < rows.second) {
+        size_t w = pages_.indirection_width();
+        indirection_.fill_rect(0, rows.first, w, rows.second - rows.first,
+                pages_.indirection() + rows.first * w);
+    }
+
+    return placed.size();
+}
+
+}
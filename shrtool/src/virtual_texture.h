@@ -0,0 +1,47 @@
+#ifndef VIRTUAL_TEXTURE_H_INCLUDED
+#define VIRTUAL_TEXTURE_H_INCLUDED
+
+#include "render_assets.h"
+#include "common/image.h"
+#include "common/page_cache.h"
+
+namespace shrtool {
+
+/*
+ * virtual_texture shows an image larger than is to be resident, of which
+ * page_cache decides the pages kept. An atlas texture2d holds the resident
+ * pages in its slots, and an indirection texture2d, to be sampled nearest,
+ * holds the table of the page_cache: the slot (sx, sy) and level l of the
+ * page to sample for each page of level 0. Pages are uploaded into the
+ * atlas with fill_rect as they are placed, and only the rows of the
+ * indirection which changed are uploaded again.
+ *
+ * A shader finds the texel at uv of an image of width w in the atlas at
+ *     (sx, sy) * slot_size + border + fract(uv * w / (page_size * 2^l)) * page_size
+ */
+class virtual_texture {
+public:
+    virtual_texture(const image& im, size_t page_size = 128,
+            size_t slots_x = 16, size_t slots_y = 16);
+
+    page_cache& pages() { return pages_; }
+    const page_cache& pages() const { return pages_; }
+    render_assets::texture2d& atlas() { return atlas_; }
+    render_assets::texture2d& indirection() { return indirection_; }
+
+    /*
+     * Places the pages requested since the last update, uploading up to
+     * max_uploads of them, and returns how many were.
+     */
+    size_t update(size_t max_uploads = 16);
+
+private:
+    page_cache pages_;
+    render_assets::texture2d atlas_;
+    render_assets::texture2d indirection_;
+    image scratch_;
+};
+
+}
+
+#endif // VIRTUAL_TEXTURE_H_INCLUDED
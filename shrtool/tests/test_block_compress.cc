@@ -0,0 +1,139 @@
+#define EXPOSE_EXCEPTION
+
+#include <cstdlib>
+
+#include "common/unit_test.h"
+#include "common/block_compress.h"
+
+using namespace std;
+using namespace shrtool;
+using namespace shrtool::unit_test;
+
+image gradient(size_t w, size_t h)
+{
+    image im(w, h);
+    for(size_t y = 0; y < h; y++)
+        for(size_t x = 0; x < w; x++)
+            im.pixel(x, y) = color(x * 255 / w, y * 255 / h,
+                    (x + y) * 127 / (w + h), 255);
+    return im;
+}
+
+image crop(const const_image_view& v)
+{
+    image im(v.width(), v.height());
+    v.copy_to(im.view());
+    return im;
+}
+
+int max_error(const image& a, const image& b, size_t channels)
+{
+    int e = 0;
+    for(size_t y = 0; y < a.height(); y++)
+        for(size_t x = 0; x < a.width(); x++)
+            for(size_t c = 0; c < channels; c++)
+                e = max(e, abs(int(a.pixel(x, y).data.bytes[c]) -
+                            int(b.pixel(x, y).data.bytes[c])));
+    return e;
+}
+
+double mean_error(const image& a, const image& b, size_t channels)
+{
+    double e = 0;
+    for(size_t y = 0; y < a.height(); y++)
+        for(size_t x = 0; x < a.width(); x++)
+            for(size_t c = 0; c < channels; c++)
+                e += abs(int(a.pixel(x, y).data.bytes[c]) -
+                        int(b.pixel(x, y).data.bytes[c]));
+    return e / (a.width() * a.height() * channels);
+}
+
+TEST_CASE(test_encoded_size) {
+    assert_equal_print(compressed_image::encoded_size(4, 4, BC1_RGBA), 8u);
+    assert_equal_print(compressed_image::encoded_size(8, 4, BC3_RGBA), 32u);
+    // partial blocks at the edges are whole
+    assert_equal_print(compressed_image::encoded_size(5, 1, BC4_R), 16u);
+    assert_equal_print(compressed_image::encoded_size(6, 6, BC5_RG), 64u);
+    assert_true(compressed_image::is_compressed(BC5_RG));
+    assert_true(!compressed_image::is_compressed(RGBA_U8888));
+}
+
+TEST_CASE(test_bc1_round_trip) {
+    image im = gradient(32, 32);
+    compressed_image ci = block_compress::encode(im, BC1_RGBA);
+    assert_equal_print(ci.size(), 32u / 4 * 32 / 4 * 8);
+
+    image out = block_compress::decode(ci);
+    assert_equal_print(out.width(), 32u);
+    // colors spread over a plane in each block, off the line of the palette
+    assert_true(max_error(im, out, 3) <= 24);
+    assert_true(mean_error(im, out, 3) <= 6);
+
+    // solid blocks come back exactly as near as 565 allows
+    image solid(4, 4);
+    for(color& c : solid) c = color(255, 0, 0);
+    assert_equal_print(block_compress::decode(
+                block_compress::encode(solid, BC1_RGBA)).pixel(2, 2),
+            color(255, 0, 0));
+}
+
+TEST_CASE(test_bc1_punch_through) {
+    image im(4, 4);
+    for(size_t y = 0; y < 4; y++)
+        for(size_t x = 0; x < 4; x++)
+            im.pixel(x, y) = x < 2 ?
+                color(0, 0, 0, 0) : color(40, 200, 90, 255);
+
+    image out = block_compress::decode(
+            block_compress::encode(im, BC1_RGBA));
+    assert_equal_print(out.pixel(0, 0)[3], 0);
+    assert_equal_print(out.pixel(3, 3)[3], 255);
+    assert_true(max_error(crop(out.view(2, 0, 2, 4)),
+                crop(im.view(2, 0, 2, 4)), 3) <= 4);
+}
+
+TEST_CASE(test_bc3_alpha) {
+    image im = gradient(16, 8);
+    for(size_t y = 0; y < im.height(); y++)
+        for(size_t x = 0; x < im.width(); x++)
+            im.pixel(x, y)[3] = x * 16;
+
+    image out = block_compress::decode(
+            block_compress::encode(im, BC3_RGBA));
+    // 8 levels of alpha over a range of 48 in each block
+
+    for(size_t y = 0; y < im.height(); y++)
+        for(size_t x = 0; x < im.width(); x++)
+            assert_true(abs(int(out.pixel(x, y)[3]) - int(x * 16)) <= 4);
+}
+
+TEST_CASE(test_bc4_bc5_partial_blocks) {
+    // neither side a multiple of 4, and a view into a larger image
+    image big = gradient(23, 11);
+    image im = crop(big.view(1, 2, 13, 6));
+
+    compressed_image c4 = block_compress::encode(
+            big.view(1, 2, 13, 6), BC4_R);
+    assert_equal_print(c4.size(), 4u * 2 * 8);
+    image o4 = block_compress::decode(c4);
+    assert_equal_print(o4.width(), 13u);
+    assert_equal_print(o4.height(), 6u);
+    assert_true(max_error(im, o4, 1) <= 3);
+    // absent channels are 0, opaque
+    assert_equal_print(o4.pixel(12, 5)[1], 0);
+    assert_equal_print(o4.pixel(12, 5)[3], 255);
+
+    image o5 = block_compress::decode(block_compress::encode(im, BC5_RG));
+    assert_true(max_error(im, o5, 2) <= 4);
+    assert_equal_print(o5.pixel(0, 0)[2], 0);
+}
+
+TEST_CASE(test_unsupported_format) {
+    image im = gradient(4, 4);
+    assert_except(block_compress::encode(im, RGBA_F32), unsupported_error);
+}
+
+int main(int argc, char* argv[])
+{
+    return unit_test::test_main(argc, argv);
+}
@@ -0,0 +1,151 @@
+#define EXPOSE_EXCEPTION
+
+#include <random>
+
+#include "common/unit_test.h"
+#include "common/bvh.h"
+
+using namespace std;
+using namespace shrtool;
+using namespace shrtool::math;
+using namespace shrtool::unit_test;
+
+ray_hit brute_force(const mesh_indexed& m, const fcol3& o, const fcol3& d)
+{
+    ray_hit best;
+
+    for(size_t i = 0; i < m.triangles(); i++) {
+        col3 p0(m.get_position(i, 0)), p1(m.get_position(i, 1)),
+             p2(m.get_position(i, 2));
+        col3 dd(d), e1 = p1 - p0, e2 = p2 - p0;
+        col3 pv = cross(dd, e2);
+        double det = dot(e1, pv);
+        if(det == 0) continue;
+        col3 tv = col3(o) - p0;
+        double u = dot(tv, pv) / det;
+        col3 qv = cross(tv, e1);
+        double v = dot(dd, qv) / det;
+        double t = dot(e2, qv) / det;
+        if(u < 0 || v < 0 || u + v > 1 || t < 0 || t >= best.t) continue;
+        best.t = t;
+        best.u = u;
+        best.v = v;
+        best.triangle = i;
+    }
+
+    return best;
+}
+
+TEST_CASE(test_bvh_axis_rays) {
+    mesh_indexed s = mesh_uv_sphere(2, 64, 32);
+    mesh_bvh bvh(s);
+
+    assert_equal_print(bvh.triangles(), s.triangles());
+    assert_true(bvh.node_count() > 1);
+
+    fcol3 dirs[] = {
+        { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0.001 },
+        { 0, -1, 0.001 }, { 0, 0, 1 }, { 0, 0, -1 },
+    };
+    for(const fcol3& d : dirs) {
+        ray_hit h = bvh.intersect(d * -5.f, d);
+        assert_true(h.hit());
+        // the tessellated sphere lies slightly inside the ideal one
+        assert_float_close(h.t, 3, 0.01);
+    }
+
+    // from inside, the ray leaves through the far side
+    ray_hit h = bvh.intersect(fcol3 { 0, 0, 0 }, fcol3 { 1, 0, 0 });
+    assert_float_close(h.t, 2, 0.01);
+
+    assert_false(bvh.intersect(fcol3 { 0, 5, 0 }, fcol3 { 1, 0, 0 }).hit());
+    assert_false(bvh.intersect(fcol3 { -5, 0, 0 }, fcol3 { 1, 0, 0 },
+                0, 2.5).hit());
+}
+
+TEST_CASE(test_bvh_against_brute_force) {
+    mesh_indexed s = mesh_uv_sphere(1, 24, 12);
+    mesh_indexed b = mesh_box(0.5, 3, 0.5);
+    mesh_bvh bvh_s(s), bvh_b(b);
+
+    mt19937 rng(1234);
+    uniform_real_distribution<float> dist(-1, 1);
+
+    for(size_t i = 0; i < 500; i++) {
+        fcol3 o { dist(rng) * 4, dist(rng) * 4, dist(rng) * 4 };
+        fcol3 target { dist(rng) * 0.7f, dist(rng) * 0.7f, dist(rng) * 0.7f };
+        fcol3 d = target - o;
+
+        for(auto* p : { &s, &b }) {
+            const mesh_bvh& bvh = p == &s ? bvh_s : bvh_b;
+            ray_hit ref = brute_force(*p, o, d);
+            ray_hit h = bvh.intersect(o, d);
+
+            assert_equal_print(h.hit(), ref.hit());
+            assert_equal_print(bvh.occluded(o, d), ref.hit());
+            if(ref.hit()) {
+                assert_float_close(h.t, ref.t, 0.0001);
+                assert_float_close(h.u + h.v, ref.u + ref.v, 0.001);
+            }
+        }
+    }
+}
+
+TEST_CASE(test_bvh_large_and_refit) {
+    // large enough to be built on several threads
+    mesh_indexed s = mesh_uv_sphere(1, 512, 256);
+    mesh_bvh bvh(s);
+
+    ray_hit h = bvh.intersect(fcol3 { -5, 0.1, 0.2 }, fcol3 { 1, 0, 0 });
+    assert_true(h.hit());
+    col3 p = col3(s.get_position(h.triangle, 0)) * (1 - h.u - h.v) +
+        col3(s.get_position(h.triangle, 1)) * h.u +
+        col3(s.get_position(h.triangle, 2)) * h.v;
+    assert_float_close(p[0], -5 + h.t, 0.0001);
+    assert_float_close(p[1], 0.1, 0.0001);
+
+    // moving the vertices without touching the topology
+    mesh_indexed moved = s;
+    moved.stor_positions.reset(
+            new mesh_indexed::stor_vector<col4>(*s.stor_positions));
+    for(col4& v : *moved.stor_positions)
+        v[0] += 10;
+
+    bvh.refit(moved);
+    assert_false(bvh.intersect(fcol3 { -5, 0, 0 }, fcol3 { 0, 0, 1 }).hit());
+    h = bvh.intersect(fcol3 { 0, 0.1, 0.2 }, fcol3 { 1, 0, 0 });
+    assert_float_close(h.t, 10 - sqrt(0.95), 0.001);
+
+    assert_except(bvh.refit(mesh_indexed(mesh_box(1, 1, 1))),
+            restriction_error);
+}
+
+TEST_CASE(test_bvh_reflection) {
+    using namespace refl;
+    meta_manager::init();
+    mesh_indexed::meta_reg_();
+    ray_hit::meta_reg_();
+    mesh_bvh::meta_reg_();
+
+    instance mesh = instance::make(mesh_indexed(mesh_box(2, 2, 2)));
+    meta& m_bvh = meta_manager::get_meta("bvh");
+    instance bvh = m_bvh.call("__init_1", mesh);
+
+    instance hit = m_bvh.call("raycast", bvh,
+            instance::make(dxmat(col3 { -5, 0, 0 })),
+            instance::make(dxmat(col3 { 1, 0, 0 })));
+    meta& m_hit = meta_manager::get_meta("ray_hit");
+    assert_true(m_hit.call("hit", hit).get<bool>());
+    assert_float_close(m_hit.call("distance", hit).get<double>(), 4, 0.0001);
+
+    instance occ = m_bvh.call("occluded", bvh,
+            instance::make(dxmat(col3 { -5, 0, 0 })),
+            instance::make(dxmat(col3 { 1, 0, 0 })),
+            instance::make(3.0));
+    assert_false(occ.get<bool>());
+}
+
+int main(int argc, char* argv[])
+{
+    test_main(argc, argv);
+}
@@ -1,5 +1,6 @@
 #include "common/unit_test.h"
 #include "common/image.h"
+#include "common/image_transform.h"
 
 using namespace std;
 using namespace shrtool;
@@ -96,6 +97,253 @@ TEST_CASE(test_binary_invalid) {
     assert_except(image_io_netpbm::load(ss), parse_error);
 }
 
+TEST_CASE(test_binary_ppm_16bit) {
+    // samples are two bytes, most significant first
+    char s[] = "P6\n2 1\n65535\n"
+    "\xff\xff\x80\x00\x00\xff"
+    "\x12\x34\x00\x00\xab\xcd";
+
+    stringstream ss(string(s, sizeof(s) - 1));
+    image im = image_io_netpbm::load(ss);
+
+    // rounded to nearest, as any other space
+    assert_equal_print(im.pixel(0, 0), color(0xff, 0x80, 0x01));
+    assert_equal_print(im.pixel(1, 0), color(0x12, 0x00, 0xab));
+
+    char t[] = "P6\n1 1\n1000\n"
+    "\x03\xe8\x01\xf4\x00\x00";
+
+    ss = stringstream(string(t, sizeof(t) - 1));
+    im = image_io_netpbm::load(ss);
+    assert_equal_print(im.pixel(0, 0), color(0xff, 0x80, 0x00));
+}
+
+TEST_CASE(test_binary_ppm_16bit_rounding) {
+    // every sample of a few rows, more than the lanes hold at once
+    size_t w = 256, h = 86;
+    string s = "P6\n" + to_string(w) + " " + to_string(h) + "\n65535\n";
+    for(size_t v = 0; v < w * h * 3; v++) {
+        size_t u = min(v, size_t(65535));
+        s += char(u >> 8);
+        s += char(u & 0xff);
+    }
+
+    stringstream ss(s);
+    image im = image_io_netpbm::load(ss);
+    for(size_t v = 0; v < w * h * 3; v++) {
+        size_t u = min(v, size_t(65535));
+        size_t ch = im.pixel(v / 3 % w, v / 3 / w).data.bytes[v % 3];
+        if(ch != (u * 255 + 32767) / 65535) {
+            assert_equal_print(ch, (u * 255 + 32767) / 65535);
+            break;
+        }
+    }
+}
+
+TEST_CASE(test_plain_ppm_scanner) {
+    // comments in between, and samples beyond the space saturate
+    const char* s = "P3 2 1 1000\n"
+        "1000 # full\n500\n0 2000\t0\r\n 1";
+
+    stringstream ss(s);
+    image im = image_io_netpbm::load(ss);
+
+    assert_equal_print(im.pixel(0, 0), color(0xff, 0x80, 0x00));
+    assert_equal_print(im.pixel(1, 0), color(0xff, 0x00, 0x00));
+
+    ss = stringstream("P3 1 1 255\n12 x 3\n");
+    assert_except(image_io_netpbm::load(ss), parse_error);
+}
+
+TEST_CASE(test_ppm_round_trip) {
+    // a few blocks of body, with a partial one at the end
+    image im(301, 257);
+    for(size_t y = 0; y < im.height(); y++)
+        for(size_t x = 0; x < im.width(); x++)
+            im.pixel(x, y) = color(x, y, x ^ y);
+
+    stringstream ss;
+    image_io_netpbm io(im);
+    io(static_cast<ostream&>(ss));
+    assert_equal_print(ss.str().size(),
+            size_t(im.width() * im.height() * 3 + 36));
+
+    image back = image_io_netpbm::load(ss);
+    assert_equal_print(back.width(), im.width());
+    assert_equal_print(back.height(), im.height());
+    assert_true(equal(im.begin(), im.end(), back.begin(),
+            [](const color& a, const color& b) {
+                return a.data.rgba == b.data.rgba; }));
+}
+
+TEST_CASE(test_image_view) {
+    image im(8, 6);
+    for(size_t y = 0; y < im.height(); y++)
+        for(size_t x = 0; x < im.width(); x++)
+            im.pixel(x, y) = color(x, y, 0);
+
+    image_view v = im.view(2, 1, 4, 3);
+    assert_equal_print(v.stride(), 8u);
+    assert_false(v.contiguous());
+    assert_equal_print(v.pixel(0, 0), color(2, 1, 0));
+
+    // a sub-view of a sub-view still slices the image
+    const_image_view w = v.sub(1, 1, 3, 2);
+    assert_equal_print(w.pixel(2, 1), color(5, 3, 0));
+    assert_true(&w.pixel(0, 0) == &im.pixel(3, 2));
+    assert_except(v.sub(2, 0, 3, 1), restriction_error);
+
+    pixel_view pv = w;
+    assert_equal_print(pv.row_length, 8u);
+    assert_true(pv.data == &im.pixel(3, 2));
+    assert_true(pixel_view(im.view()).packed());
+
+    v.pixel(0, 0) = color(0xff, 0xff, 0xff);
+    image dest(4, 3);
+    v.copy_to(dest.view());
+    assert_equal_print(dest.pixel(0, 0), color(0xff, 0xff, 0xff));
+    assert_equal_print(dest.pixel(3, 2), color(5, 3, 0));
+}
+
+TEST_CASE(test_cubemap_faces) {
+    image cross(16, 12);
+    for(size_t y = 0; y < cross.height(); y++)
+        for(size_t x = 0; x < cross.width(); x++)
+            cross.pixel(x, y) = color(x / 4, y / 4, 0);
+
+    auto faces = image::cubemap_faces(cross);
+    assert_equal_print(faces[0].width(), 4u);
+    // +X is the third of the middle row, in place
+    assert_true(faces[0].data() == &cross.pixel(8, 4));
+    assert_equal_print(faces[5].pixel(3, 3), color(3, 1, 0));
+
+    image strip = image::load_cubemap_from(cross);
+    assert_equal_print(strip.height(), 24u);
+    assert_equal_print(strip.pixel(0, 8), color(1, 0, 0));
+
+    // stacked faces are taken as they are
+    auto strip_faces = image::cubemap_faces(strip);
+    assert_true(strip_faces[2].data() == &strip.pixel(0, 8));
+
+    assert_except(image::cubemap_faces(image(5, 3)), restriction_error);
+}
+
+TEST_CASE(test_image_copy_on_write) {
+    image im(6, 4);
+    for(size_t y = 0; y < im.height(); y++)
+        for(size_t x = 0; x < im.width(); x++)
+            im.pixel(x, y) = color(x, y, 0);
+    const image& cim = im;
+
+    // copies and clones only share the pixels
+    image cp = im;
+    assert_true(im.shared() && cp.shared());
+    assert_true(static_cast<const image&>(cp).data() == cim.data());
+
+    refl::meta_manager::init();
+    image::meta_reg_();
+    refl::instance ins = refl::instance::make(im);
+    refl::instance cl = ins.clone();
+    assert_true(static_cast<const image&>(cl.get<image>()).data()
+            == cim.data());
+
+    // pixel does not check, the pixels are still shared
+    assert_true(&cp.pixel(1, 1) == cim.data() + 7);
+
+    // the one written is given pixels of its own
+    cp.view().pixel(1, 1) = color(9, 9, 9);
+    assert_true(static_cast<const image&>(cp).data() != cim.data());
+    assert_equal_print(cim.pixel(1, 1), color(1, 1, 0));
+    assert_equal_print(cp.pixel(2, 3), color(2, 3, 0));
+    assert_false(cp.shared());
+
+    // flipped and transposed into pixels of their own in one pass
+    image fl = im;
+    fl.flip_h();
+    assert_equal_print(fl.pixel(0, 2), color(5, 2, 0));
+    assert_equal_print(cim.pixel(0, 2), color(0, 2, 0));
+    image tr = im;
+    image_transform::apply(tr, image_transform::ROTATE_CW);
+    assert_equal_print(tr.width(), 4u);
+    assert_equal_print(tr.pixel(0, 0), color(0, 3, 0));
+    assert_equal_print(cim.pixel(0, 0), color(0, 0, 0));
+
+    // resizing keeps pixels as they lie in memory
+    image rs = im;
+    rs.resize(3, 2);
+    assert_equal_print(rs.pixel(2, 1), color(5, 0, 0));
+    assert_equal_print(im.width(), 6u);
+
+    // pixels not owned by the image are copied
+    color ext[4];
+    image wrap(2, 2, ext);
+    image wcp = wrap;
+    assert_false(wrap.shared());
+    assert_true(static_cast<const image&>(wcp).data() != ext);
+
+    image moved = std::move(cp);
+    assert_equal_print(moved.pixel(1, 1), color(9, 9, 9));
+}
+
+TEST_CASE(test_image_qoi) {
+    // a luma chunk from the starting pixel, then a run of one
+    image tiny(2, 1);
+    tiny.pixel(0, 0) = tiny.pixel(1, 0) = color(1, 2, 3);
+    stringstream ss;
+    image_io_qoi::save_image(ss, tiny);
+    const char expect[] = "qoif\0\0\0\2\0\0\0\1\3\0\xa2\x79\xc0"
+        "\0\0\0\0\0\0\0\1";
+    assert_equal_print(ss.str().size(), sizeof(expect) - 1);
+    assert_true(ss.str() == string(expect, sizeof(expect) - 1));
+
+    // smooth areas, flat runs, repeated colors and translucent pixels
+    image im(301, 157);
+    for(size_t y = 0; y < im.height(); y++)
+        for(size_t x = 0; x < im.width(); x++) {
+            color& c = im.pixel(x, y);
+            if(y < 50) c = color(x, y * 2, x + y);
+            else if(y < 100) c = color(x / 40 * 30, 7, 7);
+            else c = color(x * 13 + y, x * y, 255 - y, (x % 3) * 100);
+        }
+
+    // the smooth and flat parts are several times smaller than in PPM
+    image smooth(301, 100);
+    im.view(0, 0, 301, 100).copy_to(smooth.view());
+    stringstream ppm, qoi;
+    image_io_netpbm::save_image(ppm, smooth);
+    image_io_qoi::save_image(qoi, smooth);
+    assert_true(qoi.str().size() * 3 < ppm.str().size());
+
+    ss.str("");
+    image_io_qoi out(im);
+    out(static_cast<ostream&>(ss));
+
+    image back;
+    image_io_qoi io(back);
+    io(static_cast<istream&>(ss));
+    assert_equal_print(back.width(), 301u);
+    assert_true(equal(im.begin(), im.end(), back.begin()));
+
+    // told apart from PPM by image::load
+    ss.clear(); ss.seekg(0);
+    assert_true(equal(im.begin(), im.end(), image::load(ss).begin()));
+    assert_equal_print(image::load(ppm).pixel(10, 60), color(0, 7, 7));
+    stringstream other("GIF89a");
+    assert_except(image::load(other), unsupported_error);
+
+    // cut short, or running past the image
+    string body = ss.str();
+    stringstream cut(body.substr(0, body.size() / 2));
+    assert_except(image_io_qoi::load(cut), parse_error);
+    string bad(expect, sizeof(expect) - 1);
+    bad[16] = char(0xc5);
+    stringstream over(bad);
+    assert_except(image_io_qoi::load(over), parse_error);
+    bad[12] = 5;
+    stringstream channels(bad);
+    assert_except(image_io_qoi::load(channels), parse_error);
+}
+
 int main(int argc, char* argv[])
 {
     return test_main(argc, argv);
@@ -0,0 +1,155 @@
+#define EXPOSE_EXCEPTION
+
+#include <cmath>
+#include <random>
+
+#include "common/unit_test.h"
+#include "common/image_diff.h"
+
+using namespace std;
+using namespace shrtool;
+using namespace shrtool::unit_test;
+
+static image noise_image(size_t w, size_t h, unsigned seed)
+{
+    mt19937 rng(seed);
+    image im(w, h);
+    for(color& c : im)
+        c = color(rng() & 0xff, rng() & 0xff, rng() & 0xff, rng() & 0xff);
+    return im;
+}
+
+// a smooth image, with noise of up to amp levels added
+static image shaded(size_t w, size_t h, int amp, unsigned seed)
+{
+    mt19937 rng(seed);
+    image im(w, h);
+    for(size_t y = 0; y < h; y++)
+        for(size_t x = 0; x < w; x++) {
+            int n = amp ? int(rng() % (2 * amp + 1)) - amp : 0;
+            int v = max(0, min(255, int(x * 2 + y) % 256 + n));
+            im.pixel(x, y) = color(v, 255 - v, v / 2);
+        }
+    return im;
+}
+
+static bool near(double a, double b, double eps = 1e-6)
+{
+    return fabs(a - b) <= eps;
+}
+
+TEST_CASE(test_diff_equal) {
+    image a = shaded(37, 19, 0, 0);
+    image_diff::stats s = image_diff::compare(a, a);
+
+    for(size_t c = 0; c < 4; c++) {
+        assert_equal_print(s.max_error.data.floats[c], 0.f);
+        assert_equal_print(s.mean_error.data.floats[c], 0.f);
+    }
+    assert_true(std::isinf(s.psnr));
+    assert_true(near(s.ssim, 1));
+    assert_equal_print(s.differing, 0u);
+}
+
+TEST_CASE(test_diff_known) {
+    image a = shaded(37, 19, 0, 0);
+    image b = a;
+    image_view v = b.view();
+    v.pixel(3, 4).data.bytes[0] ^= 0x0a;
+    v.pixel(36, 18).data.bytes[3] = 0xfc;
+    int dr = abs(int(a.pixel(3, 4).data.bytes[0]) - b.pixel(3, 4).data.bytes[0]);
+
+    image_diff::stats s = image_diff::compare(a, b);
+    double n = 37 * 19;
+    assert_true(near(s.max_error.data.floats[0], dr / 255.));
+    assert_true(near(s.max_error.data.floats[3], 3 / 255.));
+    assert_equal_print(s.max_error.data.floats[1], 0.f);
+    assert_true(near(s.mean_error.data.floats[0], dr / 255. / n));
+    assert_true(near(s.psnr, 10 * log10(n * 3 * 255 * 255 / (dr * dr)), 1e-4));
+    assert_true(s.ssim < 1 && s.ssim > 0.99);
+    assert_equal_print(s.differing, 2u);
+
+    // the alpha, three levels off, is within a tolerance of 3
+    assert_equal_print(image_diff::compare(a, b, 3 / 255.f).differing, 1u);
+    assert_equal_print(image_diff::compare(a, b, 2 / 255.f).differing, 2u);
+
+    image m = image_diff::mask(a, b, 3 / 255.f);
+    assert_equal_print(m.pixel(3, 4), color(255, 255, 255));
+    assert_equal_print(m.pixel(36, 18), color(0, 0, 0));
+    assert_equal_print(m.pixel(0, 0), color(0, 0, 0));
+}
+
+TEST_CASE(test_diff_against_loops) {
+    // wide enough for the sums to be taken out along rows
+    image a = noise_image(5003, 7, 1), b = noise_image(5003, 7, 2);
+    image_diff::stats s = image_diff::compare(a, b, 100 / 255.f);
+
+    double sum[4] = { 0 }, sq = 0;
+    int mx[4] = { 0 };
+    size_t differing = 0;
+    for(size_t i = 0; i < a.width() * a.height(); i++) {
+        bool differs = false;
+        for(size_t c = 0; c < 4; c++) {
+            int d = abs(int(a.data()[i].data.bytes[c]) - b.data()[i].data.bytes[c]);
+            sum[c] += d;
+            mx[c] = max(mx[c], d);
+            if(c < 3) sq += d * d;
+            differs = differs || d > 100;
+        }
+        differing += differs;
+    }
+
+    double n = a.width() * a.height();
+    for(size_t c = 0; c < 4; c++) {
+        assert_true(near(s.max_error.data.floats[c], mx[c] / 255.));
+        assert_true(near(s.mean_error.data.floats[c], sum[c] / 255. / n));
+    }
+    assert_true(near(s.psnr, 10 * log10(n * 3 * 255 * 255 / sq), 1e-6));
+    assert_equal_print(s.differing, differing);
+
+    image m = image_diff::mask(a, b, 100 / 255.f);
+    size_t white = 0;
+    for(const color& c : m) white += c == color(255, 255, 255);
+    assert_equal_print(white, differing);
+
+    // unrelated noise is hardly similar at all
+    assert_true(fabs(s.ssim) < 0.1);
+}
+
+TEST_CASE(test_diff_ssim_order) {
+    image ref = shaded(128, 96, 0, 0);
+    double slight = image_diff::compare(ref, shaded(128, 96, 4, 1)).ssim;
+    double heavy = image_diff::compare(ref, shaded(128, 96, 40, 2)).ssim;
+    assert_true(slight < 1 && slight > heavy && heavy > 0);
+
+    // images smaller than a window are one window
+    image tiny = shaded(5, 3, 0, 0);
+    assert_true(near(image_diff::compare(tiny, tiny).ssim, 1));
+}
+
+TEST_CASE(test_diff_float) {
+    image a = noise_image(61, 13, 3), b = noise_image(61, 13, 4);
+    float_image fa = float_image::from_image(a.view(), false);
+    float_image fb = float_image::from_image(b.view(), false);
+
+    image_diff::stats s = image_diff::compare(a, b, 0.5f);
+    image_diff::stats f = image_diff::compare(fa, fb, 0.5f);
+    for(size_t c = 0; c < 4; c++) {
+        assert_true(near(s.max_error.data.floats[c], f.max_error.data.floats[c]));
+        assert_true(near(s.mean_error.data.floats[c], f.mean_error.data.floats[c]));
+    }
+    assert_true(near(s.psnr, f.psnr, 1e-4));
+    assert_true(near(s.ssim, f.ssim, 1e-4));
+    assert_equal_print(s.differing, f.differing);
+
+    image ma = image_diff::mask(a, b, 0.5f), mf = image_diff::mask(fa, fb, 0.5f);
+    assert_true(equal(ma.begin(), ma.end(), mf.begin()));
+
+    assert_except(image_diff::compare(a, image(61, 12)), restriction_error);
+    assert_except(image_diff::mask(fa, float_image(2, 2)), restriction_error);
+}
+
+int main(int argc, char* argv[])
+{
+    return test_main(argc, argv);
+}
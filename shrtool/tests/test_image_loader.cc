@@ -0,0 +1,96 @@
+#define EXPOSE_EXCEPTION
+
+#include <cstdio>
+#include <fstream>
+#include <atomic>
+
+#include "common/unit_test.h"
+#include "common/image_loader.h"
+
+using namespace std;
+using namespace shrtool;
+using namespace shrtool::unit_test;
+
+TEST_CASE(test_thread_pool) {
+    vector<future<size_t>> results;
+    atomic<size_t> sum(0);
+    {
+        thread_pool pool(3);
+        assert_equal_print(pool.size(), 3u);
+
+        for(size_t i = 0; i < 100; i++)
+            results.push_back(pool.submit([i, &sum]() {
+                        sum += i;
+                        return i * i;
+                    }));
+
+        // queued tasks are all run before the pool goes away
+    }
+    assert_equal_print(sum.load(), 4950u);
+    assert_equal_print(results[7].get(), 49u);
+
+    thread_pool pool(1);
+    future<int> f = pool.submit([]() -> int {
+                throw parse_error("bad");
+            });
+    assert_except(f.get(), parse_error);
+}
+
+TEST_CASE(test_image_loader) {
+    image im(5, 3);
+    for(size_t y = 0; y < im.height(); y++)
+        for(size_t x = 0; x < im.width(); x++)
+            im.pixel(x, y) = color(x * 50, y * 100, 9);
+
+    vector<string> paths;
+    // of both formats, told apart as they are decoded
+    for(size_t i = 0; i < 4; i++) {
+        bool qoi = i % 2;
+        paths.push_back("test_image_loader_" + to_string(i) +
+                (qoi ? ".qoi" : ".ppm"));
+        ofstream fout(paths.back(), ios::binary);
+        if(qoi) image_io_qoi::save_image(fout, im);
+        else image_io_netpbm::save_image(fout, im);
+    }
+
+    image_loader loader(2);
+    vector<async_image> loads;
+    for(const string& p : paths)
+        loads.push_back(loader.load(p));
+    async_image missing = loader.load("test_image_loader_missing.ppm");
+
+    for(async_image& a : loads) {
+        const image& out = a.wait();
+        assert_true(a.ready());
+        assert_equal_print(out.width(), 5u);
+        assert_equal_print(out.pixel(4, 2), im.pixel(4, 2));
+    }
+    for(const string& p : paths)
+        remove(p.c_str());
+
+    assert_except(missing.wait(), not_found_error);
+    assert_true(!async_image().valid());
+    assert_except(async_image().wait(), restriction_error);
+}
+
+TEST_CASE(test_image_loader_decoder) {
+    // a decoder held back, so the image is seen before it is ready
+    promise<void> go;
+    shared_future<void> gate = go.get_future().share();
+
+    image_loader loader(1);
+    async_image a = loader.load("/dev/null", [gate](istream&) {
+                gate.wait();
+                return image(2, 2);
+            });
+
+    assert_true(a.valid());
+    assert_true(!a.ready());
+    go.set_value();
+    assert_equal_print(a.wait().width(), 2u);
+}
+
+int main(int argc, char* argv[])
+{
+    return unit_test::test_main(argc, argv);
+}
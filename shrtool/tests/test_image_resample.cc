@@ -0,0 +1,115 @@
+#define EXPOSE_EXCEPTION
+
+#include "common/unit_test.h"
+#include "common/image_resample.h"
+
+using namespace std;
+using namespace shrtool;
+using namespace shrtool::unit_test;
+
+image checker(size_t w, size_t h)
+{
+    image im(w, h);
+    for(size_t y = 0; y < h; y++)
+        for(size_t x = 0; x < w; x++)
+            im.pixel(x, y) = (x + y) % 2 ?
+                color(0, 0, 0) : color(255, 255, 255);
+    return im;
+}
+
+TEST_CASE(test_box_mip_chain) {
+    vector<image> levels = image_resample::mip_chain(checker(8, 4));
+
+    assert_equal_print(levels.size(), 4u);
+    assert_equal_print(levels[1].width(), 4u);
+    assert_equal_print(levels[1].height(), 2u);
+    assert_equal_print(levels[3].width(), 1u);
+    assert_equal_print(levels[3].height(), 1u);
+
+    // half black and half white is a linear 0.5, which is 188 in sRGB
+    for(size_t i = 1; i < levels.size(); i++)
+        for(const color& c : levels[i])
+            assert_equal_print(c, color(188, 188, 188));
+
+    // and averaged as is otherwise
+    levels = image_resample::mip_chain(checker(8, 4),
+            image_resample::BOX, false);
+    assert_equal_print(levels[2].pixel(1, 0), color(128, 128, 128));
+}
+
+TEST_CASE(test_odd_mip_chain) {
+    assert_equal_print(image_resample::mip_levels(5, 3), 3u);
+    assert_equal_print(image_resample::mip_levels(1024, 1), 11u);
+
+    float_image fi(5, 3);
+    for(size_t y = 0; y < 3; y++)
+        for(size_t x = 0; x < 5; x++)
+            fi.pixel(x, y) = fcolor(x, y, 1, 1);
+
+    // every filter keeps a constant channel, and the mean of a ramp
+    for(auto f : { image_resample::BOX, image_resample::BILINEAR,
+            image_resample::KAISER, image_resample::LANCZOS }) {
+        vector<float_image> levels = image_resample::mip_chain(fi, f);
+        assert_equal_print(levels.size(), 3u);
+        assert_equal_print(levels[1].width(), 2u);
+        assert_equal_print(levels[1].height(), 1u);
+
+        const fcolor& c = levels[2].pixel(0, 0);
+        assert_float_close(c.b(), 1, 1e-5);
+        assert_float_close(c.a(), 1, 1e-5);
+        assert_float_close(c.r(), 2, 0.5);
+    }
+}
+
+TEST_CASE(test_resize) {
+    float_image ramp(4, 1);
+    for(size_t x = 0; x < 4; x++)
+        ramp.pixel(x, 0) = fcolor(x, 0, 0, 1);
+
+    // bilinear between the centers, clamped at both ends
+    float_image up = image_resample::resize(ramp, 8, 1);
+    assert_float_close(up.pixel(0, 0).r(), 0, 1e-5);
+    assert_float_close(up.pixel(1, 0).r(), 0.25, 1e-5);
+    assert_float_close(up.pixel(4, 0).r(), 1.75, 1e-5);
+    assert_float_close(up.pixel(7, 0).r(), 3, 1e-5);
+
+    // lanczos passes through the samples when the size is kept
+    float_image same = image_resample::resize(ramp, 4, 1,
+            image_resample::LANCZOS);
+    assert_float_close(same.pixel(2, 0).r(), 2, 1e-5);
+
+    // arbitrary ratios on both axes, on several threads
+    image big = checker(640, 480);
+    image small = image_resample::resize(big, 123, 77,
+            image_resample::LANCZOS);
+    assert_equal_print(small.width(), 123u);
+    assert_equal_print(small.height(), 77u);
+    for(size_t i = 0; i < small.width() * small.height(); i += 101)
+        assert_true(abs(small.data()[i].r() - 188) <= 3);
+
+    image same_size = image_resample::resize(big, 640, 480);
+    assert_true(equal(big.begin(), big.end(), same_size.begin()));
+
+    assert_except(image_resample::resize(big, 0, 1), restriction_error);
+}
+
+TEST_CASE(test_float_image_conversion) {
+    image im(256, 1);
+    for(size_t x = 0; x < 256; x++)
+        im.pixel(x, 0) = color(x, x, 255 - x, x);
+
+    for(bool srgb : { true, false }) {
+        float_image fi = float_image::from_image(im.view(), srgb);
+        image back = fi.to_image(srgb);
+        assert_true(equal(im.begin(), im.end(), back.begin()));
+    }
+
+    float_image fi = float_image::from_image(im.view());
+    assert_float_close(fi.pixel(128, 0).r(), 0.2158605, 1e-5);
+    assert_float_close(fi.pixel(128, 0).a(), 128 / 255.0, 1e-5);
+}
+
+int main(int argc, char* argv[])
+{
+    return test_main(argc, argv);
+}
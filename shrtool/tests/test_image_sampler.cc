@@ -0,0 +1,123 @@
+#define EXPOSE_EXCEPTION
+
+#include <cmath>
+
+#include "common/unit_test.h"
+#include "common/image_sampler.h"
+
+using namespace std;
+using namespace shrtool;
+using namespace shrtool::unit_test;
+
+image ramp(size_t w, size_t h)
+{
+    image im(w, h);
+    for(size_t y = 0; y < h; y++)
+        for(size_t x = 0; x < w; x++)
+            im.pixel(x, y) = color(x % 256, y % 256, (x ^ y) % 256, 255);
+    return im;
+}
+
+bool near(const fcolor& a, const fcolor& b, float eps = 1e-5)
+{
+    for(size_t i = 0; i < 4; i++)
+        if(fabs(a.data.floats[i] - b.data.floats[i]) > eps)
+            return false;
+    return true;
+}
+
+TEST_CASE(test_tile_cache_lazy) {
+    image im = ramp(100, 70);
+    float_tile_cache c(im.view());
+    assert_equal_print(c.converted_tiles(), 0u);
+
+    assert_equal_print(fcolor(c.pixel(99, 69)), fcolor(im.pixel(99, 69)));
+    assert_equal_print(c.converted_tiles(), 1u);
+    assert_equal_print(fcolor(c.pixel(33, 3)), fcolor(im.pixel(33, 3)));
+    assert_equal_print(fcolor(c.pixel(63, 31)), fcolor(im.pixel(63, 31)));
+    assert_equal_print(c.converted_tiles(), 2u);
+
+    for(size_t y = 0; y < im.height(); y++)
+        for(size_t x = 0; x < im.width(); x++)
+            assert_equal_print(fcolor(c.pixel(x, y)), fcolor(im.pixel(x, y)));
+    assert_equal_print(c.converted_tiles(), 4u * 3);
+}
+
+TEST_CASE(test_image_quad) {
+    image im = ramp(5, 3);
+    fcolor c00, c10, c01, c11;
+    assert_except(im.quad(0, 0, c00, c10, c01, c11), restriction_error);
+
+    im.make_float_cache();
+    im.quad(1, 1, c00, c10, c01, c11);
+    assert_equal_print(c10, fcolor(im.pixel(2, 1)));
+    assert_equal_print(c01, fcolor(im.pixel(1, 2)));
+
+    // clamped at the corner
+    im.quad(4, 2, c00, c10, c01, c11);
+    assert_equal_print(c11, fcolor(im.pixel(4, 2)));
+    assert_equal_print(c10, c00);
+
+    // of pixels shared with a copy, which are only read
+    image cp = im;
+    cp.make_float_cache();
+    assert_true(im.shared() && cp.shared());
+}
+
+TEST_CASE(test_sampler_bilinear) {
+    image im = ramp(8, 4);
+    image_sampler s(im);
+
+    // texel centers are at half pixels
+    assert_true(near(s.sample(2.5f / 8, 1.5f / 4), im.pixel(2, 1)));
+
+    // halfway between two texels
+    fcolor mid = s.sample(3.f / 8, 1.5f / 4);
+    assert_true(near(mid, fcolor(2.5f / 255, 1.f / 255,
+                    ((2 ^ 1) + (3 ^ 1)) / 2.f / 255, 1)));
+
+    // repeat blends the edges with each other, clamp does not
+    fcolor edge = s.sample(0, 1.5f / 4);
+    assert_true(near(edge, fcolor(3.5f / 255, 1.f / 255,
+                    ((0 ^ 1) + (7 ^ 1)) / 2.f / 255, 1)));
+    image_sampler sc(im, image_sampler::BILINEAR, image_sampler::CLAMP);
+    assert_true(near(sc.sample(-3, 1.5f / 4), im.pixel(0, 1)));
+    assert_true(near(sc.sample(0.5f / 8, 7), im.pixel(0, 3)));
+
+    // far outside, as inside
+    assert_true(near(s.sample(2.5f / 8 + 3, 1.5f / 4 - 2), im.pixel(2, 1)));
+}
+
+TEST_CASE(test_sampler_nearest) {
+    image im = ramp(8, 4);
+    image_sampler s(im, image_sampler::NEAREST);
+    assert_equal_print(s.sample(0.99f / 8, 0), fcolor(im.pixel(0, 0)));
+    assert_equal_print(s.sample(1.01f / 8, 0.3f), fcolor(im.pixel(1, 1)));
+    assert_equal_print(s.sample(-0.1f / 8, 1), fcolor(im.pixel(7, 0)));
+
+    image_sampler sc(im, image_sampler::NEAREST, image_sampler::CLAMP);
+    assert_equal_print(sc.sample(1, 1), fcolor(im.pixel(7, 3)));
+}
+
+TEST_CASE(test_sampler_batch) {
+    image im = ramp(300, 200);
+    image_sampler s(im);
+
+    // odd count, so the last ones are sampled one by one
+    const size_t n = 40001;
+    vector<float> uv(n * 2);
+    for(size_t i = 0; i < n; i++) {
+        uv[i * 2] = sin(i * 0.37f) * 1.7f;
+        uv[i * 2 + 1] = cos(i * 0.11f) * 2.3f;
+    }
+
+    vector<fcolor> out(n);
+    s.sample(uv.data(), n, out.data());
+    for(size_t i = 0; i < n; i++)
+        assert_true(near(out[i], s.sample(uv[i * 2], uv[i * 2 + 1]), 1e-4));
+}
+
+int main(int argc, char* argv[])
+{
+    return unit_test::test_main(argc, argv);
+}
@@ -0,0 +1,118 @@
+#define EXPOSE_EXCEPTION
+
+#include "common/unit_test.h"
+#include "common/image_transform.h"
+
+using namespace std;
+using namespace shrtool;
+using namespace shrtool::unit_test;
+
+image numbered(size_t w, size_t h)
+{
+    image im(w, h);
+    for(size_t y = 0; y < h; y++)
+        for(size_t x = 0; x < w; x++)
+            im.pixel(x, y).data.rgba = uint32_t(y << 16 | x);
+    return im;
+}
+
+// where pixel (x, y) of the result comes from, pixel by pixel
+image reference(const image& im, image_transform::op o)
+{
+    size_t w = im.width(), h = im.height();
+    bool swap = image_transform::swaps_axes(o);
+    image out(swap ? h : w, swap ? w : h);
+
+    for(size_t y = 0; y < out.height(); y++)
+        for(size_t x = 0; x < out.width(); x++) {
+            size_t sx = x, sy = y;
+            switch(o) {
+            case image_transform::IDENTITY: break;
+            case image_transform::FLIP_H: sx = w - x - 1; break;
+            case image_transform::FLIP_V: sy = h - y - 1; break;
+            case image_transform::ROTATE_180:
+                sx = w - x - 1; sy = h - y - 1; break;
+            case image_transform::TRANSPOSE: sx = y; sy = x; break;
+            case image_transform::ROTATE_CW: sx = y; sy = h - x - 1; break;
+            case image_transform::ROTATE_CCW: sx = w - y - 1; sy = x; break;
+            }
+            out.pixel(x, y) = im.pixel(sx, sy);
+        }
+    return out;
+}
+
+bool same(const image& a, const image& b)
+{
+    return a.width() == b.width() && a.height() == b.height() &&
+        equal(a.begin(), a.end(), b.begin());
+}
+
+const size_t sizes[][2] = {
+    { 1, 1 }, { 1, 9 }, { 7, 1 }, { 5, 3 }, { 64, 64 }, { 70, 70 },
+    { 33, 97 }, { 130, 41 },
+};
+
+TEST_CASE(test_transform_in_place) {
+    for(auto& s : sizes)
+        for(int o = image_transform::IDENTITY;
+                o <= image_transform::ROTATE_CCW; o++) {
+            image im = numbered(s[0], s[1]);
+            image expected = reference(im, image_transform::op(o));
+            image_transform::apply(im, image_transform::op(o));
+            assert_true(same(im, expected));
+        }
+}
+
+TEST_CASE(test_transform_flips) {
+    image im = numbered(9, 4);
+    image expected = reference(im, image_transform::FLIP_V);
+    im.flip_v();
+    assert_true(same(im, expected));
+
+    expected = reference(im, image_transform::FLIP_H);
+    im.flip_h();
+    assert_true(same(im, expected));
+
+    // rotating right, then twice around, then left, is where it began
+    image org = im;
+    image_transform::apply(im, image_transform::ROTATE_CW);
+    assert_equal_print(im.width(), 4u);
+    image_transform::apply(im, image_transform::ROTATE_180);
+    image_transform::apply(im, image_transform::ROTATE_180);
+    image_transform::apply(im, image_transform::ROTATE_CCW);
+    assert_true(same(im, org));
+}
+
+TEST_CASE(test_transformed_view) {
+    for(auto& s : sizes)
+        for(int o = image_transform::IDENTITY;
+                o <= image_transform::ROTATE_CCW; o++) {
+            // of a view into a larger image
+            image big = numbered(s[0] + 3, s[1] + 2);
+            image src(s[0], s[1]);
+            big.view(2, 1, s[0], s[1]).copy_to(src.view());
+
+            transformed_image_view tv(big.view(2, 1, s[0], s[1]),
+                    image_transform::op(o));
+            image out(tv.width(), tv.height());
+            tv.copy_to(out.view());
+            assert_true(same(out, reference(src, image_transform::op(o))));
+
+            // and a band in the middle alone
+            if(tv.height() < 3) continue;
+            image band(tv.width(), 2);
+            tv.rows(1, 2, band.data());
+            assert_true(equal(band.begin(), band.end(),
+                        &out.pixel(0, 1)));
+        }
+
+    image im = numbered(4, 4);
+    transformed_image_view tv(im.view(), image_transform::ROTATE_CW);
+    color c;
+    assert_except(tv.rows(3, 2, &c), restriction_error);
+}
+
+int main(int argc, char* argv[])
+{
+    return unit_test::test_main(argc, argv);
+}
@@ -0,0 +1,209 @@
+#define EXPOSE_EXCEPTION
+
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+#include "common/unit_test.h"
+#include "common/ktx.h"
+
+using namespace std;
+using namespace shrtool;
+using namespace shrtool::unit_test;
+
+vector<uint8_t> bytes_of(const stringstream& ss)
+{
+    string s = ss.str();
+    return vector<uint8_t>(s.begin(), s.end());
+}
+
+image gradient(size_t w, size_t h)
+{
+    image im(w, h);
+    for(size_t y = 0; y < h; y++)
+        for(size_t x = 0; x < w; x++)
+            im.pixel(x, y) = color(x, y, 0x55);
+    return im;
+}
+
+TEST_CASE(test_ktx_round_trip) {
+    image im = gradient(16, 4);
+    stringstream ss;
+    ktx_texture::bake(ss, im);
+
+    ktx_texture t = ktx_texture::from_memory(bytes_of(ss));
+    assert_equal_print(t.width(), 16u);
+    assert_equal_print(t.height(), 4u);
+    assert_equal_print(t.levels(), 5u);
+    assert_equal_print(t.format(), size_t(RGBA_U8888));
+    assert_false(t.cubemap());
+
+    assert_equal_print(t.level_width(2), 4u);
+    assert_equal_print(t.level_height(3), 1u);
+    assert_equal_print(t.image_size(2), 4u * 1u * 4u);
+
+    // the base level is the image as it is
+    assert_equal_print(memcmp(t.data(0), im.data(), 16 * 4 * 4), 0);
+
+    vector<image> chain = image_resample::mip_chain(im);
+    assert_equal_print(memcmp(t.data(4), chain[4].data(), 4), 0);
+
+    assert_except(t.data(5), restriction_error);
+}
+
+TEST_CASE(test_ktx_float) {
+    vector<float_image> levels;
+    levels.emplace_back(2, 2);
+    levels.emplace_back(1, 1);
+    levels[0].pixel(1, 1) = fcolor(0.5, 2, -1, 1);
+
+    stringstream ss;
+    ktx_texture::save(ss, levels);
+    ktx_texture t = ktx_texture::from_memory(bytes_of(ss));
+
+    assert_equal_print(t.format(), size_t(RGBA_F32));
+    assert_equal_print(t.levels(), 2u);
+    const fcolor* p = static_cast<const fcolor*>(t.data(0));
+    assert_true(p[3] == fcolor(0.5, 2, -1, 1));
+
+    levels.emplace_back(1, 1);
+    assert_except(ktx_texture::save(ss, levels), restriction_error);
+}
+
+TEST_CASE(test_ktx_formats) {
+    // bytes of a pixel, or of a block of 4x4 pixels when compressed
+    struct { size_t format, unit; bool compressed; } formats[] = {
+        { R_U8, 1, false }, { RG_U88, 2, false },
+        { R_F16, 2, false }, { RG_F16, 4, false }, { RGBA_F16, 8, false },
+        { RGB_F111110, 4, false }, { R_F32, 4, false },
+        { BC1_RGBA, 8, true }, { BC3_RGBA, 16, true },
+        { BC4_R, 8, true }, { BC5_RG, 16, true },
+    };
+
+    // not a multiple of the blocks, nor of 4 bytes per row
+    size_t w = 6, h = 5;
+    for(const auto& f : formats) {
+        vector<vector<uint8_t>> levels;
+        vector<const void*> ptrs;
+        for(size_t l = 0; l < 3; l++) {
+            size_t lw = max<size_t>(1, w >> l), lh = max<size_t>(1, h >> l);
+            size_t sz = f.compressed ?
+                (lw + 3) / 4 * ((lh + 3) / 4) * f.unit : lw * lh * f.unit;
+            levels.emplace_back(sz);
+            for(size_t i = 0; i < sz; i++)
+                levels.back()[i] = uint8_t(i * 7 + l + f.format);
+            ptrs.push_back(levels.back().data());
+        }
+
+        stringstream ss;
+        ktx_texture::save(ss, f.format, w, h, ptrs);
+        ktx_texture t = ktx_texture::from_memory(bytes_of(ss));
+
+        assert_equal_print(t.format(), f.format);
+        assert_equal_print(t.levels(), 3u);
+        for(size_t l = 0; l < 3; l++) {
+            assert_equal_print(t.image_size(l), levels[l].size());
+            assert_equal_print(memcmp(t.data(l), levels[l].data(),
+                        levels[l].size()), 0);
+        }
+    }
+
+    stringstream ss;
+    vector<uint8_t> px(4);
+    assert_except(ktx_texture::save(ss, 0, 1, 1, { px.data() }),
+            unsupported_error);
+}
+
+TEST_CASE(test_ktx_compressed) {
+    image im = gradient(16, 8);
+    stringstream ss;
+    ktx_texture::bake_compressed(ss, im, BC3_RGBA);
+    ktx_texture t = ktx_texture::from_memory(bytes_of(ss));
+
+    assert_equal_print(t.format(), size_t(BC3_RGBA));
+    assert_equal_print(t.levels(), 5u);
+    // levels under a block take a whole one
+    assert_equal_print(t.image_size(3), 16u);
+
+    vector<image> chain = image_resample::mip_chain(im);
+    for(size_t l = 0; l < t.levels(); l++) {
+        compressed_image ci = block_compress::encode(chain[l], BC3_RGBA);
+        assert_equal_print(memcmp(t.data(l), ci.data(), ci.size()), 0);
+    }
+
+    assert_except(ktx_texture::bake_compressed(ss, im, RGBA_U8888),
+            unsupported_error);
+}
+
+TEST_CASE(test_ktx_cubemap_file) {
+    image cross(32, 24);
+    for(size_t y = 0; y < cross.height(); y++)
+        for(size_t x = 0; x < cross.width(); x++)
+            cross.pixel(x, y) = color(x / 8 * 60, y / 8 * 100, 7);
+
+    string path = "test_ktx_cubemap.ktx";
+    {
+        ofstream fout(path, ios::binary);
+        ktx_texture::bake(fout, cross, true);
+    }
+
+    ktx_texture t = ktx_texture::open(path);
+    remove(path.c_str());
+
+    assert_true(t.cubemap());
+    assert_equal_print(t.width(), 8u);
+    assert_equal_print(t.levels(), 4u);
+
+    // faces stay flat colors all the way down
+    auto faces = image::cubemap_faces(cross);
+    for(size_t l = 0; l < t.levels(); l++) {
+        for(size_t i = 0; i < 6; i++) {
+            const color* p = static_cast<const color*>(t.data(l, 0, i));
+            assert_equal_print(p[0], faces[i].pixel(0, 0));
+        }
+    }
+}
+
+TEST_CASE(test_ktx_meta) {
+    // scenes get the file through reflection, as image files are
+    refl::meta_manager::init();
+    ktx_texture::meta_reg_();
+    assert_true(refl::meta_manager::find_meta("ktx_texture"));
+
+    stringstream ss;
+    ktx_texture::bake(ss, gradient(8, 4));
+    refl::instance ins = refl::instance::make(
+            ktx_texture::from_memory(bytes_of(ss)));
+    assert_equal_print(ins.call("width").get<size_t>(), 8u);
+    assert_equal_print(ins.call("levels").get<size_t>(), 4u);
+    assert_false(ins.call("cubemap?").get<bool>());
+}
+
+TEST_CASE(test_ktx_bad_input) {
+    stringstream ss;
+    ktx_texture::bake(ss, gradient(4, 4));
+    vector<uint8_t> data = bytes_of(ss);
+
+    assert_except(ktx_texture::from_memory(
+                vector<uint8_t>(data.begin(), data.begin() + 40)),
+            parse_error);
+    assert_except(ktx_texture::from_memory(
+                vector<uint8_t>(data.begin(), data.end() - 8)),
+            parse_error);
+
+    vector<uint8_t> other_format = data;
+    other_format[12 + 4 * 4] = 0x01;
+    assert_except(ktx_texture::from_memory(other_format), unsupported_error);
+
+    vector<uint8_t> bad_magic = data;
+    bad_magic[1] = 'X';
+    assert_except(ktx_texture::from_memory(bad_magic), parse_error);
+
+    assert_except(ktx_texture::open("no/such/file.ktx"), not_found_error);
+}
+
+int main(int argc, char* argv[])
+{
+    return test_main(argc, argv);
+}
@@ -120,6 +120,42 @@ TEST_CASE(test_load_multiple_shapes) {
     assert_equal_print(meshes[0].positions.size(), 6u);
 }
 
+TEST_CASE(test_load_into_arena) {
+    stringstream data;
+    for(size_t g = 0; g < 200; g++) {
+        data << "g group" << g << "\n";
+        for(size_t i = 0; i < 4; i++)
+            data << "v " << g << " " << i % 2 << " " << i / 2 << "\n";
+        data << "f -4 -3 -2 -1\n";
+    }
+
+    shared_ptr<arena> a = make_shared<arena>(1 << 16);
+    vector<mesh_indexed> meshes = mesh_io_object::load(data, a);
+
+    assert_equal_print(meshes.size(), 200u);
+    assert_equal_print(meshes[199].positions.size(), 6u);
+    assert_equal_print(meshes[199].positions[5], col4({ 199, 1, 1, 1 }));
+    assert_equal_print(meshes[0].stor_positions->size(), 800u);
+
+    assert_true(meshes[0].stor_positions->get_allocator().source == a);
+    assert_true(meshes[7].positions.indices.get_allocator().source == a);
+    // 200 groups and their storages in a couple of blocks
+    assert_true(a->blocks() <= 2);
+
+    // copies have their indices on the heap, but share the storages, so the
+    // arena goes with the last of the meshes
+    weak_ptr<arena> wa = a;
+    {
+        mesh_indexed copy = meshes[3];
+        assert_false(bool(copy.positions.indices.get_allocator().source));
+
+        a.reset();
+        meshes.clear();
+        assert_false(wa.expired());
+    }
+    assert_true(wa.expired());
+}
+
 TEST_CASE(test_uv_sphere) {
     mesh_uv_sphere us(2, 6, 3);
 
@@ -156,6 +192,82 @@ TEST_CASE(test_plane) {
     }
 }
 
+TEST_CASE(test_uv_sphere_flat) {
+    mesh_uv_sphere us(1, 8, 4, false);
+
+    // one normal per grid, shared by both of its triangles
+    assert_equal_print(us.stor_normals->size(), 8u * 4u);
+    assert_equal_print(us.triangles(), 8u * 2u * 3u);
+
+    for(size_t i = 0; i < us.triangles(); ++i)
+        for(size_t j = 0; j < 3; ++j)
+            assert_true(dot(us.get_normal(i, j),
+                    col3(us.get_position(i, j))) > 0);
+}
+
+TEST_CASE(test_dense_generators) {
+    // large enough to be generated on several threads
+    mesh_uv_sphere us(3, 512, 256);
+    mesh_plane pl(4, 4, 300, 300);
+
+    assert_equal_print(us.stor_positions->size(), 513u * 257u);
+    assert_equal_print(us.positions.size(), 512u * 255u * 6u);
+    assert_equal_print(pl.positions.size(), 300u * 300u * 6u);
+
+    for(size_t i = 0; i < us.triangles(); i += 997) {
+        for(size_t j = 0; j < 3; ++j) {
+            assert_float_close(norm(col3(us.get_position(i, j))), 3, 0.00001);
+            assert_float_close(norm(us.get_normal(i, j)), 1, 0.00001);
+        }
+    }
+
+    for(size_t t = 0; t < pl.triangles(); t += 997) {
+        double res = norm(cross(
+            col3(pl.get_position(t, 1) - pl.get_position(t, 0)),
+            col3(pl.get_position(t, 2) - pl.get_position(t, 1))));
+        assert_true(res > 0.000001);
+    }
+}
+
+TEST_CASE(test_gen_cache) {
+    mesh_indexed a = mesh_indexed::gen_uv_sphere(1, 16, 8);
+    mesh_indexed b = mesh_indexed::gen_uv_sphere(1, 16, 8);
+    mesh_indexed c = mesh_indexed::gen_uv_sphere(1, 16, 8, false);
+
+    assert_equal(a.stor_positions, b.stor_positions);
+    assert_equal(a.stor_normals, b.stor_normals);
+    assert_equal_print(a.positions.size(), b.positions.size());
+    assert_false(a.stor_normals == c.stor_normals);
+
+    mesh_indexed::clear_gen_cache();
+    mesh_indexed d = mesh_indexed::gen_uv_sphere(1, 16, 8);
+    assert_false(a.stor_positions == d.stor_positions);
+    assert_equal_print(a.positions.size(), d.positions.size());
+
+    mesh_indexed p1 = mesh_indexed::gen_plane(2, 2, 1, 1);
+    mesh_indexed p2 = mesh_indexed::gen_plane(2, 2, 1, 1);
+    mesh_indexed b1 = mesh_indexed::gen_box(1, 2, 3);
+    assert_equal(p1.stor_uvs, p2.stor_uvs);
+    assert_equal_print(b1.triangles(), 12u);
+}
+
+TEST_CASE(test_gen_cache_lru) {
+    mesh_indexed::clear_gen_cache();
+    mesh_indexed first = mesh_indexed::gen_box(1, 1, 1);
+    mesh_indexed second = mesh_indexed::gen_box(2, 1, 1);
+    for(size_t i = 2; i < mesh_indexed::gen_cache_capacity; i++)
+        mesh_indexed::gen_box(i + 1, 1, 1);
+
+    // asked for again, the first one is no more the least recently used
+    mesh_indexed::gen_box(1, 1, 1);
+    mesh_indexed::gen_box(0.5, 1, 1);
+
+    assert_equal(mesh_indexed::gen_box(1, 1, 1).stor_positions,
+            first.stor_positions);
+    assert_false(mesh_indexed::gen_box(2, 1, 1).stor_positions ==
+            second.stor_positions);
+}
+
 #include "providers.h"
 
 int main(int argc, char* argv[])
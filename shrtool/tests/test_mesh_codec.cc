@@ -0,0 +1,147 @@
+#define EXPOSE_EXCEPTION
+
+#include <sstream>
+
+#include "common/unit_test.h"
+#include "common/mesh_codec.h"
+
+using namespace std;
+using namespace shrtool;
+using namespace shrtool::math;
+using namespace shrtool::unit_test;
+
+template<typename Attr>
+void assert_attr_close(const Attr& a, const Attr& b, double eps)
+{
+    assert_equal_print(a.size(), b.size());
+    for(size_t i = 0; i < a.size(); i++)
+        for(size_t c = 0; c < Attr::value_type::rows; c++)
+            assert_float_close(a[i][c], b[i][c], eps);
+}
+
+void assert_mesh_close(const mesh_indexed& a, const mesh_indexed& b,
+        double eps)
+{
+    assert_equal(a.name, b.name);
+    assert_equal_print(a.has_positions(), b.has_positions());
+    assert_equal_print(a.has_normals(), b.has_normals());
+    assert_equal_print(a.has_uvs(), b.has_uvs());
+    assert_equal_print(a.has_weights(), b.has_weights());
+    assert_equal_print(a.has_bone_indices(), b.has_bone_indices());
+
+    if(a.has_positions()) assert_attr_close(a.positions, b.positions, eps);
+    if(a.has_normals()) assert_attr_close(a.normals, b.normals, eps);
+    if(a.has_uvs()) assert_attr_close(a.uvs, b.uvs, eps);
+    if(a.has_weights()) assert_attr_close(a.weights, b.weights, eps);
+    if(a.has_bone_indices())
+        assert_attr_close(a.bone_indices, b.bone_indices, eps);
+}
+
+TEST_CASE(test_codec_lossless) {
+    vector<mesh_indexed> ms;
+    ms.push_back(mesh_uv_sphere(1.5, 64, 32));
+    ms.push_back(mesh_plane(2, 3, 20, 10));
+    ms.push_back(mesh_box(1, 2, 3));
+    ms.back().name = "box";
+
+    // skinned attributes, bone indices are always kept exact
+    for(size_t i = 0; i < ms[2].stor_positions->size(); i++) {
+        ms[2].stor_weights->push_back(col4 { 0.25, 0.25, 0.5, 0 });
+        ms[2].stor_bone_indices->push_back(col4 { double(i), 1, 2, 0 });
+    }
+    ms[2].weights.indices = ms[2].positions.indices;
+    ms[2].bone_indices.indices = ms[2].positions.indices;
+
+    vector<uint8_t> data = mesh_codec::encode(ms);
+    vector<mesh_indexed> out = mesh_codec::decode(data.data(), data.size());
+
+    assert_equal_print(out.size(), ms.size());
+    for(size_t i = 0; i < ms.size(); i++)
+        assert_mesh_close(ms[i], out[i], 0);
+
+    // quantized: error within half a step of the range
+    mesh_codec::options opt;
+    opt.prec = mesh_codec::QUANTIZED;
+    opt.quant_bits = 12;
+    vector<uint8_t> qdata = mesh_codec::encode(ms, opt);
+    out = mesh_codec::decode(qdata.data(), qdata.size());
+    assert_true(qdata.size() < data.size());
+    assert_mesh_close(ms[0], out[0], 3.0 / 4095);
+    assert_equal_print(out[2].bone_indices[7][0], ms[2].bone_indices[7][0]);
+}
+
+TEST_CASE(test_codec_shared_storage) {
+    string obj = R"EOF(
+    v 0 0 0
+    v 1 0 0
+    v 1 1 0
+    v 0 1 0
+    vn 0 0 1
+    g first
+    f 1//1 2//1 3//1
+    g second
+    f 1//1 3//1 4//1
+    )EOF";
+
+    stringstream ss(obj);
+    vector<mesh_indexed> ms = mesh_io_object::load(ss);
+
+    stringstream bin;
+    mesh_io_compressed::save(bin, ms);
+    vector<mesh_indexed> out = mesh_io_compressed::load(bin);
+
+    assert_equal_print(out.size(), ms.size());
+    for(size_t i = 0; i < ms.size(); i++)
+        assert_mesh_close(ms[i], out[i], 0);
+
+    // groups of one file keep sharing their storages
+    assert_equal(out[0].stor_positions, out[1].stor_positions);
+    assert_equal_print(out[0].stor_positions->size(), 4u);
+    assert_false(bool(out[0].stor_weights));
+
+    // decoding into an arena, storages and indices all come from it
+    shared_ptr<arena> a = make_shared<arena>();
+    bin.clear();
+    bin.seekg(0);
+    out = mesh_io_compressed::load(bin, a);
+    assert_true(out[1].stor_normals->get_allocator().source == a);
+    assert_true(out[1].positions.indices.get_allocator().source == a);
+    assert_equal_print(a->blocks(), 1u);
+}
+
+TEST_CASE(test_codec_ratio) {
+    vector<mesh_indexed> ms;
+    ms.push_back(mesh_plane(4, 4, 300, 300));
+
+    size_t raw = 0;
+    raw += ms[0].stor_positions->size() * sizeof(float) * 4;
+    raw += ms[0].stor_normals->size() * sizeof(float) * 3;
+    raw += ms[0].stor_uvs->size() * sizeof(float) * 3;
+    raw += ms[0].positions.size() * sizeof(uint32_t) * 3;
+
+    mesh_codec::options opt;
+    opt.prec = mesh_codec::SINGLE;
+    vector<uint8_t> data = mesh_codec::encode(ms, opt);
+    assert_true(data.size() * 4 < raw);
+
+    vector<mesh_indexed> out = mesh_codec::decode(data.data(), data.size());
+    assert_mesh_close(ms[0], out[0], 0.000001);
+}
+
+TEST_CASE(test_codec_bad_input) {
+    vector<mesh_indexed> ms;
+    ms.push_back(mesh_box(1, 1, 1));
+    vector<uint8_t> data = mesh_codec::encode(ms);
+
+    assert_except(mesh_codec::decode(data.data(), 4), parse_error);
+    assert_except(mesh_codec::decode(data.data(), data.size() - 3),
+            parse_error);
+
+    data[0] = 'X';
+    assert_except(mesh_codec::decode(data.data(), data.size()), parse_error);
+}
+
+int main(int argc, char* argv[])
+{
+    test_main(argc, argv);
+}
@@ -164,6 +164,233 @@ TEST_CASE(test_dynamic_property) {
     assert_equal_print(*(int*)(buf + 60), 2);
 }
 
+TEST_CASE(test_array_items) {
+    refl::meta_manager::init();
+
+    // arrays are apart by their element size rounded to the align
+    typedef std::array<math::fcol3, 2> lights_t;
+    universal_property<int, lights_t, float> up;
+    assert_equal_print(item_trait<lights_t>::size(), 32U);
+    assert_equal_print(item_offset<1>(up), 16U);
+    assert_equal_print(item_offset<2>(up), 48U);
+    assert_equal_print(
+        trim_str(property_glsl_definition(up, "lights",
+                "count", "positions", "range")),
+        trim_str("uniform lights { int count; "
+                "vec3 positions[2]; float range; };"));
+
+    // elements of scalars take 16 bytes each, as std140 has them
+    typedef std::array<float, 3> weights_t;
+    universal_property<int, weights_t, float> wp;
+    assert_equal_print(item_trait<weights_t>::size(), 48U);
+    assert_equal_print(item_offset<1>(wp), 16U);
+    assert_equal_print(item_offset<2>(wp), 64U);
+    item_set<1>(wp, weights_t {{ 1, 2, 3 }});
+    vector<float> wbuf(property_size(wp) / 4, 0);
+    prop_trait<decltype(wp)>::copy(wp,
+            reinterpret_cast<uint8_t*>(wbuf.data()));
+    assert_equal_print(wbuf[4], 1.f);
+    assert_equal_print(wbuf[8], 2.f);
+    assert_equal_print(wbuf[12], 3.f);
+
+    // an unsized array ends a storage block
+    dynamic_property dp;
+    dp.append<int>(2);
+    dp.append<vector<math::fxmat>>(vector<math::fxmat> {
+        math::fxmat(3, 1, { 1, 2, 3 }), math::fxmat(3, 1, { 4, 5, 6 }) });
+    assert_equal_print(dp.size_in_bytes(), 48U);
+    assert_equal_print(
+        trim_str(dp.storage_definition("lights", { "count", "positions" })),
+        trim_str("layout (std430) buffer lights { int count; "
+                "vec3 positions[]; };"));
+
+    float buf[12] = { 0 };
+    dp.copy(reinterpret_cast<uint8_t*>(buf));
+    assert_equal_print(buf[4], 1.f);
+    assert_equal_print(buf[8], 4.f);
+    assert_equal_print(buf[10], 6.f);
+
+    vector<math::fxmat> more = dp.get<vector<math::fxmat>>(1);
+    more.push_back(math::fxmat(3, 1));
+    dp.set<vector<math::fxmat>>(1, std::move(more));
+    assert_equal_print(dp.size_in_bytes(), 64U);
+
+    // grown in place, the layout follows
+    dp.get<vector<math::fxmat>>(1).push_back(math::fxmat(3, 1, { 7, 8, 9 }));
+    dp.touch(1);
+    assert_equal_print(dp.size_in_bytes(), 80U);
+    assert_true(dp.dirty_ranges().all());
+    vector<float> grown(20, -1);
+    dp.copy(reinterpret_cast<uint8_t*>(grown.data()));
+    assert_equal_print(grown[16], 7.f);
+    assert_equal_print(grown[18], 9.f);
+}
+
+TEST_CASE(test_dynamic_property_plan) {
+    refl::meta_manager::init();
+
+    dynamic_property dp;
+    dp.append<float>(1.5f);
+    dp.append<math::fxmat>(math::fxmat(3, 1));
+    dp.append<int>(2);
+    dp.append<math::fxmat>(math::fxmat(4, 4));
+    dp.append<char>('z');
+    dp.append<double>(0.25);
+
+    // laid out as the functions registered by name lay each item
+    size_t n = dp.size_in_bytes();
+    vector<uint8_t> buf(n, 0), by_name(n, 0);
+    dp.copy(buf.data());
+    size_t off = 0;
+    for(refl::instance& ins : dp.underlying()) {
+        size_t align = ins.call("__align").get<size_t>();
+        off = (off + align - 1) / align * align;
+        ins.call("__raw_into", refl::instance::make((void*)(by_name.data() + off)));
+        off += ins.call("__size").get<size_t>();
+    }
+    assert_equal_print(off, n);
+    assert_true(buf == by_name);
+
+    // values changed in place are copied without laying out again
+    dp.get<int>(2) = 9;
+    dp.get<double>(5) = 4.0;
+    dp.copy(buf.data());
+    assert_equal_print(*(int*)(buf.data() + 28), 9);
+    assert_equal_print(*(double*)(buf.data() + n - 8), 4.0);
+
+    // replaced instances are laid out again
+    dp.set<double>(0, 8.0);
+    assert_equal_print(dp.size_in_bytes(), n);
+    dp.copy(buf.data());
+    assert_equal_print(*(double*)buf.data(), 8.0);
+    dp.underlying()[4] = refl::instance::make(math::fxmat(4, 1));
+    assert_equal_print(dp.size_in_bytes(), n + 8);
+
+    dp.append_instance(refl::instance::make(string("text")));
+    assert_except(dp.copy(buf.data()), restriction_error);
+}
+
+TEST_CASE(test_byte_ranges) {
+    byte_ranges r;
+    assert_true(r.empty());
+
+    r.add(160, 164);
+    r.add(4, 8);
+    r.add(80, 84);
+    assert_equal_print(r.ranges().size(), 3u);
+    assert_equal_print(r.ranges()[0].first, 4u);
+    assert_equal_print(r.ranges()[2].first, 160u);
+
+    // closer than the gap to both neighbours, merged with them
+    r.add(120, 124);
+    assert_equal_print(r.ranges().size(), 2u);
+    assert_equal_print(r.ranges()[1].first, 80u);
+    assert_equal_print(r.ranges()[1].second, 164u);
+    assert_equal_print(r.bytes(), 88u);
+
+    r.add_all();
+    r.add(0, 4);
+    assert_true(r.all() && r.ranges().empty());
+    r.clear();
+    assert_true(r.empty());
+}
+
+TEST_CASE(test_dynamic_property_dirty) {
+    refl::meta_manager::init();
+
+    dynamic_property dp;
+    for(size_t i = 0; i < 64; i++)
+        dp.append<float>(float(i));
+
+    // a new layout is dirty as a whole
+    assert_true(dp.dirty_ranges().all());
+    dp.mark_applied();
+    assert_true(dp.dirty_ranges().empty());
+
+    dp.set<float>(1, 0.5f);
+    dp.set<float>(40, 0.5f);
+    dp.get<float>(20) = 0.5f;
+    dp.touch(20);
+    assert_true(dp.is_changed());
+    const vector<byte_ranges::range>& r = dp.dirty_ranges().ranges();
+    assert_equal_print(r.size(), 3u);
+    assert_equal_print(r[1].first, 80u);
+    assert_equal_print(r[1].second, 84u);
+    assert_equal_print(r[2].first, 160u);
+
+    dp.mark_applied();
+    assert_false(dp.is_changed());
+    assert_true(dp.dirty_ranges().empty());
+
+    // items of the same size keep the layout
+    dp.set<int>(2, 7);
+    assert_equal_print(dp.dirty_ranges().ranges().size(), 1u);
+    dp.mark_applied();
+
+    // others move the items after them
+    dp.set<double>(3, 2.0);
+    assert_true(dp.dirty_ranges().all());
+    dp.mark_applied();
+
+    !dp;
+    assert_true(dp.dirty_ranges().all());
+    assert_except(dp.touch(64), restriction_error);
+}
+
+TEST_CASE(test_universal_property_dirty) {
+    typedef universal_property<math::fcol4, float, math::fmat4, int> up_t;
+    up_t up;
+    assert_true(up.is_changed());
+    assert_true(up.dirty_ranges().all());
+
+    up.mark_applied();
+    assert_false(up.is_changed());
+    assert_true(up.dirty_ranges().empty());
+
+    item_set<1>(up, 2.f);
+    item_modify<3>(up) = 3;
+    assert_true(up.is_changed());
+    assert_true(item_changed<1>(up));
+    assert_false(item_changed<2>(up));
+    assert_equal_print(item_get<3>(up), 3);
+
+    // far apart, told as two ranges
+    byte_ranges r = up.dirty_ranges();
+    assert_equal_print(r.ranges().size(), 2u);
+    assert_equal_print(r.ranges()[0].first, item_offset<1>(up));
+    assert_equal_print(r.ranges()[0].second, item_offset<1>(up) + 4);
+    assert_equal_print(r.ranges()[1].first, item_offset<3>(up));
+
+    // only those are copied
+    vector<uint8_t> buf(property_size(up), 0xee);
+    prop_trait<up_t>::copy_changed(up, buf.data());
+    assert_equal_print(*(float*)(buf.data() + item_offset<1>(up)), 2.f);
+    assert_equal_print(*(int*)(buf.data() + item_offset<3>(up)), 3);
+    assert_equal_print(buf[item_offset<2>(up)], 0xee);
+    assert_equal_print(buf[0], 0xee);
+
+    // each item changed is the whole
+    up.mark_applied();
+    for(int i = 0; i < 2; i++) {
+        item_set<0>(up, math::fcol4 { 1, 2, 3, 4 });
+        item_set<1>(up, 1.f);
+        item_set<2>(up, math::fmat4());
+    }
+    assert_false(up.dirty_ranges().all());
+    item_set<3>(up, 4);
+    assert_true(up.dirty_ranges().all());
+
+    up.mark_applied();
+    item_get<0>(!up)[0] = 1;
+    assert_true(up.dirty_ranges().all());
+
+    // a nested property has its items at the same bits
+    up.mark_applied();
+    item_set<2>(up, math::fmat4());
+    assert_true(item_changed<0>(
+                static_cast<universal_property<math::fmat4, int>&>(up)));
+}
+
 int main(int argc, char* argv[])
 {
     return test_main(argc, argv);
@@ -1,4 +1,7 @@
+#include <cstring>
+#include <cstdlib>
 #include <vector>
+#include <algorithm>
 
 #define EXPOSE_EXCEPTION
 #include "test_utils.h"
@@ -121,6 +124,420 @@ TEST_CASE(test_provided_dynamic_property) {
     p.stop_map();
 }
 
+TEST_CASE(test_property_dirty_upload) {
+    refl::meta_manager::init();
+    dynamic_property dp;
+    for(size_t i = 0; i < 256; i++)
+        dp.append<float>(float(i));
+
+    typedef provider<dynamic_property, property_buffer> prov;
+    auto p = prov::load(dp);
+    assert_false(dp.is_changed());
+
+    // bytes not changed are not written: a mark left there stays
+    float mark = -1;
+    p.write_range_raw(&mark, 100 * sizeof(float), sizeof(float));
+
+    dp.set<float>(3, 0.5f);
+    dp.set<float>(200, 0.25f);
+    prov::update(dp, p, false);
+    assert_false(dp.is_changed());
+
+    vector<float> buf(256);
+    p.read(buf.data(), 256);
+    assert_equal_print(buf[3], 0.5f);
+    assert_equal_print(buf[200], 0.25f);
+    assert_equal_print(buf[100], -1.f);
+    assert_equal_print(buf[199], 199.f);
+
+    assert_except(p.write_range_raw(&mark, 1024, sizeof(float)),
+            restriction_error);
+
+    typedef universal_property<math::fcol4, math::fmat4, float> up_t;
+    up_t up;
+    item_get<2>(up) = 3;
+    auto q = provider<up_t, property_buffer>::load(up);
+    item_modify<0>(up) = math::fcol4 { 1, 2, 3, 4 };
+    provider<up_t, property_buffer>::update(up, q, false);
+    q.read(buf.data(), 21);
+    assert_equal_print(buf[1], 2.f);
+    assert_equal_print(buf[20], 3.f);
+}
+
+TEST_CASE(test_property_dirty_merged) {
+    // items changed, close enough to be written in a range with the one
+    // between them, which keeps its value
+    typedef universal_property<math::fcol4, float, math::fcol4,
+            math::fmat4, math::fmat4, math::fmat4> up_t;
+    up_t up;
+    item_get<1>(up) = 7;
+    auto p = provider<up_t, property_buffer>::load(up);
+
+    // staged whole first, then only the items changed are copied
+    for(float f : { 1.f, 2.f }) {
+        item_modify<0>(up) = math::fcol4 { f, 2, 3, 4 };
+        item_modify<2>(up) = math::fcol4 { 5, 6, 7, f };
+        assert_equal_print(up.dirty_ranges().ranges().size(), 1u);
+        provider<up_t, property_buffer>::update(up, p, false);
+
+        vector<float> buf(12);
+        p.read(buf.data(), 12);
+        assert_equal_print(buf[0], f);
+        assert_equal_print(buf[4], 7.f);
+        assert_equal_print(buf[11], f);
+    }
+
+    // and so does an item of a dynamic property
+    refl::meta_manager::init();
+    dynamic_property dp;
+    for(size_t i = 0; i < 64; i++)
+        dp.append<float>(float(i));
+    auto q = provider<dynamic_property, property_buffer>::load(dp);
+    dp.set<float>(10, -1);
+    dp.set<float>(12, -2);
+    assert_equal_print(dp.dirty_ranges().ranges().size(), 1u);
+    provider<dynamic_property, property_buffer>::update(dp, q, false);
+
+    vector<float> all(64);
+    q.read(all.data(), 64);
+    assert_equal_print(all[10], -1.f);
+    assert_equal_print(all[11], 11.f);
+    assert_equal_print(all[12], -2.f);
+}
+
+TEST_CASE(test_property_stage_reused) {
+    refl::meta_manager::init();
+    dynamic_property dp;
+    for(size_t i = 0; i < 256; i++)
+        dp.append<float>(float(i));
+
+    typedef provider<dynamic_property, property_buffer> prov;
+    auto p = prov::load(dp);
+    assert_false(p.stage().valid);
+
+    // the first range written fills the stage, kept by the buffer
+    dp.set<float>(3, 0.5f);
+    prov::update(dp, p, false);
+    assert_true(p.stage().valid);
+    const uint8_t* stage = p.stage().bytes.data();
+
+    // then only the items changed are copied over it
+    float* staged = reinterpret_cast<float*>(p.stage().bytes.data());
+    staged[100] = -1;
+    dp.set<float>(200, 0.25f);
+    prov::update(dp, p, false);
+    assert_true(p.stage().bytes.data() == stage);
+    assert_equal_print(staged[100], -1.f);
+    assert_equal_print(staged[200], 0.25f);
+
+    // written whole again, the stage is not taken for what is in the buffer
+    prov::update(dp, p, true);
+    assert_false(p.stage().valid);
+}
+
+#include "common/image.h"
+
+TEST_CASE(test_texture_from_views) {
+    image atlas(64, 32);
+    for(size_t y = 0; y < atlas.height(); y++)
+        for(size_t x = 0; x < atlas.width(); x++)
+            atlas.pixel(x, y) = color(x, y, 7);
+
+    // a tile of the atlas, straight from it
+    typedef provider<const_image_view, texture2d> prov;
+    const_image_view tile = atlas.view(16, 8, 8, 4);
+    auto t = prov::load(tile);
+
+    vector<color> out(8 * 4);
+    t.read(out.data());
+    assert_equal_print(out[0], color(16, 8, 7));
+    assert_equal_print(out[8 * 3 + 7], color(23, 11, 7));
+
+    // and a sub-rect of another tile
+    t.fill_rect(2, 1, 3, 2, atlas.view(40, 20, 3, 2));
+    t.read(out.data());
+    assert_equal_print(out[8 + 2], color(40, 20, 7));
+    assert_equal_print(out[8 * 2 + 4], color(42, 21, 7));
+    assert_equal_print(out[8 * 2 + 5], color(21, 10, 7));
+}
+
+TEST_CASE(test_cubemap_from_cross) {
+    image cross(32, 24);
+    for(size_t y = 0; y < cross.height(); y++)
+        for(size_t x = 0; x < cross.width(); x++)
+            cross.pixel(x, y) = color(x / 8, y / 8, x % 8 + y % 8 * 8);
+
+    typedef provider<image, texture_cubemap> prov;
+    auto cm = prov::load(cross);
+    assert_equal_print(cm.get_width(), 8u);
+
+    image faces(8, 48);
+    cm.read(faces.data());
+
+    image expected = image::load_cubemap_from(cross);
+    assert_true(equal(faces.begin(), faces.end(), expected.begin()));
+}
+
+#include "common/image_resample.h"
+
+TEST_CASE(test_texture_fill_levels) {
+    image im(16, 8);
+    for(size_t y = 0; y < im.height(); y++)
+        for(size_t x = 0; x < im.width(); x++)
+            im.pixel(x, y) = x < 8 ? color(255, 0, 0) : color(0, 0, 255);
+
+    vector<image> chain = image_resample::mip_chain(im);
+    vector<pixel_view> levels;
+    for(const image& l : chain)
+        levels.push_back(l.data());
+
+    texture2d t(16, 8);
+    t.fill_levels(levels);
+
+    // the levels are exactly those baked
+    vector<color> out(2 * 1);
+    t.bind_to(0);
+    glGetTexImage(GL_TEXTURE_2D, 3, GL_RGBA, GL_UNSIGNED_BYTE, out.data());
+    t.bind_to(-1);
+    assert_equal_print(out[0], chain[3].pixel(0, 0));
+    assert_equal_print(out[1], color(0, 0, 255));
+
+    GLint max_level = 0;
+    glBindTexture(GL_TEXTURE_2D, t.id());
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &max_level);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    assert_equal_print(max_level, 4);
+
+    texture_cubemap c(4);
+    assert_except(c.fill_levels(levels), unsupported_error);
+}
+
+#include "common/ktx.h"
+
+TEST_CASE(test_texture_from_ktx) {
+    image im(8, 8);
+    for(size_t y = 0; y < im.height(); y++)
+        for(size_t x = 0; x < im.width(); x++)
+            im.pixel(x, y) = color(x * 30, y * 30, 0);
+
+    stringstream ss;
+    ktx_texture::bake(ss, im);
+    string bytes = ss.str();
+    ktx_texture k = ktx_texture::from_memory(
+            vector<uint8_t>(bytes.begin(), bytes.end()));
+
+    auto t = provider<ktx_texture, texture2d>::load(k);
+    vector<color> out(2 * 2);
+    glBindTexture(GL_TEXTURE_2D, t.id());
+    glGetTexImage(GL_TEXTURE_2D, 2, GL_RGBA, GL_UNSIGNED_BYTE, out.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    assert_equal_print(memcmp(out.data(), k.data(2), 16), 0);
+
+    // every face of every level of a cubemap
+    image cross(16, 12);
+    for(size_t y = 0; y < cross.height(); y++)
+        for(size_t x = 0; x < cross.width(); x++)
+            cross.pixel(x, y) = color(x / 4 * 60, y / 4 * 100, 7);
+
+    ss.str("");
+    ktx_texture::bake(ss, cross, true);
+    bytes = ss.str();
+    ktx_texture kc = ktx_texture::from_memory(
+            vector<uint8_t>(bytes.begin(), bytes.end()));
+
+    auto c = provider<ktx_texture, texture_cubemap>::load(kc);
+    color face;
+    glBindTexture(GL_TEXTURE_CUBE_MAP, c.id());
+    glGetTexImage(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, 2,
+            GL_RGBA, GL_UNSIGNED_BYTE, &face);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    assert_equal_print(face, image::cubemap_faces(cross)[5].pixel(0, 0));
+}
+
+#include "common/block_compress.h"
+
+TEST_CASE(test_texture_compressed) {
+    image im(8, 8);
+    for(size_t y = 0; y < im.height(); y++)
+        for(size_t x = 0; x < im.width(); x++)
+            im.pixel(x, y) = color(x * 30, y * 30, 60);
+
+    compressed_image ci = block_compress::encode(im, BC1_RGBA);
+    auto t = provider<compressed_image, texture2d>::load(ci);
+    assert_equal_print(t.get_internal_format(), texture::BC1_RGBA);
+
+    // the blocks are taken as they are
+    vector<uint8_t> blocks(ci.size());
+    t.read(blocks.data(), texture::BC1_RGBA);
+    assert_equal_print(memcmp(blocks.data(), ci.data(), ci.size()), 0);
+
+    // and the driver decodes them as the encoder does
+    image out(8, 8);
+    glBindTexture(GL_TEXTURE_2D, t.id());
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, out.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    image expected = block_compress::decode(ci);
+    for(size_t y = 0; y < 8; y++)
+        for(size_t x = 0; x < 8; x++)
+            for(size_t c = 0; c < 4; c++)
+                assert_true(abs(int(out.pixel(x, y)[c]) -
+                            int(expected.pixel(x, y)[c])) <= 2);
+
+    // baked with its levels, each one is taken as it is
+    stringstream ss;
+    ktx_texture::bake_compressed(ss, im, BC1_RGBA);
+    string bytes = ss.str();
+    ktx_texture k = ktx_texture::from_memory(
+            vector<uint8_t>(bytes.begin(), bytes.end()));
+    auto tk = provider<ktx_texture, texture2d>::load(k);
+    assert_equal_print(tk.get_internal_format(), texture::BC1_RGBA);
+
+    uint8_t level[8];
+    glBindTexture(GL_TEXTURE_2D, tk.id());
+    glGetCompressedTexImage(GL_TEXTURE_2D, 1, level);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    assert_equal_print(memcmp(level, k.data(1), 8), 0);
+
+    // nor converted from another format
+    texture2d t2(8, 8, texture::BC1_RGBA);
+    assert_except(t2.fill(im.data(), texture::RGBA_U8888),
+            restriction_error);
+}
+
+TEST_CASE(test_texture_narrow_formats) {
+    // rows of 5 bytes, which the driver would take as aligned to 4
+    vector<uint8_t> r8 { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+    texture2d t(5, 2, texture::R_U8);
+    t.fill(r8.data(), texture::R_U8);
+
+    vector<uint8_t> out(10);
+    t.read(out.data());
+    assert_equal_print(out == r8, true);
+
+    vector<uint16_t> rg8(3 * 3, 0x4020);
+    texture2d t2(3, 3, texture::RG_U88);
+    t2.fill(rg8.data());
+    vector<float> rg(3 * 3 * 2);
+    t2.read(rg.data(), texture::RG_F32);
+    assert_equal_print(int(rg[16] * 255 + 0.5), 0x20);
+    assert_equal_print(int(rg[17] * 255 + 0.5), 0x40);
+
+    // halfs are filled from floats, and read back as exactly as they fit
+    vector<float> f { 0.5f, -2.0f, 1024.0f, 0.25f };
+    texture2d h(1, 1, texture::RGBA_F16);
+    h.fill(f.data(), texture::RGBA_F32);
+    vector<uint16_t> halfs(4);
+    h.read(halfs.data());
+    assert_equal_print(halfs[0], 0x3800);
+    assert_equal_print(halfs[1], 0xC000);
+    vector<float> back(4);
+    h.read(back.data(), texture::RGBA_F32);
+    assert_equal_print(back == f, true);
+
+    texture2d p(2, 1, texture::RGB_F111110);
+    vector<float> rgb { 1, 2, 4, 0.5f, 0.25f, 8 };
+    p.fill(rgb.data(), texture::RGB_F32);
+    vector<float> rgb_out(6);
+    p.read(rgb_out.data(), texture::RGB_F32);
+    assert_equal_print(rgb_out == rgb, true);
+}
+
+#include "shading.h"
+
+TEST_CASE(test_renderbuffer_target) {
+    texture2d color_tex(4, 4, texture::RGBA_F16);
+    renderbuffer depth(4, 4, texture::DEPTH_U24);
+
+    render_target rt;
+    rt.attach_texture(render_target::COLOR_BUFFER_0, color_tex);
+    rt.attach_renderbuffer(render_target::DEPTH_BUFFER, depth);
+    assert_true(!rt.is_screen());
+    assert_true(!depth.vacuum());
+
+    glBindFramebuffer(GL_FRAMEBUFFER, rt.id());
+    assert_equal_print(glCheckFramebufferStatus(GL_FRAMEBUFFER),
+            GLenum(GL_FRAMEBUFFER_COMPLETE));
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    rt.set_bgcolor(fcolor(0.25, 0.5, 0.75, 1));
+    rt.clear_buffer(render_target::COLOR_BUFFER);
+    rt.clear_buffer(render_target::DEPTH_BUFFER);
+
+    vector<float> px(4 * 4 * 4);
+    color_tex.read(px.data(), texture::RGBA_F32);
+    assert_equal_print(px[20], 0.25f);
+    assert_equal_print(px[22], 0.75f);
+
+    // refused, the target stays as it was
+    texture_cubemap shared(4, texture::RGBA_U8888);
+    assert_except(rt.attach_texture(render_target::COLOR_BUFFER_0, shared),
+            restriction_error);
+    assert_true(rt.get_attachment(render_target::COLOR_BUFFER_0) ==
+            &color_tex);
+    glBindFramebuffer(GL_FRAMEBUFFER, rt.id());
+    assert_equal_print(glCheckFramebufferStatus(GL_FRAMEBUFFER),
+            GLenum(GL_FRAMEBUFFER_COMPLETE));
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // the faces of a cubemap are rendered one after another
+    texture_cubemap cube(4, texture::RGBA_U8888);
+    render_target crt;
+    crt.attach_texture(render_target::COLOR_BUFFER_0, cube);
+    assert_except(crt.attach_renderbuffer(
+                render_target::DEPTH_BUFFER, depth), restriction_error);
+}
+
+#include "common/image_transform.h"
+
+TEST_CASE(test_texture_from_transformed_view) {
+    // more rows than a band holds, so the upload takes several
+    image im(300, 400);
+    for(size_t y = 0; y < im.height(); y++)
+        for(size_t x = 0; x < im.width(); x++)
+            im.pixel(x, y) = color(x, y, x ^ y, 255);
+
+    transformed_image_view tv(im.view(), image_transform::ROTATE_CW);
+    auto t = provider<transformed_image_view, texture2d>::load(tv);
+    assert_equal_print(t.get_width(), 400u);
+    assert_equal_print(t.get_height(), 300u);
+
+    image out(400, 300);
+    t.read(out.data());
+    image_transform::apply(im, image_transform::ROTATE_CW);
+    assert_true(equal(out.begin(), out.end(), im.begin()));
+}
+
+#include <future>
+#include "common/image_loader.h"
+
+TEST_CASE(test_texture_from_async_image) {
+    promise<image> decoded;
+    async_image a(decoded.get_future().share());
+
+    // left empty until the image is ready, and bound as none meanwhile
+    texture2d t;
+    provider<async_image, texture2d>::update(a, t, true);
+    assert_true(t.vacuum());
+    t.bind_to(0);
+    assert_true(t.vacuum());
+    t.bind_to(-1);
+
+    image im(3, 2);
+    for(color& c : im) c = color(10, 20, 30);
+    decoded.set_value(im);
+
+    provider<async_image, texture2d>::update(a, t, false);
+    assert_equal_print(t.get_width(), 3u);
+    image out(3, 2);
+    t.read(out.data());
+    assert_equal_print(out.pixel(2, 1), color(10, 20, 30));
+
+    // an image always ready is not uploaded again but anew
+    texture2d u;
+    provider<image, texture2d>::update(im, u, false);
+    assert_true(u.vacuum());
+}
+
 int main(int argc, char* argv[])
 {
     gui_test_context::init("330 core", "");
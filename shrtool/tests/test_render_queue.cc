@@ -110,6 +110,78 @@ TEST_CASE(test_topology_sort_failure) {
 using namespace shrtool::render_assets;
 using namespace shrtool::math;
 
+TEST_CASE(test_property_release) {
+    refl::meta_manager::init();
+    provided_render_task::provider_bindings pb;
+    universal_property<fcol4> a, b, c;
+    auto offset_of = [&pb](const void* obj) {
+        return pb.arena.offset(pb.property_bindings.at(
+                    reinterpret_cast<size_t>(obj)).get_handle());
+    };
+
+    size_t offset;
+    {
+        provided_render_task t1(pb), t2(pb);
+        t1.set_property("material", a);
+        t2.set_property("material", a);
+        offset = offset_of(&a);
+
+        // set again by the same object, its range is kept
+        t1.set_property("material", a);
+        assert_equal_print(offset_of(&a), offset);
+
+        // replaced in one task, the other one still sets it
+        t1.set_property("material", b);
+        assert_equal_print(pb.property_bindings.size(), 2u);
+        t2.set_property("material", b);
+        assert_equal_print(pb.property_bindings.size(), 1u);
+
+        // copies of a task set the objects as well
+        provided_render_task t3(t2);
+        t1.set_property("material", c);
+        t2.set_property("material", c);
+        assert_equal_print(pb.property_bindings.count(
+                    reinterpret_cast<size_t>(&b)), 1u);
+    }
+
+    // all tasks gone, the ranges are given back
+    assert_true(pb.property_bindings.empty());
+    assert_equal_print(pb.arena.used(), 0u);
+
+    provided_render_task t(pb);
+    t.set_property("material", a);
+    assert_equal_print(offset_of(&a), offset);
+}
+
+TEST_CASE(test_property_arena_bounded) {
+    refl::meta_manager::init();
+    provided_render_task::provider_bindings pb;
+    universal_property<fcol4, fcol4> a;
+    universal_property<fcol4> b;
+
+    size_t used = 0, blocks = 0;
+    for(int n = 0; n < 64; n++) {
+        provided_render_task t1(pb), t2(pb);
+        t1.set_property("material", a);
+        t1.set_property("light", b);
+        t2.set_property("material", b);
+        provided_render_task t3(t1);
+        t3.set_property("light", a);
+
+        // as much held by each round as by the first one
+        if(!n) {
+            used = pb.arena.used();
+            blocks = pb.arena.blocks();
+        }
+        assert_equal_print(pb.arena.used(), used);
+        assert_equal_print(pb.arena.blocks(), blocks);
+    }
+
+    assert_true(pb.property_bindings.empty());
+    assert_equal_print(pb.arena.used(), 0u);
+    assert_equal_print(pb.arena.blocks(), blocks);
+}
+
 struct rotate_model_fixture : singlefunc_fixture {
     bool actions[4] = { false, false, false, false, };
 
@@ -95,6 +95,81 @@ TEST_CASE(test_parse_property) {
     assert_equal_print(lo[4].second, "attr5");
 }
 
+TEST_CASE(test_parse_storage_group) {
+    stringstream ss(R"EOF(
+    '((name . "storage-test-shader")
+      (property-group
+        (name . "lights")
+        (layout
+          (int . "count")
+          (col4-array . "positions")
+          (tex2d . "shadow"))))
+    )EOF");
+
+    shader_info si;
+    shader_parser::load_shader(ss, si);
+
+    const layout& lo = si.property_groups[0].second;
+    assert_equal_print(lo[1].first, layout::COL4 | layout::ARRAY);
+    assert_true(layout::is_array(lo[1].first));
+    assert_true(!layout::is_array(lo[2].first));
+
+    assert_equal_print(lo.make_source_as_prop("lights"),
+        "layout (std430) buffer lights {\n"
+        "    int count;\n"
+        "    vec4 positions[];\n"
+        "};\n"
+        "uniform sampler2D shadow;\n");
+
+    layout bad(lo);
+    bad.value.push_back(make_pair(layout::FLOAT, string("after")));
+    assert_except(bad.make_source_as_prop("lights"), restriction_error);
+}
+
+TEST_CASE(test_property_struct) {
+    layout lo;
+    lo.value = {
+        { layout::COL3, "position" },
+        { layout::FLOAT, "range" },
+        { layout::COL2, "falloff" },
+        { layout::COL3, "color" },
+        { layout::TEX2D, "shadow" },
+    };
+
+    assert_equal_print(lo.make_source_as_struct("point-light"),
+        "struct point_light {\n"
+        "    float position[3];\n"
+        "    float range;\n"
+        "    float falloff[2];\n"
+        "    uint8_t pad0_[8];\n"
+        "    float color[3];\n"
+        "    uint8_t pad1_[4];\n"
+        "};\n"
+        "static_assert(offsetof(point_light, position) == 0,\n"
+        "    \"point_light::position is not at its std140 offset\");\n"
+        "static_assert(offsetof(point_light, range) == 12,\n"
+        "    \"point_light::range is not at its std140 offset\");\n"
+        "static_assert(offsetof(point_light, falloff) == 16,\n"
+        "    \"point_light::falloff is not at its std140 offset\");\n"
+        "static_assert(offsetof(point_light, color) == 32,\n"
+        "    \"point_light::color is not at its std140 offset\");\n"
+        "static_assert(sizeof(point_light) == 48,\n"
+        "    \"point_light is not of its std140 size\");\n");
+
+    layout textures;
+    textures.value = { { layout::TEX2D, "diffuse" } };
+    assert_equal_print(textures.make_source_as_struct("tex"), "");
+
+    string path = locate_assets("shaders/solid-color.scm");
+    ifstream fs(path);
+    vector<shader_info> shaders { shader_parser::load(fs) };
+    string header = shader_parser::make_struct_header(shaders);
+    assert_true(header.find("namespace solid_color {") != string::npos);
+    assert_true(header.find("struct prop_trait<"
+                "props::solid_color::material>") != string::npos);
+    assert_true(header.find("sizeof(camera) == 192") != string::npos);
+}
+
 TEST_CASE(test_parse_blinn_phong_sample) {
     string path = locate_assets("shaders/blinn-phong.scm");
 
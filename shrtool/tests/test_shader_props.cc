@@ -0,0 +1,48 @@
+#include <vector>
+
+#define EXPOSE_EXCEPTION
+#include "test_utils.h"
+#include "providers.h"
+// generated from the shader definitions at build time
+#include "shader_props.h"
+
+using namespace std;
+using namespace shrtool;
+using namespace shrtool::render_assets;
+
+typedef props::blinn_phong::material material_t;
+typedef props::blinn_phong::transfrm transfrm_t;
+
+TEST_CASE(test_shader_props_layout) {
+    // checked at compile time as well, by the header
+    assert_equal_print(sizeof(material_t), 48u);
+    assert_equal_print(offsetof(material_t, specularColor), 32u);
+    assert_equal_print(sizeof(transfrm_t), 128u);
+    assert_equal_print(sizeof(props::solid_color::material), 16u);
+}
+
+TEST_CASE(test_shader_props_upload) {
+    material_t m = { };
+    m.diffuseColor[1] = 0.5f;
+    m.specularColor[3] = 1;
+
+    typedef provider<material_t, property_buffer> prov;
+    auto p = prov::load(m);
+    assert_equal_print(p.size(), sizeof(material_t));
+
+    // structs keep no record of changes, so each update writes them
+    m.ambientColor[0] = 0.25f;
+    prov::update(m, p, false);
+
+    vector<float> buf(12);
+    p.read(buf.data(), 12);
+    assert_equal_print(buf[0], 0.25f);
+    assert_equal_print(buf[5], 0.5f);
+    assert_equal_print(buf[11], 1.f);
+}
+
+int main(int argc, char* argv[])
+{
+    gui_test_context::init("330 core", "");
+    return unit_test::test_main(argc, argv);
+}
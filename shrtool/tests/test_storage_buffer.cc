@@ -0,0 +1,128 @@
+#include <vector>
+
+#define EXPOSE_EXCEPTION
+#include "test_utils.h"
+#include "providers.h"
+#include "properties.h"
+#include "render_queue.h"
+
+using namespace shrtool;
+using namespace shrtool::render_assets;
+using namespace std;
+
+static const char* vert_src = R"EOF(
+    #version 430 core
+    layout (location = 0) in vec4 position;
+    void main() { gl_Position = position; }
+    )EOF";
+
+static void fill_quad(vertex_attr_vector& vat) {
+    float quad[4 * 6] = {
+         1,  1, 0, 1,  -1,  1, 0, 1,  -1, -1, 0, 1,
+        -1, -1, 0, 1,   1, -1, 0, 1,   1,  1, 0, 1,
+    };
+    vat.primitives_count(6);
+    vat.add_input(0).write(quad, 4 * 6);
+    vat.updated();
+}
+
+TEST_CASE(test_storage_buffer) {
+    refl::meta_manager::init();
+    dynamic_property dp;
+    dp.append<int>(3);
+    dp.append<vector<float>>(vector<float> { 0.25f, 0.5f, 0.75f });
+
+    typedef provider<dynamic_property, storage_buffer> prov;
+    auto p = prov::load(dp);
+    assert_equal_print(p.size(), 16U);
+
+    // the array grown, the buffer is specified again
+    dp.set<int>(0, 4);
+    dp.set<vector<float>>(1, vector<float> { 0.25f, 0.5f, 0.75f, 1 });
+    prov::update(dp, p, false);
+    assert_equal_print(p.size(), 20U);
+
+    shader shr;
+    shr.add_sub_shader(shader::VERTEX).compile(vert_src);
+    shr.add_sub_shader(shader::FRAGMENT).compile(R"EOF(
+    #version 430 core
+    )EOF" + dp.storage_definition("levels", { "count", "values" }) + R"EOF(
+    out vec4 outColor;
+    void main() {
+        int i = int(gl_FragCoord.x);
+        outColor = vec4(i < count ? values[i] : 0, 0, 0, 1);
+    }
+    )EOF");
+    shr.link();
+
+    vertex_attr_vector vat;
+    fill_quad(vat);
+
+    texture2d tex(4, 1, texture::RGBA_U8888);
+    render_target rt;
+    rt.attach_texture(render_target::COLOR_BUFFER_0, tex);
+    shr.target(rt);
+    rt.set_viewport(rect(0, 0, 4, 1));
+    shr.property("levels", p);
+    shr.draw(vat);
+
+    vector<color> px(4);
+    tex.read(px.data());
+    for(size_t i = 0; i < 4; i++)
+        assert_equal_print(size_t(px[i].data.bytes[0]),
+                size_t((i + 1) * 255 / 4.f + 0.5f));
+}
+
+TEST_CASE(test_storage_render_task) {
+    refl::meta_manager::init();
+    dynamic_property dp;
+    dp.append<int>(2);
+    dp.append<vector<float>>(vector<float> { 0.5f, 1 });
+
+    shader shr;
+    shr.add_sub_shader(shader::VERTEX).compile(vert_src);
+    shr.add_sub_shader(shader::FRAGMENT).compile(R"EOF(
+    #version 430 core
+    )EOF" + dp.storage_definition("levels", { "count", "values" }) + R"EOF(
+    out vec4 outColor;
+    void main() {
+        int i = int(gl_FragCoord.x);
+        outColor = vec4(i < count ? values[i] : 0, 0, 0, 1);
+    }
+    )EOF");
+    shr.link();
+
+    vertex_attr_vector vat;
+    fill_quad(vat);
+
+    texture2d tex(4, 1, texture::RGBA_U8888);
+    render_target rt;
+    rt.attach_texture(render_target::COLOR_BUFFER_0, tex);
+    rt.set_viewport(rect(0, 0, 4, 1));
+
+    provided_render_task::provider_bindings bindings;
+    provided_render_task t(bindings);
+    t.set_shader(shr);
+    t.set_target(rt);
+    t.set_attributes(vat);
+    t.set_storage_property("levels", dp);
+    assert_equal_print(bindings.storage_bindings.size(), 1U);
+
+    // the array grown after set, the buffer is updated before rendering
+    dp.set<int>(0, 4);
+    dp.set<vector<float>>(1, vector<float> { 0.25f, 0.5f, 0.75f, 1 });
+    t.render();
+
+    vector<color> px(4);
+    tex.read(px.data());
+    for(size_t i = 0; i < 4; i++)
+        assert_equal_print(size_t(px[i].data.bytes[0]),
+                size_t((i + 1) * 255 / 4.f + 0.5f));
+}
+
+int main(int argc, char* argv[])
+{
+    // storage blocks are core since 4.3
+    gui_test_context::init("430 core", "");
+    return unit_test::test_main(argc, argv);
+}
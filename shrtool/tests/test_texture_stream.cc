@@ -0,0 +1,88 @@
+#include <vector>
+#include <thread>
+#include <cstring>
+
+#define EXPOSE_EXCEPTION
+#include "test_utils.h"
+
+using namespace std;
+using namespace shrtool;
+using namespace shrtool::render_assets;
+
+TEST_CASE(test_texture_stream_slices) {
+    for(bool persistent : { true, false }) {
+        texture_stream ts(100, 3, persistent);
+        assert_except(ts.data(0), restriction_error);
+
+        size_t a = ts.acquire(), b = ts.acquire(), c = ts.acquire();
+        assert_equal_print(a, 0u);
+        assert_equal_print(c, 2u);
+        assert_equal_print(ts.slice_size() % 64, 0u);
+        assert_true(ts.slice_size() >= 100);
+        assert_equal_print(static_cast<uint8_t*>(ts.data(b)) -
+                static_cast<uint8_t*>(ts.data(a)), ptrdiff_t(ts.slice_size()));
+
+        // the next slice is not given before it is uploaded
+        assert_except(ts.acquire(), restriction_error);
+
+        texture2d tex(4, 4, texture::RGBA_U8888);
+        tex.reserve();
+        assert_except(ts.upload(a, tex, 0, 0, 5, 5), restriction_error);
+        assert_except(ts.upload(a, tex, 2, 2, 4, 4), restriction_error);
+        ts.upload(a, tex, 0, 0, 4, 4);
+        assert_except(ts.upload(a, tex), restriction_error);
+        assert_equal_print(ts.acquire(), 0u);
+    }
+}
+
+TEST_CASE(test_texture_stream_threads) {
+    // frames written by a thread of their own, more than slices in the ring
+    for(bool persistent : { true, false }) {
+        texture2d tex(8, 4, texture::RGBA_U8888);
+        tex.reserve();
+        texture_stream ts(8 * sizeof(color), 2, persistent);
+
+        for(size_t f = 0; f < 4; f++) {
+            size_t s = ts.acquire();
+            color* row = static_cast<color*>(ts.data(s));
+            thread writer([row, f]() {
+                for(size_t x = 0; x < 8; x++)
+                    row[x] = color(x * 16, f * 32, 7);
+            });
+            writer.join();
+            ts.upload(s, tex, 0, f, 8, 1);
+        }
+
+        vector<color> px(8 * 4);
+        tex.read(px.data());
+        for(size_t y = 0; y < 4; y++)
+            for(size_t x = 0; x < 8; x++) {
+                assert_equal_print(px[y * 8 + x].data.bytes[0], x * 16);
+                assert_equal_print(px[y * 8 + x].data.bytes[1], y * 32);
+                assert_equal_print(px[y * 8 + x].data.bytes[2], 7);
+            }
+    }
+}
+
+TEST_CASE(test_texture_stream_narrow) {
+    // rows of 5 bytes, tightly packed in slices, the first one at offset 0
+    texture2d tex(5, 2, texture::R_U8);
+    tex.reserve();
+    texture_stream ts(16, 2);
+
+    uint8_t r8[10] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+    size_t s = ts.acquire();
+    memcpy(ts.data(s), r8, sizeof(r8));
+    ts.upload(s, tex);
+
+    uint8_t out[10] = { 0 };
+    tex.read(out);
+    for(size_t i = 0; i < 10; i++)
+        assert_equal_print(size_t(out[i]), size_t(r8[i]));
+}
+
+int main(int argc, char* argv[])
+{
+    gui_test_context::init("330 core", "");
+    return unit_test::test_main(argc, argv);
+}
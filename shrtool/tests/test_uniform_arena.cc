@@ -0,0 +1,194 @@
+#include <vector>
+
+#define EXPOSE_EXCEPTION
+#include "test_utils.h"
+#include "providers.h"
+#include "properties.h"
+
+using namespace std;
+using namespace shrtool;
+using namespace shrtool::render_assets;
+
+typedef uniform_arena::handle handle;
+
+static handle put(uniform_arena& a, size_t n, float v)
+{
+    handle h = a.allocate(n * sizeof(float));
+    vector<float> data(n, v);
+    a.write(h, data.data(), 0, n * sizeof(float));
+    return h;
+}
+
+static float first(const uniform_arena& a, handle h)
+{
+    vector<float> data(a.size(h) / sizeof(float));
+    a.read(h, data.data());
+    return data[0];
+}
+
+TEST_CASE(test_arena_reuse) {
+    uniform_arena a(4096);
+    handle h0 = put(a, 3, 1);
+    assert_true(a.alignment() > 0);
+    size_t step = a.alignment() * ((12 + a.alignment() - 1) / a.alignment());
+
+    handle h1 = put(a, 3, 2), h2 = put(a, 3, 3);
+    assert_equal_print(a.blocks(), 1u);
+    assert_equal_print(a.offset(h0), 0u);
+    assert_equal_print(a.offset(h2), 2 * step);
+    assert_equal_print(a.buffer_id(h1), a.buffer_id(h0));
+    assert_equal_print(a.used(), 3 * step);
+
+    // the hole left is taken again, by the handle given back as well
+    a.release(h1);
+    assert_except(a.size(h1), restriction_error);
+    handle h3 = put(a, 2, 4);
+    assert_equal_print(h3, h1);
+    assert_equal_print(a.offset(h3), step);
+    assert_equal_print(a.size(h3), 8u);
+
+    // holes next to each other are merged
+    a.release(h0);
+    a.release(h3);
+    handle h4 = put(a, 2 * step / sizeof(float), 5);
+    assert_equal_print(a.offset(h4), 0u);
+    assert_equal_print(first(a, h2), 3.f);
+
+    assert_except(a.write(h2, &h2, 8, 8), restriction_error);
+}
+
+TEST_CASE(test_arena_compact) {
+    uniform_arena a(4096);
+    handle h = a.allocate(4);
+    size_t align = a.alignment();
+    a.release(h);
+
+    // the block filled, then every other range released
+    size_t n = 4096 / align;
+    vector<handle> hs;
+    for(size_t i = 0; i < n; i++)
+        hs.push_back(put(a, 1, float(i)));
+    assert_equal_print(a.blocks(), 1u);
+    for(size_t i = 0; i < n; i += 2)
+        a.release(hs[i]);
+
+    // too large for a hole, but the block has room: it is packed
+    id_type before = a.buffer_id(hs[1]);
+    handle big = put(a, 2 * align / sizeof(float), -1);
+    assert_equal_print(a.blocks(), 1u);
+    assert_true(a.buffer_id(big) != before);
+    for(size_t i = 1; i < n; i += 2) {
+        assert_equal_print(a.offset(hs[i]), i / 2 * align);
+        assert_equal_print(first(a, hs[i]), float(i));
+    }
+    assert_equal_print(first(a, big), -1.f);
+
+    // more than a block holds makes another
+    handle more = put(a, 4096 / sizeof(float), 7);
+    assert_equal_print(a.blocks(), 2u);
+    assert_equal_print(first(a, more), 7.f);
+
+    // packed on demand
+    a.release(hs[1]);
+    a.compact();
+    assert_equal_print(a.offset(hs[3]), 0u);
+    assert_equal_print(first(a, hs[3]), 3.f);
+}
+
+TEST_CASE(test_property_range) {
+    refl::meta_manager::init();
+    uniform_arena a;
+
+    dynamic_property dp;
+    for(size_t i = 0; i < 64; i++)
+        dp.append<float>(float(i));
+
+    typedef provider<dynamic_property, property_range> prov;
+    property_range r = prov::load(dp, a);
+    assert_equal_print(r.size(), 256u);
+    assert_equal_print(a.used(), a.alignment() *
+            ((256 + a.alignment() - 1) / a.alignment()));
+
+    dp.set<float>(10, 0.5f);
+    prov::update(dp, r, false);
+    vector<float> buf(64);
+    r.read_raw(buf.data());
+    assert_equal_print(buf[10], 0.5f);
+    assert_equal_print(buf[63], 63.f);
+
+    // a larger layout takes another range
+    dp.append<float>(64);
+    prov::update(dp, r, false);
+    assert_equal_print(r.size(), 260u);
+
+    {
+        property_range moved(std::move(r));
+        assert_true(r.vacuum());
+    }
+    assert_equal_print(a.used(), 0u);
+}
+
+TEST_CASE(test_property_range_draw) {
+    shader shr;
+    shr.add_sub_shader(shader::VERTEX).compile(R"EOF(
+    #version 330 core
+    layout (location = 0) in vec4 position;
+    void main() { gl_Position = position; }
+    )EOF");
+    shr.add_sub_shader(shader::FRAGMENT).compile(R"EOF(
+    #version 330 core
+    layout (std140) uniform material { vec4 color; };
+    out vec4 outColor;
+    void main() { outColor = color; }
+    )EOF");
+    shr.link();
+
+    float quad[4 * 6] = {
+         1,  1, 0, 1,  -1,  1, 0, 1,  -1, -1, 0, 1,
+        -1, -1, 0, 1,   1, -1, 0, 1,   1,  1, 0, 1,
+    };
+    vertex_attr_vector vat;
+    vat.primitives_count(6);
+    vat.add_input(0).write(quad, 4 * 6);
+    vat.updated();
+
+    texture2d tex(4, 1, texture::RGBA_U8888);
+    render_target rt;
+    rt.attach_texture(render_target::COLOR_BUFFER_0, tex);
+    shr.target(rt);
+
+    // materials of four objects, of a buffer packed between draws
+    uniform_arena a;
+    typedef universal_property<math::fcol4> mat_t;
+    vector<mat_t> mats;
+    vector<property_range> ranges;
+    for(size_t i = 0; i < 4; i++) {
+        mats.emplace_back(math::fcol4 { 0, i / 4.f, 1, 1 });
+        ranges.push_back(provider<mat_t, property_range>::load(mats[i], a));
+    }
+    handle gap = a.allocate(4);
+    ranges[1].reset();
+    a.compact();
+    provider<mat_t, property_range>::update(mats[1], ranges[1], true);
+    a.release(gap);
+
+    for(size_t i = 0; i < 4; i++) {
+        shr.property("material", ranges[i]);
+        rt.set_viewport(rect(i, 0, i + 1, 1));
+        shr.draw(vat);
+    }
+
+    vector<color> px(4);
+    tex.read(px.data());
+    for(size_t i = 0; i < 4; i++) {
+        assert_equal_print(size_t(px[i].data.bytes[1]),
+                size_t(i * 255 / 4.f + 0.5f));
+        assert_equal_print(px[i].data.bytes[2], 255);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    gui_test_context::init("330 core", "");
+    return unit_test::test_main(argc, argv);
+}
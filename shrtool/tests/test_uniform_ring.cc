@@ -0,0 +1,128 @@
+#include <vector>
+
+#define EXPOSE_EXCEPTION
+#include "test_utils.h"
+#include "properties.h"
+
+using namespace std;
+using namespace shrtool;
+using namespace shrtool::render_assets;
+
+static void check_frames(bool persistent)
+{
+    uniform_ring ring(100, 3, persistent);
+    assert_except(ring.push("x", 1), restriction_error);
+
+    vector<size_t> starts;
+    for(size_t f = 0; f < 5; f++) {
+        ring.begin_frame();
+        float v[3] = { float(f), 1, 2 };
+        size_t a = ring.push(v, sizeof(v));
+        size_t b = ring.push(v, 4);
+        assert_equal_print(a % ring.alignment(), 0u);
+        assert_equal_print(b - a, ring.alignment());
+        starts.push_back(a);
+
+        float r[3];
+        ring.read_raw(r, a, sizeof(r));
+        assert_equal_print(r[0], float(f));
+        assert_equal_print(r[2], 2.f);
+        ring.end_frame();
+    }
+
+    // regions are taken in turn, rounded to the alignment
+    size_t region = ring.region_size();
+    assert_equal_print(region % ring.alignment(), 0u);
+    assert_true(region >= 100);
+    assert_equal_print(starts[1], region);
+    assert_equal_print(starts[3], 0u);
+    assert_equal_print(starts[4], region);
+
+    ring.begin_frame();
+    assert_except(ring.begin_frame(), restriction_error);
+    vector<uint8_t> big(region + 1);
+    assert_except(ring.push(big.data(), big.size()), restriction_error);
+    ring.push(big.data(), region);
+    assert_except(ring.push(big.data(), 1), restriction_error);
+    ring.end_frame();
+    assert_except(ring.end_frame(), restriction_error);
+}
+
+TEST_CASE(test_uniform_ring_frames) {
+    check_frames(true);
+    check_frames(false);
+    assert_equal_print(uniform_ring(16, 2, false).persistent(), false);
+}
+
+TEST_CASE(test_uniform_ring_property) {
+    universal_property<math::fcol4, float> up(
+            math::fcol4 { 1, 2, 3, 4 }, 5);
+    uniform_ring ring(256, 2);
+    ring.begin_frame();
+    size_t off = ring.push_property(up);
+
+    float r[5];
+    ring.read_raw(r, off, sizeof(r));
+    assert_equal_print(r[3], 4.f);
+    assert_equal_print(r[4], 5.f);
+    ring.end_frame();
+}
+
+TEST_CASE(test_uniform_ring_draw) {
+    shader shr;
+    shr.add_sub_shader(shader::VERTEX).compile(R"EOF(
+    #version 330 core
+    layout (location = 0) in vec4 position;
+    void main() { gl_Position = position; }
+    )EOF");
+    shr.add_sub_shader(shader::FRAGMENT).compile(R"EOF(
+    #version 330 core
+    layout (std140) uniform material { vec4 color; };
+    out vec4 outColor;
+    void main() { outColor = color; }
+    )EOF");
+    shr.link();
+
+    float quad[4 * 6] = {
+         1,  1, 0, 1,  -1,  1, 0, 1,  -1, -1, 0, 1,
+        -1, -1, 0, 1,   1, -1, 0, 1,   1,  1, 0, 1,
+    };
+    vertex_attr_vector vat;
+    vat.primitives_count(6);
+    vat.add_input(0).write(quad, 4 * 6);
+    vat.updated();
+
+    texture2d tex(8, 1, texture::RGBA_U8888);
+    render_target rt;
+    rt.attach_texture(render_target::COLOR_BUFFER_0, tex);
+    shr.target(rt);
+
+    // two regions taken in turn by eight frames, each drawing a pixel
+    for(bool persistent : { true, false }) {
+        uniform_ring ring(64, 2, persistent);
+        for(size_t f = 0; f < 8; f++) {
+            ring.begin_frame();
+            float c[4] = { f / 8.f, persistent ? 1.f : 0.f, 0, 1 };
+            size_t off = ring.push(c, sizeof(c));
+            ring.push(c, sizeof(c));
+            shr.property("material", ring, off, sizeof(c));
+            rt.set_viewport(rect(f, 0, f + 1, 1));
+            shr.draw(vat);
+            ring.end_frame();
+        }
+
+        vector<color> px(8);
+        tex.read(px.data());
+        for(size_t f = 0; f < 8; f++) {
+            assert_equal_print(size_t(px[f].data.bytes[0]),
+                    size_t(f * 255 / 8.f + 0.5f));
+            assert_equal_print(px[f].data.bytes[1], persistent ? 255 : 0);
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    gui_test_context::init("330 core", "");
+    return unit_test::test_main(argc, argv);
+}
@@ -0,0 +1,233 @@
+#include <vector>
+#include <algorithm>
+
+#define EXPOSE_EXCEPTION
+#include "test_utils.h"
+#include "virtual_texture.h"
+
+using namespace std;
+using namespace shrtool;
+using namespace shrtool::render_assets;
+
+typedef page_cache::page_id page_id;
+
+// each texel tells where it is
+static image make_terrain(size_t w, size_t h)
+{
+    image im(w, h);
+    for(size_t y = 0; y < h; y++)
+        for(size_t x = 0; x < w; x++)
+            im.pixel(x, y) = color(x & 0xff, y & 0xff, (x >> 8) | (y >> 8) << 4);
+    return im;
+}
+
+// a frame of feedback seeing the given pages, each over a band of pixels
+static vector<color> feedback_of(const vector<page_id>& pages)
+{
+    vector<color> fb(64 * 64, color(0, 0, 0, 0));
+    for(size_t i = 0; i < fb.size(); i++)
+        if(i % 5 && !pages.empty())
+            fb[i] = page_cache::feedback_color(
+                    pages[i * pages.size() / fb.size()]);
+    return fb;
+}
+
+static color cell(const page_cache& pc, size_t x, size_t y)
+{
+    return pc.indirection()[y * pc.indirection_width() + x];
+}
+
+TEST_CASE(test_page_cache_levels) {
+    page_cache pc(make_terrain(1024, 512), 128, 4, 4);
+
+    // halved while larger than a page
+    assert_equal_print(pc.levels(), 4u);
+    assert_equal_print(pc.pages_x(0), 8u);
+    assert_equal_print(pc.pages_y(0), 4u);
+    assert_equal_print(pc.pages_x(3), 1u);
+    assert_equal_print(pc.level(3).height(), 64u);
+    assert_equal_print(pc.slot_size(), 130u);
+
+    // odd sizes are rounded up
+    page_cache odd(make_terrain(300, 200), 64, 8, 8);
+    assert_equal_print(odd.levels(), 4u);
+    assert_equal_print(odd.level(2).width(), 75u);
+    assert_equal_print(odd.level(3).width(), 38u);
+    assert_equal_print(odd.level(3).height(), 25u);
+
+    assert_except(pc.request(page_id(0, 8, 0)), restriction_error);
+}
+
+TEST_CASE(test_page_cache_odd_source) {
+    // of 2^n + 1 texels a side, halved down to a page all the same
+    image im(257, 257);
+    for(size_t y = 0; y < im.height(); y++)
+        for(size_t x = 0; x < im.width(); x++)
+            im.pixel(x, y) = color(x & 0xff, 0x40, x >> 8);
+    page_cache pc(im, 32, 2, 2);
+    assert_equal_print(pc.levels(), 5u);
+    assert_equal_print(pc.level(1).width(), 129u);
+    assert_equal_print(pc.level(4).width(), 17u);
+    assert_equal_print(pc.pages_x(1), 5u);
+
+    // the last texel of a level covers the repeated edge alone
+    for(size_t y = 0; y < 4; y++)
+        assert_equal_print(pc.level(1).pixel(128, y * 32), im.pixel(256, 0));
+
+    assert_equal_print(pc.update(4).size(), 1u);
+    assert_true(pc.resident(page_id(4, 0, 0)));
+    assert_equal_print(cell(pc, 8, 8), color(0, 0, 4, 0xff));
+}
+
+TEST_CASE(test_page_cache_feedback) {
+    page_cache pc(make_terrain(1024, 512), 128, 4, 4);
+
+    // the coarsest level comes first, and alone covers everything
+    assert_equal_print(pc.update(16).size(), 1u);
+    assert_true(pc.resident(page_id(3, 0, 0)));
+    assert_equal_print(cell(pc, 7, 3), color(0, 0, 3, 0xff));
+    pair<size_t, size_t> rows = pc.take_dirty_rows();
+    assert_equal_print(rows.first, 0u);
+    assert_equal_print(rows.second, 4u);
+
+    // a frame looking at two pages of level 0
+    vector<color> fb = feedback_of({ page_id(0, 2, 1), page_id(0, 3, 1) });
+    pc.request_feedback(fb.data(), fb.size());
+    vector<page_cache::placement> placed = pc.update(2);
+
+    // in budget, the coarse ones first: (2, 1, 0) and (1, 1, 0)
+    assert_equal_print(placed.size(), 2u);
+    assert_equal_print(placed[0].page.level, 2u);
+    assert_equal_print(placed[1].page.level, 1u);
+    assert_equal_print(cell(pc, 2, 1).data.bytes[2], 1u);
+    assert_equal_print(cell(pc, 7, 3).data.bytes[2], 3u);
+    pc.take_dirty_rows();
+
+    pc.request_feedback(fb.data(), fb.size());
+    placed = pc.update(16);
+    assert_equal_print(placed.size(), 2u);
+    assert_true(pc.resident(page_id(0, 2, 1)));
+    assert_true(pc.resident(page_id(0, 3, 1)));
+    color c = cell(pc, 3, 1);
+    assert_equal_print(c.data.bytes[2], 0u);
+    assert_equal_print(c.data.bytes[0] + c.data.bytes[1] * 4u,
+            size_t(placed[1].slot_x + placed[1].slot_y * 4));
+    rows = pc.take_dirty_rows();
+    assert_equal_print(rows.first, 1u);
+    assert_equal_print(rows.second, 2u);
+
+    // nothing more is wanted, nothing is loaded
+    pc.request_feedback(fb.data(), fb.size());
+    assert_equal_print(pc.update(16).size(), 0u);
+    assert_equal_print(pc.resident_pages(), 5u);
+}
+
+TEST_CASE(test_page_cache_eviction) {
+    // a coarse page and three others, panned over a row of level 0
+    page_cache pc(make_terrain(512, 512), 128, 2, 2);
+    assert_equal_print(pc.levels(), 3u);
+    pc.update(16);
+
+    // pages of level 1 wanted in turn, each with its page of level 0
+    vector<color> fb;
+    for(size_t x = 0; x < 4; x++) {
+        fb = feedback_of({ page_id(0, x, 0) });
+        pc.request_feedback(fb.data(), fb.size());
+        pc.update(16);
+        assert_true(pc.resident(page_id(0, x, 0)));
+        assert_true(pc.resident(page_id(1, x / 2, 0)));
+        assert_true(pc.resident(page_id(2, 0, 0)));
+        assert_equal_print(pc.resident_pages(), min<size_t>(x + 3, 4));
+    }
+
+    // the first pages, least recently wanted, were evicted and fall back
+    assert_false(pc.resident(page_id(0, 0, 0)));
+    assert_false(pc.resident(page_id(1, 0, 0)));
+    assert_equal_print(cell(pc, 0, 0).data.bytes[2], 2u);
+    assert_equal_print(cell(pc, 3, 0).data.bytes[2], 0u);
+    assert_equal_print(cell(pc, 2, 1).data.bytes[2], 1u);
+
+    // more wanted at once than fit, those wanted are kept
+    fb = feedback_of({ page_id(0, 0, 3), page_id(0, 3, 3) });
+    pc.request_feedback(fb.data(), fb.size());
+    vector<page_cache::placement> placed = pc.update(16);
+    assert_equal_print(placed.size(), 3u);
+    assert_true(pc.resident(page_id(1, 0, 1)));
+    assert_true(pc.resident(page_id(1, 1, 1)));
+    assert_equal_print(pc.resident_pages(), 4u);
+}
+
+TEST_CASE(test_page_cache_area) {
+    page_cache pc(make_terrain(1024, 512), 128, 8, 8);
+    pc.update(16);
+
+    // the right half of the top, at level 1
+    pc.request_area(0.5f, 0, 1.5f, 0.4f, 1);
+    vector<page_cache::placement> placed = pc.update(16);
+    size_t fine = count_if(placed.begin(), placed.end(),
+            [](const page_cache::placement& p) { return p.page.level == 1; });
+    assert_equal_print(fine, 2u);
+    assert_true(pc.resident(page_id(1, 2, 0)));
+    assert_true(pc.resident(page_id(1, 3, 0)));
+    assert_false(pc.resident(page_id(1, 1, 0)));
+}
+
+TEST_CASE(test_page_cache_copy_page) {
+    image im = make_terrain(512, 256);
+    page_cache pc(im, 64, 2, 2, 2);
+    image slot(68, 68);
+
+    // inside, the border is of the neighbours
+    pc.copy_page(page_id(0, 1, 1), slot.view());
+    assert_equal_print(slot.pixel(2, 2), im.pixel(64, 64));
+    assert_equal_print(slot.pixel(0, 0), im.pixel(62, 62));
+    assert_equal_print(slot.pixel(67, 67), im.pixel(129, 129));
+
+    // at the edges it is clamped
+    pc.copy_page(page_id(0, 7, 0), slot.view());
+    assert_equal_print(slot.pixel(0, 0), im.pixel(446, 0));
+    assert_equal_print(slot.pixel(67, 1), im.pixel(511, 0));
+
+    // the coarser level, of averaged texels
+    pc.copy_page(page_id(1, 0, 0), slot.view());
+    assert_equal_print(slot.pixel(2, 2), pc.level(1).pixel(0, 0));
+
+    assert_except(pc.copy_page(page_id(0, 0, 0), image(4, 4).view()),
+            restriction_error);
+}
+
+TEST_CASE(test_virtual_texture) {
+    image im = make_terrain(512, 256);
+    virtual_texture vt(im, 64, 4, 2);
+    const page_cache& pc = vt.pages();
+    assert_equal_print(vt.atlas().get_width(), 4u * 66);
+    assert_equal_print(vt.indirection().get_width(), 8u);
+
+    assert_equal_print(vt.update(), 1u);
+    vt.pages().request(page_id(0, 5, 2));
+    assert_equal_print(vt.update(), 3u);
+
+    // the slot of the page holds it, borders and all
+    color c = pc.indirection()[2 * 8 + 5];
+    assert_equal_print(c.data.bytes[2], 0u);
+    size_t n = pc.slot_size();
+    image atlas(vt.atlas().get_width(), vt.atlas().get_height());
+    vt.atlas().read(atlas.data());
+    image expect(n, n);
+    pc.copy_page(page_id(0, 5, 2), expect.view());
+    for(size_t y = 0; y < n; y += 13)
+        for(size_t x = 0; x < n; x += 7)
+            assert_equal_print(atlas.pixel(
+                        c.data.bytes[0] * n + x, c.data.bytes[1] * n + y),
+                    expect.pixel(x, y));
+
+    image table(8, 4);
+    vt.indirection().read(table.data());
+    assert_true(equal(table.begin(), table.end(), pc.indirection()));
+}
+
+int main(int argc, char* argv[])
+{
+    gui_test_context::init("330 core", "");
+    return unit_test::test_main(argc, argv);
+}
@@ -0,0 +1,56 @@
+/*
+ * Generates the header of property structs of shader definitions:
+ *
+ *     shrtool_propgen <output header> <shader.scm>...
+ *
+ * The header is left untouched when it would not change, so that what
+ * includes it is not built again for nothing.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include <libguile.h>
+
+#include "shader_parser.h"
+#include "common/exception.h"
+
+using namespace shrtool;
+
+int main(int argc, char* argv[])
+{
+    if(argc < 3) {
+        std::cerr << "Usage: " << argv[0]
+            << " <output header> <shader.scm>..." << std::endl;
+        return 1;
+    }
+
+    scm_init_guile();
+
+    std::vector<shader_info> shaders;
+    std::string src;
+    try {
+        for(int i = 2; i < argc; i++) {
+            std::ifstream fs(argv[i]);
+            if(!fs) throw not_found_error(
+                    std::string("Cannot open shader definition ") + argv[i]);
+            shaders.push_back(shader_parser::load(fs));
+        }
+        src = shader_parser::make_struct_header(shaders);
+    } catch(const error_base& e) {
+        std::cerr << argv[0] << ": " << e.error_name() << ": "
+            << e.what() << std::endl;
+        return 1;
+    }
+
+    std::ifstream old(argv[1]);
+    std::stringstream old_src;
+    old_src << old.rdbuf();
+    if(old && old_src.str() == src) return 0;
+
+    std::ofstream out(argv[1]);
+    out << src;
+    return out ? 0 : 1;
+}